@@ -5,6 +5,9 @@
 #include <stdint.h>        // Includes standard integer types (e.g., uint8_t).
 #include <stdbool.h>       // Includes boolean type (bool).
 
+#include <zmk/text_codec.h> // For the streaming text decoder.
+#include <zmk/text_expander_internals.h> // For struct text_expander_text_ref.
+
 // The Kconfig options CONFIG_ZMK_TEXT_EXPANDER_MAX_EXPANDED_LEN and
 // CONFIG_ZMK_TEXT_EXPANDER_TYPING_DELAY directly control the behavior of this module.
 // Their default values are typically managed in Kconfig and referenced via
@@ -14,6 +17,35 @@
 // or rely on Kconfig values being available.
 // For this module's .c file, it typically includes text_expander_internals.h or relies on Kconfig.
 
+// Maximum nesting depth of fragment references followed while typing.
+#ifndef CONFIG_ZMK_TEXT_EXPANDER_FRAGMENT_DEPTH
+#define CONFIG_ZMK_TEXT_EXPANDER_FRAGMENT_DEPTH 4
+#endif
+
+/**
+ * @brief A text being typed: the expansion's own text or a fragment referenced from it.
+ *
+ * Only a chunk of the text is held at a time. The decoder's window is refilled from the
+ * dictionary through ref as typing proceeds, so texts may be longer than the chunk.
+ */
+struct expansion_text {
+    struct text_window window;                            // The part of the text held in chunk.
+    char chunk[CONFIG_ZMK_TEXT_EXPANDER_MAX_EXPANDED_LEN]; // Copy of part of the (encoded) text.
+    struct text_expander_text_ref ref;                    // Where the rest of the text is read from.
+    struct text_decoder decoder;                          // Position within the text.
+};
+
+/**
+ * @brief A word-ending key that triggered an expansion (see CONFIG_ZMK_TEXT_EXPANDER_TERMINATORS).
+ *
+ * The key reached the host after the short code, so it is deleted along with it and typed
+ * again once the expanded text is complete.
+ */
+struct expansion_terminator {
+    uint32_t keycode; // HID usage ID of the key, or 0 if there is nothing to type again.
+    bool shift;       // True if Shift was held when the key was pressed.
+};
+
 /**
  * @brief Structure to manage the state of an ongoing text expansion.
  *
@@ -25,11 +57,34 @@ struct expansion_work {
     struct k_work_delayable work;         // Zephyr work item for scheduling expansion tasks.
                                           // Allows parts of the expansion (like typing each char)
                                           // to be done asynchronously without blocking.
-    char expanded_text[CONFIG_ZMK_TEXT_EXPANDER_MAX_EXPANDED_LEN]; // Buffer to store the full text to be typed out.
-    uint8_t backspace_count;              // Number of backspace characters to send to delete the short code.
+    struct expansion_text text;           // The text to be typed out, read chunk by chunk.
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_IMAGE_COMPRESSION)
+    struct text_codec_table tokens;       // Copy of the token table the text was encoded with, so the
+                                          // dictionary image may be replaced while typing.
+#endif
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_FRAGMENTS)
+    struct expansion_text fragments[CONFIG_ZMK_TEXT_EXPANDER_FRAGMENT_DEPTH]; // Stack of referenced
+                                          // fragments being typed; the innermost one is on top.
+    uint8_t fragment_depth;               // Number of entries on the fragment stack.
+#endif
+    bool stale;                           // Set if a text changed in the dictionary while being typed.
+    size_t backspace_count;               // Number of backspace characters to send to delete the short code
+                                          // (or, when replacing, the part of the previous text that differs).
+    uint32_t word_delete;                 // Modifier of the word-delete chord that deletes the short code after
+                                          // the backspaces, or 0 if backspaces delete all of it.
     bool is_backspace_phase;              // Flag indicating if the engine is currently sending backspaces.
                                           // True if backspacing, false if typing the expanded text.
-    size_t text_index;                    // Current index into expanded_text being typed.
+    size_t text_index;                    // Number of characters typed so far.
+    struct expansion_terminator terminator; // Key typed again after the text, if its keycode is not 0.
+    bool terminator_typed;                // Set once the terminator has been typed again.
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_CANDIDATE_CYCLING)
+    char typed[CONFIG_ZMK_TEXT_EXPANDER_MAX_EXPANDED_LEN]; // The first characters typed for the text, which
+                                          // replace_expansion() compares the next text against.
+    size_t typed_count;                   // Number of characters of the text that reached the host.
+    bool has_pending;                     // Set if pending is the next character to type.
+    char pending;                         // First character that differs from the replaced text, already
+                                          // taken from the decoder ('\0' if the new text ended first).
+#endif
 };
 
 /**
@@ -45,15 +100,48 @@ void expansion_work_handler(struct k_work *work);
 /**
  * @brief Starts the text expansion process.
  *
- * Initializes the expansion_work item with the provided short code and expanded text,
- * and schedules the first part of the expansion (backspacing).
+ * Initializes the expansion_work item with the provided short code and a reference to the
+ * expanded text, reads the first chunk of the text and schedules the first part of the
+ * expansion (backspacing).
+ *
+ * If the expansion was triggered by a terminator, the same job also deletes the terminator
+ * before typing the text and types it again afterwards, so the host sees a single sequence.
  *
  * @param short_code The short code string that triggered the expansion (used for logging).
- * @param expanded_text The text string to be typed out.
+ * @param ref Reference to the text to be typed out, as filled in by the dictionary lookup.
  * @param short_len The length of the short_code, indicating how many backspaces are needed.
- * @return 0 on success, or a negative error code if initialization fails.
+ * @param tokens Token table the text is compressed with (see text_codec.h), or NULL if
+ * it is plain text. The table is copied, so it only needs to stay valid for the call.
+ * @param terminator Word-ending key that triggered the expansion, or NULL if it was triggered
+ * by the behavior key. Copied, like tokens.
+ * @param word_delete Modifier keycode (e.g. HID_USAGE_KEY_KEYBOARD_LEFTCONTROL) to delete the
+ * short code with a single modifier+Backspace chord, or 0 to send short_len backspaces. Only
+ * pass a modifier if the short code is a whole word on the host. A terminator is still deleted
+ * with a backspace first.
+ * @return 0 on success, or a negative error code if initialization fails (-ESTALE if the
+ * text changed since the lookup).
+ */
+int start_expansion(const char *short_code, const struct text_expander_text_ref *ref, uint8_t short_len,
+                    const struct text_codec_table *tokens, const struct expansion_terminator *terminator,
+                    uint32_t word_delete);
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_CANDIDATE_CYCLING)
+/**
+ * @brief Replaces the text typed by the last expansion with another text.
+ *
+ * The characters the new text starts with that are already on the host are kept: only the
+ * rest of the previous text is deleted and only the rest of the new one typed. The last
+ * expansion may still be in progress; whatever it has not typed yet is dropped. Its
+ * terminator, if it had one, ends up after the new text.
+ *
+ * @param short_code The short code of the new text (used for logging).
+ * @param ref Reference to the new text, as filled in by the dictionary lookup.
+ * @param tokens Token table the new text is compressed with, or NULL, as for start_expansion().
+ * @return 0 on success, or a negative error code as for start_expansion().
  */
-int start_expansion(const char *short_code, const char *expanded_text, uint8_t short_len);
+int replace_expansion(const char *short_code, const struct text_expander_text_ref *ref,
+                      const struct text_codec_table *tokens);
+#endif
 
 /**
  * @brief Cancels any ongoing text expansion.
@@ -0,0 +1,63 @@
+#ifndef ZMK_KEYSTROKE_RING_H // Start of include guard.
+#define ZMK_KEYSTROKE_RING_H
+
+#include <zephyr/kernel.h> // For atomic_t.
+#include <stdint.h>        // For uint8_t, uint16_t, uint32_t, int64_t.
+#include <stdbool.h>       // For bool type.
+
+// Number of entries in the keystroke ring. Must be a power of two so indices can wrap with a mask.
+#ifndef CONFIG_ZMK_TEXT_EXPANDER_INPUT_RING_SIZE
+#define CONFIG_ZMK_TEXT_EXPANDER_INPUT_RING_SIZE 32
+#endif
+
+/**
+ * @brief A key press captured by the keycode listener for deferred processing.
+ */
+struct keystroke_event {
+    uint16_t usage_page; // HID usage page of the key (e.g. HID_USAGE_KEY).
+    uint32_t keycode;    // HID usage ID of the key within usage_page.
+    uint8_t modifiers;   // Modifiers held or implied when the key was pressed (MOD_* flags).
+    int64_t timestamp;   // Uptime in milliseconds at which the key was pressed.
+};
+
+/**
+ * @brief Single-producer/single-consumer ring of key presses.
+ *
+ * The producer (the keycode listener on the event manager thread) only writes `head`, and the
+ * consumer (whoever currently owns the matcher) only writes `tail`. Neither side ever blocks.
+ */
+struct keystroke_ring {
+    struct keystroke_event entries[CONFIG_ZMK_TEXT_EXPANDER_INPUT_RING_SIZE]; // Ring storage.
+    atomic_t head;     // Free-running count of pushed entries. Written by the producer only.
+    atomic_t tail;     // Free-running count of popped entries. Written by the consumer only.
+    atomic_t overflow; // Set by the producer when an entry had to be dropped because the ring was full.
+};
+
+/**
+ * @brief Appends a key press to the ring. Producer side; never blocks.
+ *
+ * @param ring Pointer to the ring.
+ * @param event The key press to append.
+ * @return True if the entry was stored, false if the ring was full. In the latter case the
+ * overflow flag is raised so the consumer can discard its now incomplete state.
+ */
+bool keystroke_ring_push(struct keystroke_ring *ring, const struct keystroke_event *event);
+
+/**
+ * @brief Removes the oldest key press from the ring. Consumer side; never blocks.
+ *
+ * @param ring Pointer to the ring.
+ * @param event Output: the removed key press.
+ * @return True if an entry was removed, false if the ring was empty.
+ */
+bool keystroke_ring_pop(struct keystroke_ring *ring, struct keystroke_event *event);
+
+/**
+ * @brief Checks and clears the overflow flag. Consumer side.
+ *
+ * @param ring Pointer to the ring.
+ * @return True if at least one entry was dropped since the last call.
+ */
+bool keystroke_ring_take_overflow(struct keystroke_ring *ring);
+
+#endif // ZMK_KEYSTROKE_RING_H End of include guard.
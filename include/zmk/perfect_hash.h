@@ -0,0 +1,42 @@
+#ifndef ZMK_PERFECT_HASH_H // Start of include guard.
+#define ZMK_PERFECT_HASH_H
+
+#include <stdint.h> // For uint16_t, uint32_t.
+
+/*
+ * Minimal perfect hashes over fixed sets of short codes, built at build time.
+ *
+ * scripts/perfect_hash.py reads the devicetree and, for the expansions and the fragments of
+ * every text expander instance, generates constant tables (placed in flash) that map each
+ * short code of the set to a distinct slot in 0..n-1 (hash and displace): the key's hash
+ * picks a bucket, and the bucket's seed remixes the hash into the slot. Each slot holds the
+ * index of the device tree child stored there.
+ *
+ * A lookup is one pass over the key and two table reads. A key outside the set also lands on
+ * some slot, so the caller confirms the candidate with a single string compare. The tables
+ * cannot answer prefix queries.
+ *
+ * The hash functions here and in scripts/perfect_hash.py must stay identical.
+ */
+
+/**
+ * @brief Build-time tables of one minimal perfect hash.
+ */
+struct perfect_hash {
+    const uint16_t *seeds;  // Per bucket: seed that places the bucket's keys in free slots.
+    const uint16_t *slots;  // Per slot: index of the entry whose key hashes there.
+    uint16_t bucket_count;  // Number of entries in seeds.
+    uint16_t slot_count;    // Number of entries in slots (and keys in the set).
+};
+
+/**
+ * @brief Finds the only entry that can hold a key.
+ *
+ * @param hash The tables, as generated for the set.
+ * @param key The null-terminated short code.
+ * @return The index stored in the key's slot, or -ENOENT if the set is empty. The entry at
+ * the index holds key only if its short code compares equal.
+ */
+int perfect_hash_lookup(const struct perfect_hash *hash, const char *key);
+
+#endif // ZMK_PERFECT_HASH_H End of include guard.
@@ -0,0 +1,162 @@
+#ifndef ZMK_SORTED_DICT_H // Start of include guard.
+#define ZMK_SORTED_DICT_H
+
+#include <stdbool.h> // For bool type.
+#include <stddef.h>  // For size_t.
+#include <stdint.h>  // For uint64_t.
+
+/*
+ * Read-mostly dictionary stored as a sorted array of packed integer keys.
+ *
+ * Short codes use a 36-symbol alphabet (a-z, 0-9), so each character fits in 6 bits. A code of
+ * up to SORTED_DICT_MAX_KEY_LEN characters is packed into one uint64_t, first character in the
+ * most significant bits and unused positions zero. Symbols are numbered from 1, so numeric order
+ * of packed keys is lexicographic order of the codes, and all codes starting with a prefix form
+ * one contiguous range of the sorted array.
+ *
+ * Exact lookup is a binary search over the key array, and a prefix check is a single lower
+ * bound search followed by one compare. Keys and texts live in separate parallel arrays so the
+ * searches only touch the contiguous keys. Texts are not copied; the dictionary points at
+ * strings owned by the caller (e.g. device tree literals in flash).
+ *
+ * Inserting keeps the array sorted by shifting the entries above the new key, so building a
+ * dictionary of n entries is O(n^2) in the worst case. This is meant for dictionaries that are
+ * built once and read many times.
+ */
+
+#define SORTED_DICT_BITS_PER_CHAR 6 // Bits per packed character.
+#define SORTED_DICT_MAX_KEY_LEN 10  // Characters that fit into a packed key.
+
+/**
+ * @brief Callback invoked by sorted_dict_for_each() for every entry.
+ *
+ * @param key The null-terminated short code. Only valid for the duration of the call.
+ * @param text The text stored for the short code.
+ * @param user_data Opaque pointer passed through from sorted_dict_for_each().
+ * @return 0 to continue, or a negative error code to stop.
+ */
+typedef int (*sorted_dict_visit_cb)(const char *key, const char *text, void *user_data);
+
+/**
+ * @brief A sorted dictionary over caller-provided storage.
+ */
+struct sorted_dict {
+    uint64_t *keys;     // Packed keys in ascending order.
+    const char **texts; // texts[i] is the text stored under keys[i].
+    size_t count;       // Number of entries in use.
+    size_t capacity;    // Number of entries keys and texts can hold.
+};
+
+/**
+ * @brief Packs a short code into an integer key.
+ *
+ * @param key The null-terminated short code.
+ * @param packed Output: the packed key.
+ * @return 0 on success, -EINVAL if key is longer than SORTED_DICT_MAX_KEY_LEN characters or
+ * contains a character outside a-z and 0-9.
+ */
+int sorted_dict_pack_key(const char *key, uint64_t *packed);
+
+/**
+ * @brief Initializes an empty dictionary.
+ *
+ * @param dict Dictionary to initialize.
+ * @param keys Storage for capacity packed keys.
+ * @param texts Storage for capacity text pointers.
+ * @param capacity Maximum number of entries.
+ */
+void sorted_dict_init(struct sorted_dict *dict, uint64_t *keys, const char **texts, size_t capacity);
+
+/**
+ * @brief Inserts or replaces an entry.
+ *
+ * @param dict The dictionary.
+ * @param key The null-terminated short code.
+ * @param text The text to store. Must outlive the dictionary; it is not copied.
+ * @return 0 on success, -EINVAL if key cannot be packed, -ENOMEM if the dictionary is full.
+ */
+int sorted_dict_insert(struct sorted_dict *dict, const char *key, const char *text);
+
+/**
+ * @brief Removes an entry.
+ *
+ * @param dict The dictionary.
+ * @param key The null-terminated short code.
+ * @return 0 on success, -ENOENT if key is not in the dictionary.
+ */
+int sorted_dict_remove(struct sorted_dict *dict, const char *key);
+
+/**
+ * @brief Looks up a short code.
+ *
+ * @param dict The dictionary.
+ * @param key The null-terminated short code.
+ * @return The stored text, or NULL if key is not in the dictionary.
+ */
+const char *sorted_dict_search(const struct sorted_dict *dict, const char *key);
+
+/**
+ * @brief Checks whether any stored short code starts with prefix.
+ *
+ * @param dict The dictionary.
+ * @param prefix The null-terminated (possibly partial) short code. An empty prefix matches.
+ * @return True if some stored short code starts with prefix.
+ */
+bool sorted_dict_has_prefix(const struct sorted_dict *dict, const char *prefix);
+
+/**
+ * @brief Narrows a range of entries sharing a prefix to those continuing with c.
+ *
+ * Starting from the whole array (lo = 0, hi = count, depth 0), each call consumes one more
+ * character of a prefix, so a prefix typed one character at a time costs two binary searches
+ * per character, each within the previous range.
+ *
+ * @param dict The dictionary.
+ * @param lo In/out: first entry of the range.
+ * @param hi In/out: end of the range.
+ * @param depth Number of characters consumed before c.
+ * @param c The next character of the prefix.
+ * @return True if the narrowed range is not empty.
+ */
+bool sorted_dict_prefix_step(const struct sorted_dict *dict, size_t *lo, size_t *hi, size_t depth, char c);
+
+/**
+ * @brief Counts the entries starting with prefix and completes the prefix if it is unique.
+ *
+ * The entries starting with a prefix are adjacent, so this costs two binary searches.
+ *
+ * @param dict The dictionary.
+ * @param prefix The null-terminated (possibly partial) short code.
+ * @param key Output: the only short code starting with prefix, if the return value is 1.
+ * @param size Size of the key buffer; must exceed the length of prefix.
+ * @return Number of entries starting with prefix, counting prefix itself if it is stored.
+ */
+size_t sorted_dict_complete(const struct sorted_dict *dict, const char *prefix, char *key, size_t size);
+
+/**
+ * @brief Finds the first entry starting with prefix that ranks after another short code.
+ *
+ * Candidates are ranked as by trie_key_compare(): shorter short codes first, then in key
+ * order. Scans the entries starting with prefix.
+ *
+ * @param dict The dictionary.
+ * @param prefix The null-terminated (possibly partial) short code.
+ * @param after The previous candidate, or NULL for the first one.
+ * @param key Output: the candidate.
+ * @param size Size of the key buffer.
+ * @return True if a candidate was found.
+ */
+bool sorted_dict_next_candidate(const struct sorted_dict *dict, const char *prefix, const char *after,
+                                char *key, size_t size);
+
+/**
+ * @brief Visits every entry in key order.
+ *
+ * @param dict The dictionary.
+ * @param cb Callback invoked as `cb(short_code, text, user_data)` for each entry.
+ * @param user_data Opaque pointer passed to the callback.
+ * @return 0 after visiting all entries, or the negative value returned by the callback.
+ */
+int sorted_dict_for_each(const struct sorted_dict *dict, sorted_dict_visit_cb cb, void *user_data);
+
+#endif // ZMK_SORTED_DICT_H End of include guard.
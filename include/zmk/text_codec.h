@@ -0,0 +1,127 @@
+#ifndef ZMK_TEXT_CODEC_H // Start of include guard.
+#define ZMK_TEXT_CODEC_H
+
+#include <stdbool.h> // For bool type.
+#include <stddef.h>  // For size_t.
+#include <stdint.h>  // For uint8_t.
+
+/*
+ * Pair-token text compression for dictionary images.
+ *
+ * Texts are ASCII, so bytes 0x80-0xff are free to act as tokens. Token i (byte 0x80 + i) stands
+ * for a pair of symbols, each either an ASCII character or an earlier token, so a token can
+ * expand to a long run of characters through nesting. The token table is trained once at build
+ * time over the whole dictionary (scripts/trie_image.py) and stored next to the texts.
+ *
+ * Decoding needs no output buffer: text_decoder_next() yields one character at a time, keeping
+ * only a small stack of pending right-hand symbols whose depth is bounded by
+ * TEXT_CODEC_MAX_DEPTH. An encoded text is still a null-terminated C string.
+ *
+ * The decoder reads its input through a text_window, which either holds the whole text or a
+ * chunk of it that is refilled on demand, so texts longer than any buffer can be streamed.
+ *
+ * Decoded texts may contain fragment references of the form {{name}}, where name is the short
+ * code of another expansion or fragment. text_decoder_take_reference() recognizes them in the
+ * decoded stream, so references work the same in plain and compressed texts.
+ */
+
+#define TEXT_CODEC_FIRST_TOKEN 0x80 // Byte value of token 0.
+#define TEXT_CODEC_MAX_TOKENS 128   // Number of byte values available for tokens.
+#define TEXT_CODEC_MAX_DEPTH 16     // Maximum nesting depth of a token.
+
+/**
+ * @brief Token table used to decode compressed texts.
+ */
+struct text_codec_table {
+    uint8_t count;                              // Number of tokens in use.
+    uint8_t pairs[TEXT_CODEC_MAX_TOKENS * 2];   // Left and right symbol of each token.
+};
+
+struct text_window;
+
+/**
+ * @brief Loads the part of a text starting at offset into a window.
+ *
+ * @return 0 on success (the window may be empty past the end of the text), or a negative
+ * error code if the text can no longer be read.
+ */
+typedef int (*text_window_fill_t)(struct text_window *win, size_t offset);
+
+/**
+ * @brief The part of a text that is currently available to a decoder.
+ *
+ * Shared by a decoder and the copies it makes of itself, so refilling it never invalidates
+ * any of them: every fill of the same offset yields the same bytes.
+ */
+struct text_window {
+    const char *data;         // Bytes of the text, starting at offset `start`.
+    size_t start;             // Offset of data[0] within the text.
+    size_t len;               // Number of valid bytes at data.
+    text_window_fill_t fill;  // Loads another part of the text, or NULL if data holds all of it.
+};
+
+/**
+ * @brief State of a streaming decoder.
+ */
+struct text_decoder {
+    struct text_window *win;                    // Source of the encoded text.
+    size_t offset;                              // Offset of the next byte of the encoded text.
+    bool ended;                                 // Set once the text ended or turned out corrupt.
+    const struct text_codec_table *table;       // Token table, or NULL for plain text.
+    uint8_t stack[TEXT_CODEC_MAX_DEPTH];        // Right-hand symbols still to be emitted.
+    uint8_t depth;                              // Number of entries on the stack.
+};
+
+/**
+ * @brief Validates a token table.
+ *
+ * Every symbol must be non-zero and may only refer to earlier tokens, which rules out cycles,
+ * and no token may nest deeper than TEXT_CODEC_MAX_DEPTH.
+ *
+ * @param pairs Left and right symbol of each token.
+ * @param count Number of tokens.
+ * @return 0 if the table is valid, -EINVAL otherwise.
+ */
+int text_codec_validate(const uint8_t *pairs, size_t count);
+
+/**
+ * @brief Sets up a window holding a whole null-terminated text.
+ *
+ * @param win Window to initialize.
+ * @param text The encoded, null-terminated text.
+ */
+void text_window_init_string(struct text_window *win, const char *text);
+
+/**
+ * @brief Starts decoding a text.
+ *
+ * @param dec Decoder state to initialize.
+ * @param win Window the encoded text is read through.
+ * @param table Token table the text was encoded with, or NULL if it is plain text.
+ */
+void text_decoder_init(struct text_decoder *dec, struct text_window *win, const struct text_codec_table *table);
+
+/**
+ * @brief Returns the next character of the decoded text.
+ *
+ * @param dec Decoder state.
+ * @return The next character, or '\0' at the end of the text (or at an undefined token, or if
+ * the window could not be refilled).
+ */
+char text_decoder_next(struct text_decoder *dec);
+
+/**
+ * @brief Consumes a fragment reference following an opening '{'.
+ *
+ * Call after text_decoder_next() returned '{'. If the decoded stream continues with
+ * `{name}}`, where name is 1 to size - 1 lowercase letters or digits, the reference is
+ * consumed and its name returned. Otherwise the decoder is left unchanged.
+ *
+ * @param dec Decoder state.
+ * @param name Output: the null-terminated name of the referenced fragment.
+ * @param size Size of the name buffer.
+ * @return True if a reference was consumed.
+ */
+bool text_decoder_take_reference(struct text_decoder *dec, char *name, size_t size);
+
+#endif // ZMK_TEXT_CODEC_H End of include guard.
@@ -0,0 +1,247 @@
+#ifndef ZMK_TEXT_DICT_H // Start of include guard.
+#define ZMK_TEXT_DICT_H
+
+#include <errno.h>   // For error codes.
+#include <stdbool.h> // For bool type.
+#include <stddef.h>  // For size_t.
+#include <stdint.h>  // For uint8_t.
+
+#include <zmk/trie.h>         // For the trie backend.
+#include <zmk/sorted_dict.h>  // For the sorted key backend.
+#include <zmk/perfect_hash.h> // For the perfect hash backend.
+
+/*
+ * Interface of the read-mostly dictionaries mapping short codes to texts.
+ *
+ * The device tree dictionaries are accessed only through this interface, so the listener and
+ * the trigger do not depend on how a dictionary is laid out. Each backend embeds a
+ * struct text_dict as its first member and provides the operations in a struct text_dict_api:
+ * - the trie (trie.c), one node per short code character;
+ * - sorted packed keys (sorted_dict.c), searched by binary search;
+ * - a build-time minimal perfect hash (perfect_hash.c), which is fixed and answers no prefix
+ *   queries.
+ *
+ * Texts are referenced, not copied, so they must outlive the dictionary (device tree texts
+ * are string constants in flash). A dictionary has no locking of its own; it is either
+ * read-only or owned by a single writer.
+ */
+
+/**
+ * @brief Callback invoked by text_dict_for_each() for every entry.
+ *
+ * @param key The null-terminated short code. Only valid for the duration of the call.
+ * @param text The text stored for the short code.
+ * @param user_data Opaque pointer passed through from text_dict_for_each().
+ * @return 0 to continue, or a negative error code to stop.
+ */
+typedef int (*text_dict_visit_cb)(const char *key, const char *text, void *user_data);
+
+/**
+ * @brief Position of a prefix typed one character at a time.
+ */
+struct text_dict_cursor {
+    const void *node; // Trie: node reached by the consumed characters.
+    size_t lo;        // Sorted keys: first entry starting with the consumed characters.
+    size_t hi;        // Sorted keys: end of those entries.
+    uint8_t depth;    // Number of characters consumed.
+    bool alive;       // False once no short code starts with the consumed characters.
+};
+
+/**
+ * @brief Memory used by a dictionary.
+ */
+struct text_dict_stats {
+    size_t entries; // Number of short codes stored.
+    size_t bytes;   // Bytes used by the index (nodes, keys or tables), not counting the texts.
+};
+
+struct text_dict;
+struct text_expander_expansion; // A device tree child of an instance (see text_expander_internals.h).
+
+/**
+ * @brief Operations of a dictionary backend.
+ */
+struct text_dict_api {
+    const char *name; // Name of the backend, for logging.
+
+    /**
+     * @brief Stores text under key.
+     * @return 0 on success, 1 if key has another definition (the last definition wins), or a
+     * negative error code.
+     */
+    int (*insert)(struct text_dict *dict, const char *key, const char *text);
+
+    /**
+     * @brief Removes key.
+     * @return 0 on success, -ENOENT if key is not stored, -ENOTSUP if the backend is fixed.
+     */
+    int (*remove)(struct text_dict *dict, const char *key);
+
+    /**
+     * @brief Looks up key.
+     * @return The text stored under key, or NULL.
+     */
+    const char *(*lookup)(const struct text_dict *dict, const char *key);
+
+    /**
+     * @brief Sets a cursor to the empty prefix. NULL if the backend answers no prefix queries.
+     */
+    void (*prefix_start)(const struct text_dict *dict, struct text_dict_cursor *cursor);
+
+    /**
+     * @brief Consumes one more character of the prefix at a live cursor.
+     * @return True if some short code starts with the consumed characters.
+     */
+    bool (*prefix_step)(const struct text_dict *dict, struct text_dict_cursor *cursor, char c);
+
+    /**
+     * @brief Counts the short codes starting with prefix and completes prefix if only one does.
+     * NULL if the backend answers no prefix queries.
+     * @return Number of short codes starting with prefix; if 1, key holds it.
+     */
+    size_t (*complete)(const struct text_dict *dict, const char *prefix, char *key, size_t size);
+
+    /**
+     * @brief Finds the first short code starting with prefix that ranks after another one
+     * (see trie_key_compare()). NULL if the backend answers no prefix queries.
+     * @return True if key holds a candidate.
+     */
+    bool (*next_candidate)(const struct text_dict *dict, const char *prefix, const char *after, char *key,
+                           size_t size);
+
+    /**
+     * @brief Visits every entry.
+     * @return 0 after visiting all entries, or the negative value returned by the callback.
+     */
+    int (*for_each)(const struct text_dict *dict, text_dict_visit_cb cb, void *user_data);
+
+    /**
+     * @brief Reports the memory used by the dictionary.
+     */
+    void (*stats)(const struct text_dict *dict, struct text_dict_stats *stats);
+};
+
+/**
+ * @brief A dictionary, embedded as the first member of each backend.
+ */
+struct text_dict {
+    const struct text_dict_api *api; // Operations of the backend.
+};
+
+/**
+ * @brief A dictionary stored as a trie whose texts are referenced in place.
+ */
+struct text_dict_trie {
+    struct text_dict dict;           // Interface.
+    struct trie_node *root;          // Root of the trie.
+    struct text_expander_pool *pool; // Node pool, possibly shared with other tries.
+};
+
+/**
+ * @brief A dictionary stored as sorted packed keys.
+ */
+struct text_dict_sorted {
+    struct text_dict dict;     // Interface.
+    struct sorted_dict sorted; // The sorted keys and texts.
+};
+
+/**
+ * @brief A fixed dictionary indexed by a build-time minimal perfect hash.
+ */
+struct text_dict_hash {
+    struct text_dict dict;                         // Interface.
+    const struct perfect_hash *hash;               // Hash tables generated for the entries.
+    const struct text_expander_expansion *entries; // Entries the hash slots index into.
+    size_t entry_count;                            // Number of entries.
+};
+
+/**
+ * @brief Initializes a trie dictionary with an empty root allocated from pool.
+ *
+ * @return 0 on success, -ENOMEM if the pool has no node for the root.
+ */
+int text_dict_trie_init(struct text_dict_trie *td, struct text_expander_pool *pool);
+
+/**
+ * @brief Initializes an empty sorted key dictionary over caller-provided storage.
+ */
+void text_dict_sorted_init(struct text_dict_sorted *td, uint64_t *keys, const char **texts, size_t capacity);
+
+/**
+ * @brief Initializes a dictionary over build-time hash tables and the entries they index.
+ *
+ * The entries are fixed; insert() only confirms that an entry is the one stored for its key.
+ */
+void text_dict_hash_init(struct text_dict_hash *td, const struct perfect_hash *hash,
+                         const struct text_expander_expansion *entries, size_t entry_count);
+
+static inline int text_dict_insert(struct text_dict *dict, const char *key, const char *text) {
+    return dict->api->insert(dict, key, text);
+}
+
+static inline int text_dict_remove(struct text_dict *dict, const char *key) {
+    return dict->api->remove(dict, key);
+}
+
+static inline const char *text_dict_lookup(const struct text_dict *dict, const char *key) {
+    return dict->api->lookup(dict, key);
+}
+
+static inline int text_dict_for_each(const struct text_dict *dict, text_dict_visit_cb cb, void *user_data) {
+    return dict->api->for_each(dict, cb, user_data);
+}
+
+static inline void text_dict_stats(const struct text_dict *dict, struct text_dict_stats *stats) {
+    dict->api->stats(dict, stats);
+}
+
+/**
+ * @brief Counts the short codes starting with prefix and completes prefix if only one does.
+ *
+ * @param key Output: the only short code starting with prefix, if the return value is 1.
+ * @param size Size of the key buffer.
+ * @return Number of short codes starting with prefix, or 0 if the backend cannot tell.
+ */
+static inline size_t text_dict_complete(const struct text_dict *dict, const char *prefix, char *key, size_t size) {
+    return dict->api->complete ? dict->api->complete(dict, prefix, key, size) : 0;
+}
+
+/**
+ * @brief Finds the first short code starting with prefix that ranks after another one.
+ *
+ * @param after The previous candidate, or NULL for the first one.
+ * @param key Output: the candidate.
+ * @param size Size of the key buffer.
+ * @return True if a candidate was found, false if there is none or the backend cannot tell.
+ */
+static inline bool text_dict_next_candidate(const struct text_dict *dict, const char *prefix, const char *after,
+                                            char *key, size_t size) {
+    return dict->api->next_candidate && dict->api->next_candidate(dict, prefix, after, key, size);
+}
+
+/**
+ * @brief Sets a cursor to the empty prefix, which every non-empty dictionary has.
+ */
+static inline void text_dict_prefix_start(const struct text_dict *dict, struct text_dict_cursor *cursor) {
+    cursor->depth = 0;
+    cursor->alive = dict->api->prefix_start != NULL;
+    if (cursor->alive) {
+        dict->api->prefix_start(dict, cursor);
+    }
+}
+
+/**
+ * @brief Consumes one more character of a prefix.
+ *
+ * @return True if some short code in the dictionary starts with the consumed characters.
+ * Once false, the cursor stays dead until text_dict_prefix_start().
+ */
+static inline bool text_dict_prefix_step(const struct text_dict *dict, struct text_dict_cursor *cursor, char c) {
+    if (cursor->alive) {
+        cursor->alive = dict->api->prefix_step(dict, cursor, c);
+        cursor->depth++;
+    }
+    return cursor->alive;
+}
+
+#endif // ZMK_TEXT_DICT_H End of include guard.
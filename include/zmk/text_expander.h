@@ -3,6 +3,7 @@
 
 #include <zephyr/kernel.h> // For Zephyr specific types if needed by underlying implementations.
 #include <stdbool.h>       // For bool type.
+#include <stddef.h>        // For size_t.
 
 // Standard C++ extern "C" guard for compatibility if this header is included in C++ code.
 #ifdef __cplusplus
@@ -18,17 +19,22 @@ extern "C" {
  * @param short_code The null-terminated string for the short code (e.g., "eml").
  * Must contain only lowercase letters (a-z) and numbers (0-9).
  * @param expanded_text The null-terminated string for the expanded text (e.g., "user@example.com").
+ * With CONFIG_ZMK_TEXT_EXPANDER_FRAGMENTS, it may reference other expansions as {{short_code}}.
  * @return 0 on success.
  * @return -EINVAL if short_code or expanded_text is NULL, or if their lengths are invalid,
  * or if short_code contains invalid characters.
  * @return -ENOMEM if there is not enough memory to store the new expansion.
+ * @return -ELOOP if the fragment references of expanded_text would form a cycle or nest
+ * deeper than CONFIG_ZMK_TEXT_EXPANDER_FRAGMENT_DEPTH.
  */
 int zmk_text_expander_add_expansion(const char *short_code, const char *expanded_text);
 
 /**
  * @brief Removes a text expansion.
  *
- * Deletes the expansion associated with the given short_code.
+ * Deletes the expansion associated with the given short_code from the runtime dictionary.
+ * Expansions defined in the device tree are read-only; they can only be overridden by
+ * adding a runtime expansion with the same short code.
  *
  * @param short_code The null-terminated string for the short code to remove.
  * @return 0 on success.
@@ -40,26 +46,185 @@ int zmk_text_expander_remove_expansion(const char *short_code);
 /**
  * @brief Clears all stored text expansions.
  *
- * Removes all short_code to expanded_text mappings.
+ * Removes all short_code to expanded_text mappings from the runtime dictionary.
+ * Expansions defined in the device tree are not affected.
  */
 void zmk_text_expander_clear_all(void);
 
+/**
+ * @brief Starts a batch of dictionary updates.
+ *
+ * Subsequent calls to zmk_text_expander_add_expansion(), zmk_text_expander_remove_expansion()
+ * and zmk_text_expander_clear_all() from the same thread are collected into the batch. Other
+ * writers block until the batch is committed or aborted.
+ *
+ * With CONFIG_ZMK_TEXT_EXPANDER_SHADOW_BUILD the batch is applied to a shadow copy of the
+ * dictionary and becomes visible all at once on commit, so typing is never stalled by a large
+ * reload. Without it, updates are applied in place as they are made.
+ *
+ * @return 0 on success.
+ * @return -EBUSY if a batch is already in progress.
+ * @return -ENOMEM if the shadow copy of the dictionary could not be built.
+ */
+int zmk_text_expander_batch_begin(void);
+
+/**
+ * @brief Commits a batch started with zmk_text_expander_batch_begin().
+ *
+ * Must be called from the thread that started the batch.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if no batch is in progress.
+ * @return -EPERM if the batch was started by another thread.
+ */
+int zmk_text_expander_batch_commit(void);
+
+/**
+ * @brief Aborts a batch started with zmk_text_expander_batch_begin().
+ *
+ * With CONFIG_ZMK_TEXT_EXPANDER_SHADOW_BUILD all updates of the batch are discarded.
+ * Without it, updates were already applied in place and stay in effect.
+ * Must be called from the thread that started the batch.
+ *
+ * @return 0 on success.
+ * @return -EINVAL if no batch is in progress.
+ * @return -EPERM if the batch was started by another thread.
+ */
+int zmk_text_expander_batch_abort(void);
+
 /**
  * @brief Gets the current number of stored text expansions.
  *
- * @return The total count of active text expansions.
+ * @return The total count of runtime expansions plus the expansions defined in the
+ * device tree dictionaries of all instances.
  */
 int zmk_text_expander_get_count(void);
 
 /**
  * @brief Checks if a text expansion exists for a given short code.
  *
+ * Checks the runtime dictionary and the device tree dictionaries of all instances,
+ * regardless of the active layers.
+ *
  * @param short_code The null-terminated string for the short code to check.
  * @return True if an expansion exists for the short_code, false otherwise.
  * Returns false if short_code is NULL.
  */
 bool zmk_text_expander_exists(const char *short_code);
 
+/**
+ * @brief Usage of the text storage of the runtime dictionary.
+ *
+ * capacity is the sum of used, free and fragmented.
+ */
+struct zmk_text_expander_text_stats {
+    size_t capacity;   // Bytes of text storage.
+    size_t used;       // Bytes held by stored texts, including their bookkeeping.
+    size_t free;       // Bytes available for new texts.
+    size_t fragmented; // Bytes neither in use nor available: unreferenced texts waiting to be
+                       // reused (bump allocator), or heap bookkeeping and gaps (heap allocator).
+    size_t peak;       // Highest number of bytes held by texts since boot.
+    size_t count;      // Number of distinct stored texts (shared texts count once).
+};
+
+/**
+ * @brief Usage of the trie node storage of the runtime dictionary.
+ *
+ * capacity is the sum of live and free.
+ */
+struct zmk_text_expander_node_stats {
+    size_t capacity; // Number of nodes in the pool.
+    size_t live;     // Nodes currently part of the trie.
+    size_t free;     // Nodes available for new short codes, including ones freed by deletes.
+    size_t peak;     // Highest number of live nodes since boot.
+};
+
+/**
+ * @brief Memory usage of the runtime dictionary.
+ */
+struct zmk_text_expander_memory_stats {
+    struct zmk_text_expander_node_stats nodes; // Node storage of the live dictionary.
+    struct zmk_text_expander_text_stats text;  // Text storage of the live dictionary.
+};
+
+/**
+ * @brief Reports the memory usage of the runtime dictionary.
+ * Device tree dictionaries are sized at build time and reference their texts in flash, so
+ * they are not included.
+ * @param stats Output: the current usage.
+ * @return 0 on success.
+ * @return -EINVAL if stats is NULL.
+ */
+int zmk_text_expander_get_memory_stats(struct zmk_text_expander_memory_stats *stats);
+
+/**
+ * @brief Writes pending runtime updates to the flash journal immediately.
+ *
+ * Updates are normally coalesced and written CONFIG_ZMK_TEXT_EXPANDER_JOURNAL_FLUSH_DELAY
+ * milliseconds after the first one. Call this before a planned power-off to avoid losing them.
+ * Only available with CONFIG_ZMK_TEXT_EXPANDER_JOURNAL.
+ *
+ * @return 0 on success.
+ * @return -ENODEV if the journal partition is unavailable.
+ * @return -EBUSY if called inside the caller's own batch, which is not persisted before commit.
+ * @return Another negative error code if the flash operation failed.
+ */
+int zmk_text_expander_flush_journal(void);
+
+/**
+ * @brief Validates and loads the dictionary image from its flash partition.
+ *
+ * The image is queried in place through the memory-mapped partition; nothing is copied to
+ * RAM. Its expansions are active on all layers, with lower precedence than runtime and
+ * device tree expansions. Call this after writing a new image to the partition.
+ * Only available with CONFIG_ZMK_TEXT_EXPANDER_IMAGE.
+ *
+ * @return 0 on success.
+ * @return -ENOENT if the partition holds no image.
+ * @return -ENOTSUP if the image version is not supported.
+ * @return -EINVAL if the image is truncated or fails its CRC check.
+ */
+int zmk_text_expander_reload_image(void);
+
+/**
+ * @brief Stops using the dictionary image.
+ *
+ * Returns once no lookup reads from the partition anymore, so it can then be erased and
+ * rewritten. Only available with CONFIG_ZMK_TEXT_EXPANDER_IMAGE.
+ */
+void zmk_text_expander_unload_image(void);
+
+/**
+ * @brief Operating system of a host, as far as deleting a word is concerned.
+ */
+enum zmk_text_expander_host {
+    ZMK_TEXT_EXPANDER_HOST_UNKNOWN = 0, // Short codes are deleted with backspaces.
+    ZMK_TEXT_EXPANDER_HOST_PC,          // Windows or Linux: Ctrl+Backspace deletes a word.
+    ZMK_TEXT_EXPANDER_HOST_MACOS,       // macOS: Alt (Option)+Backspace deletes a word.
+};
+
+/**
+ * @brief Sets the operating system of the host on the selected endpoint.
+ *
+ * Each endpoint (USB, or a BLE profile) starts out with the host set by Kconfig. Short codes
+ * typed as whole words are deleted with the host's word-delete chord instead of one backspace
+ * per character. Only available with CONFIG_ZMK_TEXT_EXPANDER_WORD_DELETE.
+ *
+ * @param host The host's operating system, or ZMK_TEXT_EXPANDER_HOST_UNKNOWN to use backspaces.
+ * @return 0 on success.
+ * @return -EINVAL if host is not a known value or no endpoint is selected.
+ */
+int zmk_text_expander_set_host(enum zmk_text_expander_host host);
+
+/**
+ * @brief Gets the operating system of the host on the selected endpoint.
+ *
+ * Only available with CONFIG_ZMK_TEXT_EXPANDER_WORD_DELETE.
+ *
+ * @return The host set with zmk_text_expander_set_host() or by Kconfig.
+ */
+enum zmk_text_expander_host zmk_text_expander_get_host(void);
+
 #ifdef __cplusplus
 } // End of extern "C"
 #endif
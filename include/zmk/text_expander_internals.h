@@ -2,7 +2,9 @@
 #define ZMK_TEXT_EXPANDER_INTERNALS_H
 
 #include <zephyr/kernel.h> // For k_mutex, etc.
+#include <zephyr/sys/atomic.h> // For atomic_t and atomic_ptr_t used by the lock-free keystroke path.
 #include <zephyr/sys/util.h> // For ARRAY_SIZE if used, though not directly visible here.
+#include <zephyr/sys/sys_heap.h> // For struct sys_heap backing the heap text allocator.
 #include <stdbool.h>       // For bool type.
 #include <stdint.h>        // For uint8_t, uint16_t.
 
@@ -22,6 +24,30 @@
 #ifndef CONFIG_ZMK_TEXT_EXPANDER_MAX_EXPANDED_LEN
 #define CONFIG_ZMK_TEXT_EXPANDER_MAX_EXPANDED_LEN 256
 #endif
+// Configuration for the maximum length of a single expanded text (excluding null terminator).
+// 0 (the default) keeps texts within MAX_EXPANDED_LEN.
+#ifndef CONFIG_ZMK_TEXT_EXPANDER_MAX_TEXT_LEN
+#define CONFIG_ZMK_TEXT_EXPANDER_MAX_TEXT_LEN 0
+#endif
+// Configuration for the size of each runtime text pool in bytes.
+// 0 (the default) sizes it for MAX_EXPANSIONS distinct texts of average length.
+#ifndef CONFIG_ZMK_TEXT_EXPANDER_TEXT_POOL_SIZE
+#define CONFIG_ZMK_TEXT_EXPANDER_TEXT_POOL_SIZE 0
+#endif
+// Configuration for the number of nodes in each runtime node pool.
+// 0 (the default) sizes it for MAX_EXPANSIONS short codes of average length.
+#ifndef CONFIG_ZMK_TEXT_EXPANDER_NODE_POOL_SIZE
+#define CONFIG_ZMK_TEXT_EXPANDER_NODE_POOL_SIZE 0
+#endif
+// Configuration for the average text length the default text pool size is budgeted for.
+#ifndef CONFIG_ZMK_TEXT_EXPANDER_AVG_TEXT_LEN
+#define CONFIG_ZMK_TEXT_EXPANDER_AVG_TEXT_LEN 32
+#endif
+// Configuration for the average number of new trie nodes per short code the default node pool
+// size is budgeted for.
+#ifndef CONFIG_ZMK_TEXT_EXPANDER_AVG_SHORT_LEN
+#define CONFIG_ZMK_TEXT_EXPANDER_AVG_SHORT_LEN 4
+#endif
 // Configuration for the delay between typing characters during expansion.
 // Defaults to 10 milliseconds if not set in Kconfig.
 #ifndef CONFIG_ZMK_TEXT_EXPANDER_TYPING_DELAY
@@ -31,37 +57,245 @@
 // Define constants based on Kconfig or default values for easier use in code.
 #define MAX_EXPANSIONS CONFIG_ZMK_TEXT_EXPANDER_MAX_EXPANSIONS
 #define MAX_SHORT_LEN CONFIG_ZMK_TEXT_EXPANDER_MAX_SHORT_LEN         // Max length for the short code string itself.
-#define MAX_EXPANDED_LEN CONFIG_ZMK_TEXT_EXPANDER_MAX_EXPANDED_LEN   // Max length for the expanded text string.
+#define MAX_EXPANDED_LEN CONFIG_ZMK_TEXT_EXPANDER_MAX_EXPANDED_LEN   // Size of the buffers texts are typed from.
+// Size limit (including the null terminator) of a stored expanded text. Texts that do not fit
+// into MAX_EXPANDED_LEN are streamed in chunks.
+#define MAX_TEXT_LEN (CONFIG_ZMK_TEXT_EXPANDER_MAX_TEXT_LEN > 0 ? CONFIG_ZMK_TEXT_EXPANDER_MAX_TEXT_LEN + 1 : MAX_EXPANDED_LEN)
 #define TYPING_DELAY CONFIG_ZMK_TEXT_EXPANDER_TYPING_DELAY           // Milliseconds
 
 #include <zmk/trie.h> // Include trie data structure definitions.
+#include <zmk/text_dict.h> // Backends of the device tree dictionaries.
+#include <zmk/text_codec.h> // For struct text_codec_table.
+
+// Number of memory pool generations. With CONFIG_ZMK_TEXT_EXPANDER_SHADOW_BUILD, updates are built
+// into a second (shadow) pool and published with a single atomic root swap; otherwise the live
+// trie is modified in place and one pool suffices.
+#define TEXT_EXPANDER_POOL_COUNT (IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SHADOW_BUILD) ? 2 : 1)
+
+struct text_heap_block; // A text allocated by the heap text allocator (see text_heap.c).
+
+// An expansion (or fragment) defined as a device tree child of a behavior instance.
+struct text_expander_expansion {
+    const char *short_code;    // The short code string.
+    const char *expanded_text; // The corresponding expanded text string.
+    bool fragment;             // True for named fragments, which are only referenced, never typed.
+};
+
+/**
+ * @brief One generation of memory pools backing a trie.
+ *
+ * Holds the nodes and expanded text strings of one complete dictionary. The storage itself is
+ * provided by the owner, so pools can be sized per dictionary: the runtime dictionary uses
+ * MAX_EXPANSIONS-based pools, while each device tree instance gets pools sized from its own
+ * children. In shadow build mode the runtime dictionary has two of these: the live one that
+ * readers walk, and the shadow one that updates are built into before being published.
+ */
+struct text_expander_pool {
+    struct trie_node *node_pool;       // Memory pool for trie nodes.
+    size_t node_pool_size;             // Number of nodes in node_pool.
+    size_t node_pool_used;             // Number of nodes currently allocated from node_pool.
+    size_t node_pool_peak;             // Highest node_pool_used since boot.
+    size_t node_pool_next;             // Index of the first node that was never handed out.
+    struct trie_node *node_free_list;  // Nodes freed by trie_delete(), reused before node_pool_next.
+    struct trie_node *node_retired_list; // Nodes freed while readers may still hold them; they join
+                                       // node_free_list once readers drops to zero.
+
+    char *text_pool;                   // Memory pool for storing the expanded text strings.
+    size_t text_pool_size;             // Size of text_pool in bytes.
+    size_t text_pool_used;             // Number of bytes currently allocated from text_pool.
+    size_t text_pool_peak;             // Highest text_pool_used since boot.
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_TEXT_ALLOC_HEAP)
+    struct sys_heap text_heap;         // Heap managing text_pool.
+#else
+    size_t text_pool_last;             // Offset of the last allocation, if text_pool_used > 0.
+#endif
+    trie_text_link *text_buckets;      // Index of the stored texts by trie_text_bucket(), so interning
+                                       // and releasing a text only compares the texts of one bucket.
+    size_t text_bucket_count;          // Number of text_buckets; 0 for pools without a text_pool.
+
+    atomic_t readers;                  // Number of lock-free readers currently walking this generation.
+                                       // A pool is only reset, and its retired nodes only reused,
+                                       // once this drops to zero.
+};
+
+/**
+ * @brief How the previous generation of the runtime dictionary differs from the live one.
+ *
+ * In shadow build mode the generation that was live before the last publish stays intact in
+ * the shadow pool. When it is a single update behind, the next update replays that update on
+ * it instead of rebuilding the shadow generation from a copy of the whole dictionary.
+ */
+enum text_expander_lag {
+    TEXT_EXPANDER_LAG_UNKNOWN, // Unknown (or modified since): copy the live dictionary.
+    TEXT_EXPANDER_LAG_NONE,    // It matches the live one (a failed update left it unchanged).
+    TEXT_EXPANDER_LAG_ADD,     // The live one has `stale_key` added or updated.
+    TEXT_EXPANDER_LAG_REMOVE,  // The live one has `stale_key` removed.
+};
+
+/**
+ * @brief Per-instance runtime data of a text expander behavior (its `dev->data`).
+ *
+ * Each device tree instance owns a dictionary built from its own child nodes, sized for
+ * exactly those children. It is filled once at init and read-only afterwards, so the
+ * listener and the trigger can search it without any synchronization.
+ */
+struct text_expander_instance_data {
+    struct text_dict *dict;            // This instance's expansions.
+    struct text_dict *fragments;       // The named fragments, which can only be referenced from other
+                                       // texts as {{name}}, not typed.
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SORTED_DICT)
+    struct text_dict_sorted dict_backend;      // Sorted packed keys behind `dict`.
+    struct text_dict_sorted fragment_backend;  // Sorted packed keys behind `fragments`.
+#elif IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_PERFECT_HASH)
+    struct text_dict_hash dict_backend;        // Build-time hash (in flash) behind `dict`.
+    struct text_dict_hash fragment_backend;    // Build-time hash (in flash) behind `fragments`.
+#else
+    struct text_dict_trie dict_backend;        // Trie behind `dict`.
+    struct text_dict_trie fragment_backend;    // Trie behind `fragments`.
+    struct text_expander_pool pool;            // Node pool shared by both tries.
+#endif
+    uint16_t expansion_count;          // Number of expansions loaded from the device tree.
+    uint16_t fragment_count;           // Number of fragments loaded from the device tree.
+};
 
 /**
  * @brief Structure holding the internal data for the text expander.
  *
- * This structure contains the trie used for storing expansions, the current
+ * This structure contains the runtime trie managed through the public API, the current
  * input buffer for short codes, memory pools for trie nodes and text,
- * and synchronization primitives.
+ * and synchronization primitives. Device tree expansions live in per-instance dictionaries
+ * (struct text_expander_instance_data) instead.
+ *
+ * The fields fall into two ownership groups:
+ * - Matcher state (`current_short`, `current_short_len`, `matcher_generation`) is owned by the
+ *   event manager thread, i.e. the keycode listener and the behavior binding handlers. Nothing
+ *   else writes it, so the per-keystroke path never needs the mutex and never drops a key.
+ *   With CONFIG_ZMK_TEXT_EXPANDER_DEFERRED_INPUT, ownership moves to whoever holds the input
+ *   consumer mutex (the input worker, the trigger or the idle timer) while the listener only
+ *   queues key presses.
+ * - Dictionary state (the trie, the pools, `expansion_count`) is modified only by API callers
+ *   holding `mutex`. New trie nodes are fully initialized before they are linked in and the root
+ *   is published with an atomic store, so the listener can walk the trie without locking.
  */
 struct text_expander_data {
-    struct trie_node *root;           // Pointer to the root of the trie storing expansions.
+    atomic_ptr_t root;                 // Pointer to the root of the trie storing expansions (a struct trie_node *).
+                                       // Always read with atomic_ptr_get() and published with atomic_ptr_set().
     char current_short[MAX_SHORT_LEN]; // Buffer to store the currently typed short code.
                                        // Its actual usable length is MAX_SHORT_LEN-1 for the null terminator.
     uint8_t current_short_len;         // Current length of the string in current_short.
-    uint8_t expansion_count;           // Number of active expansions stored.
-    struct k_mutex mutex;              // Mutex to protect access to shared data within this structure.
-
-    // Memory pool for trie nodes. Sized to accommodate the maximum number of expansions,
-    // where each character in a short code might potentially create a new node in the worst case.
-    struct trie_node node_pool[MAX_EXPANSIONS * MAX_SHORT_LEN];
-    uint16_t node_pool_used;           // Number of nodes currently allocated from node_pool.
-
-    // Memory pool for storing the expanded text strings.
-    // Sized to accommodate the maximum number of expansions, each with the maximum expanded length.
-    char text_pool[MAX_EXPANSIONS * MAX_EXPANDED_LEN];
-    uint16_t text_pool_used;           // Number of bytes currently allocated from text_pool.
+    atomic_val_t matcher_generation;   // Value of `generation` the matcher state was last synchronized with.
+    atomic_t generation;               // Bumped by writers whenever previously typed prefixes may have become stale
+                                       // (e.g. clear_all). The matcher resets itself when it observes a new value.
+    uint16_t expansion_count;          // Number of active expansions stored.
+    struct k_mutex mutex;              // Serializes writers (API callers) against each other and against the
+                                       // trie's in-place updates. Never taken on the per-keystroke path.
+    atomic_t text_version;             // Bumped after any published change to the runtime dictionary or the
+                                       // image, so texts streamed in chunks notice when they may have changed.
+
+    struct text_expander_pool pools[TEXT_EXPANDER_POOL_COUNT]; // Pool generations (see TEXT_EXPANDER_POOL_COUNT).
+    uint8_t live_pool;                 // Index of the pool holding the published root.
+
+    // Write target of the current update. Outside shadow build mode this is always the live trie.
+    // In shadow build mode it is the shadow generation while an update or batch is in progress.
+    struct trie_node *build_root;      // Root that writers insert into / delete from.
+    uint8_t build_pool;                // Index of the pool that build_root allocates from.
+    uint16_t build_count;              // Expansion count of the build generation.
+    bool batch_active;                 // True between zmk_text_expander_batch_begin() and commit/abort.
+    k_tid_t batch_owner;               // Thread that started the batch, which holds the mutex.
+
+    // Previous generation, left in the shadow pool by the last publish (shadow build mode only).
+    struct trie_node *stale_root;      // Its root.
+    enum text_expander_lag stale_lag;  // The update that separates it from the live generation.
+    char stale_key[MAX_SHORT_LEN];     // Short code of that update.
 };
 
+/**
+ * @brief Returns the currently published trie root.
+ *
+ * Safe to call from any context without holding the mutex. In shadow build mode the returned
+ * generation may be recycled by a writer at any time; lock-free readers that dereference it
+ * must use text_expander_read_begin()/text_expander_read_end() instead.
+ *
+ * @param data Pointer to the text_expander_data structure.
+ * @return The root node of the trie, or NULL if it has not been allocated yet.
+ */
+static inline struct trie_node *text_expander_get_root(struct text_expander_data *data) {
+    return (struct trie_node *)atomic_ptr_get(&data->root);
+}
+
+/**
+ * @brief Enters a lock-free read-side section and returns the published trie root.
+ *
+ * Pins the generation the root belongs to, so writers will not recycle its pool, nor hand
+ * out again a node they unlink from it, until text_expander_read_end() is called. Without
+ * shadow build mode there is a single generation, pool 0. Never blocks.
+ *
+ * @param pool_index Output: index of the pinned pool, to be passed to text_expander_read_end().
+ * @return The root node of the trie.
+ */
+struct trie_node *text_expander_read_begin(uint8_t *pool_index);
+
+/**
+ * @brief Leaves a read-side section entered with text_expander_read_begin().
+ *
+ * @param pool_index The pool index returned by text_expander_read_begin().
+ */
+void text_expander_read_end(uint8_t pool_index);
+
+/**
+ * @brief Dictionaries an expanded text can come from.
+ */
+enum text_expander_origin {
+    TEXT_EXPANDER_ORIGIN_RUNTIME,  // The runtime dictionary managed through the public API.
+    TEXT_EXPANDER_ORIGIN_INSTANCE, // The expansions of a device tree instance.
+    TEXT_EXPANDER_ORIGIN_FRAGMENT, // The fragments of a device tree instance.
+    TEXT_EXPANDER_ORIGIN_IMAGE,    // The dictionary image.
+};
+
+/**
+ * @brief Identifies a stored text so it can be read in chunks.
+ *
+ * Texts can be longer than any buffer, so readers keep this reference instead of a copy and
+ * read the text piece by piece with text_expander_read_text().
+ */
+struct text_expander_text_ref {
+    char short_code[MAX_SHORT_LEN]; // Short code the text is stored under.
+    uint8_t origin;                 // enum text_expander_origin.
+    uint8_t instance;               // Index of the instance for the instance and fragment origins.
+    atomic_val_t version;           // expander_data.text_version when the text was looked up.
+};
+
+/**
+ * @brief Reads part of a stored text.
+ *
+ * Copies the text starting at offset into buf, up to and including its terminator or until
+ * buf is full. Safe to call from any thread.
+ *
+ * @param ref The text, as returned by a lookup.
+ * @param offset Offset within the (possibly compressed) text.
+ * @param buf Output buffer.
+ * @param size Size of buf.
+ * @return The number of bytes copied (0 past the end of the text), or -ESTALE if the
+ * dictionary changed since the text was looked up.
+ */
+int text_expander_read_text(const struct text_expander_text_ref *ref, size_t offset, char *buf, size_t size);
+
+/**
+ * @brief Looks up the target of a fragment reference.
+ *
+ * Looks name up like a short code, regardless of the active layers: first in the runtime
+ * dictionary, then in the expansions and fragments of each device tree instance, then in the
+ * dictionary image. Safe to call from any thread.
+ *
+ * @param name Short code of the referenced expansion or fragment.
+ * @param ref Output: reference to the text, to be read with text_expander_read_text().
+ * @param tokens Output: the token table the text is compressed with (count 0 for plain text).
+ * May be NULL if compressed images are not supported.
+ * @return 0 on success, or -ENOENT if nothing is stored under name.
+ */
+int text_expander_resolve_fragment(const char *name, struct text_expander_text_ref *ref,
+                                   struct text_codec_table *tokens);
+
 /**
  * @brief Global instance of the text expander data.
  *
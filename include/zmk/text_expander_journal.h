@@ -0,0 +1,62 @@
+#ifndef ZMK_TEXT_EXPANDER_JOURNAL_H // Start of include guard.
+#define ZMK_TEXT_EXPANDER_JOURNAL_H
+
+#include <zephyr/sys/util.h> // For IS_ENABLED.
+
+/*
+ * Persistence of the runtime dictionary in an append-only flash journal.
+ *
+ * Every successful update made through the public API is staged as a record in RAM and
+ * written to flash in one go after CONFIG_ZMK_TEXT_EXPANDER_JOURNAL_FLUSH_DELAY, so bursts of
+ * edits cost a single flash write. When the active bank fills up, the live runtime dictionary
+ * is compacted into the other bank. At boot the newest valid bank is replayed through the
+ * batch API.
+ *
+ * Flash is only written from a dedicated work queue, which holds expander_data.mutex just long
+ * enough to take the staged records or to look up one expansion, never across an erase or a
+ * write.
+ *
+ * All functions below must be called with expander_data.mutex held; the staged records are
+ * protected by that mutex.
+ */
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_JOURNAL)
+
+/**
+ * @brief Stages an add/update record for the runtime dictionary.
+ *
+ * @param short_code The short code that was added or updated.
+ * @param expanded_text The text now stored for it.
+ */
+void text_expander_journal_record_add(const char *short_code, const char *expanded_text);
+
+/**
+ * @brief Stages a remove record for the runtime dictionary.
+ *
+ * @param short_code The short code that was removed.
+ */
+void text_expander_journal_record_remove(const char *short_code);
+
+/**
+ * @brief Stages a clear record for the runtime dictionary.
+ */
+void text_expander_journal_record_clear(void);
+
+/**
+ * @brief Drops all staged records and schedules a compaction of the live dictionary.
+ *
+ * Used when staged records no longer describe the live dictionary, e.g. after a shadow
+ * batch was aborted.
+ */
+void text_expander_journal_discard_pending(void);
+
+#else
+
+static inline void text_expander_journal_record_add(const char *short_code, const char *expanded_text) {}
+static inline void text_expander_journal_record_remove(const char *short_code) {}
+static inline void text_expander_journal_record_clear(void) {}
+static inline void text_expander_journal_discard_pending(void) {}
+
+#endif // IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_JOURNAL)
+
+#endif // ZMK_TEXT_EXPANDER_JOURNAL_H End of include guard.
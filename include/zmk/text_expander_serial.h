@@ -0,0 +1,59 @@
+#ifndef ZMK_TEXT_EXPANDER_SERIAL_H // Start of include guard.
+#define ZMK_TEXT_EXPANDER_SERIAL_H
+
+#include <zephyr/sys/util.h> // For BIT.
+
+/*
+ * Dictionary upload protocol over a UART/CDC-ACM link.
+ *
+ * Every frame, in both directions, has the layout
+ *
+ *   0xa5 | type (1) | seq (1) | len (2, LE) | payload (len) | crc32_ieee (4, LE)
+ *
+ * where the CRC covers type, seq, len and the payload. The device parses frames byte by byte
+ * and buffers at most one frame, so dictionaries of any size can be streamed.
+ *
+ * Flow control is stop-and-wait: the host sends one frame and waits for the ACK or NAK
+ * carrying the same seq before sending the next one. A frame repeating the seq of the last
+ * acknowledged frame is acknowledged again without being applied, so the host can simply
+ * retransmit when a response is lost. Frames with a bad CRC are dropped silently.
+ *
+ * The dictionary version hash is the sum (mod 2^32) of crc32_ieee(short_code '\0' expanded_text)
+ * over all runtime expansions; it is 0 for an empty dictionary and does not depend on the
+ * order in which entries were added. A host that knows the dictionary matching the device's
+ * hash only needs to send the differences.
+ *
+ * scripts/text_expander_upload.py implements the host side.
+ */
+
+#define TEXT_EXPANDER_SERIAL_SOF 0xa5       // First byte of every frame.
+#define TEXT_EXPANDER_SERIAL_VERSION 1      // Protocol version reported in STATUS.
+#define TEXT_EXPANDER_SERIAL_HEADER_LEN 5   // SOF, type, seq and len.
+#define TEXT_EXPANDER_SERIAL_CRC_LEN 4      // Trailing CRC.
+
+// BEGIN flag: clear the runtime dictionary before applying the records of the session.
+#define TEXT_EXPANDER_SERIAL_BEGIN_REPLACE BIT(0)
+
+/**
+ * @brief Frame types.
+ */
+enum text_expander_serial_frame_type {
+    // Host to device.
+    TEXT_EXPANDER_SERIAL_HELLO = 0x01,  // No payload. Answered with STATUS.
+    TEXT_EXPANDER_SERIAL_BEGIN = 0x02,  // base hash (4, LE), flags (1). Starts a batch; NAK ESTALE
+                                        // if the hash differs and REPLACE is not set.
+    TEXT_EXPANDER_SERIAL_ADD = 0x03,    // short code length (1), short code, expanded text.
+    TEXT_EXPANDER_SERIAL_REMOVE = 0x04, // short code.
+    TEXT_EXPANDER_SERIAL_CLEAR = 0x05,  // No payload.
+    TEXT_EXPANDER_SERIAL_COMMIT = 0x06, // expected hash (4, LE). Commits the batch; NAK EBADMSG if
+                                        // the resulting dictionary does not match the hash.
+    TEXT_EXPANDER_SERIAL_ABORT = 0x07,  // No payload. Aborts the batch.
+
+    // Device to host.
+    TEXT_EXPANDER_SERIAL_ACK = 0x80,    // No payload.
+    TEXT_EXPANDER_SERIAL_NAK = 0x81,    // errno value (1).
+    TEXT_EXPANDER_SERIAL_STATUS = 0x82, // protocol version (1), hash (4, LE), runtime count (2, LE),
+                                        // max short code length (1), max expanded length (2, LE).
+};
+
+#endif // ZMK_TEXT_EXPANDER_SERIAL_H End of include guard.
@@ -5,47 +5,147 @@
 #include <stdbool.h>       // For bool type.
 #include <stdint.h>        // For standard integer types.
 
+#include <zmk/text_expander.h> // For struct zmk_text_expander_text_stats.
+
 // Defines the size of the alphabet for the trie.
 // This version supports lowercase letters 'a'-'z' (26) and digits '0'-'9' (10), totaling 36.
 #ifndef TRIE_ALPHABET_SIZE
 #define TRIE_ALPHABET_SIZE 36
 #endif
 
-// Forward declaration of text_expander_data to avoid circular dependencies.
+// Bytes of bookkeeping per text allocation in a text_pool, and bytes of bookkeeping per
+// text_pool. Pools must reserve this much on top of the texts themselves. The bump allocator
+// stores a reference count, the length, the length of the previous allocation and a link to
+// the next text of the same index bucket in front of each text; the heap allocator adds the
+// heap's own chunk headers, rounding and free lists.
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_TEXT_ALLOC_HEAP)
+#define TRIE_TEXT_OVERHEAD 16
+#define TRIE_TEXT_POOL_OVERHEAD 256
+#else
+#define TRIE_TEXT_OVERHEAD 10
+#define TRIE_TEXT_POOL_OVERHEAD 0
+#endif
+
+// Number of trailing characters texts are filed by in the text index (see trie_text_bucket()).
+// A text can only share the storage of a longer text if it has at least this many characters.
+#define TRIE_TEXT_INDEX_TAIL 8
+
+// Head of one bucket of the text index: the first block of the bucket for the heap allocator,
+// or the offset of the first allocation plus one (0 for an empty bucket) for the bump allocator.
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_TEXT_ALLOC_HEAP)
+typedef struct text_heap_block *trie_text_link;
+#else
+typedef uint32_t trie_text_link;
+#endif
+
+// Forward declaration of text_expander_pool to avoid circular dependencies.
 // This structure is defined in text_expander_internals.h and is needed by
 // trie allocation functions which use its memory pools.
-struct text_expander_data;
+struct text_expander_pool;
 
 /**
  * @brief Structure representing a node in the trie.
  *
  * Each node can have children corresponding to characters in the alphabet,
  * a pointer to the expanded text if this node marks the end of a short code,
- * and a flag indicating if it's a terminal node.
+ * and a flag indicating if it's a terminal node. Each node also counts the terminal nodes
+ * below it, so the short codes starting with a prefix can be counted without a walk.
  */
 struct trie_node {
     struct trie_node *children[TRIE_ALPHABET_SIZE]; // Array of pointers to child nodes.
-    char *expanded_text;                            // Pointer to the null-terminated expanded string if this node is terminal.
-                                                    // This points into the text_pool in text_expander_data.
+    const char *expanded_text;                      // Pointer to the null-terminated expanded string if this node is terminal.
+                                                    // This points into the text_pool of a text_expander_pool,
+                                                    // or at a constant string if flash_text is set.
     bool is_terminal;                               // True if this node represents the end of a complete short code.
+    bool flash_text;                                // True if expanded_text is a constant string (e.g. a device tree
+                                                    // literal in flash) that is not owned by the text_pool.
+    uint32_t terminal_count;                        // Number of terminal nodes in this node's subtree, itself
+                                                    // included. Kept up to date by trie_insert() and trie_delete().
+                                                    // 32 bits, since a runtime node pool is not bounded to 65535
+                                                    // short codes.
 };
 
 /**
- * @brief Allocates a new trie node from the node_pool in text_expander_data.
+ * @brief Callback invoked by trie_for_each() for every stored expansion.
+ *
+ * @param key The null-terminated short code. Only valid for the duration of the call.
+ * @param value The expanded text stored for the short code.
+ * @param user_data Opaque pointer passed through from trie_for_each().
+ * @return 0 to continue the walk, or a negative error code to stop it.
+ */
+typedef int (*trie_visit_cb)(const char *key, const char *value, void *user_data);
+
+/**
+ * @brief Allocates a new trie node from the node_pool of a pool generation.
+ *
+ * Nodes freed by trie_delete() are reused first. O(1).
  *
- * @param data Pointer to the text_expander_data structure containing the memory pool.
+ * @param pool Pointer to the text_expander_pool containing the memory pool.
  * @return Pointer to the allocated trie_node, or NULL if the pool is exhausted.
  */
-struct trie_node *trie_allocate_node(struct text_expander_data *data);
+struct trie_node *trie_allocate_node(struct text_expander_pool *pool);
+
+/**
+ * @brief Stores an expanded text in the text_pool of a pool generation, sharing storage.
+ *
+ * If the pool already holds the same string, or a string ending with it, the existing
+ * allocation is reused and its reference count incremented. Otherwise a new allocation is made.
+ * Texts shorter than TRIE_TEXT_INDEX_TAIL only share identical texts. Only the texts in the
+ * text's index bucket are compared, so the cost does not grow with the dictionary.
+ *
+ * @param pool Pointer to the text_expander_pool containing the memory pool.
+ * @param text The null-terminated text to store.
+ * @return Pointer to the stored text within the text_pool, or NULL if the pool is exhausted.
+ */
+char *trie_intern_text(struct text_expander_pool *pool, const char *text);
+
+/**
+ * @brief Drops a reference to a text returned by trie_intern_text().
+ *
+ * Allocations without references are reused by later identical or suffix texts, and freed
+ * ones at the end of the pool are returned to it.
+ *
+ * @param pool Pointer to the text_expander_pool the text was interned in.
+ * @param text Pointer returned by trie_intern_text().
+ */
+void trie_release_text(struct text_expander_pool *pool, const char *text);
+
+/**
+ * @brief Returns the index bucket of a text.
+ *
+ * Texts are filed by a hash of their last TRIE_TEXT_INDEX_TAIL characters (all of them for
+ * shorter texts), so a text and every text it is a suffix of land in the same bucket.
+ *
+ * @param pool Pointer to the text_expander_pool whose index to use. Must have buckets.
+ * @param text The text, not necessarily null-terminated.
+ * @param len Length of text.
+ * @return The index into pool->text_buckets.
+ */
+size_t trie_text_bucket(const struct text_expander_pool *pool, const char *text, size_t len);
+
+/**
+ * @brief Frees all text storage of a pool generation.
+ *
+ * Implemented by the selected text allocator; called by trie_reset_pool().
+ *
+ * @param pool Pointer to the text_expander_pool whose text storage to reset.
+ */
+void trie_reset_text(struct text_expander_pool *pool);
 
 /**
- * @brief Allocates storage for an expanded text string from the text_pool in text_expander_data.
+ * @brief Reports the text storage usage of a pool generation.
  *
- * @param data Pointer to the text_expander_data structure containing the memory pool.
- * @param len The length of the text string to allocate (including space for null terminator).
- * @return Pointer to the allocated memory block within the text_pool, or NULL if the pool is exhausted.
+ * @param pool Pointer to the text_expander_pool to inspect.
+ * @param stats Output: the usage of its text storage.
  */
-char *trie_allocate_text_storage(struct text_expander_data *data, size_t len);
+void trie_text_stats(const struct text_expander_pool *pool, struct zmk_text_expander_text_stats *stats);
+
+/**
+ * @brief Resets a pool generation so all its nodes and text storage can be reused.
+ *
+ * @param pool Pointer to the text_expander_pool to reset.
+ */
+void trie_reset_pool(struct text_expander_pool *pool);
 
 /**
  * @brief Searches the trie for a given key (short code).
@@ -59,32 +159,53 @@ struct trie_node *trie_search(struct trie_node *root, const char *key);
 /**
  * @brief Inserts a key-value pair (short code and expanded text) into the trie.
  *
- * If the key already exists, its value might be updated (behavior depends on implementation details,
- * e.g., if new value fits in old space or if reallocation happens).
+ * If the key already exists, it is pointed at the new (interned) text and its reference to the
+ * old text is released. Stored texts are never modified in place, since they may be shared.
  *
  * @param root The root node of the trie.
  * @param key The null-terminated short code string to insert.
  * @param value The null-terminated expanded text string.
- * @param data Pointer to the text_expander_data structure for memory allocation.
+ * @param pool Pointer to the pool generation the trie allocates from.
  * @return 0 on success.
  * @return -EINVAL if key or value is invalid (e.g., NULL, invalid characters in key).
  * @return -ENOMEM if memory allocation fails.
  */
-int trie_insert(struct trie_node *root, const char *key, const char *value, struct text_expander_data *data);
+int trie_insert(struct trie_node *root, const char *key, const char *value, struct text_expander_pool *pool);
+
+/**
+ * @brief Inserts a key that refers to a constant text instead of a copy of it.
+ *
+ * Like trie_insert(), but the node points at value itself and no text_pool storage is used.
+ * Meant for string literals such as device tree texts, which already live in (memory-mapped)
+ * flash. Updates and deletes of the key never release value.
+ *
+ * @param root The root node of the trie.
+ * @param key The null-terminated short code string to insert.
+ * @param value The null-terminated expanded text. Must stay valid and unchanged for the
+ * lifetime of the trie.
+ * @param pool Pointer to the pool generation the trie allocates nodes from.
+ * @return 0 on success.
+ * @return -EINVAL if key or value is invalid (e.g., NULL, invalid characters in key).
+ * @return -ENOMEM if a node could not be allocated.
+ */
+int trie_insert_static(struct trie_node *root, const char *key, const char *value,
+                       struct text_expander_pool *pool);
 
 /**
  * @brief Deletes a key (short code) from the trie.
  *
- * This typically involves marking the terminal node as non-terminal.
- * Memory for the node and text itself might not be immediately reclaimed in simple implementations.
+ * Marks the terminal node as non-terminal and releases its reference to the text (unless it
+ * is a constant text inserted with trie_insert_static()). Nodes that no longer lead to any
+ * expansion are returned to the pool.
  *
  * @param root The root node of the trie.
  * @param key The null-terminated short code string to delete.
+ * @param pool Pointer to the pool generation the trie's texts were interned in.
  * @return 0 on success.
  * @return -EINVAL if the key is invalid.
  * @return -ENOENT if the key is not found in the trie or is not a terminal node.
  */
-int trie_delete(struct trie_node *root, const char *key);
+int trie_delete(struct trie_node *root, const char *key, struct text_expander_pool *pool);
 
 /**
  * @brief Converts a character to its corresponding index in the trie's children array.
@@ -122,4 +243,71 @@ const char *trie_get_expanded_text(struct trie_node *node);
  */
 struct trie_node *trie_get_node_for_key(struct trie_node *root, const char *key);
 
+/**
+ * @brief Counts the short codes starting with a prefix and completes the prefix if it is unique.
+ *
+ * Reads the count kept in the prefix's node, and only if it is 1 follows the single branch
+ * that still holds a terminal node: O(length of the short code).
+ *
+ * @param root The root node of the trie.
+ * @param prefix The null-terminated prefix.
+ * @param key Output: the only short code starting with prefix, if the return value is 1.
+ * @param size Size of the key buffer.
+ * @return Number of short codes starting with prefix, counting prefix itself if it is one.
+ * A count of 1 that cannot be completed (e.g. due to a concurrent update) is reported as 0.
+ */
+size_t trie_complete(struct trie_node *root, const char *prefix, char *key, size_t size);
+
+/**
+ * @brief Compares two short codes in candidate order.
+ *
+ * Shorter short codes come first, and short codes of the same length are in alphabet order
+ * (letters before digits), as in trie_for_each().
+ *
+ * @return A negative value, 0 or a positive value if a ranks before, with or after b.
+ */
+int trie_key_compare(const char *a, const char *b);
+
+/**
+ * @brief Finds the first short code starting with a prefix that ranks after another one.
+ *
+ * Candidates are ranked by trie_key_compare(), so stepping from one to the next visits all
+ * short codes below the prefix's node without allocating anything. Subtrees without terminal
+ * nodes, and those whose short codes would be longer than the best candidate so far, are
+ * skipped.
+ *
+ * @param root The root node of the trie.
+ * @param prefix The null-terminated prefix.
+ * @param after The previous candidate, or NULL for the first one.
+ * @param key Output: the candidate.
+ * @param size Size of the key buffer.
+ * @return True if a candidate was found.
+ */
+bool trie_next_candidate(struct trie_node *root, const char *prefix, const char *after, char *key, size_t size);
+
+/**
+ * @brief Visits every stored expansion in the trie in lexicographic order of the short codes.
+ *
+ * @param root The root node of the trie.
+ * @param cb Callback invoked for each terminal node.
+ * @param user_data Opaque pointer passed to the callback.
+ * @return 0 if all expansions were visited, or the first negative value returned by the callback.
+ */
+int trie_for_each(struct trie_node *root, trie_visit_cb cb, void *user_data);
+
+/**
+ * @brief Finds the short code that follows another one in lexicographic order.
+ *
+ * Visits short codes in the order of trie_for_each(), but one at a time, so a walk can be
+ * resumed after the trie was unlocked and changed: a short code that was removed in the
+ * meantime still marks the position to continue from.
+ *
+ * @param root The root node of the trie.
+ * @param after The previous short code, or "" for the first one.
+ * @param key Output: the next short code. May be the same buffer as after.
+ * @param size Size of the key buffer.
+ * @return The terminal node of the next short code, or NULL if after was the last one.
+ */
+struct trie_node *trie_next_key(struct trie_node *root, const char *after, char *key, size_t size);
+
 #endif // ZMK_TRIE_H End of include guard.
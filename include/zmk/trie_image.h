@@ -0,0 +1,148 @@
+#ifndef ZMK_TRIE_IMAGE_H // Start of include guard.
+#define ZMK_TRIE_IMAGE_H
+
+#include <stdbool.h> // For bool type.
+#include <stddef.h>  // For size_t.
+#include <stdint.h>  // For fixed-width integer types.
+#include <errno.h>   // For ENOTSUP.
+#include <zephyr/sys/util.h> // For IS_ENABLED.
+
+#include <zmk/text_codec.h> // For struct text_codec_table.
+
+/*
+ * Position-independent, read-only dictionary image.
+ *
+ * The image is a single blob that can be queried in place, e.g. through the memory-mapped
+ * address of a flash partition, without copying anything to RAM. All multi-byte fields are
+ * little-endian, and all references are offsets from the start of the image or indices into
+ * its arrays, so the blob can live at any address.
+ *
+ * Layout:
+ *   struct trie_image_header
+ *   struct trie_image_node  nodes[node_count]  at nodes_offset (node 0 is the root)
+ *   struct trie_image_edge  edges[edge_count]  at edges_offset
+ *   uint32_t                texts[entry_count] at texts_offset (string table offset per entry)
+ *   char                    strings[]          at strings_offset (null-terminated texts)
+ *   uint8_t                 tokens[token_count][2] at tokens_offset (only if token_count > 0)
+ *
+ * The short codes form a minimized acyclic automaton (DAWG): the trie over all short codes
+ * with identical subtrees merged, so codes sharing a suffix share its nodes as well as their
+ * common prefix. On large dictionaries this takes far fewer nodes than a trie. A node can
+ * then end many short codes, so it cannot hold a text; instead the entries are numbered in
+ * sorted order of their short codes, and each edge records how many entries sort before
+ * those reached through it from its node. The sum of these along the path of a short code
+ * is its entry number, the index of its text in texts[].
+ *
+ * The edges of each node are stored contiguously and sorted by symbol. If the image has a
+ * token table, its texts are compressed as described in text_codec.h; lookups return the
+ * encoded text, which the expansion engine decodes while typing.
+ * scripts/trie_image.py builds images from a list of short codes and texts.
+ */
+
+#define TRIE_IMAGE_MAGIC 0x31495854   // "TXI1" in little-endian byte order.
+#define TRIE_IMAGE_VERSION 3          // Bumped on incompatible layout changes.
+#define TRIE_IMAGE_NODE_TERMINAL 0x01 // Node flag: a short code ends at the node.
+
+/**
+ * @brief Header at the start of a trie image.
+ */
+struct trie_image_header {
+    uint32_t magic;          // TRIE_IMAGE_MAGIC.
+    uint16_t version;        // TRIE_IMAGE_VERSION.
+    uint16_t header_size;    // sizeof(struct trie_image_header) of the writer.
+    uint32_t total_size;     // Size of the whole image in bytes.
+    uint32_t entry_count;    // Number of short codes stored in the image.
+    uint32_t node_count;     // Number of entries in the node array.
+    uint32_t nodes_offset;   // Offset of the node array.
+    uint32_t edge_count;     // Number of entries in the edge array.
+    uint32_t edges_offset;   // Offset of the edge array.
+    uint32_t texts_offset;   // Offset of the text offset array (entry_count entries).
+    uint32_t strings_offset; // Offset of the string table.
+    uint32_t strings_size;   // Size of the string table in bytes.
+    uint32_t tokens_offset;  // Offset of the token table.
+    uint32_t token_count;    // Number of tokens; 0 if the texts are not compressed.
+    uint32_t crc;            // crc32_ieee over everything after the header, up to total_size.
+};
+
+/**
+ * @brief A node of a dictionary image.
+ */
+struct trie_image_node {
+    uint32_t first_edge;  // Index of the node's first edge in the edge array.
+    uint8_t edge_count;   // Number of edges (children) of the node.
+    uint8_t flags;        // TRIE_IMAGE_NODE_TERMINAL if a short code ends here.
+    uint8_t reserved[2];  // Written as zero.
+};
+
+/**
+ * @brief An edge from a node to one of its children.
+ */
+struct trie_image_edge {
+    uint8_t symbol;      // Short code character ('a'-'z' or '0'-'9').
+    uint8_t reserved[3]; // Written as zero.
+    uint32_t child;      // Index of the child node in the node array.
+    uint32_t skip;       // Entries ending at the node or reached through its earlier edges.
+};
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_IMAGE)
+
+/**
+ * @brief Validates a dictionary image.
+ *
+ * Checks the magic, version, bounds of all sections against the available size, the token
+ * table and the CRC. Validation reads the whole image once; lookups afterwards only touch the
+ * nodes on the path.
+ *
+ * @param image Start of the image.
+ * @param size Number of readable bytes at image (e.g. the partition size).
+ * @return 0 if the image is valid, -ENOENT if no image is present (erased or foreign data),
+ * -ENOTSUP for an unsupported version or a compressed image without
+ * CONFIG_ZMK_TEXT_EXPANDER_IMAGE_COMPRESSION, or -EINVAL if the image is truncated or corrupt.
+ */
+int trie_image_validate(const void *image, size_t size);
+
+/**
+ * @brief Looks up a short code in a validated trie image.
+ *
+ * @param image Start of a validated image.
+ * @param key The null-terminated short code.
+ * @return Pointer to the expanded text inside the image, or NULL if the key is not stored.
+ * The text is encoded with the image's token table if it has one (see trie_image_get_tokens()).
+ */
+const char *trie_image_search(const void *image, const char *key);
+
+/**
+ * @brief Checks whether a key is a prefix of any short code in a validated trie image.
+ *
+ * @param image Start of a validated image.
+ * @param key The null-terminated (partial) short code.
+ * @return True if the path for key exists in the image.
+ */
+bool trie_image_has_prefix(const void *image, const char *key);
+
+/**
+ * @brief Returns the number of short codes stored in a validated trie image.
+ */
+uint32_t trie_image_entry_count(const void *image);
+
+/**
+ * @brief Copies the token table of a validated trie image.
+ *
+ * @param image Start of a validated image.
+ * @param table Output: the token table. Its count is 0 if the image's texts are not compressed.
+ */
+void trie_image_get_tokens(const void *image, struct text_codec_table *table);
+
+#else
+
+static inline int trie_image_validate(const void *image, size_t size) { return -ENOTSUP; }
+static inline const char *trie_image_search(const void *image, const char *key) { return NULL; }
+static inline bool trie_image_has_prefix(const void *image, const char *key) { return false; }
+static inline uint32_t trie_image_entry_count(const void *image) { return 0; }
+static inline void trie_image_get_tokens(const void *image, struct text_codec_table *table) {
+    table->count = 0;
+}
+
+#endif // IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_IMAGE)
+
+#endif // ZMK_TRIE_IMAGE_H End of include guard.
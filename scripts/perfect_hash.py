@@ -0,0 +1,142 @@
+#!/usr/bin/env python3
+"""Generate minimal perfect hashes of the device tree text expander dictionaries.
+
+Reads the devicetree of a Zephyr build (edt.pickle) and writes a C header with,
+for every enabled zmk,behavior-text-expander instance, one hash over the short
+codes of its expansions and one over its fragments (see
+include/zmk/perfect_hash.h). Each slot holds the index of the child node in
+device tree order, which is the order of the instance's expansion array. When
+a short code is defined twice, the last definition wins, as in the other
+backends.
+
+The build runs this for CONFIG_ZMK_TEXT_EXPANDER_PERFECT_HASH; see
+CMakeLists.txt. The edtlib package from zephyr/scripts/dts/python-devicetree
+must be importable to load the pickle.
+
+Usage: perfect_hash.py --edt-pickle edt.pickle --max-short-len 16 --output text_expander_hash.h
+"""
+
+import argparse
+import pickle
+import sys
+
+COMPAT = "zmk,behavior-text-expander"
+ALPHABET = set("abcdefghijklmnopqrstuvwxyz0123456789")
+MASK = 0xFFFFFFFF
+MAX_SEED = 0xFFFF
+MAX_CHILDREN = 0xFFFF  # Slots hold 16-bit child indices.
+
+
+def key_hash(key):
+    """32-bit FNV-1a, as perfect_hash_key() in src/perfect_hash.c."""
+    h = 0x811C9DC5
+    for b in key.encode():
+        h = ((h ^ b) * 0x01000193) & MASK
+    return h
+
+
+def mix(h):
+    """MurmurHash3 finalizer, as perfect_hash_mix() in src/perfect_hash.c."""
+    h ^= h >> 16
+    h = (h * 0x85EBCA6B) & MASK
+    h ^= h >> 13
+    h = (h * 0xC2B2AE35) & MASK
+    h ^= h >> 16
+    return h
+
+
+def slot_of(h, seed, slot_count):
+    return mix(h ^ (((seed + 1) * 0x9E3779B9) & MASK)) % slot_count
+
+
+def build(entries):
+    """Builds (seeds, slots) for a dict of short code -> entry index.
+
+    Buckets are placed largest first, each with the first seed that puts all of its
+    keys into distinct free slots.
+    """
+    slot_count = len(entries)
+    if slot_count == 0:
+        return [], []
+    bucket_count = (slot_count + 1) // 2
+    buckets = [[] for _ in range(bucket_count)]
+    for code in entries:
+        h = key_hash(code)
+        buckets[mix(h) % bucket_count].append((code, h))
+
+    seeds = [0] * bucket_count
+    slots = [None] * slot_count
+    for b in sorted(range(bucket_count), key=lambda b: -len(buckets[b])):
+        if not buckets[b]:
+            break
+        for seed in range(MAX_SEED + 1):
+            wanted = {slot_of(h, seed, slot_count) for _, h in buckets[b]}
+            if len(wanted) == len(buckets[b]) and all(slots[s] is None for s in wanted):
+                break
+        else:
+            sys.exit(f"No perfect hash found for bucket {b}; please report this dictionary")
+        seeds[b] = seed
+        for code, h in buckets[b]:
+            slots[slot_of(h, seed, slot_count)] = entries[code]
+    return seeds, slots
+
+
+def instance_entries(node, max_short_len):
+    """Returns the (expansions, fragments) of an instance as short code -> child index."""
+    expansions, fragments = {}, {}
+    if len(node.children) > MAX_CHILDREN:
+        sys.exit(f"{node.path}: at most {MAX_CHILDREN} children are supported")
+    for index, child in enumerate(node.children.values()):
+        code = child.props["short_code"].val
+        text = child.props["expanded_text"].val
+        if not code or not text:
+            continue  # Skipped with a warning at boot.
+        if not set(code) <= ALPHABET or len(code) >= max_short_len:
+            sys.exit(f"{child.path}: short code '{code}' must be 1 to {max_short_len - 1} "
+                     "lowercase letters or digits")
+        fragment = "fragment" in child.props and child.props["fragment"].val
+        (fragments if fragment else expansions)[code] = index  # Later definitions win.
+    return expansions, fragments
+
+
+def table(name, entries):
+    seeds, slots = build(entries)
+    if not slots:
+        return [f"static const struct perfect_hash {name} = {{NULL, NULL, 0, 0}};"]
+    return [
+        f"static const uint16_t {name}_seeds[] = {{{', '.join(map(str, seeds))}}};",
+        f"static const uint16_t {name}_slots[] = {{{', '.join(map(str, slots))}}};",
+        f"static const struct perfect_hash {name} = {{{name}_seeds, {name}_slots, "
+        f"{len(seeds)}, {len(slots)}}};",
+    ]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--edt-pickle", required=True, help="edt.pickle of the build")
+    parser.add_argument("--max-short-len", type=int, required=True,
+                        help="CONFIG_ZMK_TEXT_EXPANDER_MAX_SHORT_LEN")
+    parser.add_argument("--output", required=True, help="header to write")
+    args = parser.parse_args()
+
+    with open(args.edt_pickle, "rb") as f:
+        edt = pickle.load(f)
+
+    lines = [
+        "/* Generated by scripts/perfect_hash.py from the devicetree. Do not edit. */",
+        "#include <stddef.h>",
+        "#include <zmk/perfect_hash.h>",
+    ]
+    # Tables are named after the dependency ordinal, which C code gets from DT_INST_DEP_ORD().
+    for node in edt.compat2okay.get(COMPAT, []):
+        expansions, fragments = instance_entries(node, args.max_short_len)
+        lines.append(f"\n/* {node.path} */")
+        lines += table(f"text_expander_hash_{node.dep_ordinal}", expansions)
+        lines += table(f"text_expander_fragment_hash_{node.dep_ordinal}", fragments)
+
+    with open(args.output, "w", encoding="utf-8") as f:
+        f.write("\n".join(lines) + "\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+"""Upload a text expander dictionary over the serial protocol.
+
+See include/zmk/text_expander_serial.h for the protocol. The dictionary uses the
+same tab-separated format as trie_image.py. The last dictionary successfully
+uploaded is kept in a state file; if the device still reports its hash, only the
+differences are sent, otherwise the full dictionary replaces the device's.
+
+Usage: text_expander_upload.py /dev/ttyACM0 dictionary.tsv
+Requires pyserial.
+"""
+
+import argparse
+import os
+import struct
+import sys
+import zlib
+
+import serial
+
+from trie_image import parse
+
+SOF = 0xA5
+HELLO, BEGIN, ADD, REMOVE, CLEAR, COMMIT, ABORT = range(1, 8)
+ACK, NAK, STATUS = 0x80, 0x81, 0x82
+BEGIN_REPLACE = 0x01
+RETRIES = 5
+
+
+def dictionary_hash(entries):
+    total = 0
+    for code, text in entries.items():
+        total += zlib.crc32(code.encode() + b"\0" + text.encode("utf-8"))
+    return total & 0xFFFFFFFF
+
+
+class Link:
+    def __init__(self, port, timeout):
+        self.port = serial.Serial(port, 115200, timeout=timeout)
+        self.seq = 0
+
+    def _read_frame(self):
+        while True:
+            b = self.port.read(1)
+            if not b:
+                return None
+            if b[0] == SOF:
+                break
+        header = self.port.read(4)
+        if len(header) < 4:
+            return None
+        (length,) = struct.unpack("<H", header[2:])
+        rest = self.port.read(length + 4)
+        if len(rest) < length + 4:
+            return None
+        payload, crc = rest[:length], struct.unpack("<I", rest[length:])[0]
+        if zlib.crc32(header + payload) & 0xFFFFFFFF != crc:
+            return None
+        return header[0], header[1], payload
+
+    def request(self, frame_type, payload=b""):
+        """Sends a frame and waits for its response (stop-and-wait)."""
+        self.seq = (self.seq + 1) & 0xFF
+        body = struct.pack("<BBH", frame_type, self.seq, len(payload)) + payload
+        frame = bytes([SOF]) + body + struct.pack("<I", zlib.crc32(body) & 0xFFFFFFFF)
+        for _ in range(RETRIES):
+            self.port.write(frame)
+            while True:
+                response = self._read_frame()
+                if response is None:
+                    break  # Timed out or garbled: retransmit.
+                rtype, rseq, rpayload = response
+                if rseq == self.seq:
+                    return rtype, rpayload
+        sys.exit("No response from the device")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("port", help="serial port of the keyboard")
+    parser.add_argument("dictionary", help="tab-separated dictionary")
+    parser.add_argument("--state", default=os.path.expanduser("~/.text_expander_state.tsv"),
+                        help="file remembering the last uploaded dictionary")
+    parser.add_argument("--timeout", type=float, default=1.0, help="response timeout in seconds")
+    args = parser.parse_args()
+
+    wanted = parse(args.dictionary)
+    link = Link(args.port, args.timeout)
+
+    rtype, status = link.request(HELLO)
+    if rtype != STATUS:
+        sys.exit("Unexpected response to HELLO")
+    version, device_hash, count, max_short, max_text = struct.unpack("<BIHBH", status)
+    print(f"Device: protocol {version}, {count} runtime expansions, hash {device_hash:08x}")
+    for code, text in wanted.items():
+        if len(code) > max_short or len(text.encode("utf-8")) > max_text:
+            sys.exit(f"'{code}' exceeds the device limits ({max_short}/{max_text})")
+
+    base = parse(args.state) if os.path.exists(args.state) else None
+    if base is not None and dictionary_hash(base) == device_hash:
+        records = [(REMOVE, code.encode()) for code in base if code not in wanted]
+        records += [(ADD, bytes([len(code)]) + code.encode() + text.encode("utf-8"))
+                    for code, text in wanted.items() if base.get(code) != text]
+        begin = struct.pack("<IB", device_hash, 0)
+    else:
+        records = [(ADD, bytes([len(code)]) + code.encode() + text.encode("utf-8"))
+                   for code, text in wanted.items()]
+        begin = struct.pack("<IB", 0, BEGIN_REPLACE)
+
+    if not records and base is not None and dictionary_hash(base) == device_hash:
+        print("Device is up to date")
+        return
+
+    if link.request(BEGIN, begin)[0] != ACK:
+        sys.exit("Device rejected the upload")
+    for frame_type, payload in records:
+        rtype, rpayload = link.request(frame_type, payload)
+        if rtype != ACK:
+            link.request(ABORT)
+            sys.exit(f"Device rejected a record (errno {rpayload[0] if rpayload else '?'})")
+    rtype, _ = link.request(COMMIT, struct.pack("<I", dictionary_hash(wanted)))
+    if rtype != ACK:
+        os.path.exists(args.state) and os.remove(args.state)
+        sys.exit("Dictionary mismatch after commit; run again to send the full dictionary")
+
+    with open(args.state, "w", encoding="utf-8") as f:
+        for code, text in wanted.items():
+            f.write(f"{code}\t{text}\n")
+    print(f"Sent {len(records)} records")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,232 @@
+#!/usr/bin/env python3
+"""Build a text expander dictionary image (see include/zmk/trie_image.h).
+
+Input is a UTF-8 text file with one expansion per line, the short code and the
+expanded text separated by a tab. Empty lines and lines starting with '#' are
+ignored. The resulting image can be written to the partition chosen as
+zmk,text-expander-image, e.g. with mcumgr or a flash programmer.
+
+Unless --tokens 0 is given, texts are compressed with a table of pair tokens
+trained on the whole dictionary (see include/zmk/text_codec.h); the firmware
+then needs CONFIG_ZMK_TEXT_EXPANDER_IMAGE_COMPRESSION. Fragment references
+({{name}}) that form a cycle within the dictionary are rejected.
+
+The short codes are stored as a minimized automaton (DAWG), in which codes
+sharing a suffix share nodes; the number of nodes saved over a plain trie is
+reported.
+
+Usage: trie_image.py dictionary.tsv dictionary.bin
+"""
+
+import argparse
+from collections import Counter
+import re
+import struct
+import sys
+import zlib
+
+MAGIC = 0x31495854
+VERSION = 3
+NODE_TERMINAL = 0x01
+HEADER = struct.Struct("<IHHIIIIIIIIIIII")
+NODE = struct.Struct("<IBB2x")
+EDGE = struct.Struct("<B3xII")
+TEXT = struct.Struct("<I")
+ALPHABET = set("abcdefghijklmnopqrstuvwxyz0123456789")
+FIRST_TOKEN = 0x80
+MAX_TOKENS = 128
+MAX_DEPTH = 16
+REFERENCE = re.compile(r"\{\{([a-z0-9]+)\}\}")
+
+
+def parse(path):
+    entries = {}
+    with open(path, encoding="utf-8") as f:
+        for lineno, line in enumerate(f, 1):
+            line = line.rstrip("\n")
+            if not line or line.startswith("#"):
+                continue
+            code, sep, text = line.partition("\t")
+            if not sep or not code or not text:
+                sys.exit(f"{path}:{lineno}: expected '<short code>\\t<expanded text>'")
+            if not set(code) <= ALPHABET:
+                sys.exit(f"{path}:{lineno}: short code '{code}' must be lowercase letters or digits")
+            entries[code] = text  # Later definitions win, as in the device tree.
+    return entries
+
+
+def check_references(entries):
+    """Rejects fragment references ({{name}}) that form a cycle within the dictionary."""
+    state = {}  # code -> "visiting" or "done"
+
+    def visit(code, path):
+        if state.get(code) == "done" or code not in entries:
+            return
+        if state.get(code) == "visiting":
+            sys.exit("Fragment references form a cycle: " + " -> ".join(path + [code]))
+        state[code] = "visiting"
+        for name in REFERENCE.findall(entries[code]):
+            visit(name, path + [code])
+        state[code] = "done"
+
+    for code in entries:
+        visit(code, [])
+
+
+def train(texts, max_tokens):
+    """Learns pair tokens over the encoded texts, replacing the most frequent pair each round.
+
+    Returns the token table as a list of (left, right) symbols and the encoded texts. A token
+    costs two bytes of table, so a pair is only worth a token if it occurs at least three times.
+    """
+    seqs = [list(t) for t in texts]
+    pairs, depth = [], {}
+    while len(pairs) < max_tokens:
+        counts = Counter()
+        for seq in seqs:
+            for pair in zip(seq, seq[1:]):
+                counts[pair] += 1
+        best = None
+        for pair, count in counts.most_common():
+            if count < 3:
+                break
+            if max(depth.get(pair[0], 0), depth.get(pair[1], 0)) < MAX_DEPTH:
+                best = pair
+                break
+        if best is None:
+            break
+        token = FIRST_TOKEN + len(pairs)
+        depth[token] = max(depth.get(best[0], 0), depth.get(best[1], 0)) + 1
+        pairs.append(best)
+        for i, seq in enumerate(seqs):
+            out, j = [], 0
+            while j < len(seq):
+                if j + 1 < len(seq) and (seq[j], seq[j + 1]) == best:
+                    out.append(token)
+                    j += 2
+                else:
+                    out.append(seq[j])
+                    j += 1
+            seqs[i] = out
+    return pairs, {text: bytes(seq) for text, seq in zip(texts, seqs)}
+
+
+def minimize(entries):
+    """Builds the minimized automaton (DAWG) accepting exactly the short codes.
+
+    Each node is [children dict, terminal, number of codes accepted from the node]. Nodes are
+    merged bottom-up when they are terminal alike and have the same edges to the same merged
+    children; texts are kept out of node identity and looked up by entry number instead.
+    Returns the root and the number of nodes the plain trie would have had.
+    """
+    root = [{}, False, 0]
+    trie_nodes = 1
+    for code in entries:
+        node = root
+        for ch in code:
+            if ch not in node[0]:
+                node[0][ch] = [{}, False, 0]
+                trie_nodes += 1
+            node = node[0][ch]
+        node[1] = True
+
+    registry = {}
+
+    def canonical(node):
+        for ch in node[0]:
+            node[0][ch] = canonical(node[0][ch])
+        signature = (node[1], tuple((ch, id(node[0][ch])) for ch in sorted(node[0])))
+        if signature not in registry:
+            node[2] = int(node[1]) + sum(child[2] for child in node[0].values())
+            registry[signature] = node
+        return registry[signature]
+
+    return canonical(root), trie_nodes
+
+
+def build(entries, max_tokens=MAX_TOKENS):
+    texts = sorted(set(entries.values()))
+    if max_tokens > 0:
+        if any(ord(ch) >= FIRST_TOKEN for text in texts for ch in text):
+            sys.exit("Compressed images need ASCII texts; use --tokens 0")
+        pairs, encoded = train([text.encode("ascii") for text in texts], max_tokens)
+        encoded = {text: encoded[text.encode("ascii")] for text in texts}
+    else:
+        pairs, encoded = [], {text: text.encode("utf-8") for text in texts}
+
+    dawg, trie_nodes = minimize(entries)
+
+    # Number nodes breadth-first so the root is node 0 and each node's edges are contiguous.
+    # Shared nodes are reached more than once but numbered only the first time.
+    number = {id(dawg): 0}
+    order = [dawg]
+    for node in order:
+        for ch in sorted(node[0]):
+            child = node[0][ch]
+            if id(child) not in number:
+                number[id(child)] = len(order)
+                order.append(child)
+
+    # Entries are numbered in sorted order of their short codes. An edge skips the entries
+    # ending at its node and those below the node's earlier edges.
+    nodes, edges = [], []
+    for node in order:
+        skip = 1 if node[1] else 0
+        nodes.append((len(edges), len(node[0]), NODE_TERMINAL if node[1] else 0))
+        for ch in sorted(node[0]):
+            child = node[0][ch]
+            edges.append((ord(ch), number[id(child)], skip))
+            skip += child[2]
+
+    strings, text_offsets = bytearray(), {}
+    for text in texts:
+        text_offsets[text] = len(strings)
+        strings += encoded[text] + b"\0"
+
+    body = bytearray()
+    for first_edge, count, flags in nodes:
+        body += NODE.pack(first_edge, count, flags)
+    edges_offset = HEADER.size + len(body)
+    for symbol, child, skip in edges:
+        body += EDGE.pack(symbol, child, skip)
+    texts_offset = HEADER.size + len(body)
+    for code in sorted(entries):
+        body += TEXT.pack(text_offsets[entries[code]])
+    strings_offset = HEADER.size + len(body)
+    body += strings
+    tokens_offset = HEADER.size + len(body)
+    for left, right in pairs:
+        body += bytes([left, right])
+
+    header = HEADER.pack(MAGIC, VERSION, HEADER.size, HEADER.size + len(body), len(entries),
+                         len(nodes), HEADER.size, len(edges), edges_offset, texts_offset,
+                         strings_offset, len(strings), tokens_offset, len(pairs),
+                         zlib.crc32(body) & 0xFFFFFFFF)
+    return header + body, trie_nodes
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("input", help="tab-separated dictionary")
+    parser.add_argument("output", help="image file to write")
+    parser.add_argument("--tokens", type=int, default=MAX_TOKENS,
+                        help=f"maximum number of compression tokens (0-{MAX_TOKENS}, 0 disables compression)")
+    args = parser.parse_args()
+    if not 0 <= args.tokens <= MAX_TOKENS:
+        sys.exit(f"--tokens must be between 0 and {MAX_TOKENS}")
+
+    entries = parse(args.input)
+    check_references(entries)
+    image, trie_nodes = build(entries, args.tokens)
+    with open(args.output, "wb") as f:
+        f.write(image)
+    fields = HEADER.unpack_from(image)
+    plain = sum(len(text.encode("utf-8")) + 1 for text in set(entries.values()))
+    stored = fields[11] + 2 * fields[13]  # String table plus token table.
+    print(f"Wrote {len(image)} bytes to {args.output}; texts take {stored} of {plain} bytes "
+          f"({plain / max(stored, 1):.2f}x); {fields[5]} nodes instead of {trie_nodes} "
+          f"for a trie")
+
+
+if __name__ == "__main__":
+    main()
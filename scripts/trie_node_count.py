@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+"""Count the trie nodes of the device tree text expander dictionaries.
+
+Reads the devicetree of a Zephyr build (edt.pickle) and writes a C header
+defining, for every enabled zmk,behavior-text-expander instance, how many trie
+nodes its dictionaries take: the roots of its expansion and fragment tries plus
+one node per distinct prefix of their short codes. Node pools sized from it
+hold the device tree dictionaries exactly, however much their short codes
+share.
+
+Children skipped at boot (empty properties, invalid characters, short codes of
+MAX_SHORT_LEN or more characters) take no nodes and are not counted. A short
+code defined twice takes its nodes once.
+
+The build runs this for the plain trie backend; see CMakeLists.txt. The edtlib
+package from zephyr/scripts/dts/python-devicetree must be importable to load
+the pickle.
+
+Usage: trie_node_count.py --edt-pickle edt.pickle --max-short-len 16 --output text_expander_node_count.h
+"""
+
+import argparse
+import pickle
+
+COMPAT = "zmk,behavior-text-expander"
+ALPHABET = set("abcdefghijklmnopqrstuvwxyz0123456789")
+TRIE_ROOTS = 2  # One for the expansions, one for the fragments.
+
+
+def prefixes(codes):
+    """Returns the distinct non-empty prefixes of the short codes, one per trie node."""
+    return {code[:i] for code in codes for i in range(1, len(code) + 1)}
+
+
+def instance_node_count(node, max_short_len):
+    """Returns the trie nodes taken by the dictionaries of an instance."""
+    expansions, fragments = set(), set()
+    for child in node.children.values():
+        code = child.props["short_code"].val
+        text = child.props["expanded_text"].val
+        if not code or not text or not set(code) <= ALPHABET or len(code) >= max_short_len:
+            continue  # Skipped with an error at boot.
+        fragment = "fragment" in child.props and child.props["fragment"].val
+        (fragments if fragment else expansions).add(code)
+    return TRIE_ROOTS + len(prefixes(expansions)) + len(prefixes(fragments))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--edt-pickle", required=True, help="edt.pickle of the build")
+    parser.add_argument("--max-short-len", type=int, required=True,
+                        help="CONFIG_ZMK_TEXT_EXPANDER_MAX_SHORT_LEN")
+    parser.add_argument("--output", required=True, help="header to write")
+    args = parser.parse_args()
+
+    with open(args.edt_pickle, "rb") as f:
+        edt = pickle.load(f)
+
+    lines = ["/* Generated by scripts/trie_node_count.py from the devicetree. Do not edit. */"]
+    # Counts are named after the dependency ordinal, which C code gets from DT_INST_DEP_ORD().
+    for node in edt.compat2okay.get(COMPAT, []):
+        count = instance_node_count(node, args.max_short_len)
+        lines.append(f"\n/* {node.path} */")
+        lines.append(f"#define TEXT_EXPANDER_NODE_COUNT_{node.dep_ordinal} {count}")
+
+    with open(args.output, "w", encoding="utf-8") as f:
+        f.write("\n".join(lines) + "\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -1,6 +1,7 @@
 #include <zephyr/kernel.h>      // For k_work, k_work_delayable, k_msleep, CONTAINER_OF, etc.
 #include <zephyr/logging/log.h> // For Zephyr's logging API (LOG_DBG, LOG_INF, etc.).
-#include <string.h>             // For strncpy.
+#include <string.h>             // For memcmp.
+#include <errno.h>              // For error codes.
 
 #include <zmk/expansion_engine.h> // Header for this module's public API and definitions.
 #include <zmk/hid_utils.h>        // For send_and_flush_key_action, char_to_keycode.
@@ -33,14 +34,232 @@ void cancel_current_expansion(void) {
     k_work_cancel_delayable(&expansion_work_item.work);
 }
 
+/**
+ * @brief Refills the window of a text being typed with the chunk starting at offset.
+ *
+ * Called by the decoder whenever it reaches the end of the chunk it holds. If the text is no
+ * longer what it was when typing started, the whole expansion stops rather than typing a mix
+ * of old and new text.
+ */
+static int expansion_text_fill(struct text_window *win, size_t offset) {
+    struct expansion_text *text = CONTAINER_OF(win, struct expansion_text, window);
+
+    int ret = text_expander_read_text(&text->ref, offset, text->chunk, sizeof(text->chunk));
+    if (ret < 0) {
+        LOG_WRN("Text of '%s' changed while typing (%d). Stopping the expansion.",
+                text->ref.short_code, ret);
+        expansion_work_item.stale = true;
+        return ret;
+    }
+    win->data = text->chunk;
+    win->start = offset;
+    win->len = ret;
+    return 0;
+}
+
+/**
+ * @brief Starts reading a text and loads its first chunk.
+ *
+ * @param text The text to set up.
+ * @param ref Reference to the text in the dictionary.
+ * @param table Token table to decode the text with, or NULL for plain text.
+ * @return 0 on success, or -ESTALE if the text changed since it was looked up.
+ */
+static int expansion_text_open(struct expansion_text *text, const struct text_expander_text_ref *ref,
+                               const struct text_codec_table *table) {
+    text->ref = *ref;
+    text->window.fill = expansion_text_fill;
+    text_decoder_init(&text->decoder, &text->window, table);
+    return expansion_text_fill(&text->window, 0);
+}
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_FRAGMENTS)
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_IMAGE_COMPRESSION)
+// Token table of the fragment being resolved. Only used from the expansion work item.
+static struct text_codec_table fragment_tokens;
+
+/**
+ * @brief Selects the token table to decode a newly resolved fragment with.
+ *
+ * All compressed texts of an expansion share the engine's copy of the token table. If that
+ * copy is still in use and the fragment came with a different table (the dictionary image was
+ * replaced while typing), the fragment cannot be decoded.
+ *
+ * @param exp_work The expansion in progress.
+ * @param table Output: the table to decode the fragment with, or NULL for plain text.
+ * @return True if the fragment can be decoded.
+ */
+static bool adopt_fragment_tokens(struct expansion_work *exp_work, const struct text_codec_table **table) {
+    *table = NULL;
+    if (fragment_tokens.count == 0) {
+        return true;
+    }
+
+    bool in_use = exp_work->text.decoder.table != NULL;
+    for (uint8_t i = 0; i < exp_work->fragment_depth; i++) {
+        in_use |= exp_work->fragments[i].decoder.table != NULL;
+    }
+    if (in_use && (exp_work->tokens.count != fragment_tokens.count ||
+                   memcmp(exp_work->tokens.pairs, fragment_tokens.pairs, fragment_tokens.count * 2) != 0)) {
+        return false;
+    }
+
+    exp_work->tokens = fragment_tokens;
+    *table = &exp_work->tokens;
+    return true;
+}
+#endif
+
+/**
+ * @brief Starts typing the fragment referenced as {{name}}.
+ *
+ * References are resolved when they are reached, so the dictionary only stores each fragment
+ * once. Cycles are rejected when expansions are added; the depth limit here only guards
+ * against chains that became too deep through later updates. Unresolvable references are
+ * skipped.
+ *
+ * @param exp_work The expansion in progress.
+ * @param name Short code of the referenced expansion or fragment.
+ */
+static void push_fragment(struct expansion_work *exp_work, const char *name) {
+    if (exp_work->fragment_depth >= ARRAY_SIZE(exp_work->fragments)) {
+        LOG_WRN("Fragment '%s' is nested too deeply. Skipping it.", name);
+        return;
+    }
+
+    struct expansion_text *fragment = &exp_work->fragments[exp_work->fragment_depth];
+    struct text_expander_text_ref ref;
+    const struct text_codec_table *table = NULL;
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_IMAGE_COMPRESSION)
+    int ret = text_expander_resolve_fragment(name, &ref, &fragment_tokens);
+    if (ret == 0 && !adopt_fragment_tokens(exp_work, &table)) {
+        ret = -ESTALE;
+    }
+#else
+    int ret = text_expander_resolve_fragment(name, &ref, NULL);
+#endif
+    if (ret == 0) {
+        ret = expansion_text_open(fragment, &ref, table);
+    }
+    if (ret < 0) {
+        LOG_WRN("Cannot resolve fragment '%s' (%d). Skipping it.", name, ret);
+        exp_work->stale = false; // A fragment that changed before it was started is just skipped.
+        return;
+    }
+
+    exp_work->fragment_depth++;
+    LOG_DBG("Typing fragment '%s' (depth %d)", name, exp_work->fragment_depth);
+}
+#endif
+
+/**
+ * @brief Returns the next character to type.
+ *
+ * Characters come from the innermost fragment being typed, or from the expansion's own text
+ * once all fragments are done. Fragment references are replaced by the fragment's text.
+ *
+ * @param exp_work The expansion in progress.
+ * @return The next character, or '\0' once the whole expansion has been typed or one of its
+ * texts changed in the dictionary.
+ */
+static char next_expansion_char(struct expansion_work *exp_work) {
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_FRAGMENTS)
+    for (;;) {
+        struct text_decoder *dec = exp_work->fragment_depth > 0
+                                       ? &exp_work->fragments[exp_work->fragment_depth - 1].decoder
+                                       : &exp_work->text.decoder;
+        char c = text_decoder_next(dec);
+        if (exp_work->stale) {
+            return '\0';
+        }
+        if (c == '\0' && exp_work->fragment_depth > 0) {
+            exp_work->fragment_depth--; // Fragment done: continue with the text that referenced it.
+            continue;
+        }
+
+        char name[MAX_SHORT_LEN];
+        if (c == '{' && text_decoder_take_reference(dec, name, sizeof(name))) {
+            push_fragment(exp_work, name);
+            continue;
+        }
+        return c;
+    }
+#else
+    char c = text_decoder_next(&exp_work->text.decoder);
+    return exp_work->stale ? '\0' : c;
+#endif
+}
+
+/**
+ * @brief Presses and releases a key, wrapped in a modifier if needed.
+ *
+ * @param modifier HID usage ID of the modifier to hold (e.g. Shift), or 0 for none.
+ * @param keycode HID usage ID of the key.
+ * @return 0 on success, or the negative error code of the HID send that failed.
+ */
+static int tap_chord(uint32_t modifier, uint32_t keycode) {
+    int ret;
+    if (modifier != 0) {
+        // Press the modifier if needed (e.g. Shift for uppercase and symbols).
+        ret = send_and_flush_key_action(modifier, true); // Press modifier
+        if (ret < 0) {
+            LOG_ERR("Failed to press modifier 0x%x for keycode 0x%x.", modifier, keycode);
+            return ret;
+        }
+        k_msleep(TYPING_DELAY / 4); // Brief pause after the modifier press.
+    }
+
+    // Press the key.
+    ret = send_and_flush_key_action(keycode, true); // Press key
+    if (ret < 0) {
+        LOG_ERR("Failed to press keycode 0x%x.", keycode);
+        // Attempt to release the modifier if it was pressed
+        if (modifier != 0) send_and_flush_key_action(modifier, false);
+        return ret;
+    }
+    k_msleep(TYPING_DELAY / 2); // Pause while key is pressed.
+
+    // Release the key.
+    ret = send_and_flush_key_action(keycode, false); // Release key
+    if (ret < 0) {
+        LOG_ERR("Failed to release keycode 0x%x. The modifier might remain pressed.", keycode);
+        // Attempt to release the modifier if it was pressed, but state might be inconsistent.
+        if (modifier != 0) send_and_flush_key_action(modifier, false);
+        return ret;
+    }
+
+    if (modifier != 0) {
+        k_msleep(TYPING_DELAY / 4); // Brief pause before releasing the modifier.
+        // Release the modifier.
+        ret = send_and_flush_key_action(modifier, false); // Release modifier
+        if (ret < 0) {
+            LOG_ERR("Failed to release modifier 0x%x after keycode 0x%x.", modifier, keycode);
+            // Continue with the next key, but the modifier might be stuck.
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Presses and releases a key, wrapped in Shift if needed.
+ *
+ * @param keycode HID usage ID of the key.
+ * @param needs_shift True to hold Shift while the key is pressed.
+ * @return 0 on success, or the negative error code of the HID send that failed.
+ */
+static int tap_key(uint32_t keycode, bool needs_shift) {
+    return tap_chord(needs_shift ? HID_USAGE_KEY_KEYBOARD_LEFTSHIFT : 0, keycode);
+}
+
 /**
  * @brief Work handler function that performs the text expansion steps.
  *
  * This function is called by the Zephyr kernel when the delayable work item
  * expansion_work_item.work is scheduled and its delay expires. It handles
  * two phases:
- * 1. Backspace phase: Sends backspace key presses to delete the typed short code.
- * 2. Typing phase: Types out the characters of the expanded text.
+ * 1. Backspace phase: Sends backspace key presses to delete the typed short code (and the
+ *    terminator, if one triggered the expansion), or a word-delete chord for the short code.
+ * 2. Typing phase: Types out the characters of the expanded text, then the terminator.
  *
  * @param work Pointer to the struct k_work embedded in expansion_work_item.
  */
@@ -52,7 +271,7 @@ void expansion_work_handler(struct k_work *work) {
     if (exp_work->is_backspace_phase) {
         // --- Backspace Phase ---
         if (exp_work->backspace_count > 0) {
-            LOG_DBG("Sending backspace (remaining: %d)", exp_work->backspace_count);
+            LOG_DBG("Sending backspace (remaining: %zu)", exp_work->backspace_count);
 
             // Send a backspace key press.
             int ret = send_and_flush_key_action(HID_USAGE_KEY_KEYBOARD_DELETE_BACKSPACE, true); // Press
@@ -73,115 +292,154 @@ void expansion_work_handler(struct k_work *work) {
             exp_work->backspace_count--; // Decrement count of remaining backspaces.
             // Reschedule this handler to send the next backspace.
             k_work_reschedule(&exp_work->work, K_MSEC(TYPING_DELAY));
+        } else if (exp_work->word_delete != 0) {
+            // The short code is a whole word, so one chord deletes all of it.
+            LOG_DBG("Sending word delete (modifier: 0x%x)", exp_work->word_delete);
+            int ret = tap_chord(exp_work->word_delete, HID_USAGE_KEY_KEYBOARD_DELETE_BACKSPACE);
+            exp_work->word_delete = 0;
+            if (ret < 0) {
+                LOG_ERR("Failed to send word delete: %d. Aborting expansion.", ret);
+                return; // Abort if HID send fails.
+            }
+            k_work_reschedule(&exp_work->work, K_MSEC(TYPING_DELAY));
         } else {
             // Backspace phase is complete.
             LOG_DBG("Backspace phase completed. Starting typing phase.");
             exp_work->is_backspace_phase = false; // Switch to typing phase.
-            exp_work->text_index = 0;             // Reset text index for typing.
             // Reschedule to start typing after a slightly longer pause.
             k_work_reschedule(&exp_work->work, K_MSEC(TYPING_DELAY * 2));
         }
     } else {
         // --- Typing Phase ---
-        // Check if there are more characters to type and we are within buffer bounds.
-        // Note: MAX_EXPANDED_LEN from text_expander_internals.h will be used for the struct's array size
-        // via CONFIG_ZMK_TEXT_EXPANDER_MAX_EXPANDED_LEN.
-        if (exp_work->expanded_text[exp_work->text_index] != '\0' &&
-            exp_work->text_index < CONFIG_ZMK_TEXT_EXPANDER_MAX_EXPANDED_LEN) {
-
-            char c = exp_work->expanded_text[exp_work->text_index]; // Get current character.
+        // Decode the next character. Compressed texts and fragment references are expanded on
+        // the fly, one character per step, and texts are read from the dictionary one chunk at
+        // a time, so the full text never needs a buffer of its own.
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_CANDIDATE_CYCLING)
+        char c = exp_work->has_pending ? exp_work->pending : next_expansion_char(exp_work);
+        exp_work->has_pending = false;
+#else
+        char c = next_expansion_char(exp_work);
+#endif
+        if (c != '\0') {
             bool needs_shift = false;
             uint32_t keycode = char_to_keycode(c, &needs_shift); // Convert char to HID keycode.
 
             if (keycode != 0) { // A keycode of 0 means the character is not supported for typing.
                 LOG_DBG("Typing character: '%c' (keycode: 0x%x, shift: %s)",
                         c, keycode, needs_shift ? "yes" : "no");
-
-                int ret;
-                if (needs_shift) {
-                    // Press Shift if needed for the character (e.g., uppercase, symbols).
-                    ret = send_and_flush_key_action(HID_USAGE_KEY_KEYBOARD_LEFTSHIFT, true); // Press Shift
-                    if (ret < 0) {
-                        LOG_ERR("Failed to press Shift. Aborting expansion for char '%c'.", c);
-                        return;
-                    }
-                    k_msleep(TYPING_DELAY / 4); // Brief pause after Shift press.
+                if (tap_key(keycode, needs_shift) < 0) {
+                    LOG_ERR("Aborting expansion at char '%c'.", c);
+                    return; // Abort if HID send fails.
                 }
-
-                // Press the character's key.
-                ret = send_and_flush_key_action(keycode, true); // Press key
-                if (ret < 0) {
-                     LOG_ERR("Failed to press keycode 0x%x for char '%c'. Aborting.", keycode, c);
-                    // Attempt to release shift if it was pressed
-                    if (needs_shift) send_and_flush_key_action(HID_USAGE_KEY_KEYBOARD_LEFTSHIFT, false);
-                    return;
-                }
-                k_msleep(TYPING_DELAY / 2); // Pause while key is pressed.
-
-                // Release the character's key.
-                ret = send_and_flush_key_action(keycode, false); // Release key
-                 if (ret < 0) {
-                    LOG_ERR("Failed to release keycode 0x%x for char '%c'. Shift might remain pressed.", keycode, c);
-                    // Attempt to release shift if it was pressed, but state might be inconsistent.
-                    if (needs_shift) send_and_flush_key_action(HID_USAGE_KEY_KEYBOARD_LEFTSHIFT, false);
-                    return;
-                }
-
-
-                if (needs_shift) {
-                    k_msleep(TYPING_DELAY / 4); // Brief pause before releasing Shift.
-                    // Release Shift.
-                    ret = send_and_flush_key_action(HID_USAGE_KEY_KEYBOARD_LEFTSHIFT, false); // Release Shift
-                    if (ret < 0) {
-                         LOG_ERR("Failed to release Shift after char '%c'.", c);
-                        // Continue with next char, but Shift might be stuck.
-                    }
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_CANDIDATE_CYCLING)
+                // Remember what reached the host, so a replacement can keep the common start.
+                if (exp_work->typed_count < sizeof(exp_work->typed)) {
+                    exp_work->typed[exp_work->typed_count] = c;
                 }
+                exp_work->typed_count++;
+#endif
             } else {
                 // Log a warning if a character in the expanded text cannot be typed.
                 LOG_WRN("Skipping unsupported character '%c' (0x%02x) during typing.", c, c);
             }
 
-            exp_work->text_index++; // Move to the next character.
+            exp_work->text_index++; // Count the character.
             // Reschedule this handler to type the next character.
             k_work_reschedule(&exp_work->work, K_MSEC(TYPING_DELAY));
         } else {
-            // End of expanded text or buffer reached. Expansion is complete.
-            LOG_INF("Text expansion completed for '%s'", exp_work->expanded_text);
+            // End of expanded text or buffer reached. Type the terminator that triggered the
+            // expansion again, even if the text stopped early, so the word boundary is kept.
+            if (exp_work->terminator.keycode != 0 && !exp_work->terminator_typed) {
+                LOG_DBG("Typing terminator (keycode: 0x%x, shift: %s)",
+                        exp_work->terminator.keycode, exp_work->terminator.shift ? "yes" : "no");
+                if (tap_key(exp_work->terminator.keycode, exp_work->terminator.shift) < 0) {
+                    LOG_ERR("Failed to type the terminator again.");
+                }
+                exp_work->terminator_typed = true;
+            }
+            // Expansion is complete.
+            LOG_INF("Text expansion completed (%zu characters)", exp_work->text_index);
             // No more rescheduling, work item becomes idle.
         }
     }
 }
 
+/**
+ * @brief Opens the text an expansion is going to type.
+ *
+ * @param ref Reference to the text to type out.
+ * @param tokens Token table of a compressed text, or NULL for plain text.
+ * @return 0 on success, -ENOTSUP for compressed text without compression support, or
+ * -ESTALE if the text changed since it was looked up.
+ */
+static int expansion_open(const struct text_expander_text_ref *ref, const struct text_codec_table *tokens) {
+    // Decode from our own copy of the token table; the text itself is read chunk by chunk.
+    const struct text_codec_table *table = NULL;
+    if (tokens && tokens->count > 0) {
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_IMAGE_COMPRESSION)
+        expansion_work_item.tokens = *tokens;
+        table = &expansion_work_item.tokens;
+#else
+        return -ENOTSUP;
+#endif
+    }
+    expansion_work_item.stale = false;
+    int ret = expansion_text_open(&expansion_work_item.text, ref, table);
+    if (ret < 0) {
+        return ret;
+    }
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_FRAGMENTS)
+    expansion_work_item.fragment_depth = 0;
+#endif
+    return 0;
+}
+
 /**
  * @brief Initializes and starts the text expansion process.
  *
- * This function prepares the expansion_work_item with the text to be expanded
- * and the number of backspaces required to delete the short code. It then
+ * This function prepares the expansion_work_item with the first chunk of the text to
+ * be expanded and the number of backspaces required to delete the short code. It then
  * schedules the expansion_work_handler to begin the process.
  *
  * @param short_code The original short code (used for logging).
- * @param expanded_text The text to type out.
+ * @param ref Reference to the text to type out.
  * @param short_len The length of the short_code, determining the number of backspaces.
- * @return 0 on success. (Currently always returns 0).
+ * @param tokens Token table of a compressed text, or NULL for plain text.
+ * @param terminator Word-ending key to delete and type again after the text, or NULL.
+ * @param word_delete Modifier of the chord that deletes the short code as a word, or 0 to
+ * delete it with backspaces.
+ * @return 0 on success, -ENOTSUP for compressed text without compression support, or
+ * -ESTALE if the text changed since it was looked up.
  */
-int start_expansion(const char *short_code, const char *expanded_text, uint8_t short_len) {
+int start_expansion(const char *short_code, const struct text_expander_text_ref *ref, uint8_t short_len,
+                    const struct text_codec_table *tokens, const struct expansion_terminator *terminator,
+                    uint32_t word_delete) {
     // Cancel any previously ongoing expansion to prevent conflicts.
     cancel_current_expansion();
 
-    // Copy the expanded text into the work item's buffer.
-    // Ensure null termination and protect against buffer overflow.
-    // Note: expansion_work_item.expanded_text array size is defined by CONFIG_ZMK_TEXT_EXPANDER_MAX_EXPANDED_LEN
-    strncpy(expansion_work_item.expanded_text, expanded_text, CONFIG_ZMK_TEXT_EXPANDER_MAX_EXPANDED_LEN - 1);
-    expansion_work_item.expanded_text[CONFIG_ZMK_TEXT_EXPANDER_MAX_EXPANDED_LEN - 1] = '\0'; // Ensure null termination.
+    int ret = expansion_open(ref, tokens);
+    if (ret < 0) {
+        return ret;
+    }
 
     // Set up the initial state for the expansion.
-    expansion_work_item.backspace_count = short_len;      // Number of backspaces to send.
+    expansion_work_item.terminator = terminator ? *terminator : (struct expansion_terminator){0};
+    expansion_work_item.terminator_typed = false;
+    // The terminator has already been typed after the short code, so it is deleted as well.
+    // With a word-delete chord, it is the only character left for a backspace.
+    expansion_work_item.word_delete = word_delete;
+    expansion_work_item.backspace_count = (word_delete ? 0 : short_len) +
+                                          (expansion_work_item.terminator.keycode ? 1 : 0);
     expansion_work_item.is_backspace_phase = true;        // Start with the backspace phase.
     expansion_work_item.text_index = 0;                   // Reset text index.
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_CANDIDATE_CYCLING)
+    expansion_work_item.typed_count = 0;
+    expansion_work_item.has_pending = false;
+#endif
 
-    LOG_INF("Initiating expansion of '%s' (backspaces: %d) to '%s'",
-            short_code, short_len, expansion_work_item.expanded_text);
+    LOG_INF("Initiating expansion of '%s' (backspaces: %zu%s, %s text)",
+            short_code, expansion_work_item.backspace_count, word_delete ? " and a word delete" : "",
+            expansion_work_item.text.decoder.table ? "compressed" : "plain");
 
     // Schedule the expansion_work_handler to run after a very short delay (10ms).
     // This allows the current context (e.g., key press handler) to return quickly.
@@ -189,3 +447,76 @@ int start_expansion(const char *short_code, const char *expanded_text, uint8_t s
 
     return 0; // Indicate success.
 }
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_CANDIDATE_CYCLING)
+/**
+ * @brief Replaces the text typed by the last expansion with another text.
+ *
+ * Decodes the new text up to the first character that differs from what the last expansion
+ * typed; that character is kept as the pending one, so the typing phase continues right after
+ * the backspaces. Only the first sizeof(typed) characters are compared.
+ *
+ * @param short_code The short code of the new text (used for logging).
+ * @param ref Reference to the new text.
+ * @param tokens Token table of a compressed text, or NULL for plain text.
+ * @return 0 on success, or a negative error code as for start_expansion().
+ */
+int replace_expansion(const char *short_code, const struct text_expander_text_ref *ref,
+                      const struct text_codec_table *tokens) {
+    struct expansion_work *exp_work = &expansion_work_item;
+
+    cancel_current_expansion();
+
+    // Whatever is on the host now: the rest of the short code if the backspaces (and the word
+    // delete, which stays pending) were not done yet, the typed part of the previous text and
+    // possibly its terminator.
+    size_t pending_backspaces = exp_work->is_backspace_phase ? exp_work->backspace_count : 0;
+    size_t previous_count = exp_work->typed_count;
+    bool terminator_typed = exp_work->terminator_typed;
+
+    size_t kept = 0;
+    char c = '\0';
+    int ret = expansion_open(ref, tokens);
+    if (ret == 0) {
+        size_t limit = MIN(previous_count, sizeof(exp_work->typed));
+        while ((c = next_expansion_char(exp_work)) != '\0') {
+            bool needs_shift;
+            if (char_to_keycode(c, &needs_shift) == 0) {
+                continue; // Never typed, so not on the host either.
+            }
+            if (kept >= limit || exp_work->typed[kept] != c) {
+                break;
+            }
+            kept++;
+        }
+        if (exp_work->stale) {
+            ret = -ESTALE;
+        }
+    }
+    if (ret < 0) {
+        // The previous expansion is cancelled and nothing replaces it, so what it typed must not
+        // be compared against by a later replacement either.
+        exp_work->typed_count = 0;
+        exp_work->has_pending = false;
+        return ret;
+    }
+
+    exp_work->pending = c;
+    exp_work->has_pending = true;
+    exp_work->typed_count = kept;
+    exp_work->text_index = kept;
+    exp_work->backspace_count = pending_backspaces + (previous_count - kept);
+    if (terminator_typed && (exp_work->backspace_count > 0 || c != '\0')) {
+        // The terminator is in the way; delete it and type it again after the new text.
+        exp_work->backspace_count++;
+        exp_work->terminator_typed = false;
+    }
+    exp_work->is_backspace_phase = true;
+
+    LOG_INF("Replacing expansion with '%s' (keeping %zu characters, backspaces: %zu)",
+            short_code, kept, exp_work->backspace_count);
+
+    k_work_reschedule(&exp_work->work, K_MSEC(10));
+    return 0;
+}
+#endif
@@ -0,0 +1,60 @@
+#include <zephyr/kernel.h>      // For atomic operations and BUILD_ASSERT.
+#include <zephyr/sys/barrier.h> // For barrier_dmem_fence_full() between entry and index updates.
+#include <zephyr/sys/util.h>    // For IS_POWER_OF_TWO.
+
+#include <zmk/keystroke_ring.h> // Header for this module's public API.
+
+BUILD_ASSERT(IS_POWER_OF_TWO(CONFIG_ZMK_TEXT_EXPANDER_INPUT_RING_SIZE),
+             "CONFIG_ZMK_TEXT_EXPANDER_INPUT_RING_SIZE must be a power of two");
+
+// Mask applied to the free-running head/tail counters to obtain an index into entries[].
+#define RING_MASK (CONFIG_ZMK_TEXT_EXPANDER_INPUT_RING_SIZE - 1)
+
+/**
+ * @brief Appends a key press to the ring.
+ *
+ * Only the producer writes `head`. The entry is written before `head` is advanced, so the
+ * consumer never observes a partially written entry.
+ */
+bool keystroke_ring_push(struct keystroke_ring *ring, const struct keystroke_event *event) {
+    atomic_val_t head = atomic_get(&ring->head);
+    atomic_val_t tail = atomic_get(&ring->tail);
+
+    if ((uint32_t)(head - tail) >= CONFIG_ZMK_TEXT_EXPANDER_INPUT_RING_SIZE) {
+        atomic_set(&ring->overflow, 1); // Let the consumer know its view of the input is incomplete.
+        return false;
+    }
+
+    ring->entries[head & RING_MASK] = *event;
+    barrier_dmem_fence_full(); // Publish the entry before the new head.
+    atomic_set(&ring->head, head + 1);
+    return true;
+}
+
+/**
+ * @brief Removes the oldest key press from the ring.
+ *
+ * Only the consumer writes `tail`. The entry is copied out before `tail` is advanced, so the
+ * producer never overwrites an entry that is still being read.
+ */
+bool keystroke_ring_pop(struct keystroke_ring *ring, struct keystroke_event *event) {
+    atomic_val_t tail = atomic_get(&ring->tail);
+    atomic_val_t head = atomic_get(&ring->head);
+
+    if (head == tail) {
+        return false; // Ring is empty.
+    }
+
+    barrier_dmem_fence_full(); // Read the entry only after observing the head that published it.
+    *event = ring->entries[tail & RING_MASK];
+    barrier_dmem_fence_full(); // Finish reading the entry before handing the slot back.
+    atomic_set(&ring->tail, tail + 1);
+    return true;
+}
+
+/**
+ * @brief Checks and clears the overflow flag.
+ */
+bool keystroke_ring_take_overflow(struct keystroke_ring *ring) {
+    return atomic_clear(&ring->overflow) != 0;
+}
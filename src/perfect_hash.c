@@ -0,0 +1,38 @@
+#include <errno.h> // For error codes.
+
+#include <zmk/perfect_hash.h> // Header for this module.
+
+/**
+ * @brief Hashes a key with 32-bit FNV-1a.
+ */
+static uint32_t perfect_hash_key(const char *key) {
+    uint32_t h = 0x811c9dc5;
+    while (*key) {
+        h = (h ^ (uint8_t)*key++) * 0x01000193;
+    }
+    return h;
+}
+
+/**
+ * @brief Spreads the bits of a hash (the MurmurHash3 finalizer).
+ */
+static uint32_t perfect_hash_mix(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+int perfect_hash_lookup(const struct perfect_hash *hash, const char *key) {
+    if (hash->slot_count == 0) {
+        return -ENOENT;
+    }
+
+    // The key is only read once; the bucket and the slot both derive from its hash.
+    uint32_t h = perfect_hash_key(key);
+    uint16_t seed = hash->seeds[perfect_hash_mix(h) % hash->bucket_count];
+    uint32_t slot = perfect_hash_mix(h ^ ((seed + 1u) * 0x9e3779b9u)) % hash->slot_count;
+    return hash->slots[slot];
+}
@@ -0,0 +1,236 @@
+#include <errno.h>  // For error codes.
+#include <string.h> // For memmove.
+
+#include <zmk/sorted_dict.h> // Header for this module.
+#include <zmk/trie.h>        // For char_to_trie_index, which defines the short code alphabet.
+
+// Number of packed bits after the last character of a key of length len.
+#define SORTED_DICT_TAIL_BITS(len) (SORTED_DICT_BITS_PER_CHAR * (SORTED_DICT_MAX_KEY_LEN - (len)))
+
+/**
+ * @brief Packs a key and reports its length.
+ *
+ * @return 0 on success, or -EINVAL if the key cannot be packed.
+ */
+static int sorted_dict_pack(const char *key, uint64_t *packed, size_t *len) {
+    uint64_t value = 0;
+    size_t i;
+
+    for (i = 0; key[i] != '\0'; i++) {
+        int index = char_to_trie_index(key[i]);
+        if (index < 0 || i >= SORTED_DICT_MAX_KEY_LEN) {
+            return -EINVAL;
+        }
+        // Symbols start at 1, so a shorter key sorts before all of its extensions.
+        value = (value << SORTED_DICT_BITS_PER_CHAR) | (uint64_t)(index + 1);
+    }
+
+    *packed = value << SORTED_DICT_TAIL_BITS(i);
+    *len = i;
+    return 0;
+}
+
+int sorted_dict_pack_key(const char *key, uint64_t *packed) {
+    size_t len;
+    return sorted_dict_pack(key, packed, &len);
+}
+
+/**
+ * @brief Returns the index of the first key in [lo, hi) that is not less than packed.
+ */
+static size_t sorted_dict_lower_bound_in(const struct sorted_dict *dict, uint64_t packed, size_t lo, size_t hi) {
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (dict->keys[mid] < packed) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+ * @brief Returns the index of the first key that is not less than packed.
+ */
+static size_t sorted_dict_lower_bound(const struct sorted_dict *dict, uint64_t packed) {
+    return sorted_dict_lower_bound_in(dict, packed, 0, dict->count);
+}
+
+void sorted_dict_init(struct sorted_dict *dict, uint64_t *keys, const char **texts, size_t capacity) {
+    dict->keys = keys;
+    dict->texts = texts;
+    dict->count = 0;
+    dict->capacity = capacity;
+}
+
+int sorted_dict_insert(struct sorted_dict *dict, const char *key, const char *text) {
+    uint64_t packed;
+    int ret = sorted_dict_pack_key(key, &packed);
+    if (ret < 0) {
+        return ret;
+    }
+
+    size_t pos = sorted_dict_lower_bound(dict, packed);
+    if (pos < dict->count && dict->keys[pos] == packed) {
+        dict->texts[pos] = text; // Replace the existing entry.
+        return 0;
+    }
+    if (dict->count >= dict->capacity) {
+        return -ENOMEM;
+    }
+
+    // Make room at pos, keeping the array sorted.
+    memmove(&dict->keys[pos + 1], &dict->keys[pos], (dict->count - pos) * sizeof(dict->keys[0]));
+    memmove(&dict->texts[pos + 1], &dict->texts[pos], (dict->count - pos) * sizeof(dict->texts[0]));
+    dict->keys[pos] = packed;
+    dict->texts[pos] = text;
+    dict->count++;
+    return 0;
+}
+
+int sorted_dict_remove(struct sorted_dict *dict, const char *key) {
+    uint64_t packed;
+    if (sorted_dict_pack_key(key, &packed) < 0) {
+        return -ENOENT;
+    }
+
+    size_t pos = sorted_dict_lower_bound(dict, packed);
+    if (pos >= dict->count || dict->keys[pos] != packed) {
+        return -ENOENT;
+    }
+    dict->count--;
+    memmove(&dict->keys[pos], &dict->keys[pos + 1], (dict->count - pos) * sizeof(dict->keys[0]));
+    memmove(&dict->texts[pos], &dict->texts[pos + 1], (dict->count - pos) * sizeof(dict->texts[0]));
+    return 0;
+}
+
+const char *sorted_dict_search(const struct sorted_dict *dict, const char *key) {
+    uint64_t packed;
+    if (sorted_dict_pack_key(key, &packed) < 0) {
+        return NULL; // Cannot be stored, so it is not there.
+    }
+
+    size_t pos = sorted_dict_lower_bound(dict, packed);
+    return (pos < dict->count && dict->keys[pos] == packed) ? dict->texts[pos] : NULL;
+}
+
+bool sorted_dict_has_prefix(const struct sorted_dict *dict, const char *prefix) {
+    uint64_t packed;
+    size_t len;
+    if (sorted_dict_pack(prefix, &packed, &len) < 0) {
+        return false;
+    }
+
+    // The prefix itself is the smallest key of its range, and filling the remaining
+    // positions with ones gives the largest.
+    uint64_t last = packed | ((UINT64_C(1) << SORTED_DICT_TAIL_BITS(len)) - 1);
+    size_t pos = sorted_dict_lower_bound(dict, packed);
+    return len == 0 || (pos < dict->count && dict->keys[pos] <= last);
+}
+
+bool sorted_dict_prefix_step(const struct sorted_dict *dict, size_t *lo, size_t *hi, size_t depth, char c) {
+    int index = char_to_trie_index(c);
+    if (index < 0 || depth >= SORTED_DICT_MAX_KEY_LEN) {
+        *hi = *lo;
+        return false;
+    }
+
+    // All keys in the range share the first depth symbols, so the range is sorted by the symbol
+    // at depth; keys ending before it have symbol 0 there and come first.
+    uint64_t base = 0; // The shared symbols, taken from any key of the range.
+    if (depth > 0 && *lo < *hi) {
+        base = dict->keys[*lo] & ~((UINT64_C(1) << SORTED_DICT_TAIL_BITS(depth)) - 1);
+    }
+    size_t shift = SORTED_DICT_TAIL_BITS(depth + 1);
+    uint64_t first = base | ((uint64_t)(index + 1) << shift);
+    uint64_t next = base | ((uint64_t)(index + 2) << shift);
+
+    size_t new_lo = sorted_dict_lower_bound_in(dict, first, *lo, *hi);
+    *hi = sorted_dict_lower_bound_in(dict, next, new_lo, *hi);
+    *lo = new_lo;
+    return *lo < *hi;
+}
+
+/**
+ * @brief Unpacks a key into a null-terminated short code of at most size - 1 characters.
+ */
+static void sorted_dict_unpack(uint64_t packed, char *key, size_t size) {
+    size_t len = 0;
+    for (; len < SORTED_DICT_MAX_KEY_LEN && len + 1 < size; len++) {
+        unsigned int sym = (packed >> SORTED_DICT_TAIL_BITS(len + 1)) & 0x3f;
+        if (sym == 0) {
+            break;
+        }
+        sym--;
+        key[len] = (sym < 26) ? ('a' + sym) : ('0' + (sym - 26)); // Inverse of char_to_trie_index().
+    }
+    key[len] = '\0';
+}
+
+size_t sorted_dict_complete(const struct sorted_dict *dict, const char *prefix, char *key, size_t size) {
+    uint64_t packed;
+    size_t len;
+    if (sorted_dict_pack(prefix, &packed, &len) < 0 || size <= len) {
+        return 0;
+    }
+
+    // The keys starting with prefix form one range, as in sorted_dict_has_prefix().
+    uint64_t last = packed | ((UINT64_C(1) << SORTED_DICT_TAIL_BITS(len)) - 1);
+    size_t lo = sorted_dict_lower_bound(dict, packed);
+    size_t hi = sorted_dict_lower_bound_in(dict, last + 1, lo, dict->count);
+    if (hi - lo == 1) {
+        sorted_dict_unpack(dict->keys[lo], key, size);
+    }
+    return hi - lo;
+}
+
+bool sorted_dict_next_candidate(const struct sorted_dict *dict, const char *prefix, const char *after,
+                                char *key, size_t size) {
+    uint64_t packed, after_packed = 0;
+    size_t len, after_len = 0;
+    if (sorted_dict_pack(prefix, &packed, &len) < 0 ||
+        (after && sorted_dict_pack(after, &after_packed, &after_len) < 0)) {
+        return false;
+    }
+
+    // Within one length, packed order is key order, so a candidate ranks by (length, packed key).
+    uint64_t last = packed | ((UINT64_C(1) << SORTED_DICT_TAIL_BITS(len)) - 1);
+    size_t lo = sorted_dict_lower_bound(dict, packed);
+    size_t hi = sorted_dict_lower_bound_in(dict, last + 1, lo, dict->count);
+    size_t best = hi;
+    size_t best_len = 0;
+    for (size_t i = lo; i < hi; i++) {
+        size_t key_len = len; // Count symbols up to the first empty one.
+        while (key_len < SORTED_DICT_MAX_KEY_LEN &&
+               ((dict->keys[i] >> SORTED_DICT_TAIL_BITS(key_len + 1)) & 0x3f) != 0) {
+            key_len++;
+        }
+        if (after && (key_len < after_len || (key_len == after_len && dict->keys[i] <= after_packed))) {
+            continue;
+        }
+        if (best == hi || key_len < best_len) {
+            best = i; // Keys of the same length come in order, so the first one found wins.
+            best_len = key_len;
+        }
+    }
+    if (best == hi || best_len >= size) {
+        return false;
+    }
+    sorted_dict_unpack(dict->keys[best], key, size);
+    return true;
+}
+
+int sorted_dict_for_each(const struct sorted_dict *dict, sorted_dict_visit_cb cb, void *user_data) {
+    char key[SORTED_DICT_MAX_KEY_LEN + 1];
+
+    for (size_t i = 0; i < dict->count; i++) {
+        sorted_dict_unpack(dict->keys[i], key, sizeof(key));
+
+        int ret = cb(key, dict->texts[i], user_data);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
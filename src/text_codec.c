@@ -0,0 +1,128 @@
+#include <errno.h>            // For error codes.
+#include <stdint.h>           // For SIZE_MAX.
+#include <zephyr/sys/util.h> // For MAX.
+
+#include <zmk/text_codec.h> // Header for this module.
+
+int text_codec_validate(const uint8_t *pairs, size_t count) {
+    uint8_t depth[TEXT_CODEC_MAX_TOKENS]; // Nesting depth of each token seen so far.
+
+    if (count > TEXT_CODEC_MAX_TOKENS || (count > 0 && !pairs)) {
+        return -EINVAL;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        uint8_t max_child = 0;
+        for (size_t side = 0; side < 2; side++) {
+            uint8_t sym = pairs[i * 2 + side];
+            if (sym == 0) {
+                return -EINVAL; // Would terminate the decoded text early.
+            }
+            if (sym >= TEXT_CODEC_FIRST_TOKEN) {
+                size_t child = sym - TEXT_CODEC_FIRST_TOKEN;
+                if (child >= i) {
+                    return -EINVAL; // Only earlier tokens may be referenced, so there are no cycles.
+                }
+                max_child = MAX(max_child, depth[child]);
+            }
+        }
+        if (max_child + 1 > TEXT_CODEC_MAX_DEPTH) {
+            return -EINVAL;
+        }
+        depth[i] = max_child + 1;
+    }
+
+    return 0;
+}
+
+void text_window_init_string(struct text_window *win, const char *text) {
+    win->data = text;
+    win->start = 0;
+    win->len = SIZE_MAX; // The terminator ends the text before the window does.
+    win->fill = NULL;
+}
+
+void text_decoder_init(struct text_decoder *dec, struct text_window *win, const struct text_codec_table *table) {
+    dec->win = win;
+    dec->offset = 0;
+    dec->ended = false;
+    dec->table = (table && table->count > 0) ? table : NULL;
+    dec->depth = 0;
+}
+
+/**
+ * @brief Returns the encoded byte at the decoder's offset, refilling the window if needed.
+ *
+ * @return The byte, or 0 at the end of the text or if the window could not be refilled.
+ */
+static uint8_t decoder_peek_byte(struct text_decoder *dec) {
+    struct text_window *win = dec->win;
+
+    if (dec->offset < win->start || dec->offset - win->start >= win->len) {
+        if (!win->fill || win->fill(win, dec->offset) < 0 ||
+            dec->offset < win->start || dec->offset - win->start >= win->len) {
+            return 0;
+        }
+    }
+    return (uint8_t)win->data[dec->offset - win->start];
+}
+
+char text_decoder_next(struct text_decoder *dec) {
+    uint8_t sym;
+
+    if (dec->ended) {
+        return '\0';
+    }
+    if (dec->depth > 0) {
+        sym = dec->stack[--dec->depth]; // Finish the right-hand side of an earlier token first.
+    } else {
+        sym = decoder_peek_byte(dec);
+        if (sym == 0) {
+            dec->ended = true;
+            return '\0';
+        }
+        dec->offset++;
+    }
+
+    if (!dec->table) {
+        return (char)sym; // Plain text: bytes above 0x7f are passed through unchanged.
+    }
+
+    // Descend into the left-hand side until a character is reached, remembering the right-hand
+    // sides. The stack can only overflow on a table that failed validation.
+    while (sym >= TEXT_CODEC_FIRST_TOKEN) {
+        size_t token = sym - TEXT_CODEC_FIRST_TOKEN;
+        if (token >= dec->table->count || dec->depth >= TEXT_CODEC_MAX_DEPTH) {
+            dec->depth = 0;
+            dec->ended = true; // Stop at undefined tokens instead of typing garbage.
+            return '\0';
+        }
+        dec->stack[dec->depth++] = dec->table->pairs[token * 2 + 1];
+        sym = dec->table->pairs[token * 2];
+    }
+
+    return (char)sym;
+}
+
+bool text_decoder_take_reference(struct text_decoder *dec, char *name, size_t size) {
+    struct text_decoder peek = *dec; // Only commit once the whole reference has been seen.
+    size_t len = 0;
+    char c;
+
+    if (size < 2 || text_decoder_next(&peek) != '{') {
+        return false;
+    }
+    while ((c = text_decoder_next(&peek)) != '}') {
+        if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) || len >= size - 1) {
+            return false;
+        }
+        name[len++] = c;
+    }
+    if (len == 0 || text_decoder_next(&peek) != '}') {
+        return false;
+    }
+
+    name[len] = '\0';
+    *dec = peek;
+    return true;
+}
@@ -0,0 +1,248 @@
+#include <string.h>          // For strcmp.
+#include <zephyr/sys/util.h> // For CONTAINER_OF.
+
+#include <zmk/text_dict.h>               // Header for this module.
+#include <zmk/text_expander_internals.h> // For struct text_expander_pool and struct text_expander_expansion.
+
+// --- Trie ---
+
+static int dict_trie_insert(struct text_dict *dict, const char *key, const char *text) {
+    struct text_dict_trie *td = CONTAINER_OF(dict, struct text_dict_trie, dict);
+    bool existed = trie_get_expanded_text(trie_search(td->root, key)) != NULL;
+    int ret = trie_insert_static(td->root, key, text, td->pool);
+    return (ret == 0 && existed) ? 1 : ret;
+}
+
+static int dict_trie_remove(struct text_dict *dict, const char *key) {
+    struct text_dict_trie *td = CONTAINER_OF(dict, struct text_dict_trie, dict);
+    return trie_delete(td->root, key, td->pool);
+}
+
+static const char *dict_trie_lookup(const struct text_dict *dict, const char *key) {
+    const struct text_dict_trie *td = CONTAINER_OF(dict, struct text_dict_trie, dict);
+    return trie_get_expanded_text(trie_search(td->root, key));
+}
+
+static void dict_trie_prefix_start(const struct text_dict *dict, struct text_dict_cursor *cursor) {
+    const struct text_dict_trie *td = CONTAINER_OF(dict, struct text_dict_trie, dict);
+    cursor->node = td->root;
+}
+
+static bool dict_trie_prefix_step(const struct text_dict *dict, struct text_dict_cursor *cursor, char c) {
+    const struct trie_node *node = cursor->node;
+    int index = char_to_trie_index(c);
+    cursor->node = index >= 0 ? node->children[index] : NULL;
+    return cursor->node != NULL;
+}
+
+static size_t dict_trie_complete(const struct text_dict *dict, const char *prefix, char *key, size_t size) {
+    const struct text_dict_trie *td = CONTAINER_OF(dict, struct text_dict_trie, dict);
+    return trie_complete(td->root, prefix, key, size);
+}
+
+static bool dict_trie_next_candidate(const struct text_dict *dict, const char *prefix, const char *after,
+                                     char *key, size_t size) {
+    const struct text_dict_trie *td = CONTAINER_OF(dict, struct text_dict_trie, dict);
+    return trie_next_candidate(td->root, prefix, after, key, size);
+}
+
+static int dict_trie_for_each(const struct text_dict *dict, text_dict_visit_cb cb, void *user_data) {
+    const struct text_dict_trie *td = CONTAINER_OF(dict, struct text_dict_trie, dict);
+    return trie_for_each(td->root, cb, user_data);
+}
+
+/**
+ * @brief Counts the nodes of a (sub)trie. Recursion is bounded by MAX_SHORT_LEN.
+ */
+static size_t dict_trie_count_nodes(const struct trie_node *node) {
+    size_t count = 1;
+    for (int i = 0; i < TRIE_ALPHABET_SIZE; i++) {
+        if (node->children[i]) {
+            count += dict_trie_count_nodes(node->children[i]);
+        }
+    }
+    return count;
+}
+
+static int dict_count_entry(const char *key, const char *text, void *user_data) {
+    (*(size_t *)user_data)++;
+    return 0;
+}
+
+static void dict_trie_stats(const struct text_dict *dict, struct text_dict_stats *stats) {
+    const struct text_dict_trie *td = CONTAINER_OF(dict, struct text_dict_trie, dict);
+    stats->entries = 0;
+    trie_for_each(td->root, dict_count_entry, &stats->entries);
+    stats->bytes = dict_trie_count_nodes(td->root) * sizeof(struct trie_node);
+}
+
+static const struct text_dict_api dict_trie_api = {
+    .name = "trie",
+    .insert = dict_trie_insert,
+    .remove = dict_trie_remove,
+    .lookup = dict_trie_lookup,
+    .prefix_start = dict_trie_prefix_start,
+    .prefix_step = dict_trie_prefix_step,
+    .complete = dict_trie_complete,
+    .next_candidate = dict_trie_next_candidate,
+    .for_each = dict_trie_for_each,
+    .stats = dict_trie_stats,
+};
+
+int text_dict_trie_init(struct text_dict_trie *td, struct text_expander_pool *pool) {
+    td->dict.api = &dict_trie_api;
+    td->pool = pool;
+    td->root = trie_allocate_node(pool);
+    return td->root ? 0 : -ENOMEM;
+}
+
+// --- Sorted packed keys ---
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SORTED_DICT)
+static int dict_sorted_insert(struct text_dict *dict, const char *key, const char *text) {
+    struct text_dict_sorted *td = CONTAINER_OF(dict, struct text_dict_sorted, dict);
+    bool existed = sorted_dict_search(&td->sorted, key) != NULL;
+    int ret = sorted_dict_insert(&td->sorted, key, text);
+    return (ret == 0 && existed) ? 1 : ret;
+}
+
+static int dict_sorted_remove(struct text_dict *dict, const char *key) {
+    struct text_dict_sorted *td = CONTAINER_OF(dict, struct text_dict_sorted, dict);
+    return sorted_dict_remove(&td->sorted, key);
+}
+
+static const char *dict_sorted_lookup(const struct text_dict *dict, const char *key) {
+    const struct text_dict_sorted *td = CONTAINER_OF(dict, struct text_dict_sorted, dict);
+    return sorted_dict_search(&td->sorted, key);
+}
+
+static void dict_sorted_prefix_start(const struct text_dict *dict, struct text_dict_cursor *cursor) {
+    const struct text_dict_sorted *td = CONTAINER_OF(dict, struct text_dict_sorted, dict);
+    cursor->lo = 0;
+    cursor->hi = td->sorted.count;
+}
+
+static bool dict_sorted_prefix_step(const struct text_dict *dict, struct text_dict_cursor *cursor, char c) {
+    const struct text_dict_sorted *td = CONTAINER_OF(dict, struct text_dict_sorted, dict);
+    return sorted_dict_prefix_step(&td->sorted, &cursor->lo, &cursor->hi, cursor->depth, c);
+}
+
+static size_t dict_sorted_complete(const struct text_dict *dict, const char *prefix, char *key, size_t size) {
+    const struct text_dict_sorted *td = CONTAINER_OF(dict, struct text_dict_sorted, dict);
+    return sorted_dict_complete(&td->sorted, prefix, key, size);
+}
+
+static bool dict_sorted_next_candidate(const struct text_dict *dict, const char *prefix, const char *after,
+                                       char *key, size_t size) {
+    const struct text_dict_sorted *td = CONTAINER_OF(dict, struct text_dict_sorted, dict);
+    return sorted_dict_next_candidate(&td->sorted, prefix, after, key, size);
+}
+
+static int dict_sorted_for_each(const struct text_dict *dict, text_dict_visit_cb cb, void *user_data) {
+    const struct text_dict_sorted *td = CONTAINER_OF(dict, struct text_dict_sorted, dict);
+    return sorted_dict_for_each(&td->sorted, cb, user_data);
+}
+
+static void dict_sorted_stats(const struct text_dict *dict, struct text_dict_stats *stats) {
+    const struct text_dict_sorted *td = CONTAINER_OF(dict, struct text_dict_sorted, dict);
+    stats->entries = td->sorted.count;
+    stats->bytes = td->sorted.capacity * (sizeof(td->sorted.keys[0]) + sizeof(td->sorted.texts[0]));
+}
+
+static const struct text_dict_api dict_sorted_api = {
+    .name = "sorted keys",
+    .insert = dict_sorted_insert,
+    .remove = dict_sorted_remove,
+    .lookup = dict_sorted_lookup,
+    .prefix_start = dict_sorted_prefix_start,
+    .prefix_step = dict_sorted_prefix_step,
+    .complete = dict_sorted_complete,
+    .next_candidate = dict_sorted_next_candidate,
+    .for_each = dict_sorted_for_each,
+    .stats = dict_sorted_stats,
+};
+
+void text_dict_sorted_init(struct text_dict_sorted *td, uint64_t *keys, const char **texts, size_t capacity) {
+    td->dict.api = &dict_sorted_api;
+    sorted_dict_init(&td->sorted, keys, texts, capacity);
+}
+#endif // IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SORTED_DICT)
+
+// --- Build-time perfect hash ---
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_PERFECT_HASH)
+/**
+ * @brief Returns the entry stored for key, or NULL.
+ */
+static const struct text_expander_expansion *dict_hash_find(const struct text_dict_hash *td, const char *key) {
+    // The hash names the only entry that can hold key; one compare confirms it.
+    int index = perfect_hash_lookup(td->hash, key);
+    if (index < 0 || (size_t)index >= td->entry_count || strcmp(td->entries[index].short_code, key) != 0) {
+        return NULL;
+    }
+    return &td->entries[index];
+}
+
+static int dict_hash_insert(struct text_dict *dict, const char *key, const char *text) {
+    // The entries were placed at build time, keeping the last of duplicate definitions. Only
+    // confirm that this one is in the tables.
+    struct text_dict_hash *td = CONTAINER_OF(dict, struct text_dict_hash, dict);
+    const struct text_expander_expansion *entry = dict_hash_find(td, key);
+    if (!entry) {
+        return -ENOENT; // The tables do not match the entries.
+    }
+    return entry->expanded_text == text ? 0 : 1;
+}
+
+static int dict_hash_remove(struct text_dict *dict, const char *key) {
+    return -ENOTSUP;
+}
+
+static const char *dict_hash_lookup(const struct text_dict *dict, const char *key) {
+    const struct text_dict_hash *td = CONTAINER_OF(dict, struct text_dict_hash, dict);
+    const struct text_expander_expansion *entry = dict_hash_find(td, key);
+    return entry ? entry->expanded_text : NULL;
+}
+
+static int dict_hash_for_each(const struct text_dict *dict, text_dict_visit_cb cb, void *user_data) {
+    const struct text_dict_hash *td = CONTAINER_OF(dict, struct text_dict_hash, dict);
+    for (size_t i = 0; i < td->hash->slot_count; i++) {
+        if (td->hash->slots[i] >= td->entry_count) {
+            continue;
+        }
+        const struct text_expander_expansion *entry = &td->entries[td->hash->slots[i]];
+        int ret = cb(entry->short_code, entry->expanded_text, user_data);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+static void dict_hash_stats(const struct text_dict *dict, struct text_dict_stats *stats) {
+    const struct text_dict_hash *td = CONTAINER_OF(dict, struct text_dict_hash, dict);
+    stats->entries = td->hash->slot_count;
+    stats->bytes = (td->hash->bucket_count + td->hash->slot_count) * sizeof(uint16_t); // In flash.
+}
+
+static const struct text_dict_api dict_hash_api = {
+    .name = "perfect hash",
+    .insert = dict_hash_insert,
+    .remove = dict_hash_remove,
+    .lookup = dict_hash_lookup,
+    .prefix_start = NULL, // Only exact lookups.
+    .prefix_step = NULL,
+    .complete = NULL,
+    .next_candidate = NULL,
+    .for_each = dict_hash_for_each,
+    .stats = dict_hash_stats,
+};
+
+void text_dict_hash_init(struct text_dict_hash *td, const struct perfect_hash *hash,
+                         const struct text_expander_expansion *entries, size_t entry_count) {
+    td->dict.api = &dict_hash_api;
+    td->hash = hash;
+    td->entries = entries;
+    td->entry_count = entry_count;
+}
+#endif // IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_PERFECT_HASH)
@@ -3,24 +3,31 @@
 #define DT_DRV_COMPAT zmk_behavior_text_expander
 
 #include <zephyr/device.h>      // For device model definitions (e.g., struct device).
-#include <zephyr/kernel.h>      // For kernel objects like mutexes (k_mutex), and K_FOREVER, K_NO_WAIT.
+#include <zephyr/kernel.h>      // For kernel objects like mutexes (k_mutex), and K_FOREVER.
 #include <zephyr/logging/log.h> // For Zephyr's logging API.
 #include <zephyr/sys/util.h>    // Required for IS_ENABLED and ARRAY_SIZE macros.
 #include <drivers/behavior.h>   // For behavior driver API structures and return codes (e.g. ZMK_BEHAVIOR_OPAQUE).
+#include <zephyr/sys/barrier.h> // For barrier_dmem_fence_full() when publishing instance dictionaries.
 #include <errno.h>              // Required for error codes like EINVAL, ENOENT, ENOMEM.
 
 #include <zmk/behavior.h>             // ZMK core behavior system.
 #include <zmk/event_manager.h>        // ZMK event manager for subscribing to events.
 #include <zmk/events/keycode_state_changed.h> // Event type for key presses/releases.
-#include <zmk/keymap.h>               // For keymap related utilities (not directly used but often related).
+#include <zmk/keymap.h>               // For zmk_keymap_layer_active() to select per-layer dictionaries.
 #include <zmk/behavior_queue.h>       // For behavior queue interaction (not directly used here).
 #include <zmk/hid.h>                  // For HID usage page definitions (e.g. HID_USAGE_KEY_KEYBOARD_A).
+#include <zmk/endpoints.h>            // For the selected endpoint, whose host picks the word-delete chord.
+#include <dt-bindings/zmk/modifiers.h> // For MOD_LSFT and MOD_RSFT, to replay shifted terminators.
 
 #include <zmk/text_expander.h>          // Public API for text expander functions.
 #include <zmk/text_expander_internals.h> // Internal data structures and constants (expander_data, MAX_SHORT_LEN etc.).
 #include <zmk/trie.h>                   // Trie data structure for storing and searching expansions.
+#include <zmk/text_dict.h>              // Backend interface of the device tree dictionaries.
 #include <zmk/hid_utils.h>              // Utilities for converting chars to keycodes and sending HID reports.
 #include <zmk/expansion_engine.h>       // Engine for handling the typing of expanded text.
+#include <zmk/keystroke_ring.h>         // Lock-free ring used to defer keystroke processing.
+#include <zmk/text_expander_journal.h>  // Flash journal persisting runtime updates.
+#include <zmk/trie_image.h>             // Read-only dictionary images queried in place.
 
 // Register a logging module for this file.
 LOG_MODULE_REGISTER(zmk_behavior_text_expander, CONFIG_ZMK_LOG_LEVEL);
@@ -29,33 +36,185 @@ LOG_MODULE_REGISTER(zmk_behavior_text_expander, CONFIG_ZMK_LOG_LEVEL);
 // in text_expander_internals.h. It holds all runtime state for the expander.
 struct text_expander_data expander_data;
 
-// Structure used to define an expansion read from the device tree.
-struct text_expander_expansion {
-    const char *short_code;    // The short code string.
-    const char *expanded_text; // The corresponding expanded text string.
-};
-
-// Structure to hold the configuration for a text expander device instance,
-// primarily a list of expansions loaded from the device tree.
+// Structure to hold the configuration for a text expander device instance:
+// the list of expansions loaded from the device tree, the layers its dictionary applies to,
+// and the storage backing its dictionary, sized from its own children. The texts are
+// referenced where they are (in flash), so the dictionary needs no text storage.
 struct text_expander_config {
     const struct text_expander_expansion *expansions; // Pointer to an array of expansions.
     size_t expansion_count;                           // Number of expansions in the array.
+    const uint8_t *layers;                            // Layers on which this dictionary is active.
+    size_t layer_count;                               // Number of entries in layers; 0 means all layers.
+    const uint32_t *terminators;                      // Extra word-ending keys (keymap key codes).
+    size_t terminator_count;                          // Number of entries in terminators.
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SORTED_DICT)
+    uint64_t *dict_keys;                              // Key storage, one entry per child: expansions first,
+    const char **dict_texts;                          // then fragments. Text storage, parallel to dict_keys.
+    size_t fragment_capacity;                         // Number of trailing entries reserved for fragments.
+#elif IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_PERFECT_HASH)
+    const struct perfect_hash *hash;                  // Generated hash of the expansions' short codes.
+    const struct perfect_hash *fragment_hash;         // Generated hash of the fragments' short codes.
+#else
+    struct trie_node *node_pool;                      // Node storage for this instance's trie.
+    size_t node_pool_size;                            // Number of nodes in node_pool.
+#endif
 };
 
-// Flag to ensure global resources (like the trie root and memory pools within expander_data)
-// are initialized only once, even if multiple text_expander behavior instances are defined
-// in the device tree (though typically there's one logical expander).
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SORTED_DICT)
+// Every short code must fit into one packed key.
+BUILD_ASSERT(MAX_SHORT_LEN - 1 <= SORTED_DICT_MAX_KEY_LEN,
+             "CONFIG_ZMK_TEXT_EXPANDER_SORTED_DICT supports short codes of at most 10 characters");
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_PERFECT_HASH)
+// Hash tables of all instances, generated from the devicetree by scripts/perfect_hash.py.
+#include <text_expander_hash.h>
+#elif !IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SORTED_DICT)
+// Node pool sizes of all instances, generated from the devicetree by scripts/trie_node_count.py.
+#include <text_expander_node_count.h>
+#endif
+
+// Average text length and new trie nodes per short code the default pool sizes are budgeted
+// for, capped by the maximum lengths.
+#define RUNTIME_AVG_TEXT_LEN MIN(CONFIG_ZMK_TEXT_EXPANDER_AVG_TEXT_LEN, MAX_TEXT_LEN - 1)
+#define RUNTIME_AVG_SHORT_LEN MIN(CONFIG_ZMK_TEXT_EXPANDER_AVG_SHORT_LEN, MAX_SHORT_LEN - 1)
+
+// Size of each runtime text pool. By default every expansion can have its own text of average
+// length, and one of them can be of maximum length. Reserving the worst case for every entry
+// would cost MAX_EXPANSIONS * MAX_TEXT_LEN bytes per pool, megabytes for large dictionaries;
+// since identical and suffix texts share storage, alias-heavy dictionaries need even less.
+#if CONFIG_ZMK_TEXT_EXPANDER_TEXT_POOL_SIZE > 0
+#define RUNTIME_TEXT_POOL_SIZE CONFIG_ZMK_TEXT_EXPANDER_TEXT_POOL_SIZE
+#else
+#define RUNTIME_TEXT_POOL_SIZE                                                          \
+    (MAX_EXPANSIONS * (RUNTIME_AVG_TEXT_LEN + 1 + TRIE_TEXT_OVERHEAD) +                \
+     (MAX_TEXT_LEN - 1 - RUNTIME_AVG_TEXT_LEN) + TRIE_TEXT_POOL_OVERHEAD)
+#endif
+
+// Number of nodes in each runtime node pool. By default every expansion can add
+// AVG_SHORT_LEN nodes to the trie, one of them a maximum-length short code sharing no prefix,
+// plus the root. Device tree expansions have pools of their own, so this only needs to cover
+// runtime additions.
+#if CONFIG_ZMK_TEXT_EXPANDER_NODE_POOL_SIZE > 0
+#define RUNTIME_NODE_POOL_SIZE CONFIG_ZMK_TEXT_EXPANDER_NODE_POOL_SIZE
+#else
+#define RUNTIME_NODE_POOL_SIZE                                                          \
+    (MAX_EXPANSIONS * RUNTIME_AVG_SHORT_LEN + (MAX_SHORT_LEN - 1 - RUNTIME_AVG_SHORT_LEN) + 1)
+#endif
+
+// Buckets of each runtime text index: about four texts per bucket when the dictionary is full.
+#define RUNTIME_TEXT_BUCKETS MAX(MAX_EXPANSIONS / 4, 1)
+
+// Storage for the pool generations of the runtime dictionary managed through the public API.
+static struct trie_node runtime_node_pool[TEXT_EXPANDER_POOL_COUNT][RUNTIME_NODE_POOL_SIZE];
+// Aligned for the heap text allocator, which manages the pool in 8-byte chunks.
+static char runtime_text_pool[TEXT_EXPANDER_POOL_COUNT][ROUND_UP(RUNTIME_TEXT_POOL_SIZE, 8)] __aligned(8);
+static trie_text_link runtime_text_buckets[TEXT_EXPANDER_POOL_COUNT][RUNTIME_TEXT_BUCKETS];
+
+// Number of enabled text expander behavior instances in the device tree.
+#define TEXT_EXPANDER_INSTANCE_COUNT DT_NUM_INST_STATUS_OKAY(DT_DRV_COMPAT)
+
+// Initialized behavior instances, in initialization order. Each one owns a read-only
+// dictionary built from its device tree children.
+static const struct device *instance_devices[MAX(TEXT_EXPANDER_INSTANCE_COUNT, 1)];
+// Position of current_short in each instance dictionary, for aggressive reset mode (see
+// instances_have_prefix()). Part of the matcher state, like current_short itself.
+static struct text_dict_cursor instance_cursors[MAX(TEXT_EXPANDER_INSTANCE_COUNT, 1)];
+// Number of characters of current_short the cursors have consumed; 0 restarts them.
+static uint8_t instance_cursor_len;
+static size_t instance_device_count;
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_IMAGE)
+BUILD_ASSERT(DT_HAS_CHOSEN(zmk_text_expander_image),
+             "CONFIG_ZMK_TEXT_EXPANDER_IMAGE requires a zmk,text-expander-image chosen partition");
+
+// Flash partition holding the dictionary image. The partition's grandparent is the flash
+// node, whose reg is the base address of the memory-mapped flash.
+#define TEXT_EXPANDER_IMAGE_NODE DT_CHOSEN(zmk_text_expander_image)
+#define TEXT_EXPANDER_IMAGE_ADDR                                                                \
+    (DT_REG_ADDR(DT_GPARENT(TEXT_EXPANDER_IMAGE_NODE)) + DT_REG_ADDR(TEXT_EXPANDER_IMAGE_NODE))
+#define TEXT_EXPANDER_IMAGE_SIZE DT_REG_SIZE(TEXT_EXPANDER_IMAGE_NODE)
+#endif
+
+// Validated dictionary image published to readers (an address inside memory-mapped flash),
+// or NULL if no valid image is loaded.
+static atomic_ptr_t dictionary_image;
+// Number of readers currently using the published image. Unloading waits for it to drop to 0.
+static atomic_t dictionary_image_readers;
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_IMAGE_COMPRESSION)
+// Token table of the image text being handed to the expansion engine. Only used by the
+// matcher owner in text_expander_trigger(), so a single static copy keeps it off the stack.
+static struct text_codec_table trigger_tokens;
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_TERMINATORS)
+// Keyboard usage IDs that end a word and expand the short code typed before them, one bit per
+// usage ID. Filled at init from CONFIG_ZMK_TEXT_EXPANDER_TERMINATOR_CHARS and the `terminators`
+// property of each instance, and only read afterwards.
+static uint32_t terminator_keys[256 / 32];
+
+// Terminators are handled on the key event path, which must never wait for the dictionary mutex,
+// and right after the key reached the host, so nothing typed later is deleted with the short code.
+BUILD_ASSERT(IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SHADOW_BUILD) &&
+             !IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_DEFERRED_INPUT),
+             "CONFIG_ZMK_TEXT_EXPANDER_TERMINATORS needs shadow build mode and inline input");
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_IDLE_TRIGGER)
+// Fires once no key has been pressed for CONFIG_ZMK_TEXT_EXPANDER_IDLE_TIMEOUT ms after a complete
+// short code was typed. Submitted to the system work queue, like the expansion engine.
+static struct k_work_delayable idle_work;
+// Set when idle_work is armed, cleared by any later key press. Part of the matcher state, so the
+// handler can tell whether a key press slipped in after the timer fired.
+static bool idle_armed;
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_WORD_DELETE)
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_WORD_DELETE_HOST_PC)
+#define WORD_DELETE_DEFAULT_HOST ZMK_TEXT_EXPANDER_HOST_PC
+#elif IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_WORD_DELETE_HOST_MACOS)
+#define WORD_DELETE_DEFAULT_HOST ZMK_TEXT_EXPANDER_HOST_MACOS
+#else
+#define WORD_DELETE_DEFAULT_HOST ZMK_TEXT_EXPANDER_HOST_UNKNOWN
+#endif
+// Shortest short code deleted with the chord: it takes 4 HID reports, a backspace 2.
+#define WORD_DELETE_MIN_LEN 3
+// Host of each endpoint (an enum zmk_text_expander_host), indexed by
+// zmk_endpoint_instance_to_index(). Set from any thread, read when an expansion starts.
+static atomic_t endpoint_hosts[ZMK_ENDPOINT_COUNT];
+// Set if the last key press left the cursor at the start of a word (after whitespace), so the
+// next short code is a whole word on the host. Unknown, and so false, at boot. Part of the
+// matcher state, like current_short.
+static bool at_word_start;
+// Set if the short code in current_short started at the start of a word.
+static bool short_is_word;
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_CANDIDATE_CYCLING)
+// The last expansion, which further presses of the behavior key replace with the next candidate
+// until another key is pressed. Part of the matcher state, like current_short.
+static struct {
+    bool active;                // Set after an expansion, cleared by any key press.
+    char prefix[MAX_SHORT_LEN]; // The short code the user typed.
+    char code[MAX_SHORT_LEN];   // Short code of the candidate expanded last.
+} candidate_cycle;
+#endif
+
+// Flag to ensure global resources (like the runtime trie root and its memory pools within
+// expander_data) are initialized only once, even if multiple text_expander behavior instances
+// are defined in the device tree.
 static bool zmk_text_expander_global_initialized = false;
 
 /**
  * @brief Searches for an expansion for the given short_code in the trie.
  *
+ * @param root The root of the trie generation to search.
  * @param short_code The short code to look up.
  * @return A pointer to the expanded text if found and the node is terminal, otherwise NULL.
  */
-static const char *find_expansion(const char *short_code) {
+static const char *find_expansion(struct trie_node *root, const char *short_code) {
     // Search the trie for the given short code.
-    struct trie_node *node = trie_search(expander_data.root, short_code);
+    struct trie_node *node = trie_search(root, short_code);
     // Get the expanded text from the node (returns NULL if node is NULL or not terminal).
     const char *result = trie_get_expanded_text(node);
 
@@ -67,6 +226,573 @@ static const char *find_expansion(const char *short_code) {
     return result;
 }
 
+/**
+ * @brief Looks up a short code in an instance's expansion or fragment dictionary.
+ *
+ * @param data The instance.
+ * @param fragment True to search the named fragments instead of the expansions.
+ * @param short_code The short code to look up.
+ * @return The expanded text, or NULL if the dictionary does not define short_code.
+ */
+static const char *instance_find(const struct text_expander_instance_data *data, bool fragment,
+                                 const char *short_code) {
+    return text_dict_lookup(fragment ? data->fragments : data->dict, short_code);
+}
+
+/**
+ * @brief Returns how strongly an instance's dictionary applies to the current layer state.
+ *
+ * @param config The configuration of the behavior instance.
+ * @return -1 if none of the instance's layers is active, 0 if the instance is not restricted
+ * to specific layers, otherwise 1 + the highest active layer it is bound to.
+ */
+static int instance_layer_rank(const struct text_expander_config *config) {
+    if (config->layer_count == 0) {
+        return 0; // Active on every layer, but less specific than any layer-bound dictionary.
+    }
+
+    int rank = -1;
+    for (size_t i = 0; i < config->layer_count; i++) {
+        if (zmk_keymap_layer_active(config->layers[i])) {
+            rank = MAX(rank, config->layers[i] + 1);
+        }
+    }
+    return rank;
+}
+
+/**
+ * @brief Searches the device tree dictionaries reachable from the active layers.
+ *
+ * If several reachable dictionaries define the same short code, the one bound to the highest
+ * active layer wins, so the same code can expand differently per layer. Instance dictionaries
+ * are read-only after init, so no locking is needed.
+ *
+ * @param short_code The short code to look up.
+ * @param instance Output: index of the instance the text was found in. May be NULL.
+ * @return A pointer to the expanded text, or NULL if no reachable dictionary defines it.
+ */
+static const char *find_instance_expansion(const char *short_code, uint8_t *instance) {
+    const char *result = NULL;
+    int best_rank = -1;
+
+    for (size_t i = 0; i < instance_device_count; i++) {
+        const struct device *dev = instance_devices[i];
+        int rank = instance_layer_rank(dev->config);
+        if (rank <= best_rank) {
+            continue; // Unreachable, or a more specific dictionary already matched.
+        }
+
+        const struct text_expander_instance_data *data = dev->data;
+        const char *text = instance_find(data, false, short_code);
+        if (text) {
+            result = text;
+            best_rank = rank;
+            if (instance) {
+                *instance = i;
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * @brief Pins the published dictionary image for reading.
+ *
+ * @return The image, or NULL if none is loaded. A non-NULL image must be released with
+ * image_read_end() once the caller is done with any pointer into it.
+ */
+static const void *image_read_begin(void) {
+    if (!IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_IMAGE)) {
+        return NULL;
+    }
+
+    // Announce the reader before loading the pointer, so an unload that cleared the pointer
+    // either is seen here or waits for this reader.
+    atomic_inc(&dictionary_image_readers);
+    const void *image = atomic_ptr_get(&dictionary_image);
+    if (!image) {
+        atomic_dec(&dictionary_image_readers);
+    }
+    return image;
+}
+
+/**
+ * @brief Releases an image pinned with image_read_begin().
+ */
+static void image_read_end(const void *image) {
+    if (image) {
+        atomic_dec(&dictionary_image_readers);
+    }
+}
+
+/**
+ * @brief Looks up a short code in every dictionary reachable from the active layers.
+ *
+ * Runtime expansions take precedence over the device tree dictionaries, and the dictionary
+ * image has the lowest precedence.
+ *
+ * @param root Root of the runtime dictionary generation to search.
+ * @param key The short code to look up.
+ * @param ref Output: origin (and instance) of the text found.
+ * @param image In/out: the dictionary image, pinned with image_read_begin() the first time it
+ * is needed. The caller releases it with image_read_end().
+ * @return The text, or NULL if no reachable dictionary defines key.
+ */
+static const char *find_any_expansion(struct trie_node *root, const char *key,
+                                      struct text_expander_text_ref *ref, const void **image) {
+    ref->origin = TEXT_EXPANDER_ORIGIN_RUNTIME;
+    const char *text = find_expansion(root, key);
+    if (!text) {
+        ref->origin = TEXT_EXPANDER_ORIGIN_INSTANCE;
+        text = find_instance_expansion(key, &ref->instance);
+    }
+    if (!text) {
+        ref->origin = TEXT_EXPANDER_ORIGIN_IMAGE;
+        if (!*image) {
+            *image = image_read_begin();
+        }
+        text = *image ? trie_image_search(*image, key) : NULL;
+    }
+    return text;
+}
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_UNIQUE_PREFIX)
+/**
+ * @brief Merges one dictionary's completion of a prefix into the overall result.
+ *
+ * @param count Number of short codes the dictionary has starting with the prefix.
+ * @param candidate The dictionary's completion, if count is 1.
+ * @param key In/out: the completion found so far.
+ * @param found In/out: whether key holds a completion.
+ * @return False if the prefix is ambiguous: the dictionary has several completions, or one
+ * that differs from another dictionary's.
+ */
+static bool merge_completion(size_t count, const char *candidate, char *key, bool *found) {
+    if (count == 0) {
+        return true;
+    }
+    if (count > 1 || (*found && strcmp(key, candidate) != 0)) {
+        return false;
+    }
+    if (!*found) {
+        strcpy(key, candidate);
+        *found = true;
+    }
+    return true;
+}
+
+/**
+ * @brief Finds the only short code reachable from the active layers that starts with prefix.
+ *
+ * Each dictionary reports how many of its short codes start with prefix from counts it keeps
+ * (see trie_complete()), so only the single branch of a unique completion is walked. A short
+ * code shadowed in several dictionaries counts once. Perfect hash dictionaries answer no
+ * prefix queries and do not take part. The dictionary image keeps no counts, so a prefix
+ * found there is treated as ambiguous.
+ *
+ * @param root Root of the runtime dictionary generation to search.
+ * @param prefix The typed short code.
+ * @param image In/out: the pinned dictionary image, as for find_any_expansion().
+ * @param key Output: the complete short code, MAX_SHORT_LEN bytes.
+ * @return True if exactly one short code starts with prefix.
+ */
+static bool find_unique_completion(struct trie_node *root, const char *prefix, const void **image, char *key) {
+    char candidate[MAX_SHORT_LEN];
+    bool found = false;
+
+    if (!merge_completion(trie_complete(root, prefix, candidate, sizeof(candidate)), candidate, key, &found)) {
+        return false;
+    }
+    for (size_t i = 0; i < instance_device_count; i++) {
+        if (instance_layer_rank(instance_devices[i]->config) < 0) {
+            continue; // Not reachable from the active layers.
+        }
+        const struct text_expander_instance_data *data = instance_devices[i]->data;
+        size_t count = text_dict_complete(data->dict, prefix, candidate, sizeof(candidate));
+        if (!merge_completion(count, candidate, key, &found)) {
+            return false;
+        }
+    }
+
+    if (!*image) {
+        *image = image_read_begin();
+    }
+    return found && !(*image && trie_image_has_prefix(*image, prefix));
+}
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_CANDIDATE_CYCLING)
+/**
+ * @brief Finds the first short code starting with prefix that ranks after another one in any
+ * dictionary reachable from the active layers.
+ *
+ * Each dictionary steps to its own next candidate (see trie_key_compare() for the ranking)
+ * and the best of them wins, so nothing is collected or sorted. Perfect hash dictionaries and
+ * the dictionary image cannot enumerate their short codes and offer no candidates.
+ *
+ * @param root Root of the runtime dictionary generation to search.
+ * @param prefix The typed short code.
+ * @param after The previous candidate, or NULL for the first one.
+ * @param key Output: the candidate, MAX_SHORT_LEN bytes.
+ * @return True if a candidate was found.
+ */
+static bool find_next_candidate(struct trie_node *root, const char *prefix, const char *after, char *key) {
+    char candidate[MAX_SHORT_LEN];
+    bool found = trie_next_candidate(root, prefix, after, key, MAX_SHORT_LEN);
+
+    for (size_t i = 0; i < instance_device_count; i++) {
+        if (instance_layer_rank(instance_devices[i]->config) < 0) {
+            continue; // Not reachable from the active layers.
+        }
+        const struct text_expander_instance_data *data = instance_devices[i]->data;
+        if (text_dict_next_candidate(data->dict, prefix, after, candidate, sizeof(candidate)) &&
+            (!found || trie_key_compare(candidate, key) < 0)) {
+            strcpy(key, candidate);
+            found = true;
+        }
+    }
+    return found;
+}
+
+/**
+ * @brief Looks up the candidate that follows another one for a typed short code.
+ *
+ * The typed short code itself comes first if any dictionary defines it, including those that
+ * offer no candidates, followed by find_next_candidate()'s. After the last candidate the cycle
+ * starts over. The text is the one find_any_expansion() finds for the candidate.
+ *
+ * @param root Root of the runtime dictionary generation to search.
+ * @param prefix The typed short code.
+ * @param after The previous candidate, or NULL for the first one.
+ * @param ref Output: origin (and instance) of the text found.
+ * @param image In/out: the pinned dictionary image, as for find_any_expansion().
+ * @param key Output: the candidate, MAX_SHORT_LEN bytes.
+ * @return The candidate's text, or NULL if prefix has no candidates.
+ */
+static const char *find_candidate_expansion(struct trie_node *root, const char *prefix, const char *after,
+                                            struct text_expander_text_ref *ref, const void **image, char *key) {
+    const char *text = NULL;
+
+    if (after && find_next_candidate(root, prefix, after, key)) {
+        text = find_any_expansion(root, key, ref, image);
+    }
+    if (!text) {
+        strcpy(key, prefix);
+        text = find_any_expansion(root, key, ref, image);
+    }
+    if (!text && find_next_candidate(root, prefix, NULL, key)) {
+        text = find_any_expansion(root, key, ref, image);
+    }
+    return text;
+}
+#endif
+
+/**
+ * @brief Checks whether the typed short code is a prefix in an instance dictionary reachable
+ * from the active layers.
+ *
+ * Instance dictionaries never change, so each keeps a cursor at the typed short code that
+ * only advances over the characters typed since the last check: one step per key press
+ * instead of a search from the root. The cursors belong to the matcher state.
+ *
+ * @return True if a reachable instance dictionary has a short code starting with current_short.
+ */
+static bool instances_have_prefix(void) {
+    const char *key = expander_data.current_short;
+    size_t len = expander_data.current_short_len;
+
+    if (instance_cursor_len == 0 || instance_cursor_len > len) {
+        instance_cursor_len = 0;
+        for (size_t i = 0; i < instance_device_count; i++) {
+            const struct text_expander_instance_data *data = instance_devices[i]->data;
+            text_dict_prefix_start(data->dict, &instance_cursors[i]);
+        }
+    }
+    // Cursors of every instance advance, so a layer change does not invalidate them.
+    for (; instance_cursor_len < len; instance_cursor_len++) {
+        for (size_t i = 0; i < instance_device_count; i++) {
+            const struct text_expander_instance_data *data = instance_devices[i]->data;
+            text_dict_prefix_step(data->dict, &instance_cursors[i], key[instance_cursor_len]);
+        }
+    }
+
+    for (size_t i = 0; i < instance_device_count; i++) {
+        if (instance_cursors[i].alive && instance_layer_rank(instance_devices[i]->config) >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Checks whether the typed short code is a prefix of any short code reachable from
+ * the active layers.
+ *
+ * @param runtime_root Root of the runtime dictionary generation to check.
+ * @return True if the runtime dictionary, a reachable instance dictionary or the image
+ * contains current_short as a prefix.
+ */
+static bool is_active_prefix(struct trie_node *runtime_root) {
+    const char *key = expander_data.current_short;
+
+    if (trie_get_node_for_key(runtime_root, key) || instances_have_prefix()) {
+        return true;
+    }
+
+    const void *image = image_read_begin();
+    bool is_prefix = image && trie_image_has_prefix(image, key);
+    image_read_end(image);
+    return is_prefix;
+}
+
+/**
+ * @brief Finds the text a reference points to.
+ *
+ * @param ref The text reference.
+ * @param root Root of the runtime dictionary generation to search.
+ * @param image Pinned dictionary image, or NULL.
+ * @return The text, or NULL if it no longer exists.
+ */
+static const char *find_ref_text(const struct text_expander_text_ref *ref, struct trie_node *root,
+                                 const void *image) {
+    const struct text_expander_instance_data *data =
+        ref->instance < instance_device_count ? instance_devices[ref->instance]->data : NULL;
+
+    switch (ref->origin) {
+    case TEXT_EXPANDER_ORIGIN_RUNTIME:
+        return find_expansion(root, ref->short_code);
+    case TEXT_EXPANDER_ORIGIN_INSTANCE:
+        return data ? instance_find(data, false, ref->short_code) : NULL;
+    case TEXT_EXPANDER_ORIGIN_FRAGMENT:
+        return data ? instance_find(data, true, ref->short_code) : NULL;
+    case TEXT_EXPANDER_ORIGIN_IMAGE:
+        return image ? trie_image_search(image, ref->short_code) : NULL;
+    default:
+        return NULL;
+    }
+}
+
+int text_expander_read_text(const struct text_expander_text_ref *ref, size_t offset, char *buf, size_t size) {
+    // The text is looked up again for every chunk, under the same protection as the trigger.
+    // Texts are never modified in place, so an unchanged version means an unchanged text.
+    if (!IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SHADOW_BUILD)) {
+        k_mutex_lock(&expander_data.mutex, K_FOREVER);
+    }
+    uint8_t pool_index;
+    struct trie_node *root = text_expander_read_begin(&pool_index);
+    const void *image = image_read_begin();
+
+    int ret = -ESTALE;
+    const char *text = NULL;
+    if (atomic_get(&expander_data.text_version) == ref->version) {
+        text = find_ref_text(ref, root, image);
+    }
+    if (text) {
+        size_t len = strlen(text) + 1; // Including the terminator.
+        size_t n = offset < len ? MIN(size, len - offset) : 0;
+        if (n > 0) {
+            memcpy(buf, text + offset, n);
+        }
+        ret = n;
+    }
+
+    image_read_end(image);
+    text_expander_read_end(pool_index);
+    if (!IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SHADOW_BUILD)) {
+        k_mutex_unlock(&expander_data.mutex);
+    }
+    return ret;
+}
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_FRAGMENTS)
+// Token table of the dictionary image while its texts are scanned for references. Only used
+// with the mutex held or during init.
+static struct text_codec_table check_tokens;
+
+/**
+ * @brief Finds the target of a fragment reference, regardless of the active layers.
+ *
+ * @param root Root of the runtime dictionary generation to search.
+ * @param name Short code of the referenced expansion or fragment.
+ * @param loading Instance whose dictionary is being loaded and not yet registered, or NULL.
+ * @param image Pinned dictionary image, or NULL.
+ * @param origin Output: the enum text_expander_origin of the text.
+ * @param instance Output: index of the instance for the instance and fragment origins.
+ * @return The text, or NULL if nothing is stored under name.
+ */
+static const char *find_fragment(struct trie_node *root, const char *name,
+                                 const struct text_expander_instance_data *loading,
+                                 const void *image, uint8_t *origin, uint8_t *instance) {
+    const char *text = find_expansion(root, name);
+    *origin = TEXT_EXPANDER_ORIGIN_RUNTIME;
+    *instance = 0;
+
+    for (size_t i = 0; i <= instance_device_count && !text; i++) {
+        const struct text_expander_instance_data *data =
+            i < instance_device_count ? instance_devices[i]->data : loading;
+        if (data) {
+            *instance = i;
+            *origin = TEXT_EXPANDER_ORIGIN_FRAGMENT;
+            text = instance_find(data, true, name);
+            if (!text) {
+                *origin = TEXT_EXPANDER_ORIGIN_INSTANCE;
+                text = instance_find(data, false, name);
+            }
+        }
+    }
+    if (!text && image) {
+        *origin = TEXT_EXPANDER_ORIGIN_IMAGE;
+        text = trie_image_search(image, name);
+    }
+    return text;
+}
+
+/**
+ * @brief Checks that the references of a new text neither form a cycle nor nest too deeply.
+ *
+ * Any cycle created by adding origin has to pass through origin, so following the references
+ * of its new text is enough. References to entries that do not exist (yet) are allowed; they
+ * are skipped while typing.
+ *
+ * @param origin Short code the text is about to be stored under.
+ * @param text The (possibly compressed) text to check.
+ * @param tokens Token table of text, or NULL for plain text.
+ * @param root Root of the runtime dictionary generation references resolve against.
+ * @param loading Instance being loaded, or NULL (see find_fragment()).
+ * @param image Pinned dictionary image, or NULL.
+ * @param depth Fragment depth of text; 0 for the text being added.
+ * @return 0 if the references are fine, -ELOOP otherwise.
+ */
+static int check_fragment_references(const char *origin, const char *text,
+                                     const struct text_codec_table *tokens, struct trie_node *root,
+                                     const struct text_expander_instance_data *loading,
+                                     const void *image, uint8_t depth) {
+    struct text_window win;
+    struct text_decoder dec;
+    char name[MAX_SHORT_LEN];
+    char c;
+
+    text_window_init_string(&win, text);
+    text_decoder_init(&dec, &win, tokens);
+    while ((c = text_decoder_next(&dec)) != '\0') {
+        if (c != '{' || !text_decoder_take_reference(&dec, name, sizeof(name))) {
+            continue;
+        }
+        if (strcmp(name, origin) == 0) {
+            LOG_ERR("Fragment reference '{{%s}}' in '%s' forms a cycle.", name, origin);
+            return -ELOOP;
+        }
+        if (depth + 1 > CONFIG_ZMK_TEXT_EXPANDER_FRAGMENT_DEPTH) {
+            LOG_ERR("Fragment references in '%s' nest deeper than %d.", origin,
+                    CONFIG_ZMK_TEXT_EXPANDER_FRAGMENT_DEPTH);
+            return -ELOOP;
+        }
+
+        uint8_t target_origin, instance;
+        const char *target = find_fragment(root, name, loading, image, &target_origin, &instance);
+        if (!target) {
+            LOG_DBG("Fragment '%s' referenced by '%s' does not exist (yet).", name, origin);
+            continue;
+        }
+        int ret = check_fragment_references(origin, target,
+                                            target_origin == TEXT_EXPANDER_ORIGIN_IMAGE ? &check_tokens : NULL,
+                                            root, loading, image, depth + 1);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Checks the fragment references of a text about to be stored under a short code.
+ *
+ * @return 0 if the references are fine, -ELOOP otherwise.
+ */
+static int validate_fragment_references(const char *short_code, const char *text, struct trie_node *root,
+                                        const struct text_expander_instance_data *loading) {
+    const void *image = image_read_begin();
+    if (image) {
+        trie_image_get_tokens(image, &check_tokens);
+    }
+    int ret = check_fragment_references(short_code, text, NULL, root, loading, image, 0);
+    image_read_end(image);
+    return ret;
+}
+
+int text_expander_resolve_fragment(const char *name, struct text_expander_text_ref *ref,
+                                   struct text_codec_table *tokens) {
+    // Same protection as text_expander_trigger(): the version is read before the lookup, so a
+    // change published after it is always noticed when the text is read.
+    if (!IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SHADOW_BUILD)) {
+        k_mutex_lock(&expander_data.mutex, K_FOREVER);
+    }
+    ref->version = atomic_get(&expander_data.text_version);
+    uint8_t pool_index;
+    struct trie_node *root = text_expander_read_begin(&pool_index);
+    const void *image = image_read_begin();
+
+    const char *text = find_fragment(root, name, NULL, image, &ref->origin, &ref->instance);
+    if (text) {
+        strncpy(ref->short_code, name, sizeof(ref->short_code) - 1);
+        ref->short_code[sizeof(ref->short_code) - 1] = '\0'; // Ensure null termination.
+        if (tokens) {
+            tokens->count = 0;
+            if (ref->origin == TEXT_EXPANDER_ORIGIN_IMAGE) {
+                trie_image_get_tokens(image, tokens);
+            }
+        }
+    }
+
+    image_read_end(image);
+    text_expander_read_end(pool_index);
+    if (!IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SHADOW_BUILD)) {
+        k_mutex_unlock(&expander_data.mutex);
+    }
+    return text ? 0 : -ENOENT;
+}
+#else
+static inline int validate_fragment_references(const char *short_code, const char *text,
+                                               struct trie_node *root,
+                                               const struct text_expander_instance_data *loading) {
+    return 0;
+}
+#endif
+
+/**
+ * @brief Validates a short code and expanded text pair.
+ *
+ * @param short_code The short code (must be lowercase alphanumeric).
+ * @param expanded_text The expanded text.
+ * @return 0 if valid, -EINVAL otherwise.
+ */
+static int validate_expansion(const char *short_code, const char *expanded_text) {
+    if (!short_code || !expanded_text) { // Null checks.
+        return -EINVAL; // Invalid argument.
+    }
+
+    size_t short_len = strlen(short_code);
+    size_t expanded_len = strlen(expanded_text);
+
+    // Validate lengths against configured maximums.
+    if (short_len == 0 || short_len >= MAX_SHORT_LEN || 
+        expanded_len == 0 || expanded_len >= MAX_TEXT_LEN) {
+        LOG_ERR("Invalid length for short code (%zu) or expanded text (%zu). Max short: %d, Max expanded: %d",
+                short_len, expanded_len, MAX_SHORT_LEN, MAX_TEXT_LEN);
+        return -EINVAL;
+    }
+
+    // Validate characters in the short code (must be lowercase alphanumeric).
+    for (int i = 0; short_code[i] != '\0'; i++) {
+        char c = short_code[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))) {
+            LOG_ERR("Short code '%s' contains invalid character '%c'. Must be lowercase letters or numbers.", short_code, c);
+            return -EINVAL;
+        }
+    }
+    return 0;
+}
+
 /**
  * @brief Resets the current short code buffer (expander_data.current_short).
  * Clears the buffer and resets its length to 0.
@@ -74,9 +800,31 @@ static const char *find_expansion(const char *short_code) {
 static void reset_current_short(void) {
     memset(expander_data.current_short, 0, MAX_SHORT_LEN); // Fill buffer with zeros.
     expander_data.current_short_len = 0;                   // Reset length.
+    instance_cursor_len = 0;                               // Restart the instance cursors.
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_IDLE_TRIGGER)
+    idle_armed = false; // Nothing left to expand; a pending timer finds the flag cleared.
+#endif
     LOG_DBG("Current short code reset.");
 }
 
+/**
+ * @brief Brings the matcher state in line with the current dictionary generation.
+ *
+ * Writers never touch `current_short` directly, since it is owned by the event manager thread.
+ * Instead they bump `expander_data.generation` when typed prefixes may have become stale
+ * (e.g. after clear_all), and the matcher resets itself the next time it runs.
+ * Must only be called from the event manager thread.
+ */
+static void sync_matcher_generation(void) {
+    atomic_val_t generation = atomic_get(&expander_data.generation);
+    if (generation != expander_data.matcher_generation) {
+        LOG_DBG("Dictionary generation changed (%ld -> %ld). Resetting current short.",
+                (long)expander_data.matcher_generation, (long)generation);
+        expander_data.matcher_generation = generation;
+        reset_current_short();
+    }
+}
+
 /**
  * @brief Appends a character to the current short code buffer.
  *
@@ -87,6 +835,12 @@ static void reset_current_short(void) {
  * @param c The character to add.
  */
 static void add_to_current_short(char c) {
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_WORD_DELETE)
+    if (expander_data.current_short_len == 0) {
+        short_is_word = at_word_start; // The short code starts here.
+    }
+    at_word_start = false;
+#endif
     if (expander_data.current_short_len < MAX_SHORT_LEN - 1) { // Check space for char + null terminator.
         expander_data.current_short[expander_data.current_short_len++] = c;
         expander_data.current_short[expander_data.current_short_len] = '\0'; // Ensure null termination.
@@ -109,52 +863,278 @@ static void add_to_current_short(char c) {
 }
 
 /**
- * @brief Public API function to add or update a text expansion.
- * (Implementation of the function declared in zmk_text_expander.h)
+ * @brief Returns the index of the pool generation a trie root was allocated from.
+ *
+ * @param root A root node allocated from one of expander_data.pools.
+ * @return The index into expander_data.pools.
  */
-int zmk_text_expander_add_expansion(const char *short_code, const char *expanded_text) {
-    if (!short_code || !expanded_text) { // Null checks.
-        return -EINVAL; // Invalid argument.
+static uint8_t pool_index_of(const struct trie_node *root) {
+    for (uint8_t i = 0; i < TEXT_EXPANDER_POOL_COUNT; i++) {
+        const struct trie_node *nodes = expander_data.pools[i].node_pool;
+        if (root >= nodes && root < nodes + expander_data.pools[i].node_pool_size) {
+            return i;
+        }
     }
+    return 0;
+}
 
-    size_t short_len = strlen(short_code);
-    size_t expanded_len = strlen(expanded_text);
+/**
+ * @brief Enters a lock-free read-side section (see text_expander_internals.h).
+ *
+ * In shadow build mode the reader announces itself on the pool generation that holds the
+ * published root, then re-checks that the root did not change in between. If it did, a writer
+ * may already be recycling that pool, so the reader backs off and retries on the new root.
+ * Without shadow build mode the single pool is updated in place: announcing the reader keeps
+ * the nodes writers unlink from being handed out again under it (see trie_allocate_node()).
+ * Writers only ever wait for readers; readers never wait for anything.
+ */
+struct trie_node *text_expander_read_begin(uint8_t *pool_index) {
+    if (!IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SHADOW_BUILD)) {
+        atomic_inc(&expander_data.pools[0].readers);
+        *pool_index = 0;
+        return text_expander_get_root(&expander_data);
+    }
 
-    // Validate lengths against configured maximums.
-    if (short_len == 0 || short_len >= MAX_SHORT_LEN || 
-        expanded_len == 0 || expanded_len >= MAX_EXPANDED_LEN) {
-        LOG_ERR("Invalid length for short code (%zu) or expanded text (%zu). Max short: %d, Max expanded: %d",
-                short_len, expanded_len, MAX_SHORT_LEN, MAX_EXPANDED_LEN);
-        return -EINVAL;
+    while (true) {
+        struct trie_node *root = text_expander_get_root(&expander_data);
+        uint8_t index = pool_index_of(root);
+        atomic_inc(&expander_data.pools[index].readers);
+        // The root may have been swapped between reading it and announcing ourselves. Only a
+        // root that is still published after the increment is guaranteed not to be recycled.
+        if (text_expander_get_root(&expander_data) == root) {
+            *pool_index = index;
+            return root;
+        }
+        atomic_dec(&expander_data.pools[index].readers);
     }
+}
 
-    // Validate characters in the short code (must be lowercase alphanumeric).
-    for (int i = 0; short_code[i] != '\0'; i++) {
-        char c = short_code[i];
-        if (!((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))) {
-            LOG_ERR("Short code '%s' contains invalid character '%c'. Must be lowercase letters or numbers.", short_code, c);
-            return -EINVAL;
+/**
+ * @brief Leaves a read-side section entered with text_expander_read_begin().
+ */
+void text_expander_read_end(uint8_t pool_index) {
+    atomic_dec(&expander_data.pools[pool_index].readers);
+}
+
+/**
+ * @brief Waits until no reader is walking a pool, so it can be reset.
+ *
+ * Readers only pin a pool for the duration of one lookup, so this wait is short.
+ */
+static void wait_for_readers(struct text_expander_pool *pool) {
+    while (atomic_get(&pool->readers) != 0) {
+        k_sleep(K_MSEC(1));
+    }
+}
+
+/**
+ * @brief Callback for trie_for_each() that copies one expansion into the build generation.
+ */
+static int copy_expansion_to_build(const char *key, const char *value, void *user_data) {
+    ARG_UNUSED(user_data);
+    return trie_insert(expander_data.build_root, key, value,
+                       &expander_data.pools[expander_data.build_pool]);
+}
+
+/**
+ * @brief Replays the update the previous generation is missing, so it matches the live one.
+ *
+ * Must be called with the mutex held, after the previous generation became the build target.
+ *
+ * @param lag The update that was published since the previous generation was live.
+ * @return 0 on success, or a negative error code if the update could not be replayed.
+ */
+static int shadow_catch_up(enum text_expander_lag lag) {
+    struct text_expander_pool *pool = &expander_data.pools[expander_data.build_pool];
+    const char *key = expander_data.stale_key;
+
+    if (lag == TEXT_EXPANDER_LAG_NONE) {
+        return 0;
+    }
+    if (lag == TEXT_EXPANDER_LAG_ADD) {
+        struct trie_node *node = trie_search(text_expander_get_root(&expander_data), key);
+        if (!node) {
+            return -ENOENT;
+        }
+        return trie_insert(expander_data.stale_root, key, node->expanded_text, pool);
+    }
+
+    int ret = trie_delete(expander_data.stale_root, key, pool);
+    return ret == -ENOENT ? 0 : ret;
+}
+
+/**
+ * @brief Prepares the shadow generation as the write target.
+ *
+ * Waits until no reader is still walking the shadow pool (it held the previous generation).
+ * If that generation is a single published update behind the live one, the update is replayed
+ * on it, so a single API update costs the same whatever the dictionary size. Otherwise the pool
+ * is reset and, optionally, all live expansions are copied into it. Must be called with the
+ * mutex held. Only used in shadow build mode.
+ *
+ * @param copy_live True to start from the live dictionary, false to start empty.
+ * @return 0 on success, or -ENOMEM if the live dictionary does not fit into the shadow pool.
+ */
+static int shadow_prepare(bool copy_live) {
+    uint8_t shadow = expander_data.live_pool ^ 1;
+    struct text_expander_pool *pool = &expander_data.pools[shadow];
+
+    // Reclaim the previous generation once every reader has moved past it.
+    wait_for_readers(pool);
+
+    // The shadow generation is about to be modified, so until the next publish it is no longer
+    // a known update behind the live one.
+    enum text_expander_lag lag = expander_data.stale_lag;
+    expander_data.stale_lag = TEXT_EXPANDER_LAG_UNKNOWN;
+    expander_data.build_pool = shadow;
+
+    if (copy_live && lag != TEXT_EXPANDER_LAG_UNKNOWN) {
+        int ret = shadow_catch_up(lag);
+        if (ret == 0) {
+            expander_data.build_root = expander_data.stale_root;
+            expander_data.build_count = expander_data.expansion_count;
+            return 0;
         }
+        // E.g. the pool is too fragmented for the text: rebuild it from a compact copy.
+        LOG_DBG("Could not catch up the shadow generation (%d); copying the dictionary.", ret);
+    }
+
+    trie_reset_pool(pool);
+    expander_data.build_root = trie_allocate_node(pool);
+    if (!expander_data.build_root) {
+        return -ENOMEM;
+    }
+
+    if (copy_live) {
+        expander_data.build_count = expander_data.expansion_count;
+        return trie_for_each(text_expander_get_root(&expander_data), copy_expansion_to_build, NULL);
+    }
+    expander_data.build_count = 0;
+    return 0;
+}
+
+/**
+ * @brief Publishes the shadow generation as the new live dictionary.
+ *
+ * A single atomic pointer store makes the new root visible to readers. The previous generation
+ * stays in the other pool, so the next update can catch it up (see shadow_prepare()). Must be
+ * called with the mutex held. Only used in shadow build mode.
+ *
+ * @param lag The update the published generation has over the previous one, or
+ * TEXT_EXPANDER_LAG_UNKNOWN for anything but a single add or remove.
+ * @param key Short code of that update, or NULL.
+ */
+static void shadow_publish(enum text_expander_lag lag, const char *key) {
+    expander_data.stale_root = text_expander_get_root(&expander_data);
+    expander_data.stale_lag = key ? lag : TEXT_EXPANDER_LAG_UNKNOWN;
+    if (key) {
+        strncpy(expander_data.stale_key, key, MAX_SHORT_LEN - 1);
+        expander_data.stale_key[MAX_SHORT_LEN - 1] = '\0';
+    }
+
+    expander_data.live_pool = expander_data.build_pool;
+    expander_data.expansion_count = expander_data.build_count;
+    atomic_ptr_set(&expander_data.root, expander_data.build_root);
+    atomic_inc(&expander_data.text_version); // After the swap: see struct text_expander_text_ref.
+    LOG_DBG("Published dictionary generation in pool %d (%d expansions).",
+            expander_data.live_pool, expander_data.expansion_count);
+}
+
+/**
+ * @brief Selects the write target for a single API update.
+ *
+ * Inside a batch, or outside shadow build mode, updates go straight to the current build
+ * target. Otherwise a fresh shadow copy of the live dictionary is prepared.
+ * Must be called with the mutex held.
+ *
+ * @return 0 on success, or a negative error code if the shadow copy could not be built.
+ */
+static int write_begin(void) {
+    if (!IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SHADOW_BUILD)) {
+        expander_data.build_root = text_expander_get_root(&expander_data);
+        expander_data.build_pool = expander_data.live_pool;
+        expander_data.build_count = expander_data.expansion_count;
+        return 0;
+    }
+    if (expander_data.batch_active) {
+        return 0;
+    }
+    return shadow_prepare(true);
+}
+
+/**
+ * @brief Completes a single API update started with write_begin().
+ *
+ * Outside a batch, a successful shadow update is published; a failed one is simply dropped
+ * and the live dictionary stays untouched. Must be called with the mutex held, and only after
+ * write_begin() succeeded.
+ *
+ * @param success True if the update was applied to the build target.
+ * @param lag Kind of the update, so the next shadow update can replay it.
+ * @param short_code Short code of the update.
+ */
+static void write_end(bool success, enum text_expander_lag lag, const char *short_code) {
+    if (!IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SHADOW_BUILD)) {
+        expander_data.expansion_count = expander_data.build_count;
+        if (success) {
+            atomic_inc(&expander_data.text_version);
+        }
+        return;
+    }
+    if (expander_data.batch_active) {
+        return;
+    }
+    if (success) {
+        shadow_publish(lag, short_code);
+    } else {
+        // Failed inserts and deletes leave the trie as it was, so the shadow generation still
+        // matches the live one and the next update can start from it right away.
+        expander_data.stale_root = expander_data.build_root;
+        expander_data.stale_lag = TEXT_EXPANDER_LAG_NONE;
+    }
+}
+
+/**
+ * @brief Public API function to add or update a text expansion.
+ * (Implementation of the function declared in zmk_text_expander.h)
+ */
+int zmk_text_expander_add_expansion(const char *short_code, const char *expanded_text) {
+    int ret = validate_expansion(short_code, expanded_text);
+    if (ret < 0) {
+        return ret;
     }
 
     k_mutex_lock(&expander_data.mutex, K_FOREVER); // Acquire mutex for thread-safe access.
 
+    ret = write_begin();
+    if (ret < 0) {
+        LOG_ERR("Failed to prepare dictionary update for '%s': %d", short_code, ret);
+        k_mutex_unlock(&expander_data.mutex);
+        return ret;
+    }
+
     // Check if this short_code already exists (to log as "Updated" vs "Added").
-    bool is_update = (find_expansion(short_code) != NULL);
+    bool is_update = (find_expansion(expander_data.build_root, short_code) != NULL);
 
-    // Insert the expansion into the trie.
-    int ret = trie_insert(expander_data.root, short_code, expanded_text, &expander_data);
+    // Reject texts whose fragment references would loop, then insert the expansion into the trie.
+    ret = validate_fragment_references(short_code, expanded_text, expander_data.build_root, NULL);
+    if (ret == 0) {
+        ret = trie_insert(expander_data.build_root, short_code, expanded_text,
+                          &expander_data.pools[expander_data.build_pool]);
+    }
 
     if (ret == 0) { // Success.
         if (!is_update) {
-            expander_data.expansion_count++; // Increment count only for new additions.
+            expander_data.build_count++; // Increment count only for new additions.
         }
-        LOG_INF("%s expansion: '%s' -> '%s' (Count: %d)", 
-                is_update ? "Updated" : "Added", short_code, expanded_text, expander_data.expansion_count);
+        LOG_DBG("%s expansion: '%s' -> '%s' (Count: %d)", 
+                is_update ? "Updated" : "Added", short_code, expanded_text, expander_data.build_count);
+        text_expander_journal_record_add(short_code, expanded_text);
     } else {
         LOG_ERR("Failed to %s expansion '%s': %d", is_update ? "update" : "add", short_code, ret);
     }
 
+    write_end(ret == 0, TEXT_EXPANDER_LAG_ADD, short_code);
     k_mutex_unlock(&expander_data.mutex); // Release mutex.
     return ret;
 }
@@ -170,18 +1150,28 @@ int zmk_text_expander_remove_expansion(const char *short_code) {
 
     k_mutex_lock(&expander_data.mutex, K_FOREVER);
 
+    int ret = write_begin();
+    if (ret < 0) {
+        LOG_ERR("Failed to prepare dictionary update for '%s': %d", short_code, ret);
+        k_mutex_unlock(&expander_data.mutex);
+        return ret;
+    }
+
     // Attempt to delete from the trie.
-    // trie_delete marks the node as non-terminal but doesn't free memory pools here.
-    int ret = trie_delete(expander_data.root, short_code); 
+    // trie_delete marks the node as non-terminal and releases its text; nodes are not freed.
+    ret = trie_delete(expander_data.build_root, short_code,
+                      &expander_data.pools[expander_data.build_pool]);
     if (ret == 0) { // Successfully found and "deleted" (marked non-terminal).
-        expander_data.expansion_count--;
-        LOG_INF("Removed expansion: '%s' (Count: %d)", short_code, expander_data.expansion_count);
+        expander_data.build_count--;
+        LOG_DBG("Removed expansion: '%s' (Count: %d)", short_code, expander_data.build_count);
+        text_expander_journal_record_remove(short_code);
     } else if (ret == -ENOENT) { // Entry not found.
         LOG_WRN("Failed to remove expansion '%s': Not found.", short_code);
     } else { // Other error during deletion.
         LOG_WRN("Failed to remove expansion '%s': Error %d", short_code, ret);
     }
 
+    write_end(ret == 0, TEXT_EXPANDER_LAG_REMOVE, short_code);
     k_mutex_unlock(&expander_data.mutex);
     return ret;
 }
@@ -193,89 +1183,464 @@ int zmk_text_expander_remove_expansion(const char *short_code) {
 void zmk_text_expander_clear_all(void) {
     k_mutex_lock(&expander_data.mutex, K_FOREVER);
 
-    // Reset memory pool usage counters. This effectively "frees" all pooled memory
-    // for nodes and text, making it available for new allocations.
-    expander_data.node_pool_used = 0;
-    expander_data.text_pool_used = 0;
-    expander_data.expansion_count = 0;
-    
-    // Reset the current short code input buffer as well.
-    memset(expander_data.current_short, 0, MAX_SHORT_LEN);
-    expander_data.current_short_len = 0;
+    if (IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SHADOW_BUILD)) {
+        // Start an empty shadow generation. Inside a batch it simply replaces the batch's
+        // build target; otherwise it is published right away.
+        if (shadow_prepare(false) < 0) {
+            LOG_ERR("Failed to allocate root trie node during clear operation!");
+        } else if (!expander_data.batch_active) {
+            shadow_publish(TEXT_EXPANDER_LAG_UNKNOWN, NULL);
+        }
+    } else {
+        // Reset memory pool usage counters. This effectively "frees" all pooled memory
+        // for nodes and text, making it available for new allocations.
+        struct text_expander_pool *pool = &expander_data.pools[expander_data.live_pool];
+        atomic_ptr_set(&expander_data.root, NULL); // New readers find an empty dictionary.
+        wait_for_readers(pool);
+        trie_reset_pool(pool);
+        expander_data.expansion_count = 0;
 
-    // Re-initialize the trie by allocating a new root node.
-    // This will use the first node from the (now considered empty) node_pool.
-    expander_data.root = trie_allocate_node(&expander_data); 
-    if (!expander_data.root) {
-        // This is a critical failure, as the trie cannot operate without a root.
-        LOG_ERR("Failed to re-allocate root trie node during clear operation!");
-        // The system might be in an unstable state if this happens.
+        // Re-initialize the trie by allocating a new root node.
+        // This will use the first node from the (now considered empty) node_pool.
+        struct trie_node *root = trie_allocate_node(pool);
+        if (!root) {
+            // This is a critical failure, as the trie cannot operate without a root.
+            LOG_ERR("Failed to re-allocate root trie node during clear operation!");
+            // The system might be in an unstable state if this happens.
+        }
+        atomic_ptr_set(&expander_data.root, root);
+        expander_data.build_root = root;
+        expander_data.build_count = 0;
+        atomic_inc(&expander_data.text_version);
     }
 
+    // The current short code buffer belongs to the event manager thread. Bump the generation
+    // so the matcher discards its now meaningless prefix on the next keystroke or trigger.
+    atomic_inc(&expander_data.generation);
+
+    text_expander_journal_record_clear();
     k_mutex_unlock(&expander_data.mutex);
     LOG_INF("Cleared all expansions and reset trie.");
 }
 
 /**
- * @brief Public API function to get the count of current expansions.
- * (Implementation of the function declared in zmk_text_expander.h)
+ * @brief Public API function to start a batch of updates.
+ * (Implementation of the function declared in zmk_text_expander.h)
+ */
+int zmk_text_expander_batch_begin(void) {
+    k_mutex_lock(&expander_data.mutex, K_FOREVER);
+
+    if (expander_data.batch_active) {
+        k_mutex_unlock(&expander_data.mutex);
+        return -EBUSY;
+    }
+
+    if (IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SHADOW_BUILD)) {
+        int ret = shadow_prepare(true);
+        if (ret < 0) {
+            LOG_ERR("Failed to prepare shadow generation for batch: %d", ret);
+            k_mutex_unlock(&expander_data.mutex);
+            return ret;
+        }
+    }
+
+    // The mutex stays locked (it is recursive for the owning thread) until the batch is
+    // committed or aborted, so other writers cannot interleave with the batch.
+    expander_data.batch_active = true;
+    expander_data.batch_owner = k_current_get();
+    LOG_DBG("Dictionary batch started.");
+    return 0;
+}
+
+/**
+ * @brief Public API function to commit a batch of updates.
+ * (Implementation of the function declared in zmk_text_expander.h)
+ */
+int zmk_text_expander_batch_commit(void) {
+    if (!expander_data.batch_active) {
+        return -EINVAL;
+    }
+    if (expander_data.batch_owner != k_current_get()) {
+        return -EPERM; // Only the owner holds the mutex, so only it may release it.
+    }
+
+    expander_data.batch_active = false;
+    if (IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SHADOW_BUILD)) {
+        shadow_publish(TEXT_EXPANDER_LAG_UNKNOWN, NULL);
+    }
+    LOG_INF("Dictionary batch committed (Count: %d).", expander_data.expansion_count);
+
+    k_mutex_unlock(&expander_data.mutex); // Taken in zmk_text_expander_batch_begin().
+    return 0;
+}
+
+/**
+ * @brief Public API function to abort a batch of updates.
+ * (Implementation of the function declared in zmk_text_expander.h)
+ */
+int zmk_text_expander_batch_abort(void) {
+    if (!expander_data.batch_active) {
+        return -EINVAL;
+    }
+    if (expander_data.batch_owner != k_current_get()) {
+        return -EPERM; // Only the owner holds the mutex, so only it may release it.
+    }
+
+    // In shadow build mode the shadow generation is simply never published, so the journal
+    // records staged for it no longer describe the live dictionary. Otherwise the updates
+    // were applied in place and stay in effect.
+    expander_data.batch_active = false;
+    if (IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SHADOW_BUILD)) {
+        text_expander_journal_discard_pending();
+    }
+    LOG_INF("Dictionary batch aborted.");
+
+    k_mutex_unlock(&expander_data.mutex); // Taken in zmk_text_expander_batch_begin().
+    return 0;
+}
+
+/**
+ * @brief Public API function to get the count of current expansions.
+ * (Implementation of the function declared in zmk_text_expander.h)
+ */
+int zmk_text_expander_get_count(void) {
+    k_mutex_lock(&expander_data.mutex, K_FOREVER);
+    int count = expander_data.expansion_count;
+    k_mutex_unlock(&expander_data.mutex);
+
+    // Add the device tree dictionaries, which are read-only after init.
+    for (size_t i = 0; i < instance_device_count; i++) {
+        const struct text_expander_instance_data *data = instance_devices[i]->data;
+        count += data->expansion_count;
+    }
+
+    const void *image = image_read_begin();
+    if (image) {
+        count += trie_image_entry_count(image);
+    }
+    image_read_end(image);
+    return count;
+}
+
+/**
+ * @brief Public API function to report the memory usage of the runtime dictionary.
+ * (Implementation of the function declared in zmk_text_expander.h)
+ */
+int zmk_text_expander_get_memory_stats(struct zmk_text_expander_memory_stats *stats) {
+    if (!stats) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&expander_data.mutex, K_FOREVER);
+    const struct text_expander_pool *live = &expander_data.pools[expander_data.live_pool];
+    stats->nodes.capacity = live->node_pool_size;
+    stats->nodes.live = live->node_pool_used;
+    stats->nodes.free = live->node_pool_size - live->node_pool_used;
+    stats->nodes.peak = 0;
+    trie_text_stats(live, &stats->text);
+    // In shadow build mode the generations take turns being live, so the peak is the
+    // highest of all of them.
+    for (int i = 0; i < TEXT_EXPANDER_POOL_COUNT; i++) {
+        stats->nodes.peak = MAX(stats->nodes.peak, expander_data.pools[i].node_pool_peak);
+        stats->text.peak = MAX(stats->text.peak, expander_data.pools[i].text_pool_peak);
+    }
+    k_mutex_unlock(&expander_data.mutex);
+    return 0;
+}
+
+/**
+ * @brief Public API function to check if an expansion exists.
+ * (Implementation of the function declared in zmk_text_expander.h)
+ */
+bool zmk_text_expander_exists(const char *short_code) {
+    if (!short_code) {
+        return false;
+    }
+
+    uint8_t pool_index;
+    struct trie_node *root = text_expander_read_begin(&pool_index);
+    bool exists = (find_expansion(root, short_code) != NULL);
+    text_expander_read_end(pool_index);
+
+    // Check the device tree dictionaries of all instances, regardless of the active layers.
+    for (size_t i = 0; i < instance_device_count && !exists; i++) {
+        const struct text_expander_instance_data *data = instance_devices[i]->data;
+        exists = (instance_find(data, false, short_code) != NULL);
+    }
+
+    if (!exists) {
+        const void *image = image_read_begin();
+        exists = image && trie_image_search(image, short_code) != NULL;
+        image_read_end(image);
+    }
+    return exists;
+}
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_IMAGE)
+/**
+ * @brief Public API function to (re)load the dictionary image.
+ * (Implementation of the function declared in zmk_text_expander.h)
+ */
+int zmk_text_expander_reload_image(void) {
+    const void *image = (const void *)TEXT_EXPANDER_IMAGE_ADDR;
+
+    zmk_text_expander_unload_image(); // Never publish over an image readers may still be using.
+
+    int ret = trie_image_validate(image, TEXT_EXPANDER_IMAGE_SIZE);
+    if (ret < 0) {
+        if (ret == -ENOENT) {
+            LOG_INF("No dictionary image in the image partition.");
+        } else {
+            LOG_ERR("Dictionary image rejected: %d", ret);
+        }
+        return ret;
+    }
+
+    atomic_ptr_set(&dictionary_image, (atomic_ptr_val_t)image);
+    atomic_inc(&expander_data.text_version);
+    atomic_inc(&expander_data.generation); // Prefixes typed so far may have changed meaning.
+    LOG_INF("Loaded dictionary image with %u expansions.", trie_image_entry_count(image));
+    return 0;
+}
+
+/**
+ * @brief Public API function to unload the dictionary image.
+ * (Implementation of the function declared in zmk_text_expander.h)
+ */
+void zmk_text_expander_unload_image(void) {
+    if (!atomic_ptr_clear(&dictionary_image)) {
+        return;
+    }
+
+    // Wait until no lookup still reads from the partition before it can be rewritten.
+    while (atomic_get(&dictionary_image_readers) != 0) {
+        k_sleep(K_MSEC(1));
+    }
+    atomic_inc(&expander_data.generation);
+    atomic_inc(&expander_data.text_version);
+    LOG_INF("Dictionary image unloaded.");
+}
+#endif
+
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_TERMINATORS)
+/**
+ * @brief Adds a key to the set of terminators.
+ *
+ * Keys that make up short codes (letters, digits, Backspace) and modifiers are rejected, since
+ * they never end a word.
+ *
+ * @param keycode Keyboard usage ID of the key, or 0 if it could not be mapped.
+ * @param origin Where the key was configured, for the warning if it is rejected.
+ */
+static void add_terminator(uint32_t keycode, const char *origin) {
+    if (keycode == 0 || keycode >= ARRAY_SIZE(terminator_keys) * 32 ||
+        (keycode >= HID_USAGE_KEY_KEYBOARD_A && keycode <= HID_USAGE_KEY_KEYBOARD_0_AND_RIGHT_PARENTHESIS) ||
+        keycode == HID_USAGE_KEY_KEYBOARD_DELETE_BACKSPACE ||
+        (keycode >= HID_USAGE_KEY_KEYBOARD_LEFTCONTROL && keycode <= HID_USAGE_KEY_KEYBOARD_RIGHT_GUI)) {
+        LOG_WRN("Ignoring terminator key 0x%02X from %s: it cannot end a short code.", keycode, origin);
+        return;
+    }
+    terminator_keys[keycode / 32] |= BIT(keycode % 32);
+}
+
+/**
+ * @brief Checks whether a keyboard key ends a word.
+ */
+static bool is_terminator(uint32_t keycode) {
+    return keycode < ARRAY_SIZE(terminator_keys) * 32 && (terminator_keys[keycode / 32] & BIT(keycode % 32));
+}
+
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_IDLE_TRIGGER)
+/**
+ * @brief Checks whether the typed short code has an expansion reachable from the active layers.
+ *
+ * A lock-free lookup: only the presence of a text is checked, not the text itself.
+ */
+static bool current_short_is_entry(void) {
+    struct text_expander_text_ref ref;
+    const void *image = NULL;
+    uint8_t pool_index;
+    struct trie_node *root = text_expander_read_begin(&pool_index);
+    bool found = find_any_expansion(root, expander_data.current_short, &ref, &image) != NULL;
+    image_read_end(image);
+    text_expander_read_end(pool_index);
+    return found;
+}
+
+/**
+ * @brief Arms the idle timer after a key press that left a complete short code typed, or stops it.
+ *
+ * Only a short code with an expansion of its own arms the timer, so typing through the start
+ * of a longer one costs one lookup per key press and no timer. The trigger looks the short
+ * code up again when the timer fires, in case the dictionary changed in the meantime.
+ *
+ * @param was_armed Whether the timer was armed before the key press.
+ * @param edited Whether the key press added to or removed from the short code.
+ */
+static void idle_timer_update(bool was_armed, bool edited) {
+    idle_armed = edited && expander_data.current_short_len > 0 && current_short_is_entry();
+    if (idle_armed) {
+        k_work_reschedule(&idle_work, K_MSEC(CONFIG_ZMK_TEXT_EXPANDER_IDLE_TIMEOUT));
+    } else if (was_armed) {
+        k_work_cancel_delayable(&idle_work);
+    }
+}
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_WORD_DELETE)
+/**
+ * @brief Checks whether a key ends a word on every host: word-delete chords stop at whitespace
+ * everywhere, while punctuation is handled differently from host to host.
+ */
+static bool is_word_boundary(uint32_t keycode) {
+    return keycode == HID_USAGE_KEY_KEYBOARD_SPACEBAR || keycode == HID_USAGE_KEY_KEYBOARD_RETURN_ENTER ||
+           keycode == HID_USAGE_KEY_KEYBOARD_TAB;
+}
+
+/**
+ * @brief Tracks whether the cursor is at the start of a word after a key press.
+ *
+ * Whitespace starts a word, modifiers keep the state, and keys that edited current_short have
+ * already updated it (see add_to_current_short()). Anything else, like punctuation, arrows or
+ * a Backspace with nothing left in the buffer, leaves it unknown.
+ *
+ * @param keycode The HID usage ID of the pressed key.
+ * @param edited_short Whether the key press added to or removed from current_short.
+ */
+static void word_start_update(uint32_t keycode, bool edited_short) {
+    if (is_word_boundary(keycode)) {
+        at_word_start = true;
+    } else if (!edited_short && !(keycode >= HID_USAGE_KEY_KEYBOARD_LEFTCONTROL &&
+                                  keycode <= HID_USAGE_KEY_KEYBOARD_RIGHT_GUI)) {
+        at_word_start = false;
+    }
+}
+
+/**
+ * @brief Picks how to delete the short code about to be expanded.
+ *
+ * The chord is only used if the short code is known to be a whole word, so it cannot take
+ * any other text with it, and the selected endpoint's host is known.
+ *
+ * @param short_len Length of the short code.
+ * @return Modifier to hold with Backspace, or 0 to delete the short code with backspaces.
  */
-int zmk_text_expander_get_count(void) {
-    k_mutex_lock(&expander_data.mutex, K_FOREVER);
-    int count = expander_data.expansion_count;
-    k_mutex_unlock(&expander_data.mutex);
-    return count;
+static uint32_t word_delete_modifier(uint8_t short_len) {
+    if (!short_is_word || short_len < WORD_DELETE_MIN_LEN) {
+        return 0;
+    }
+    int index = zmk_endpoint_instance_to_index(zmk_endpoints_selected());
+    if (index < 0 || index >= ZMK_ENDPOINT_COUNT) {
+        return 0;
+    }
+    switch (atomic_get(&endpoint_hosts[index])) {
+    case ZMK_TEXT_EXPANDER_HOST_PC:
+        return HID_USAGE_KEY_KEYBOARD_LEFTCONTROL;
+    case ZMK_TEXT_EXPANDER_HOST_MACOS:
+        return HID_USAGE_KEY_KEYBOARD_LEFTALT;
+    default:
+        return 0; // Unknown host: its word boundaries cannot be relied on.
+    }
 }
 
 /**
- * @brief Public API function to check if an expansion exists.
- * (Implementation of the function declared in zmk_text_expander.h)
+ * @brief Public API function to set the host of the selected endpoint.
  */
-bool zmk_text_expander_exists(const char *short_code) {
-    if (!short_code) {
-        return false;
+int zmk_text_expander_set_host(enum zmk_text_expander_host host) {
+    if (host != ZMK_TEXT_EXPANDER_HOST_UNKNOWN && host != ZMK_TEXT_EXPANDER_HOST_PC &&
+        host != ZMK_TEXT_EXPANDER_HOST_MACOS) {
+        return -EINVAL;
+    }
+    int index = zmk_endpoint_instance_to_index(zmk_endpoints_selected());
+    if (index < 0 || index >= ZMK_ENDPOINT_COUNT) {
+        return -EINVAL;
     }
+    atomic_set(&endpoint_hosts[index], host);
+    LOG_INF("Host of endpoint %d set to %d.", index, host);
+    return 0;
+}
 
-    k_mutex_lock(&expander_data.mutex, K_FOREVER);
-    bool exists = (find_expansion(short_code) != NULL);
-    k_mutex_unlock(&expander_data.mutex);
-    return exists;
+/**
+ * @brief Public API function to get the host of the selected endpoint.
+ */
+enum zmk_text_expander_host zmk_text_expander_get_host(void) {
+    int index = zmk_endpoint_instance_to_index(zmk_endpoints_selected());
+    if (index < 0 || index >= ZMK_ENDPOINT_COUNT) {
+        return ZMK_TEXT_EXPANDER_HOST_UNKNOWN;
+    }
+    return (enum zmk_text_expander_host)atomic_get(&endpoint_hosts[index]);
 }
+#endif
 
+// What made text_expander_trigger() look up the short code.
+enum trigger_source {
+    TRIGGER_BEHAVIOR,   // The behavior key was pressed.
+    TRIGGER_TERMINATOR, // A terminator key ended the short code.
+    TRIGGER_IDLE,       // Typing paused after the short code.
+};
+
+static int text_expander_trigger(enum trigger_source source, const struct expansion_terminator *terminator);
 
 /**
- * @brief Event listener for keycode state changes (key presses/releases).
+ * @brief Updates the matcher state for one key press.
  *
- * This function is called by the ZMK event manager whenever a keycode_state_changed event occurs.
- * It processes key presses to:
+ * This is the core of the keystroke path. It processes key presses to:
  * 1. Build the `current_short` code buffer from alphanumeric keys.
  * 2. Handle Backspace to edit the `current_short` buffer.
  * 3. Implement aggressive reset mode: if typed characters do not form a prefix of any
  * known short code, the buffer is reset.
- * 4. Handle specific keys (like Space, or others based on Kconfig) that should
+ * 4. With CONFIG_ZMK_TEXT_EXPANDER_TERMINATORS, expand the short code ended by a terminator key.
+ * 5. Handle specific keys (like Space, or others based on Kconfig) that should
  * reset the `current_short` buffer.
+ * 6. With CONFIG_ZMK_TEXT_EXPANDER_WORD_DELETE, track whether the next short code starts a word.
+ * 7. With CONFIG_ZMK_TEXT_EXPANDER_IDLE_TRIGGER, re-arm the idle timer if the short code grew,
+ * or disarm it otherwise.
  *
- * @param eh Pointer to the generic zmk_event_t.
- * @return ZMK_EV_EVENT_BUBBLE to allow other listeners to process the event,
- * or ZMK_EV_EVENT_CONSUME if the event should be stopped here (not used in this impl).
+ * Must only be called by the owner of the matcher state: the event manager thread, or with
+ * CONFIG_ZMK_TEXT_EXPANDER_DEFERRED_INPUT, whoever holds `input_consumer_mutex`.
+ *
+ * @param usage_page The HID usage page of the pressed key.
+ * @param keycode The HID usage ID of the pressed key.
+ * @param modifiers Modifiers held or implied when the key was pressed (MOD_* flags).
+ * @param timestamp Uptime in milliseconds at which the key was pressed.
  */
-static int text_expander_keycode_state_changed_listener(const zmk_event_t *eh) {
-    // Cast the generic event to the specific keycode_state_changed event type.
-    struct zmk_keycode_state_changed *ev = as_zmk_keycode_state_changed(eh);
-
-    // Only process key presses (ev->state is true for press, false for release).
-    if (ev == NULL || !ev->state) {
-        return ZMK_EV_EVENT_BUBBLE; // Let other listeners handle releases or null events.
-    }
-
-    // Attempt to lock the mutex without waiting. If busy, skip this key press to avoid blocking
-    // the event handling thread. This is a trade-off: might miss a char if system is heavily loaded.
-    if (k_mutex_lock(&expander_data.mutex, K_NO_WAIT) != 0) {
-        LOG_DBG("Could not acquire mutex for keycode listener, skipping character.");
-        return ZMK_EV_EVENT_BUBBLE;
+static void process_key_press(uint16_t usage_page, uint32_t keycode, uint8_t modifiers, int64_t timestamp) {
+    ARG_UNUSED(timestamp);
+
+    // No locking here: the matcher state is owned by the caller and the trie is only read.
+    // Every key press is processed regardless of what API callers are doing concurrently.
+    sync_matcher_generation();
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_CANDIDATE_CYCLING)
+    // Once anything else is typed, the last expansion is no longer what precedes the cursor.
+    candidate_cycle.active = false;
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_IDLE_TRIGGER)
+    // Any key press ends the pause the idle timer was waiting for. The timer is rescheduled or
+    // cancelled once the outcome of this key press is known (see idle_timer_update()).
+    bool was_idle_armed = idle_armed;
+#endif
+
+    // Keys from other usage pages (e.g. consumer controls) never form part of a short code.
+    // Their usage IDs overlap with keyboard ones, so handle them as generic reset keys.
+    if (usage_page != HID_USAGE_KEY) {
+        if (expander_data.current_short_len > 0) {
+            LOG_DBG("Generic reset for usage page 0x%02X key 0x%02X.", usage_page, keycode);
+            reset_current_short();
+        }
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_WORD_DELETE)
+        at_word_start = false; // Media keys and the like may well move the cursor.
+#endif
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_IDLE_TRIGGER)
+        idle_timer_update(was_idle_armed, false);
+#endif
+        return;
     }
 
-    uint16_t keycode = ev->keycode; // The HID keycode from the event.
     bool current_short_content_changed = false; // Flag to track if current_short buffer was modified.
 
     // --- 1. Handle keys that modify current_short (alphanumeric, backspace) ---
@@ -295,6 +1660,12 @@ static int text_expander_keycode_state_changed_listener(const zmk_event_t *eh) {
         if (expander_data.current_short_len > 0) { // If buffer is not empty.
             expander_data.current_short_len--;     // "Delete" last char by reducing length.
             expander_data.current_short[expander_data.current_short_len] = '\0'; // Null-terminate.
+            instance_cursor_len = 0; // Cursors cannot step back; restart them on the next check.
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_WORD_DELETE)
+            if (expander_data.current_short_len == 0) {
+                at_word_start = short_is_word; // Back where the short code started.
+            }
+#endif
             LOG_DBG("Backspace. Current short: '%s', len: %d",
                     expander_data.current_short, expander_data.current_short_len);
             current_short_content_changed = true;
@@ -308,8 +1679,11 @@ static int text_expander_keycode_state_changed_listener(const zmk_event_t *eh) {
     if (IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_AGGRESSIVE_RESET_MODE)) {
         if (current_short_content_changed && expander_data.current_short_len > 0) {
             // trie_get_node_for_key returns NULL if the key is not a valid path/prefix.
-            struct trie_node *node = trie_get_node_for_key(expander_data.root, expander_data.current_short);
-            if (node == NULL) {
+            uint8_t pool_index;
+            struct trie_node *root = text_expander_read_begin(&pool_index);
+            bool is_prefix = is_active_prefix(root);
+            text_expander_read_end(pool_index);
+            if (!is_prefix) {
                 LOG_DBG("Aggressive reset: '%s' is not a prefix of any known short code. Resetting.",
                         expander_data.current_short);
                 reset_current_short();
@@ -318,7 +1692,31 @@ static int text_expander_keycode_state_changed_listener(const zmk_event_t *eh) {
         }
     }
 
-    // --- 3. Handle specific reset keys (Space) or other generic non-alphanumeric keys ---
+    // --- 3. Terminators expand the word they end ---
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_TERMINATORS)
+    if (is_terminator(keycode)) {
+        if (expander_data.current_short_len > 0) {
+            // The terminator is already on its way to the host, so the expansion deletes it along
+            // with the short code and types it again after the text. Without a match the buffer
+            // is reset, as for any other word-ending key. Kconfig requires shadow build mode, so the
+            // lookup only pins a generation and never waits for the dictionary mutex.
+            struct expansion_terminator terminator = {
+                .keycode = keycode,
+                .shift = (modifiers & (MOD_LSFT | MOD_RSFT)) != 0,
+            };
+            text_expander_trigger(TRIGGER_TERMINATOR, &terminator);
+        }
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_WORD_DELETE)
+        word_start_update(keycode, false); // The terminator is the last thing typed, expansion or not.
+#endif
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_IDLE_TRIGGER)
+        idle_timer_update(was_idle_armed, false);
+#endif
+        return;
+    }
+#endif
+
+    // --- 4. Handle specific reset keys (Space) or other generic non-alphanumeric keys ---
     if (keycode == HID_USAGE_KEY_KEYBOARD_SPACEBAR) {
         // Spacebar always resets the current_short if it's not empty.
         // This is a common trigger for users to indicate the end of a potential short code
@@ -364,68 +1762,253 @@ static int text_expander_keycode_state_changed_listener(const zmk_event_t *eh) {
         }
     }
 
-    k_mutex_unlock(&expander_data.mutex); // Release the mutex.
-    return ZMK_EV_EVENT_BUBBLE; // Allow other event listeners to process this key event.
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_WORD_DELETE)
+    // --- 5. Word starts, for deleting whole-word short codes with one chord ---
+    word_start_update(keycode, current_short_content_changed);
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_IDLE_TRIGGER)
+    // --- 6. Idle trigger: wait for a pause after a complete short code ---
+    idle_timer_update(was_idle_armed, current_short_content_changed);
+#endif
 }
 
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_DEFERRED_INPUT)
+// Key presses captured by the listener and waiting to be applied to the matcher state.
+static struct keystroke_ring input_ring;
+// Held by whoever currently owns the matcher state while deferred input is enabled: the input
+// worker while it drains the ring, or the trigger while it drains and performs a lookup.
+static struct k_mutex input_consumer_mutex;
+// Low-priority work queue that drains input_ring off the event manager thread.
+K_THREAD_STACK_DEFINE(input_work_q_stack, CONFIG_ZMK_TEXT_EXPANDER_INPUT_THREAD_STACK_SIZE);
+static struct k_work_q input_work_q;
+static struct k_work input_work;
 
 /**
- * @brief Behavior action called when the key assigned to this behavior is pressed.
+ * @brief Applies all pending key presses to the matcher state.
  *
- * This function attempts to find an expansion for the `current_short` code.
- * If found, it initiates the expansion process (backspacing the short code, then typing
- * the expanded text). If not found, or if `current_short` is empty, it resets `current_short`.
+ * Must be called with input_consumer_mutex held. If the ring overflowed, the typed short code
+ * can no longer be trusted, so it is reset rather than left silently corrupted.
+ */
+static void drain_pending_keystrokes(void) {
+    struct keystroke_event event;
+    while (keystroke_ring_pop(&input_ring, &event)) {
+        process_key_press(event.usage_page, event.keycode, event.modifiers, event.timestamp);
+    }
+
+    if (keystroke_ring_take_overflow(&input_ring)) {
+        LOG_WRN("Keystroke ring overflowed. Resetting current short code.");
+        reset_current_short();
+    }
+}
+
+/**
+ * @brief Work handler for input_work: drains the keystroke ring.
  *
- * @param binding Pointer to the behavior binding data.
- * @param binding_event Event data for the binding.
- * @return ZMK_BEHAVIOR_OPAQUE if an expansion was attempted (consumes the event).
- * @return ZMK_BEHAVIOR_TRANSPARENT if no action was taken (e.g., current_short was empty).
+ * @param work Pointer to input_work.
  */
-static int text_expander_keymap_binding_pressed(struct zmk_behavior_binding *binding,
-                                                struct zmk_behavior_binding_event binding_event) {
-    LOG_DBG("Text expander behavior &%s triggered.", binding->behavior_dev);
+static void input_work_handler(struct k_work *work) {
+    ARG_UNUSED(work);
+    k_mutex_lock(&input_consumer_mutex, K_FOREVER);
+    drain_pending_keystrokes();
+    k_mutex_unlock(&input_consumer_mutex);
+}
+#endif // IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_DEFERRED_INPUT)
 
-    k_mutex_lock(&expander_data.mutex, K_FOREVER);
+/**
+ * @brief Event listener for keycode state changes (key presses/releases).
+ *
+ * This function is called by the ZMK event manager whenever a keycode_state_changed event occurs.
+ * Key presses are handed to process_key_press(), either inline or, with
+ * CONFIG_ZMK_TEXT_EXPANDER_DEFERRED_INPUT, by queueing them on a lock-free ring that a
+ * low-priority worker drains. In the deferred case the listener returns immediately, so other
+ * subscribers and the report to the host are never delayed by matching.
+ *
+ * @param eh Pointer to the generic zmk_event_t.
+ * @return ZMK_EV_EVENT_BUBBLE to allow other listeners to process the event,
+ * or ZMK_EV_EVENT_CONSUME if the event should be stopped here (not used in this impl).
+ */
+static int text_expander_keycode_state_changed_listener(const zmk_event_t *eh) {
+    // Cast the generic event to the specific keycode_state_changed event type.
+    struct zmk_keycode_state_changed *ev = as_zmk_keycode_state_changed(eh);
 
-    if (expander_data.current_short_len > 0) { // If there's something in the short code buffer.
-        // Try to find an expansion for the current short code.
-        const char *expanded_ptr = find_expansion(expander_data.current_short);
-        
-        if (expanded_ptr) { // Expansion found!
-            // Make copies of the short code and expanded text. This is important because:
-            // 1. reset_current_short() will clear expander_data.current_short.
-            // 2. The expansion engine operates asynchronously, so it needs its own copy
-            //    of the expanded text. The expanded_ptr points into the shared text_pool
-            //    which could theoretically change if another operation modified expansions
-            //    (though less likely during an active expansion). A copy is safer.
-            char expanded_copy[MAX_EXPANDED_LEN]; 
-            char short_copy[MAX_SHORT_LEN];     
-
-            strncpy(expanded_copy, expanded_ptr, sizeof(expanded_copy) - 1);
-            expanded_copy[sizeof(expanded_copy) - 1] = '\0'; // Ensure null termination.
+    // Only process key presses (ev->state is true for press, false for release).
+    if (ev == NULL || !ev->state) {
+        return ZMK_EV_EVENT_BUBBLE; // Let other listeners handle releases or null events.
+    }
+
+    // Shift state of the press, so a terminator is typed again exactly as it was typed.
+    uint8_t modifiers = ev->implicit_modifiers | zmk_hid_get_explicit_mods();
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_DEFERRED_INPUT)
+    struct keystroke_event event = {
+        .usage_page = ev->usage_page,
+        .keycode = ev->keycode,
+        .modifiers = modifiers,
+        .timestamp = ev->timestamp,
+    };
+    if (!keystroke_ring_push(&input_ring, &event)) {
+        LOG_WRN("Keystroke ring full. Dropping key 0x%02X; current short will be reset.", ev->keycode);
+    }
+    k_work_submit_to_queue(&input_work_q, &input_work);
+#else
+    process_key_press(ev->usage_page, ev->keycode, modifiers, ev->timestamp);
+#endif
+
+    return ZMK_EV_EVENT_BUBBLE; // Allow other event listeners to process this key event.
+}
+
+
+/**
+ * @brief Looks up the current short code and starts its expansion.
+ *
+ * Must only be called by the owner of the matcher state (see process_key_press()).
+ *
+ * @param source What triggered the lookup. A short code without an expansion is reset, except
+ * after a pause, so the user can continue typing a longer short code.
+ * @param terminator Word-ending key that triggered the lookup, to be deleted and typed again
+ * after the expansion, or NULL for the behavior key and the idle timer.
+ *
+ * With CONFIG_ZMK_TEXT_EXPANDER_CANDIDATE_CYCLING, the behavior key expands the top candidate of
+ * a short code without an expansion of its own, and pressing it right after an expansion, with
+ * nothing typed in between, replaces that with the next candidate. Terminators and the idle timer
+ * only expand exact short codes, so ordinary words that happen to start a short code are left as
+ * typed.
+ *
+ * @return ZMK_BEHAVIOR_OPAQUE if an expansion was attempted, ZMK_BEHAVIOR_TRANSPARENT otherwise.
+ */
+static int text_expander_trigger(enum trigger_source source, const struct expansion_terminator *terminator) {
+    // The matcher state belongs to this thread, so only the dictionary lookup needs protection.
+    // In shadow build mode a published generation is never modified, so pinning it is enough;
+    // otherwise the mutex keeps writers out during the lookup.
+    sync_matcher_generation();
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_CANDIDATE_CYCLING)
+    const bool candidates = source == TRIGGER_BEHAVIOR; // Only the behavior key looks beyond exact matches.
+    bool cycling = candidates && expander_data.current_short_len == 0 && candidate_cycle.active;
+#else
+    const bool cycling = false;
+#endif
+
+    // If there's something in the short code buffer, or an expansion to move on from.
+    if (expander_data.current_short_len > 0 || cycling) {
+        // The expansion engine operates asynchronously and texts may be longer than any buffer,
+        // so it gets a reference to the text and reads it chunk by chunk while typing. The
+        // version taken before the lookup lets it notice if the text changes in the meantime.
+        struct text_expander_text_ref ref = {.origin = TEXT_EXPANDER_ORIGIN_RUNTIME};
+        bool found = false;
+
+        if (!IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SHADOW_BUILD)) {
+            // Every update holds the mutex, and a batch (journal replay, serial upload) holds it
+            // until it commits. Terminators need shadow build mode, so only the behavior key and
+            // the idle timer get here. The idle timer runs on the system work queue and must not
+            // stall it; it gives up and keeps the short code, which a later trigger can expand.
+            k_timeout_t timeout = source == TRIGGER_BEHAVIOR ? K_FOREVER : K_NO_WAIT;
+            if (k_mutex_lock(&expander_data.mutex, timeout) != 0) {
+                LOG_DBG("Dictionary busy, not expanding '%s'.", expander_data.current_short);
+                return ZMK_BEHAVIOR_TRANSPARENT;
+            }
+        }
+        ref.version = atomic_get(&expander_data.text_version);
+        uint8_t pool_index;
+        struct trie_node *root = text_expander_read_begin(&pool_index);
+        // Try to find an expansion for the current short code, or when the behavior key is pressed
+        // with CONFIG_ZMK_TEXT_EXPANDER_UNIQUE_PREFIX, for the only short code it is a prefix of.
+        const void *image = NULL;
+        const char *key = expander_data.current_short;
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_CANDIDATE_CYCLING)
+        // When cycling, the candidates are still those of the short code typed before.
+        char candidate[MAX_SHORT_LEN];
+        const char *expanded_ptr;
+        if (candidates) {
+            expanded_ptr = find_candidate_expansion(root, cycling ? candidate_cycle.prefix : key,
+                                                    cycling ? candidate_cycle.code : NULL, &ref, &image,
+                                                    candidate);
+            key = candidate;
+        } else {
+            expanded_ptr = find_any_expansion(root, key, &ref, &image);
+        }
+#else
+        const char *expanded_ptr = find_any_expansion(root, key, &ref, &image);
+#endif
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_UNIQUE_PREFIX)
+        // Terminators and the idle timer fire on ordinary words too, which must stay as typed.
+        char completion[MAX_SHORT_LEN];
+        if (!expanded_ptr && source == TRIGGER_BEHAVIOR && find_unique_completion(root, key, &image, completion)) {
+            LOG_DBG("'%s' is a prefix of '%s' only.", key, completion);
+            key = completion;
+            expanded_ptr = find_any_expansion(root, key, &ref, &image);
+        }
+#endif
+        // Image texts may be compressed; the engine decodes them with a copy of the token table.
+        const struct text_codec_table *tokens = NULL;
+        if (expanded_ptr) {
+            strncpy(ref.short_code, key, sizeof(ref.short_code) - 1);
+            ref.short_code[sizeof(ref.short_code) - 1] = '\0'; // Ensure null termination.
+            found = true;
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_IMAGE_COMPRESSION)
+            if (ref.origin == TEXT_EXPANDER_ORIGIN_IMAGE) {
+                trie_image_get_tokens(image, &trigger_tokens);
+                tokens = &trigger_tokens;
+            }
+#endif
+        }
+        image_read_end(image);
+        text_expander_read_end(pool_index);
+        if (!IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SHADOW_BUILD)) {
+            k_mutex_unlock(&expander_data.mutex);
+        }
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_CANDIDATE_CYCLING)
+        if (cycling) {
+            if (!found || strcmp(ref.short_code, candidate_cycle.code) == 0) {
+                LOG_DBG("No other candidate for '%s'.", candidate_cycle.prefix);
+                return ZMK_BEHAVIOR_OPAQUE;
+            }
+            LOG_DBG("Replacing '%s' with candidate '%s'", candidate_cycle.code, ref.short_code);
+            int ret = replace_expansion(ref.short_code, &ref, tokens);
+            if (ret < 0) {
+                LOG_ERR("Failed to replace expansion: %d", ret);
+                // The engine dropped what it typed, so there is nothing left to cycle through.
+                memset(&candidate_cycle, 0, sizeof(candidate_cycle));
+                return ZMK_BEHAVIOR_OPAQUE;
+            }
+            strcpy(candidate_cycle.code, ref.short_code);
+            return ZMK_BEHAVIOR_OPAQUE;
+        }
+#endif
 
+        if (found) { // Expansion found!
+            // Copy the short code as well, since reset_current_short() clears it.
+            char short_copy[MAX_SHORT_LEN];
             strncpy(short_copy, expander_data.current_short, sizeof(short_copy) - 1);
             short_copy[sizeof(short_copy) - 1] = '\0'; // Ensure null termination.
 
             uint8_t len_to_delete = expander_data.current_short_len; // Store length before reset.
+            uint32_t word_delete = 0; // Delete the short code with backspaces unless it is a whole word.
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_WORD_DELETE)
+            word_delete = word_delete_modifier(len_to_delete);
+            at_word_start = false; // The cursor ends up after the expanded text.
+#endif
 
             reset_current_short(); // Reset the buffer immediately after deciding to expand.
-            k_mutex_unlock(&expander_data.mutex); // Unlock BEFORE starting the expansion engine,
-                                                  // as the engine itself might need to log or interact
-                                                  // with systems that could try to acquire this mutex later.
 
-            LOG_DBG("Attempting to expand '%s' to '%s' (delete %d chars)", short_copy, expanded_copy, len_to_delete);
+            LOG_DBG("Attempting to expand '%s' (delete %d chars)", short_copy, len_to_delete);
             // Start the asynchronous expansion process.
-            int ret = start_expansion(short_copy, expanded_copy, len_to_delete);
+            int ret = start_expansion(short_copy, &ref, len_to_delete, tokens, terminator, word_delete);
             if (ret < 0) {
                 LOG_ERR("Failed to start expansion: %d", ret);
-                // Mutex is already unlocked.
                 // Even on failure to start, we consider the event "handled" (opaque)
                 // because an action related to the behavior was attempted.
                 return ZMK_BEHAVIOR_OPAQUE;
             }
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_CANDIDATE_CYCLING)
+            candidate_cycle.active = true;
+            strcpy(candidate_cycle.prefix, short_copy);
+            strcpy(candidate_cycle.code, ref.short_code);
+#endif
             return ZMK_BEHAVIOR_OPAQUE; // Expansion started, consume the event.
-        } else {
+        } else if (source != TRIGGER_IDLE) {
             // No expansion found for the current short code.
             LOG_DBG("No expansion found for '%s'. Resetting short code.", expander_data.current_short);
             reset_current_short(); // Reset the buffer.
@@ -435,13 +2018,69 @@ static int text_expander_keymap_binding_pressed(struct zmk_behavior_binding *bin
         LOG_DBG("No current short code to expand.");
     }
 
-    k_mutex_unlock(&expander_data.mutex);
     // If no expansion was found or buffer was empty, the behavior key press doesn't "do" anything
     // other than potentially reset an invalid short code (which is a side effect).
     // Treat as transparent so the underlying key (if any) can act.
     return ZMK_BEHAVIOR_TRANSPARENT; 
 }
 
+/**
+ * @brief Behavior action called when the key assigned to this behavior is pressed.
+ *
+ * This function attempts to find an expansion for the `current_short` code.
+ * If found, it initiates the expansion process (backspacing the short code, then typing
+ * the expanded text). If not found, or if `current_short` is empty, it resets `current_short`.
+ *
+ * @param binding Pointer to the behavior binding data.
+ * @param binding_event Event data for the binding.
+ * @return ZMK_BEHAVIOR_OPAQUE if an expansion was attempted (consumes the event).
+ * @return ZMK_BEHAVIOR_TRANSPARENT if no action was taken (e.g., current_short was empty).
+ */
+static int text_expander_keymap_binding_pressed(struct zmk_behavior_binding *binding,
+                                                struct zmk_behavior_binding_event binding_event) {
+    LOG_DBG("Text expander behavior &%s triggered.", binding->behavior_dev);
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_DEFERRED_INPUT)
+    // Take over the matcher state from the input worker and apply every key press that was
+    // queued before this trigger, so the lookup sees exactly what the user typed.
+    k_mutex_lock(&input_consumer_mutex, K_FOREVER);
+    drain_pending_keystrokes();
+    int result = text_expander_trigger(TRIGGER_BEHAVIOR, NULL);
+    k_mutex_unlock(&input_consumer_mutex);
+    return result;
+#else
+    return text_expander_trigger(TRIGGER_BEHAVIOR, NULL);
+#endif
+}
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_IDLE_TRIGGER)
+/**
+ * @brief Work handler for idle_work: expands the short code after a pause in typing.
+ *
+ * ZMK raises key events from the system work queue, which this item is submitted to as well, so
+ * without deferred input the handler owns the matcher state just like the listener. With
+ * CONFIG_ZMK_TEXT_EXPANDER_DEFERRED_INPUT it takes over from the input worker, as the behavior key
+ * does. A short code without an expansion is kept, since the user may still be typing it.
+ *
+ * @param work Pointer to idle_work.
+ */
+static void idle_work_handler(struct k_work *work) {
+    ARG_UNUSED(work);
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_DEFERRED_INPUT)
+    k_mutex_lock(&input_consumer_mutex, K_FOREVER);
+    drain_pending_keystrokes(); // A key press still in the ring disarms the timer.
+#endif
+    if (idle_armed) {
+        idle_armed = false;
+        LOG_DBG("Typing paused after '%s'.", expander_data.current_short);
+        text_expander_trigger(TRIGGER_IDLE, NULL);
+    }
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_DEFERRED_INPUT)
+    k_mutex_unlock(&input_consumer_mutex);
+#endif
+}
+#endif
+
 /**
  * @brief Behavior action called when the key assigned to this behavior is released.
  *
@@ -478,14 +2117,17 @@ static const struct behavior_driver_api text_expander_driver_api = {
  * @brief Loads text expansions from the device tree configuration.
  *
  * Iterates through child nodes of the text expander behavior node in the DTS,
- * extracting `short_code` and `expanded_text` properties and adding them
- * as expansions.
+ * extracting `short_code` and `expanded_text` properties and inserting them
+ * into the instance's own dictionary. Children marked as `fragment` go into the instance's
+ * fragment trie instead.
  *
  * @param config Pointer to the text_expander_config for this device instance,
  * containing the array of expansions from DTS.
- * @return The number of expansions successfully loaded.
+ * @param data Pointer to the instance data holding the dictionary to fill.
+ * @return The number of expansions (not counting fragments) successfully loaded.
  */
-static int load_expansions_from_config(const struct text_expander_config *config) {
+static int load_expansions_from_config(const struct text_expander_config *config,
+                                       struct text_expander_instance_data *data) {
     if (!config || !config->expansions || config->expansion_count == 0) {
         LOG_INF("No expansions defined in device tree configuration.");
         return 0; // No configuration provided or no expansions listed.
@@ -500,17 +2142,34 @@ static int load_expansions_from_config(const struct text_expander_config *config
             LOG_WRN("Skipping invalid expansion at index %zu (null short_code or expanded_text)", i);
             continue;
         }
-        // Defensive check for empty strings, although zmk_text_expander_add_expansion also checks this.
+        // Defensive check for empty strings, although validate_expansion also checks this.
         // An empty short_code or expanded_text is usually not intended.
         if (exp->short_code[0] == '\0' || exp->expanded_text[0] == '\0') {
             LOG_WRN("Skipping expansion with empty short_code or expanded_text at index %zu", i);
             continue;
         }
 
-        // Add the expansion using the public API function.
-        // This ensures all validation (length, characters) and trie insertion logic is applied.
-        int ret = zmk_text_expander_add_expansion(exp->short_code, exp->expanded_text);
-        if (ret == 0) { // Success.
+        // Apply the same validation (length, characters) as the public API.
+        // Fragments live in their own dictionary, so they can be referenced but never typed.
+        int ret = validate_expansion(exp->short_code, exp->expanded_text);
+        if (ret == 0) {
+            ret = validate_fragment_references(exp->short_code, exp->expanded_text,
+                                               text_expander_get_root(&expander_data), data);
+        }
+        if (ret == 0) {
+            // The text is a device tree string constant, so the dictionary can point at it
+            // directly instead of copying it into RAM.
+            ret = text_dict_insert(exp->fragment ? data->fragments : data->dict,
+                                   exp->short_code, exp->expanded_text);
+            if (ret == 1) {
+                LOG_WRN("Duplicate short code '%s' in device tree. The last definition wins.", exp->short_code);
+                continue;
+            }
+        }
+        if (ret == 0 && exp->fragment) {
+            data->fragment_count++;
+            LOG_DBG("Loaded fragment from DT: '%s' -> '%s'", exp->short_code, exp->expanded_text);
+        } else if (ret == 0) { // Success.
             loaded_count++;
             LOG_DBG("Loaded expansion from DT: '%s' -> '%s'", exp->short_code, exp->expanded_text);
         } else { // Failed to add.
@@ -523,13 +2182,303 @@ static int load_expansions_from_config(const struct text_expander_config *config
     return loaded_count;
 }
 
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_BENCHMARK)
+static void benchmark_runtime(void);
+#endif
+
+/**
+ * @brief Initializes the global resources shared by all behavior instances.
+ *
+ * Sets up the runtime dictionary (mutex, memory pools, trie root), the matcher state and
+ * the workers.
+ *
+ * @return 0 on success, or -ENOMEM if the runtime trie root could not be allocated.
+ */
+static int text_expander_global_init(void) {
+    k_mutex_init(&expander_data.mutex); // Initialize the mutex first.
+
+    // Initialize memory pool usage counters and other global data.
+    for (int i = 0; i < TEXT_EXPANDER_POOL_COUNT; i++) {
+        struct text_expander_pool *pool = &expander_data.pools[i];
+        pool->node_pool = runtime_node_pool[i];
+        pool->node_pool_size = ARRAY_SIZE(runtime_node_pool[i]);
+        pool->text_pool = runtime_text_pool[i];
+        pool->text_pool_size = sizeof(runtime_text_pool[i]);
+        pool->text_buckets = runtime_text_buckets[i];
+        pool->text_bucket_count = ARRAY_SIZE(runtime_text_buckets[i]);
+        trie_reset_pool(pool);
+        atomic_set(&pool->readers, 0);
+    }
+    expander_data.live_pool = 0;
+    expander_data.batch_active = false;
+    expander_data.expansion_count = 0;
+    memset(expander_data.current_short, 0, MAX_SHORT_LEN); // Clear current short buffer.
+    expander_data.current_short_len = 0;
+
+    atomic_set(&expander_data.generation, 0);
+    atomic_set(&expander_data.text_version, 0);
+    expander_data.matcher_generation = 0;
+
+    // Allocate the root node for the trie from our pool.
+    struct trie_node *root = trie_allocate_node(&expander_data.pools[expander_data.live_pool]);
+    if (!root) {
+        LOG_ERR("Failed to allocate root trie node during initialization!");
+        return -ENOMEM; // Cannot proceed without a trie root.
+    }
+    atomic_ptr_set(&expander_data.root, root); // Publish the root to lock-free readers.
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_DEFERRED_INPUT)
+    // Start the low-priority worker that applies queued key presses to the matcher state.
+    k_mutex_init(&input_consumer_mutex);
+    k_work_init(&input_work, input_work_handler);
+    k_work_queue_init(&input_work_q);
+    const struct k_work_queue_config input_work_q_config = {.name = "text_expander_input"};
+    k_work_queue_start(&input_work_q, input_work_q_stack, K_THREAD_STACK_SIZEOF(input_work_q_stack),
+                       CONFIG_ZMK_TEXT_EXPANDER_INPUT_THREAD_PRIORITY, &input_work_q_config);
+#endif
+
+    // Initialize the delayable work item for the expansion engine.
+    // get_expansion_work_item() returns a pointer to the static work item in expansion_engine.c.
+    struct expansion_work *work_item = get_expansion_work_item(); 
+    if (work_item) {
+        // expansion_work_handler is the function that will be called when the work is processed.
+        k_work_init_delayable(&work_item->work, expansion_work_handler);
+    } else {
+        // This should ideally not happen if get_expansion_work_item always returns a valid static item.
+        LOG_ERR("Failed to get expansion work item for initialization!");
+        // Depending on how critical this is, could return an error.
+    }
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_IDLE_TRIGGER)
+    k_work_init_delayable(&idle_work, idle_work_handler);
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_WORD_DELETE)
+    for (size_t i = 0; i < ARRAY_SIZE(endpoint_hosts); i++) {
+        atomic_set(&endpoint_hosts[i], WORD_DELETE_DEFAULT_HOST);
+    }
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_TERMINATORS)
+    // Terminators are matched by key, so both characters of a key (e.g. ';' and ':') end a word.
+    for (const char *c = CONFIG_ZMK_TEXT_EXPANDER_TERMINATOR_CHARS; *c != '\0'; c++) {
+        bool needs_shift;
+        add_terminator(char_to_keycode(*c, &needs_shift), "CONFIG_ZMK_TEXT_EXPANDER_TERMINATOR_CHARS");
+    }
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_IMAGE)
+    // The image is read in place through memory-mapped flash, so no driver is needed yet.
+    zmk_text_expander_reload_image();
+#endif
+
+    LOG_INF("Text expander global resources initialized. Runtime pools: %zu nodes, %zu bytes of text.",
+            expander_data.pools[0].node_pool_size, expander_data.pools[0].text_pool_size);
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_BENCHMARK)
+    benchmark_runtime();
+#endif
+    return 0;
+}
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_BENCHMARK)
+// Passes over a dictionary per measurement, so the total is far above the resolution of the
+// cycle counter (a 32 kHz RTC on some SoCs).
+#define BENCHMARK_ROUNDS 16
+
+/**
+ * @brief State of a benchmark pass over a dictionary.
+ */
+struct benchmark_state {
+    const struct text_dict *dict; // Dictionary being measured.
+    bool replay;                  // False for the baseline pass, which only walks the entries.
+    size_t key_presses;           // Characters replayed so far.
+    size_t misses;                // Short codes the replay did not find; should stay 0.
+};
+
+/**
+ * @brief Replays one short code the way the listener and the trigger see it: a prefix step per
+ * key press, then a lookup of the whole short code.
+ */
+static int benchmark_visit(const char *key, const char *text, void *user_data) {
+    struct benchmark_state *state = user_data;
+    struct text_dict_cursor cursor;
+
+    state->key_presses += strlen(key);
+    if (!state->replay) {
+        return 0;
+    }
+    text_dict_prefix_start(state->dict, &cursor);
+    for (const char *p = key; *p != '\0'; p++) {
+        text_dict_prefix_step(state->dict, &cursor, *p);
+    }
+    if (!text_dict_lookup(state->dict, key)) {
+        state->misses++;
+    }
+    return 0;
+}
+
+/**
+ * @brief Times BENCHMARK_ROUNDS passes over a dictionary.
+ */
+static uint32_t benchmark_pass(struct benchmark_state *state) {
+    uint32_t start = k_cycle_get_32();
+    for (int i = 0; i < BENCHMARK_ROUNDS; i++) {
+        text_dict_for_each(state->dict, benchmark_visit, state);
+    }
+    return k_cycle_get_32() - start;
+}
+
+/**
+ * @brief Logs the average cost of a key press on an instance's dictionary.
+ *
+ * The cost of walking the entries is measured separately and subtracted, so only the prefix
+ * steps and lookups the matcher performs are counted.
+ */
+static void benchmark_instance(const struct device *dev) {
+    const struct text_expander_instance_data *data = dev->data;
+    struct benchmark_state baseline = {.dict = data->dict, .replay = false};
+    struct benchmark_state replay = {.dict = data->dict, .replay = true};
+
+    uint32_t walk_cycles = benchmark_pass(&baseline);
+    uint32_t total_cycles = benchmark_pass(&replay);
+    if (replay.key_presses == 0) {
+        return;
+    }
+    uint32_t cycles = total_cycles > walk_cycles ? total_cycles - walk_cycles : 0;
+    LOG_INF("Benchmark %s (%s): %d expansions, %u ns per key press over %zu key presses, %zu misses.",
+            dev->name, data->dict->api->name, data->expansion_count,
+            (uint32_t)(k_cyc_to_ns_floor64(cycles) / replay.key_presses), replay.key_presses,
+            replay.misses / BENCHMARK_ROUNDS);
+}
+
+// Width of the generated runtime short codes, and how many distinct ones that allows.
+#define BENCHMARK_KEY_LEN MIN(4, MAX_SHORT_LEN - 1)
+// Runtime updates are timed per quarter of the dictionary, so a cost that grows with the
+// number of stored expansions shows up as rising numbers.
+#define BENCHMARK_SLICES 4
+
+/**
+ * @brief Generates the short code of the i-th runtime benchmark expansion.
+ *
+ * Consecutive short codes share prefixes, like the words of a real dictionary.
+ */
+static void benchmark_key(uint32_t i, char *key) {
+    static const char digits[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+
+    for (int d = BENCHMARK_KEY_LEN - 1; d >= 0; d--) {
+        key[d] = digits[i % 36];
+        i /= 36;
+    }
+    key[BENCHMARK_KEY_LEN] = '\0';
+}
+
+/**
+ * @brief Generates the text of a runtime benchmark expansion.
+ *
+ * Texts have the average length the pools are budgeted for and end with their short code,
+ * so no two of them share storage.
+ */
+static void benchmark_text(const char *key, char *text) {
+    size_t len = MAX(RUNTIME_AVG_TEXT_LEN, BENCHMARK_KEY_LEN);
+
+    memset(text, 'x', len - BENCHMARK_KEY_LEN);
+    memcpy(text + len - BENCHMARK_KEY_LEN, key, BENCHMARK_KEY_LEN + 1);
+}
+
+/**
+ * @brief Logs the average cost of one slice of runtime updates.
+ */
+static void benchmark_log_slice(const char *what, uint32_t first, uint32_t last, uint32_t cycles) {
+    if (last > first) {
+        LOG_INF("Benchmark runtime: %s %u-%u: %u ns each.", what, first + 1, last,
+                (uint32_t)(k_cyc_to_ns_floor64(cycles) / (last - first)));
+    }
+}
+
+/**
+ * @brief Fills the (empty) runtime dictionary through the public API and logs the costs.
+ *
+ * Adds generated expansions one at a time until MAX_EXPANSIONS or the pools are full, then
+ * looks each of them up the way the trigger does, and removes them again one at a time. Each
+ * add and remove is a complete update, including the shadow generation in shadow build mode.
+ * Runs before the journal is replayed, so nothing is persisted.
+ */
+static void benchmark_runtime(void) {
+    static char text[MAX_TEXT_LEN];
+    char key[MAX_SHORT_LEN];
+    struct zmk_text_expander_memory_stats stats;
+    uint32_t keys = 1;
+    uint32_t added = 0;
+
+    if (expander_data.expansion_count != 0) {
+        return;
+    }
+    for (int i = 0; i < BENCHMARK_KEY_LEN; i++) {
+        keys *= 36;
+    }
+    uint32_t count = MIN(MAX_EXPANSIONS, keys);
+
+    bool full = false;
+    for (int slice = 0; slice < BENCHMARK_SLICES && !full; slice++) {
+        uint32_t first = added;
+        uint32_t last = count * (slice + 1) / BENCHMARK_SLICES;
+        uint32_t start = k_cycle_get_32();
+        for (; added < last; added++) {
+            benchmark_key(added, key);
+            benchmark_text(key, text);
+            if (zmk_text_expander_add_expansion(key, text) < 0) {
+                LOG_WRN("Benchmark runtime: pools full after %u expansions.", added);
+                full = true;
+                break;
+            }
+        }
+        benchmark_log_slice("adds", first, added, k_cycle_get_32() - start);
+    }
+
+    zmk_text_expander_get_memory_stats(&stats);
+    LOG_INF("Benchmark runtime: %u expansions use %zu of %zu nodes and %zu of %zu text bytes.",
+            added, stats.nodes.live, stats.nodes.capacity, stats.text.used, stats.text.capacity);
+
+    uint32_t misses = 0;
+    uint32_t start = k_cycle_get_32();
+    for (int round = 0; round < BENCHMARK_ROUNDS; round++) {
+        for (uint32_t i = 0; i < added; i++) {
+            uint8_t pool_index;
+            benchmark_key(i, key);
+            struct trie_node *root = text_expander_read_begin(&pool_index);
+            misses += find_expansion(root, key) == NULL;
+            text_expander_read_end(pool_index);
+        }
+    }
+    if (added > 0) {
+        LOG_INF("Benchmark runtime: %u ns per lookup, %u misses.",
+                (uint32_t)(k_cyc_to_ns_floor64(k_cycle_get_32() - start) / (added * BENCHMARK_ROUNDS)),
+                misses / BENCHMARK_ROUNDS);
+    }
+
+    uint32_t removed = 0;
+    for (int slice = 0; slice < BENCHMARK_SLICES; slice++) {
+        uint32_t first = removed;
+        uint32_t last = added * (slice + 1) / BENCHMARK_SLICES;
+        start = k_cycle_get_32();
+        for (; removed < last; removed++) {
+            benchmark_key(removed, key);
+            zmk_text_expander_remove_expansion(key);
+        }
+        benchmark_log_slice("removes", first, removed, k_cycle_get_32() - start);
+    }
+    zmk_text_expander_clear_all();
+}
+#endif // IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_BENCHMARK)
+
 /**
  * @brief Initialization function for the text expander behavior device.
  *
  * This function is called by Zephyr when the device driver for this behavior is initialized.
  * It performs one-time global initialization for the text expander system (like setting up
- * the trie, mutex, and memory pools) and then loads any expansions defined in the
- * device tree for this specific instance.
+ * the runtime trie, mutex, and memory pools) and then builds this instance's own dictionary
+ * from the expansions defined in its device tree children.
  *
  * @param dev Pointer to the device structure for this behavior instance.
  * @return 0 on success, or a negative error code if initialization fails.
@@ -537,72 +2486,87 @@ static int load_expansions_from_config(const struct text_expander_config *config
 static int text_expander_init(const struct device *dev) {
     // Get the configuration data for this device instance (contains DTS expansions).
     const struct text_expander_config *config = dev->config;
+    struct text_expander_instance_data *data = dev->data;
 
     // --- Global Initialization (once per system) ---
     if (!zmk_text_expander_global_initialized) {
-        k_mutex_init(&expander_data.mutex); // Initialize the mutex first.
-
-        // Initialize memory pool usage counters and other global data.
-        expander_data.node_pool_used = 0;
-        expander_data.text_pool_used = 0;
-        expander_data.expansion_count = 0;
-        memset(expander_data.current_short, 0, MAX_SHORT_LEN); // Clear current short buffer.
-        expander_data.current_short_len = 0;
-
-        // Allocate the root node for the trie from our pool.
-        expander_data.root = trie_allocate_node(&expander_data);
-        if (!expander_data.root) {
-            LOG_ERR("Failed to allocate root trie node during initialization!");
-            return -ENOMEM; // Cannot proceed without a trie root.
-        }
-        
-        // Initialize the delayable work item for the expansion engine.
-        // get_expansion_work_item() returns a pointer to the static work item in expansion_engine.c.
-        struct expansion_work *work_item = get_expansion_work_item(); 
-        if (work_item) {
-            // expansion_work_handler is the function that will be called when the work is processed.
-            k_work_init_delayable(&work_item->work, expansion_work_handler);
-        } else {
-            // This should ideally not happen if get_expansion_work_item always returns a valid static item.
-            LOG_ERR("Failed to get expansion work item for initialization!");
-            // Depending on how critical this is, could return an error.
-        }
-
-        // Load expansions defined in the device tree for THIS instance.
-        // Note: If multiple DT nodes use this behavior, this load_expansions_from_config
-        // will be called for each, but they all add to the same global trie.
-        int loaded_count = load_expansions_from_config(config);
-        
-        // Optional: Add a default expansion if no expansions were loaded from DT.
-        // This can be useful for testing or providing a basic example.
-        // Check both loaded_count (from current DT instance) and expander_data.expansion_count (total in trie).
-        if (loaded_count == 0 && expander_data.expansion_count == 0) { 
-            LOG_INF("No expansions loaded from any DT source. Adding default 'exp' -> 'expanded'.");
-            int ret = zmk_text_expander_add_expansion("exp", "expanded");
-            if (ret != 0) {
-                LOG_ERR("Failed to add default expansion 'exp': %d", ret);
-            }
+        int ret = text_expander_global_init();
+        if (ret < 0) {
+            return ret;
         }
-
-        LOG_INF("Text expander global resources initialized. Total expansions currently: %d.", expander_data.expansion_count);
-        LOG_INF("Trie memory usage: %d nodes used (out of %zu max pool size), %d bytes for text storage (out of %zu max pool size).",
-                expander_data.node_pool_used, ARRAY_SIZE(expander_data.node_pool), // ARRAY_SIZE gives total elements in pool
-                expander_data.text_pool_used, sizeof(expander_data.text_pool));   // sizeof gives total bytes in pool
-
         zmk_text_expander_global_initialized = true; // Mark global init as complete.
-    } else {
-        // If global init was already done by another instance, we still might want to load
-        // expansions specific to *this* device tree instance if the design supported per-instance
-        // configurations that add to the global set.
-        // The current `load_expansions_from_config(config)` call here will attempt to load
-        // expansions from the current `dev->config`.
-        LOG_DBG("Text expander global resources already initialized. Processing config for instance: %s", dev->name);
-        load_expansions_from_config(config); // Load expansions for this specific instance.
-                                             // They will be added to the already initialized global trie.
-        LOG_INF("After processing instance %s, total expansions: %d.", dev->name, expander_data.expansion_count);
+    }
+
+    // --- Per-instance dictionary ---
+    data->fragment_count = 0;
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SORTED_DICT)
+    size_t expansion_capacity = config->expansion_count - config->fragment_capacity;
+    text_dict_sorted_init(&data->dict_backend, config->dict_keys, config->dict_texts, expansion_capacity);
+    text_dict_sorted_init(&data->fragment_backend, config->dict_keys + expansion_capacity,
+                          config->dict_texts + expansion_capacity, config->fragment_capacity);
+#elif IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_PERFECT_HASH)
+    text_dict_hash_init(&data->dict_backend, config->hash, config->expansions, config->expansion_count);
+    text_dict_hash_init(&data->fragment_backend, config->fragment_hash, config->expansions,
+                        config->expansion_count);
+#else
+    data->pool.node_pool = config->node_pool;
+    data->pool.node_pool_size = config->node_pool_size;
+    data->pool.text_pool = NULL; // Texts stay in flash (see trie_insert_static()).
+    data->pool.text_pool_size = 0;
+    data->pool.text_buckets = NULL;
+    data->pool.text_bucket_count = 0;
+    trie_reset_pool(&data->pool);
+    if (text_dict_trie_init(&data->dict_backend, &data->pool) < 0 ||
+        text_dict_trie_init(&data->fragment_backend, &data->pool) < 0) {
+        LOG_ERR("Failed to allocate root trie node for instance %s!", dev->name);
+        return -ENOMEM;
+    }
+#endif
+    data->dict = &data->dict_backend.dict;
+    data->fragments = &data->fragment_backend.dict;
+
+    int loaded_count = load_expansions_from_config(config, data);
+    data->expansion_count = loaded_count;
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_TERMINATORS)
+    // Terminators apply globally, whichever instance names them. Keymap key codes carry the
+    // usage page in bits 16-23 (ZMK_HID_USAGE()); plain keyboard usage IDs are accepted as well.
+    for (size_t i = 0; i < config->terminator_count; i++) {
+        uint32_t usage = config->terminators[i];
+        uint8_t page = (usage >> 16) & 0xFF;
+        add_terminator(page == 0 || page == HID_USAGE_KEY ? usage & 0xFFFF : 0, dev->name);
+    }
+#endif
+
+    // The dictionary is complete and will not change anymore; make it visible to the
+    // listener and the trigger.
+    if (instance_device_count < ARRAY_SIZE(instance_devices)) {
+        instance_devices[instance_device_count] = dev;
+        barrier_dmem_fence_full();
+        instance_device_count++;
+    }
 
+    // Optional: Add a default expansion if the first instance defines no expansions.
+    // This can be useful for testing or providing a basic example.
+    if (instance_device_count == 1 && loaded_count == 0 && expander_data.expansion_count == 0) {
+        LOG_INF("No expansions loaded from any DT source. Adding default 'exp' -> 'expanded'.");
+        int ret = zmk_text_expander_add_expansion("exp", "expanded");
+        if (ret != 0) {
+            LOG_ERR("Failed to add default expansion 'exp': %d", ret);
+        }
     }
 
+    struct text_dict_stats stats, fragment_stats;
+    text_dict_stats(data->dict, &stats);
+    text_dict_stats(data->fragments, &fragment_stats);
+    LOG_INF("Instance %s: %d expansions and %d fragments on %s. Dictionary (%s): %zu bytes, texts in flash.",
+            dev->name, data->expansion_count, data->fragment_count,
+            config->layer_count ? "selected layers" : "all layers",
+            data->dict->api->name, stats.bytes + fragment_stats.bytes);
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_BENCHMARK)
+    benchmark_instance(dev);
+#endif
+
     LOG_DBG("Text expander instance initialized: %s (driver %p, config %p, data %p)", 
             dev->name, dev->api, dev->config, dev->data);
     return 0; // Success.
@@ -617,8 +2581,46 @@ static int text_expander_init(const struct device *dev) {
     { \
         .short_code = DT_PROP_OR(node_id, short_code, ""), \
         .expanded_text = DT_PROP_OR(node_id, expanded_text, ""), \
+        .fragment = DT_PROP(node_id, fragment), \
     },
 
+// Trie nodes taken by the dictionaries of instance `n`: the roots of its expansion and fragment
+// tries plus one per distinct prefix of their short codes, counted by scripts/trie_node_count.py.
+#define TEXT_EXPANDER_NODE_COUNT(n) UTIL_CAT(TEXT_EXPANDER_NODE_COUNT_, DT_INST_DEP_ORD(n))
+
+// Macro counting one child if it is a fragment (see TEXT_EXPANDER_FRAGMENT_COUNT).
+#define TEXT_EXPANDER_CHILD_FRAGMENT_COUNT(node_id) + DT_PROP(node_id, fragment)
+
+// Number of fragments among the children of instance `n`.
+#define TEXT_EXPANDER_FRAGMENT_COUNT(n) (0 DT_INST_FOREACH_CHILD(n, TEXT_EXPANDER_CHILD_FRAGMENT_COUNT))
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SORTED_DICT)
+// Sorted key and text arrays for instance `n`, one entry per child (at least one, so the arrays
+// are never empty). Fragments take the entries after the expansions.
+#define TEXT_EXPANDER_INST_STORAGE(n)                                                           \
+    static uint64_t text_expander_keys_##n[MAX(ARRAY_SIZE(text_expander_expansions_##n), 1)];   \
+    static const char *text_expander_texts_##n[ARRAY_SIZE(text_expander_keys_##n)];
+#define TEXT_EXPANDER_INST_STORAGE_CONFIG(n)                                                    \
+    .dict_keys = text_expander_keys_##n,                                                        \
+    .dict_texts = text_expander_texts_##n,                                                      \
+    .fragment_capacity = TEXT_EXPANDER_FRAGMENT_COUNT(n),
+#elif IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_PERFECT_HASH)
+// Instance `n` needs no RAM for its dictionary: the generated hash tables are named after its
+// dependency ordinal.
+#define TEXT_EXPANDER_INST_STORAGE(n)
+#define TEXT_EXPANDER_INST_STORAGE_CONFIG(n)                                                    \
+    .hash = &UTIL_CAT(text_expander_hash_, DT_INST_DEP_ORD(n)),                                 \
+    .fragment_hash = &UTIL_CAT(text_expander_fragment_hash_, DT_INST_DEP_ORD(n)),
+#else
+// Node pool for instance `n`'s own dictionary, sized at build time to exactly the nodes its
+// children take rather than from the configured maximum length.
+#define TEXT_EXPANDER_INST_STORAGE(n)                                                           \
+    static struct trie_node text_expander_node_pool_##n[TEXT_EXPANDER_NODE_COUNT(n)];
+#define TEXT_EXPANDER_INST_STORAGE_CONFIG(n)                                                    \
+    .node_pool = text_expander_node_pool_##n,                                                   \
+    .node_pool_size = ARRAY_SIZE(text_expander_node_pool_##n),
+#endif
+
 // Macro to define a text expander behavior device instance.
 // This is used by DT_INST_FOREACH_STATUS_OKAY to create C structures and
 // register the driver for each enabled instance in the device tree.
@@ -629,21 +2631,37 @@ static int text_expander_init(const struct device *dev) {
     static const struct text_expander_expansion text_expander_expansions_##n[] = { \
         DT_INST_FOREACH_CHILD(n, TEXT_EXPANDER_EXPANSION) /* Iterate over child nodes of instance 'n' */ \
     };                                                                           \
-    /* Create the configuration structure for this instance, pointing to the array above. */ \
+    /* Counts are kept in 16 bits (see struct text_expander_instance_data). */ \
+    BUILD_ASSERT(ARRAY_SIZE(text_expander_expansions_##n) <= UINT16_MAX,        \
+                 "A text expander instance supports at most 65535 children");   \
+    /* Layers this instance's dictionary is bound to (the placeholder is unused if none). */ \
+    static const uint8_t text_expander_layers_##n[] = DT_INST_PROP_OR(n, layers, {0}); \
+    /* Extra terminator keys named by this instance (the placeholder is unused if none). */ \
+    static const uint32_t text_expander_terminators_##n[] = DT_INST_PROP_OR(n, terminators, {0}); \
+    /* Storage for this instance's own dictionary, sized from its children. */  \
+    TEXT_EXPANDER_INST_STORAGE(n)                                               \
+    /* Runtime data holding this instance's dictionary. */                       \
+    static struct text_expander_instance_data text_expander_data_##n;           \
+    /* Create the configuration structure for this instance, pointing to the arrays above. */ \
     static const struct text_expander_config text_expander_config_##n = {       \
         .expansions = text_expander_expansions_##n,                             \
         .expansion_count = ARRAY_SIZE(text_expander_expansions_##n), /* Number of expansions for this instance */ \
+        .layers = text_expander_layers_##n,                                     \
+        .layer_count = DT_INST_PROP_LEN_OR(n, layers, 0),                       \
+        .terminators = text_expander_terminators_##n,                           \
+        .terminator_count = DT_INST_PROP_LEN_OR(n, terminators, 0),             \
+        TEXT_EXPANDER_INST_STORAGE_CONFIG(n)                                    \
     };                                                                          \
     /* Define and register the behavior device instance using ZMK's BEHAVIOR_DT_INST_DEFINE. */ \
     /* - text_expander_init: Initialization function. */                         \
     /* - NULL: No power management function. */                                  \
-    /* - &expander_data: Pointer to the (shared) runtime data structure. */      \
+    /* - &text_expander_data_##n: Pointer to this instance's runtime data. */    \
     /* - &text_expander_config_##n: Pointer to this instance's configuration. */ \
     /* - POST_KERNEL: Initialization level. */                                   \
     /* - CONFIG_KERNEL_INIT_PRIORITY_DEFAULT: Initialization priority. */        \
     /* - &text_expander_driver_api: Pointer to the behavior's driver API. */     \
     BEHAVIOR_DT_INST_DEFINE(n, text_expander_init, NULL,                        \
-                            &expander_data, &text_expander_config_##n,          \
+                            &text_expander_data_##n, &text_expander_config_##n, \
                             POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT,   \
                             &text_expander_driver_api);
 
@@ -0,0 +1,582 @@
+#include <zephyr/kernel.h>             // For the journal work queue and BUILD_ASSERT.
+#include <zephyr/init.h>               // For SYS_INIT.
+#include <zephyr/logging/log.h>        // For Zephyr's logging API.
+#include <zephyr/storage/flash_map.h>  // For the flash area holding the journal.
+#include <zephyr/sys/crc.h>            // For crc32_ieee() record checksums.
+#include <zephyr/sys/util.h>           // For ROUND_UP and IS_POWER_OF_TWO.
+#include <string.h>                    // For memcpy, memset, strlen.
+#include <errno.h>                     // For error codes.
+
+#include <zmk/text_expander.h>           // Public API used to replay the journal.
+#include <zmk/text_expander_internals.h> // For expander_data, MAX_SHORT_LEN, MAX_TEXT_LEN.
+#include <zmk/text_expander_journal.h>   // Header for this module.
+#include <zmk/trie.h>                    // For trie_next_key() during compaction.
+
+LOG_MODULE_DECLARE(zmk_behavior_text_expander, CONFIG_ZMK_LOG_LEVEL);
+
+BUILD_ASSERT(DT_HAS_CHOSEN(zmk_text_expander_journal),
+             "CONFIG_ZMK_TEXT_EXPANDER_JOURNAL requires a zmk,text-expander-journal chosen partition");
+
+// Flash partition holding the journal. It is split into two banks of equal size.
+#define JOURNAL_PARTITION_ID DT_FIXED_PARTITION_ID(DT_CHOSEN(zmk_text_expander_journal))
+
+#define JOURNAL_MAGIC 0x54584a31 // "TXJ1": identifies a written bank header.
+#define JOURNAL_MAX_ALIGN 32     // Largest flash write block size supported.
+#define JOURNAL_FLUSH_ATTEMPTS 3 // Compactions tried in a row while updates keep overflowing.
+
+// Record types. The first byte of an erased record slot reads as the flash's erased value
+// (typically 0xff), which marks the end of the journal.
+enum journal_record_type {
+    JOURNAL_RECORD_ADD = 1,    // Add or update: short code followed by the expanded text.
+    JOURNAL_RECORD_REMOVE = 2, // Remove: short code only.
+    JOURNAL_RECORD_CLEAR = 3,  // Clear the whole runtime dictionary: no payload.
+};
+
+// Header written at the start of a bank once all of its initial records are in place.
+struct journal_bank_header {
+    uint32_t magic; // JOURNAL_MAGIC.
+    uint32_t seq;   // Incremented on every compaction; the valid bank with the highest seq is live.
+    uint32_t crc;   // crc32_ieee over magic and seq.
+};
+
+// Header of a journal record. The payload follows without terminators, and the whole record
+// is padded with the erased value to a multiple of the flash write block size.
+struct journal_record_header {
+    uint8_t type;       // enum journal_record_type.
+    uint8_t short_len;  // Length of the short code in the payload.
+    uint16_t text_len;  // Length of the expanded text in the payload.
+    uint32_t crc;       // crc32_ieee over the fields above and the payload.
+};
+
+// Largest padded record: header plus the longest short code and expanded text. The sizes
+// include terminators, which leaves room to terminate a decoded text in place.
+#define JOURNAL_RECORD_MAX_SIZE                                                                 \
+    ROUND_UP(sizeof(struct journal_record_header) + MAX_SHORT_LEN + MAX_TEXT_LEN, JOURNAL_MAX_ALIGN)
+
+BUILD_ASSERT(MAX_TEXT_LEN <= UINT16_MAX, "Expanded text length must fit the record header");
+
+// Flash geometry, set once at init.
+static const struct flash_area *journal_fa; // Open flash area, or NULL if the journal is unavailable.
+static size_t journal_align;                // Flash write block size.
+static uint8_t journal_erased_val;          // Value of an erased flash byte.
+static size_t journal_bank_size;            // Size of each of the two banks.
+
+// Flash state. Protected by journal_flush_mutex, which is held for the whole of a flush. Flash
+// is erased and written with only this mutex held, so readers and writers of the dictionary
+// never wait for flash. Lock order: journal_flush_mutex, then expander_data.mutex.
+static K_MUTEX_DEFINE(journal_flush_mutex);
+static uint8_t journal_active_bank;         // Bank that records are appended to.
+static uint32_t journal_seq;                // Sequence number of the active bank.
+static size_t journal_write_offset;         // Offset of the next record within the active bank.
+static uint8_t journal_compact_buf[JOURNAL_RECORD_MAX_SIZE]; // Record being written by a compaction.
+
+// Staging state. Protected by expander_data.mutex (see text_expander_journal.h).
+static bool journal_needs_compaction;       // Staged records can't be appended; rewrite from the live dictionary.
+static bool journal_replaying;              // Set while the journal itself drives the API at boot.
+
+// Records staged since the last flush, already padded to the write block size. A flush takes
+// the filled buffer and writes it to flash while new records are staged into the other one.
+static uint8_t journal_pending_bufs[2][CONFIG_ZMK_TEXT_EXPANDER_JOURNAL_BUFFER_SIZE];
+static uint8_t *journal_pending = journal_pending_bufs[0];
+static size_t journal_pending_len;
+
+// Scratch buffer used to encode a staged record and to decode records at boot.
+static uint8_t journal_record_buf[JOURNAL_RECORD_MAX_SIZE];
+
+// Flushes run on a dedicated low-priority work queue, so a flash erase never holds up the
+// system work queue, which the expansion engine and the idle trigger run on.
+K_THREAD_STACK_DEFINE(journal_work_q_stack, CONFIG_ZMK_TEXT_EXPANDER_JOURNAL_THREAD_STACK_SIZE);
+static struct k_work_q journal_work_q;
+
+static void journal_flush_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(journal_flush_work, journal_flush_work_handler);
+
+/**
+ * @brief Returns the size of the bank header area, padded to the write block size.
+ */
+static size_t journal_header_size(void) {
+    return ROUND_UP(sizeof(struct journal_bank_header), journal_align);
+}
+
+/**
+ * @brief Computes the checksum of a record header and its payload.
+ */
+static uint32_t journal_record_crc(const struct journal_record_header *hdr, const uint8_t *payload) {
+    uint32_t crc = crc32_ieee((const uint8_t *)hdr, offsetof(struct journal_record_header, crc));
+    return crc32_ieee_update(crc, payload, hdr->short_len + hdr->text_len);
+}
+
+/**
+ * @brief Encodes a record.
+ *
+ * @param buf Buffer of JOURNAL_RECORD_MAX_SIZE bytes to encode the record into.
+ * @param type The record type.
+ * @param short_code The short code, or NULL for JOURNAL_RECORD_CLEAR.
+ * @param expanded_text The expanded text, or NULL unless type is JOURNAL_RECORD_ADD.
+ * @return The padded size of the encoded record.
+ */
+static size_t journal_encode(uint8_t *buf, enum journal_record_type type, const char *short_code,
+                             const char *expanded_text) {
+    struct journal_record_header hdr = {
+        .type = type,
+        .short_len = short_code ? strlen(short_code) : 0,
+        .text_len = expanded_text ? strlen(expanded_text) : 0,
+    };
+    uint8_t *payload = buf + sizeof(hdr);
+
+    if (short_code) {
+        memcpy(payload, short_code, hdr.short_len);
+    }
+    if (expanded_text) {
+        memcpy(payload + hdr.short_len, expanded_text, hdr.text_len);
+    }
+    hdr.crc = journal_record_crc(&hdr, payload);
+    memcpy(buf, &hdr, sizeof(hdr));
+
+    size_t len = sizeof(hdr) + hdr.short_len + hdr.text_len;
+    size_t padded = ROUND_UP(len, journal_align);
+    memset(buf + len, journal_erased_val, padded - len);
+    return padded;
+}
+
+/**
+ * @brief Encodes the ADD record of the expansion following a short code in the live dictionary.
+ *
+ * Only holds the dictionary for one lookup: in shadow build mode the published generation is
+ * pinned, which never blocks anyone; otherwise the mutex is taken, as writers change the trie
+ * in place.
+ *
+ * @param key In/out: the previous short code ("" to start), replaced by the one encoded.
+ * @return The padded size of the record in journal_compact_buf, or 0 after the last expansion.
+ */
+static size_t journal_encode_next(char *key) {
+    size_t len = 0;
+
+    if (!IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SHADOW_BUILD)) {
+        k_mutex_lock(&expander_data.mutex, K_FOREVER);
+    }
+    uint8_t pool_index;
+    struct trie_node *root = text_expander_read_begin(&pool_index);
+    struct trie_node *node = trie_next_key(root, key, key, MAX_SHORT_LEN);
+    if (node) {
+        len = journal_encode(journal_compact_buf, JOURNAL_RECORD_ADD, key, trie_get_expanded_text(node));
+    }
+    text_expander_read_end(pool_index);
+    if (!IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SHADOW_BUILD)) {
+        k_mutex_unlock(&expander_data.mutex);
+    }
+    return len;
+}
+
+/**
+ * @brief Takes the records staged so far, for a flush to write.
+ *
+ * @param records Output: the staged records. Valid until the next call.
+ * @return Their size, or -EAGAIN if some were dropped since the last call (see journal_stage()).
+ */
+static int journal_take_pending(const uint8_t **records) {
+    k_mutex_lock(&expander_data.mutex, K_FOREVER);
+    int ret = journal_needs_compaction ? -EAGAIN : (int)journal_pending_len;
+    *records = journal_pending;
+    journal_pending = (journal_pending == journal_pending_bufs[0]) ? journal_pending_bufs[1]
+                                                                   : journal_pending_bufs[0];
+    journal_pending_len = 0;
+    k_mutex_unlock(&expander_data.mutex);
+    return ret;
+}
+
+/**
+ * @brief Rewrites the live runtime dictionary into the inactive bank and makes it active.
+ *
+ * The dictionary is walked one expansion at a time, so updates can go on during the walk; an
+ * expansion changed in the meantime may be written before or after its change. Every update
+ * made since the walk started was staged, though, so appending the staged records behind the
+ * walk brings the bank to the exact state at the last take. That take holds the mutex, so it
+ * never falls inside a batch. The bank header is written last, so a bank interrupted by a
+ * reset is never considered valid and the previous bank stays authoritative.
+ *
+ * Must be called with journal_flush_mutex held, right after journal_needs_compaction was
+ * cleared and the staged records dropped under expander_data.mutex.
+ *
+ * @return 0 on success, -EAGAIN if staged records were dropped during the walk, or another
+ * negative error code.
+ */
+static int journal_compact(void) {
+    uint8_t target = journal_active_bank ^ 1;
+    off_t bank_base = (off_t)target * journal_bank_size;
+    size_t offset = journal_header_size();
+
+    int ret = flash_area_erase(journal_fa, bank_base, journal_bank_size);
+    if (ret < 0) {
+        LOG_ERR("Failed to erase journal bank %u: %d", target, ret);
+        return ret;
+    }
+
+    char key[MAX_SHORT_LEN] = "";
+    size_t len;
+    while ((len = journal_encode_next(key)) > 0) {
+        if (offset + len > journal_bank_size) {
+            LOG_ERR("Runtime dictionary does not fit journal bank %u.", target);
+            return -ENOSPC;
+        }
+        ret = flash_area_write(journal_fa, bank_base + offset, journal_compact_buf, len);
+        if (ret < 0) {
+            LOG_ERR("Failed to compact journal into bank %u: %d", target, ret);
+            return ret;
+        }
+        offset += len;
+    }
+
+    // Catch up with the updates made during the walk, until none are left.
+    const uint8_t *records;
+    while ((ret = journal_take_pending(&records)) > 0) {
+        if (offset + ret > journal_bank_size) {
+            return -ENOSPC;
+        }
+        ret = flash_area_write(journal_fa, bank_base + offset, records, ret);
+        if (ret < 0) {
+            LOG_ERR("Failed to compact journal into bank %u: %d", target, ret);
+            return ret;
+        }
+        offset += ret;
+    }
+    if (ret < 0) {
+        return ret; // Updates were dropped; the walk has to start over.
+    }
+
+    uint8_t header_buf[ROUND_UP(sizeof(struct journal_bank_header), JOURNAL_MAX_ALIGN)];
+    struct journal_bank_header header = {.magic = JOURNAL_MAGIC, .seq = journal_seq + 1};
+    header.crc = crc32_ieee((const uint8_t *)&header, offsetof(struct journal_bank_header, crc));
+    memset(header_buf, journal_erased_val, sizeof(header_buf));
+    memcpy(header_buf, &header, sizeof(header));
+
+    ret = flash_area_write(journal_fa, bank_base, header_buf, journal_header_size());
+    if (ret < 0) {
+        LOG_ERR("Failed to write journal bank %u header: %d", target, ret);
+        return ret;
+    }
+
+    journal_active_bank = target;
+    journal_seq = header.seq;
+    journal_write_offset = offset;
+    LOG_INF("Compacted text expander journal into bank %u (%zu bytes, seq %u).",
+            target, offset, journal_seq);
+    return 0;
+}
+
+/**
+ * @brief Writes staged records to flash once, compacting first if they do not fit.
+ *
+ * Must be called with journal_flush_mutex held and expander_data.mutex not held.
+ *
+ * @return 0 on success, -EAGAIN if staged records were dropped meanwhile, or another negative
+ * error code.
+ */
+static int journal_flush_once(void) {
+    k_mutex_lock(&expander_data.mutex, K_FOREVER);
+    bool compact = journal_needs_compaction ||
+                   journal_write_offset + journal_pending_len > journal_bank_size;
+    if (compact) {
+        // The compaction covers everything staged so far.
+        journal_needs_compaction = false;
+        journal_pending_len = 0;
+    }
+    k_mutex_unlock(&expander_data.mutex);
+
+    if (compact) {
+        return journal_compact();
+    }
+
+    const uint8_t *records;
+    int ret = journal_take_pending(&records);
+    if (ret <= 0) {
+        return ret;
+    }
+
+    off_t bank_base = (off_t)journal_active_bank * journal_bank_size;
+    size_t len = ret;
+    ret = flash_area_write(journal_fa, bank_base + journal_write_offset, records, len);
+    if (ret < 0) {
+        // The slot may be partially written now; only a compaction can recover a clean tail.
+        LOG_ERR("Failed to append %zu bytes to the journal: %d", len, ret);
+        return ret;
+    }
+
+    LOG_DBG("Appended %zu bytes to the journal at offset %zu.", len, journal_write_offset);
+    journal_write_offset += len;
+    return 0;
+}
+
+/**
+ * @brief Writes staged records to flash, compacting first if they do not fit.
+ *
+ * Must not be called with expander_data.mutex held; it is only taken briefly to hand over the
+ * staged records.
+ *
+ * @return 0 on success, or a negative error code.
+ */
+static int journal_flush(void) {
+    if (!journal_fa) {
+        return -ENODEV;
+    }
+
+    k_mutex_lock(&journal_flush_mutex, K_FOREVER);
+    int ret;
+    for (int attempt = 0; attempt < JOURNAL_FLUSH_ATTEMPTS; attempt++) {
+        ret = journal_flush_once();
+        if (ret == 0) {
+            break;
+        }
+        // Whatever was handed over is lost; a compaction rewrites it from the live dictionary.
+        k_mutex_lock(&expander_data.mutex, K_FOREVER);
+        journal_needs_compaction = true;
+        k_mutex_unlock(&expander_data.mutex);
+        if (ret != -EAGAIN) {
+            break;
+        }
+    }
+    k_mutex_unlock(&journal_flush_mutex);
+    return ret;
+}
+
+/**
+ * @brief Work handler flushing coalesced records.
+ *
+ * Runs on journal_work_q, so it may wait for a batch in progress: it only takes the staged
+ * records once the batch is done, so a flush never persists half of one.
+ */
+static void journal_flush_work_handler(struct k_work *work) {
+    if (journal_flush() < 0) {
+        k_work_schedule_for_queue(&journal_work_q, &journal_flush_work,
+                                  K_MSEC(CONFIG_ZMK_TEXT_EXPANDER_JOURNAL_FLUSH_DELAY));
+    }
+}
+
+/**
+ * @brief Stages one record and schedules the coalesced flush.
+ */
+static void journal_stage(enum journal_record_type type, const char *short_code,
+                          const char *expanded_text) {
+    if (!journal_fa || journal_replaying) {
+        return;
+    }
+
+    if (!journal_needs_compaction) {
+        size_t len = journal_encode(journal_record_buf, type, short_code, expanded_text);
+        if (journal_pending_len + len <= sizeof(journal_pending_bufs[0])) {
+            memcpy(journal_pending + journal_pending_len, journal_record_buf, len);
+            journal_pending_len += len;
+        } else {
+            // The burst outgrew the staging buffer. A snapshot of the live dictionary
+            // covers all of it in one rewrite.
+            journal_needs_compaction = true;
+            journal_pending_len = 0;
+        }
+    }
+
+    // Does nothing if a flush is already scheduled, so a burst of edits costs one write.
+    k_work_schedule_for_queue(&journal_work_q, &journal_flush_work,
+                              K_MSEC(CONFIG_ZMK_TEXT_EXPANDER_JOURNAL_FLUSH_DELAY));
+}
+
+void text_expander_journal_record_add(const char *short_code, const char *expanded_text) {
+    journal_stage(JOURNAL_RECORD_ADD, short_code, expanded_text);
+}
+
+void text_expander_journal_record_remove(const char *short_code) {
+    journal_stage(JOURNAL_RECORD_REMOVE, short_code, NULL);
+}
+
+void text_expander_journal_record_clear(void) {
+    journal_stage(JOURNAL_RECORD_CLEAR, NULL, NULL);
+}
+
+void text_expander_journal_discard_pending(void) {
+    if (!journal_fa) {
+        return;
+    }
+    journal_pending_len = 0;
+    journal_needs_compaction = true;
+    k_work_schedule_for_queue(&journal_work_q, &journal_flush_work,
+                              K_MSEC(CONFIG_ZMK_TEXT_EXPANDER_JOURNAL_FLUSH_DELAY));
+}
+
+/**
+ * @brief Public API function to flush the journal immediately.
+ * (Implementation of the function declared in zmk_text_expander.h)
+ */
+int zmk_text_expander_flush_journal(void) {
+    // The mutex is recursive, so a flush from inside the caller's own batch would persist half
+    // of it.
+    k_mutex_lock(&expander_data.mutex, K_FOREVER);
+    bool own_batch = expander_data.batch_active && expander_data.batch_owner == k_current_get();
+    k_mutex_unlock(&expander_data.mutex);
+    if (own_batch) {
+        return -EBUSY;
+    }
+
+    k_work_cancel_delayable(&journal_flush_work);
+    return journal_flush();
+}
+
+/**
+ * @brief Reads the header of a bank.
+ *
+ * @param bank The bank index (0 or 1).
+ * @param seq Output for the bank's sequence number.
+ * @return True if the bank carries a valid header.
+ */
+static bool journal_read_bank_header(uint8_t bank, uint32_t *seq) {
+    struct journal_bank_header header;
+
+    if (flash_area_read(journal_fa, (off_t)bank * journal_bank_size, &header, sizeof(header)) < 0) {
+        return false;
+    }
+    if (header.magic != JOURNAL_MAGIC ||
+        header.crc != crc32_ieee((const uint8_t *)&header, offsetof(struct journal_bank_header, crc))) {
+        return false;
+    }
+    *seq = header.seq;
+    return true;
+}
+
+/**
+ * @brief Replays the records of the active bank into the runtime dictionary.
+ *
+ * Stops at the first erased slot. A record with a bad checksum is the remnant of an
+ * interrupted write; replay stops there and a compaction is scheduled to get a clean tail.
+ */
+static void journal_replay_records(void) {
+    off_t bank_base = (off_t)journal_active_bank * journal_bank_size;
+    size_t offset = journal_header_size();
+    char short_code[MAX_SHORT_LEN];
+    int applied = 0;
+
+    while (offset + sizeof(struct journal_record_header) <= journal_bank_size) {
+        struct journal_record_header hdr;
+        if (flash_area_read(journal_fa, bank_base + offset, &hdr, sizeof(hdr)) < 0) {
+            journal_needs_compaction = true;
+            break;
+        }
+        if (hdr.type == journal_erased_val) {
+            break; // End of the journal.
+        }
+
+        size_t len = sizeof(hdr) + hdr.short_len + hdr.text_len;
+        uint8_t *payload = journal_record_buf + sizeof(hdr);
+        if (hdr.short_len >= MAX_SHORT_LEN || hdr.text_len >= MAX_TEXT_LEN ||
+            offset + len > journal_bank_size ||
+            flash_area_read(journal_fa, bank_base + offset + sizeof(hdr), payload,
+                            hdr.short_len + hdr.text_len) < 0 ||
+            hdr.crc != journal_record_crc(&hdr, payload)) {
+            LOG_WRN("Discarding torn journal record at offset %zu.", offset);
+            journal_needs_compaction = true;
+            break;
+        }
+
+        memcpy(short_code, payload, hdr.short_len);
+        short_code[hdr.short_len] = '\0';
+        // Texts may be long, so the text is terminated in place rather than copied. Nothing
+        // else uses the record buffer while replaying.
+        char *expanded_text = (char *)payload + hdr.short_len;
+        expanded_text[hdr.text_len] = '\0';
+
+        switch (hdr.type) {
+        case JOURNAL_RECORD_ADD:
+            zmk_text_expander_add_expansion(short_code, expanded_text);
+            break;
+        case JOURNAL_RECORD_REMOVE:
+            zmk_text_expander_remove_expansion(short_code);
+            break;
+        case JOURNAL_RECORD_CLEAR:
+            zmk_text_expander_clear_all();
+            break;
+        default:
+            LOG_WRN("Unknown journal record type %u at offset %zu.", hdr.type, offset);
+            break;
+        }
+
+        applied++;
+        offset += ROUND_UP(len, journal_align);
+    }
+
+    journal_write_offset = offset;
+    LOG_INF("Replayed %d journal records from bank %u (seq %u).", applied, journal_active_bank,
+            journal_seq);
+}
+
+/**
+ * @brief Opens the journal partition and replays it into the runtime dictionary.
+ *
+ * Runs at APPLICATION level, after the behavior instances (POST_KERNEL) have set up the
+ * runtime dictionary and after the flash driver is ready.
+ */
+static int text_expander_journal_init(void) {
+    const struct flash_area *fa;
+    int ret = flash_area_open(JOURNAL_PARTITION_ID, &fa);
+    if (ret < 0) {
+        LOG_ERR("Failed to open text expander journal partition: %d", ret);
+        return 0; // Keep the expander usable without persistence.
+    }
+
+    journal_align = MAX(flash_area_align(fa), 1);
+    journal_erased_val = flash_area_erased_val(fa);
+    journal_bank_size = fa->fa_size / 2;
+    if (journal_align > JOURNAL_MAX_ALIGN || !IS_POWER_OF_TWO(journal_align) ||
+        journal_bank_size < ROUND_UP(sizeof(struct journal_bank_header), journal_align) +
+                                JOURNAL_RECORD_MAX_SIZE) {
+        LOG_ERR("Unsupported journal partition (size %zu, write block %zu).",
+                (size_t)fa->fa_size, journal_align);
+        flash_area_close(fa);
+        return 0;
+    }
+
+    k_work_queue_init(&journal_work_q);
+    k_work_queue_start(&journal_work_q, journal_work_q_stack,
+                       K_THREAD_STACK_SIZEOF(journal_work_q_stack),
+                       CONFIG_ZMK_TEXT_EXPANDER_JOURNAL_THREAD_PRIORITY,
+                       &(struct k_work_queue_config){.name = "text_expander_journal"});
+
+    k_mutex_lock(&expander_data.mutex, K_FOREVER);
+    journal_fa = fa;
+
+    uint32_t seq0, seq1;
+    bool valid0 = journal_read_bank_header(0, &seq0);
+    bool valid1 = journal_read_bank_header(1, &seq1);
+
+    if (!valid0 && !valid1) {
+        // Fresh partition: start the first bank from whatever the runtime dictionary holds.
+        LOG_INF("No text expander journal found; initializing a new one.");
+        journal_active_bank = 1; // journal_compact() writes the other bank, i.e. bank 0.
+        journal_seq = 0;
+        journal_needs_compaction = true;
+    } else {
+        journal_active_bank = (valid1 && (!valid0 || (int32_t)(seq1 - seq0) > 0)) ? 1 : 0;
+        journal_seq = journal_active_bank ? seq1 : seq0;
+
+        // The persisted state replaces whatever was set up before the journal was available,
+        // and becomes visible all at once.
+        journal_replaying = true;
+        ret = zmk_text_expander_batch_begin();
+        if (ret == 0) {
+            zmk_text_expander_clear_all();
+            journal_replay_records();
+            zmk_text_expander_batch_commit();
+        } else {
+            LOG_ERR("Failed to start journal replay batch: %d", ret);
+        }
+        journal_replaying = false;
+    }
+
+    bool compact = journal_needs_compaction;
+    k_mutex_unlock(&expander_data.mutex);
+
+    if (compact) {
+        // Fresh partition or torn tail: rewrite the bank now, so the journal is clean before
+        // the first update is appended.
+        journal_flush();
+    }
+    return 0;
+}
+
+SYS_INIT(text_expander_journal_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
@@ -0,0 +1,355 @@
+#include <zephyr/device.h>            // For device_is_ready.
+#include <zephyr/drivers/uart.h>      // For the interrupt-driven UART API.
+#include <zephyr/kernel.h>            // For threads, semaphores and mutexes.
+#include <zephyr/logging/log.h>       // For Zephyr's logging API.
+#include <zephyr/sys/byteorder.h>     // For little-endian field access.
+#include <zephyr/sys/crc.h>           // For crc32_ieee().
+#include <zephyr/sys/ring_buffer.h>   // For the RX ring between the ISR and the parser thread.
+#include <string.h>                   // For memcpy.
+#include <errno.h>                    // For error codes.
+
+#include <zmk/text_expander.h>           // Public API the records are applied through.
+#include <zmk/text_expander_internals.h> // For expander_data, MAX_SHORT_LEN, MAX_EXPANDED_LEN.
+#include <zmk/text_expander_serial.h>    // Protocol definitions.
+#include <zmk/trie.h>                    // For trie_for_each() when computing the version hash.
+
+LOG_MODULE_DECLARE(zmk_behavior_text_expander, CONFIG_ZMK_LOG_LEVEL);
+
+BUILD_ASSERT(IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SHADOW_BUILD),
+             "CONFIG_ZMK_TEXT_EXPANDER_SERIAL keeps a batch open across frames and requires "
+             "CONFIG_ZMK_TEXT_EXPANDER_SHADOW_BUILD");
+BUILD_ASSERT(DT_HAS_CHOSEN(zmk_text_expander_uart),
+             "CONFIG_ZMK_TEXT_EXPANDER_SERIAL requires a zmk,text-expander-uart chosen node");
+
+static const struct device *const serial_dev = DEVICE_DT_GET(DT_CHOSEN(zmk_text_expander_uart));
+
+// Largest payload: an ADD record with the longest short code and expanded text.
+#define SERIAL_MAX_PAYLOAD (1 + MAX_SHORT_LEN + MAX_EXPANDED_LEN)
+// Largest frame on the wire.
+#define SERIAL_MAX_FRAME (TEXT_EXPANDER_SERIAL_HEADER_LEN + SERIAL_MAX_PAYLOAD + TEXT_EXPANDER_SERIAL_CRC_LEN)
+
+// The host sends a whole frame before it waits for the response, and the parser thread may
+// not run until the last byte is in, so the ring must hold the largest frame.
+BUILD_ASSERT(CONFIG_ZMK_TEXT_EXPANDER_SERIAL_RX_BUFFER_SIZE >= SERIAL_MAX_FRAME,
+             "CONFIG_ZMK_TEXT_EXPANDER_SERIAL_RX_BUFFER_SIZE must hold a frame of 10 + "
+             "MAX_SHORT_LEN + MAX_EXPANDED_LEN bytes");
+
+RING_BUF_DECLARE(serial_rx_ring, CONFIG_ZMK_TEXT_EXPANDER_SERIAL_RX_BUFFER_SIZE);
+static K_SEM_DEFINE(serial_rx_sem, 0, 1);
+
+/**
+ * @brief States of the incremental frame parser.
+ */
+enum serial_parser_state {
+    SERIAL_WAIT_SOF, // Skipping bytes until the start of a frame.
+    SERIAL_HEADER,   // Collecting type, seq and len.
+    SERIAL_PAYLOAD,  // Collecting the payload.
+    SERIAL_CRC,      // Collecting the trailing CRC.
+};
+
+/**
+ * @brief Incremental frame parser. Holds at most one frame.
+ */
+struct serial_parser {
+    enum serial_parser_state state;
+    uint8_t header[TEXT_EXPANDER_SERIAL_HEADER_LEN - 1]; // type, seq, len (LE).
+    uint8_t payload[SERIAL_MAX_PAYLOAD];
+    uint8_t crc[TEXT_EXPANDER_SERIAL_CRC_LEN];
+    uint16_t len; // Payload length announced in the header.
+    size_t pos;   // Bytes collected in the current state.
+};
+
+static struct serial_parser parser;
+
+// Session state, owned by the serial thread.
+static bool session_active; // A BEGIN was accepted and the batch is open.
+static int last_seq = -1;   // Seq of the last acknowledged frame, for retransmissions.
+static int last_result;     // Result sent for last_seq.
+
+/**
+ * @brief UART interrupt handler moving received bytes into the RX ring.
+ */
+static void serial_isr(const struct device *dev, void *user_data) {
+    uint8_t buf[16];
+
+    while (uart_irq_update(dev) && uart_irq_is_pending(dev)) {
+        if (!uart_irq_rx_ready(dev)) {
+            continue;
+        }
+        int len = uart_fifo_read(dev, buf, sizeof(buf));
+        if (len > 0 && ring_buf_put(&serial_rx_ring, buf, len) < (uint32_t)len) {
+            // The ring holds a whole frame, so this only happens if the host sends the next frame
+            // before the response to the last one. The frame will fail its CRC.
+            LOG_WRN("Text expander serial RX overrun.");
+        }
+        k_sem_give(&serial_rx_sem);
+    }
+}
+
+/**
+ * @brief Sends one frame to the host.
+ */
+static void serial_send(uint8_t type, uint8_t seq, const uint8_t *payload, uint16_t len) {
+    uint8_t header[TEXT_EXPANDER_SERIAL_HEADER_LEN] = {TEXT_EXPANDER_SERIAL_SOF, type, seq};
+    uint8_t crc_buf[TEXT_EXPANDER_SERIAL_CRC_LEN];
+
+    sys_put_le16(len, &header[3]);
+    uint32_t crc = crc32_ieee(&header[1], sizeof(header) - 1);
+    crc = crc32_ieee_update(crc, payload, len);
+    sys_put_le32(crc, crc_buf);
+
+    for (size_t i = 0; i < sizeof(header); i++) {
+        uart_poll_out(serial_dev, header[i]);
+    }
+    for (size_t i = 0; i < len; i++) {
+        uart_poll_out(serial_dev, payload[i]);
+    }
+    for (size_t i = 0; i < sizeof(crc_buf); i++) {
+        uart_poll_out(serial_dev, crc_buf[i]);
+    }
+}
+
+/**
+ * @brief Sends an ACK or a NAK for a frame.
+ */
+static void serial_respond(uint8_t seq, int result) {
+    if (result == 0) {
+        serial_send(TEXT_EXPANDER_SERIAL_ACK, seq, NULL, 0);
+    } else {
+        uint8_t err = (uint8_t)-result;
+        serial_send(TEXT_EXPANDER_SERIAL_NAK, seq, &err, sizeof(err));
+    }
+}
+
+/**
+ * @brief trie_for_each() callback adding one entry to the version hash.
+ */
+static int serial_hash_visit(const char *key, const char *value, void *user_data) {
+    uint32_t *hash = user_data;
+    uint32_t crc = crc32_ieee((const uint8_t *)key, strlen(key) + 1); // Includes the '\0'.
+    *hash += crc32_ieee_update(crc, (const uint8_t *)value, strlen(value));
+    return 0;
+}
+
+/**
+ * @brief Computes the version hash of the live runtime dictionary.
+ */
+static uint32_t serial_dictionary_hash(void) {
+    uint32_t hash = 0;
+
+    k_mutex_lock(&expander_data.mutex, K_FOREVER); // Keeps writers from changing texts mid-walk.
+    trie_for_each(text_expander_get_root(&expander_data), serial_hash_visit, &hash);
+    k_mutex_unlock(&expander_data.mutex);
+    return hash;
+}
+
+/**
+ * @brief Copies a length-delimited string out of a payload and terminates it.
+ *
+ * @return 0 on success, -EINVAL if it is empty or does not fit dst.
+ */
+static int serial_copy_string(char *dst, size_t dst_size, const uint8_t *src, size_t len) {
+    if (len == 0 || len >= dst_size) {
+        return -EINVAL;
+    }
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+    return 0;
+}
+
+/**
+ * @brief Applies one complete, CRC-checked frame.
+ *
+ * @return 0 to acknowledge the frame, or a negative error code to reject it.
+ */
+static int serial_handle_frame(uint8_t type, uint8_t seq, const uint8_t *payload, uint16_t len) {
+    char short_code[MAX_SHORT_LEN];
+    char expanded_text[MAX_EXPANDED_LEN];
+    int ret;
+
+    switch (type) {
+    case TEXT_EXPANDER_SERIAL_HELLO: {
+        uint8_t status[10];
+        status[0] = TEXT_EXPANDER_SERIAL_VERSION;
+        sys_put_le32(serial_dictionary_hash(), &status[1]);
+        sys_put_le16(expander_data.expansion_count, &status[5]);
+        status[7] = MAX_SHORT_LEN - 1;
+        sys_put_le16(MAX_EXPANDED_LEN - 1, &status[8]);
+        serial_send(TEXT_EXPANDER_SERIAL_STATUS, seq, status, sizeof(status));
+        return 0;
+    }
+
+    case TEXT_EXPANDER_SERIAL_BEGIN: {
+        if (len != 5 || session_active) {
+            return -EINVAL;
+        }
+        bool replace = payload[4] & TEXT_EXPANDER_SERIAL_BEGIN_REPLACE;
+        if (!replace && sys_get_le32(payload) != serial_dictionary_hash()) {
+            return -ESTALE; // The host's base is outdated; it has to send the full dictionary.
+        }
+        ret = zmk_text_expander_batch_begin();
+        if (ret < 0) {
+            return ret;
+        }
+        session_active = true;
+        if (replace) {
+            zmk_text_expander_clear_all();
+        }
+        LOG_INF("Serial dictionary upload started (%s).", replace ? "full" : "delta");
+        return 0;
+    }
+
+    case TEXT_EXPANDER_SERIAL_ADD:
+        if (len < 1 || payload[0] >= len) {
+            return -EINVAL;
+        }
+        ret = serial_copy_string(short_code, sizeof(short_code), &payload[1], payload[0]);
+        if (ret == 0) {
+            ret = serial_copy_string(expanded_text, sizeof(expanded_text), &payload[1 + payload[0]],
+                                     len - 1 - payload[0]);
+        }
+        return ret < 0 ? ret : zmk_text_expander_add_expansion(short_code, expanded_text);
+
+    case TEXT_EXPANDER_SERIAL_REMOVE:
+        ret = serial_copy_string(short_code, sizeof(short_code), payload, len);
+        if (ret == 0) {
+            ret = zmk_text_expander_remove_expansion(short_code);
+        }
+        return ret == -ENOENT ? 0 : ret; // Already gone is what the host wants.
+
+    case TEXT_EXPANDER_SERIAL_CLEAR:
+        zmk_text_expander_clear_all();
+        return 0;
+
+    case TEXT_EXPANDER_SERIAL_COMMIT:
+        if (len != 4 || !session_active) {
+            return -EINVAL;
+        }
+        session_active = false;
+        ret = zmk_text_expander_batch_commit();
+        if (ret == 0 && serial_dictionary_hash() != sys_get_le32(payload)) {
+            LOG_WRN("Dictionary hash mismatch after serial upload.");
+            ret = -EBADMSG; // The host should resend the full dictionary.
+        }
+        LOG_INF("Serial dictionary upload committed: %d", ret);
+        return ret;
+
+    case TEXT_EXPANDER_SERIAL_ABORT:
+        if (session_active) {
+            session_active = false;
+            zmk_text_expander_batch_abort();
+        }
+        return 0;
+
+    default:
+        return -ENOTSUP;
+    }
+}
+
+/**
+ * @brief Feeds one received byte to the parser, handling the frame once it is complete.
+ */
+static void serial_parse_byte(uint8_t byte) {
+    switch (parser.state) {
+    case SERIAL_WAIT_SOF:
+        if (byte == TEXT_EXPANDER_SERIAL_SOF) {
+            parser.state = SERIAL_HEADER;
+            parser.pos = 0;
+        }
+        return;
+
+    case SERIAL_HEADER:
+        parser.header[parser.pos++] = byte;
+        if (parser.pos == sizeof(parser.header)) {
+            parser.len = sys_get_le16(&parser.header[2]);
+            parser.pos = 0;
+            if (parser.len > sizeof(parser.payload)) {
+                LOG_WRN("Oversized serial frame (%u bytes) dropped.", parser.len);
+                parser.state = SERIAL_WAIT_SOF; // Resynchronize on the next SOF.
+            } else {
+                parser.state = parser.len ? SERIAL_PAYLOAD : SERIAL_CRC;
+            }
+        }
+        return;
+
+    case SERIAL_PAYLOAD:
+        parser.payload[parser.pos++] = byte;
+        if (parser.pos == parser.len) {
+            parser.state = SERIAL_CRC;
+            parser.pos = 0;
+        }
+        return;
+
+    case SERIAL_CRC:
+        parser.crc[parser.pos++] = byte;
+        if (parser.pos < sizeof(parser.crc)) {
+            return;
+        }
+        parser.state = SERIAL_WAIT_SOF;
+        break;
+    }
+
+    uint32_t crc = crc32_ieee(parser.header, sizeof(parser.header));
+    crc = crc32_ieee_update(crc, parser.payload, parser.len);
+    if (crc != sys_get_le32(parser.crc)) {
+        LOG_DBG("Serial frame with bad CRC dropped.");
+        return; // The host times out and retransmits.
+    }
+
+    uint8_t type = parser.header[0];
+    uint8_t seq = parser.header[1];
+    if (seq == last_seq && type != TEXT_EXPANDER_SERIAL_HELLO) {
+        serial_respond(seq, last_result); // Retransmission: the response was lost.
+        return;
+    }
+
+    int result = serial_handle_frame(type, seq, parser.payload, parser.len);
+    if (type != TEXT_EXPANDER_SERIAL_HELLO) {
+        serial_respond(seq, result);
+    }
+    // HELLO starts a new conversation, after which any seq is fresh.
+    last_seq = (type == TEXT_EXPANDER_SERIAL_HELLO) ? -1 : seq;
+    last_result = result;
+}
+
+/**
+ * @brief Thread draining the RX ring into the parser.
+ *
+ * Updates run on this thread, which also owns the batch (and with it the dictionary mutex)
+ * while an upload is in progress. Readers do not need the mutex in shadow build mode, which
+ * Kconfig requires, so only other writers wait for the upload. If the host goes silent in the
+ * middle of an upload, the batch is aborted so they are not blocked forever.
+ */
+static void serial_thread_main(void *p1, void *p2, void *p3) {
+    if (!device_is_ready(serial_dev)) {
+        LOG_ERR("Text expander serial device %s is not ready.", serial_dev->name);
+        return;
+    }
+
+    uart_irq_callback_user_data_set(serial_dev, serial_isr, NULL);
+    uart_irq_rx_enable(serial_dev);
+    LOG_INF("Text expander serial upload listening on %s.", serial_dev->name);
+
+    while (true) {
+        k_timeout_t timeout = session_active ? K_MSEC(CONFIG_ZMK_TEXT_EXPANDER_SERIAL_TIMEOUT) : K_FOREVER;
+        if (k_sem_take(&serial_rx_sem, timeout) == -EAGAIN) {
+            LOG_WRN("Serial dictionary upload timed out; aborting.");
+            session_active = false;
+            zmk_text_expander_batch_abort();
+            parser.state = SERIAL_WAIT_SOF;
+            continue;
+        }
+
+        uint8_t buf[32];
+        uint32_t len;
+        while ((len = ring_buf_get(&serial_rx_ring, buf, sizeof(buf))) > 0) {
+            for (uint32_t i = 0; i < len; i++) {
+                serial_parse_byte(buf[i]);
+            }
+        }
+    }
+}
+
+K_THREAD_DEFINE(text_expander_serial_thread, CONFIG_ZMK_TEXT_EXPANDER_SERIAL_THREAD_STACK_SIZE,
+                serial_thread_main, NULL, NULL, NULL, CONFIG_ZMK_TEXT_EXPANDER_SERIAL_THREAD_PRIORITY,
+                0, 0);
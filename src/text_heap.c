@@ -0,0 +1,146 @@
+#include <zephyr/kernel.h>        // For basic Zephyr types.
+#include <zephyr/logging/log.h>   // For Zephyr's logging API.
+#include <zephyr/sys/sys_heap.h>  // For the heap managing the text pool.
+#include <string.h>               // For strlen, memcmp, memcpy, memset.
+
+#include <zmk/trie.h>                    // Declarations of the text allocator functions.
+#include <zmk/text_expander_internals.h> // For struct text_expander_pool.
+
+LOG_MODULE_DECLARE(zmk_behavior_text_expander, CONFIG_ZMK_LOG_LEVEL);
+
+/*
+ * Heap allocator for texts, selected with CONFIG_ZMK_TEXT_EXPANDER_TEXT_ALLOC_HEAP.
+ *
+ * The text_pool is managed by a sys_heap, so a text whose last reference is dropped is freed
+ * right away and its space can be reused by any later text, wherever it lies. Allocations are
+ * filed in the buckets of the pool's text index (see trie_text_bucket()), so new texts can
+ * still share storage with identical texts and texts they are a suffix of without comparing
+ * against every stored text. Only used by writers, which are serialized by the caller.
+ */
+
+/**
+ * @brief A text allocated from the heap.
+ */
+struct text_heap_block {
+    struct text_heap_block *next; // Next allocation of the same index bucket.
+    uint16_t refs;                // Number of nodes pointing into text.
+    uint16_t len;                 // Length of text, so scans need no strlen().
+    char text[];                  // The null-terminated text.
+};
+
+/**
+ * @brief Bytes requested from the heap for a text of length len.
+ */
+static size_t text_heap_block_size(size_t len) {
+    return sizeof(struct text_heap_block) + len + 1;
+}
+
+/**
+ * @brief Allocates a new text from the heap.
+ */
+static char *text_heap_allocate(struct text_expander_pool *pool, const char *text, size_t len,
+                                size_t bucket) {
+    size_t size = text_heap_block_size(len);
+
+    struct text_heap_block *block =
+        pool->text_pool_size > 0 ? sys_heap_alloc(&pool->text_heap, size) : NULL;
+    if (!block) {
+        LOG_ERR("Text heap exhausted. Requested: %zu, Used: %zu, Total: %zu. Increase CONFIG_ZMK_TEXT_EXPANDER_TEXT_POOL_SIZE.",
+                size, pool->text_pool_used, pool->text_pool_size);
+        return NULL;
+    }
+
+    block->refs = 1;
+    block->len = len;
+    memcpy(block->text, text, len + 1);
+    block->next = pool->text_buckets[bucket];
+    pool->text_buckets[bucket] = block;
+
+    pool->text_pool_used += size;
+    pool->text_pool_peak = MAX(pool->text_pool_peak, pool->text_pool_used);
+    return block->text;
+}
+
+char *trie_intern_text(struct text_expander_pool *pool, const char *text) {
+    size_t len = strlen(text);
+
+    if (pool->text_bucket_count == 0) {
+        LOG_ERR("Text pool has no text index; cannot store '%s'.", text);
+        return NULL;
+    }
+
+    size_t bucket = trie_text_bucket(pool, text, len);
+    for (struct text_heap_block *block = pool->text_buckets[bucket]; block; block = block->next) {
+        size_t candidate_len = block->len;
+        // Texts shorter than the index tail only share identical texts (see trie_intern_text()).
+        if (candidate_len < len || (len < TRIE_TEXT_INDEX_TAIL && candidate_len != len) ||
+            block->refs == UINT16_MAX || memcmp(block->text + candidate_len - len, text, len) != 0) {
+            continue;
+        }
+
+        block->refs++;
+        LOG_DBG("Interned '%s' into existing text %p (refs %u).", text, (void *)block, block->refs);
+        return block->text + candidate_len - len;
+    }
+
+    return text_heap_allocate(pool, text, len, bucket);
+}
+
+void trie_release_text(struct text_expander_pool *pool, const char *text) {
+    if (pool->text_bucket_count == 0) {
+        LOG_WRN("Released text %p is not part of this text pool.", (void *)text);
+        return;
+    }
+
+    // A text shares its tail, and so its bucket, with the block it points into.
+    struct text_heap_block **link = &pool->text_buckets[trie_text_bucket(pool, text, strlen(text))];
+    for (; *link; link = &(*link)->next) {
+        struct text_heap_block *block = *link;
+        size_t len = block->len;
+        if (text < block->text || text > block->text + len) {
+            continue;
+        }
+
+        if (block->refs > 0 && --block->refs == 0) {
+            // Nothing refers to the text anymore: give its memory back right away.
+            *link = block->next;
+            pool->text_pool_used -= text_heap_block_size(len);
+            sys_heap_free(&pool->text_heap, block);
+        }
+        return;
+    }
+
+    LOG_WRN("Released text %p is not part of this text pool.", (void *)text);
+}
+
+void trie_reset_text(struct text_expander_pool *pool) {
+    if (pool->text_bucket_count > 0) {
+        memset(pool->text_buckets, 0, pool->text_bucket_count * sizeof(pool->text_buckets[0]));
+    }
+    pool->text_pool_used = 0;
+    if (pool->text_pool_size > 0) {
+        sys_heap_init(&pool->text_heap, pool->text_pool, pool->text_pool_size);
+    }
+}
+
+void trie_text_stats(const struct text_expander_pool *pool, struct zmk_text_expander_text_stats *stats) {
+    struct sys_memory_stats heap_stats = {0};
+
+    stats->count = 0;
+    for (size_t i = 0; i < pool->text_bucket_count; i++) {
+        for (const struct text_heap_block *block = pool->text_buckets[i]; block; block = block->next) {
+            stats->count++;
+        }
+    }
+    if (pool->text_pool_size > 0) {
+        sys_heap_runtime_stats_get((struct sys_heap *)&pool->text_heap, &heap_stats);
+    }
+
+    // What the heap does not report as free is either held by texts or lost to chunk
+    // headers, rounding, the heap's own bookkeeping and gaps too small to be useful.
+    stats->capacity = pool->text_pool_size;
+    stats->used = pool->text_pool_used;
+    stats->free = MIN(heap_stats.free_bytes, pool->text_pool_size - pool->text_pool_used);
+    stats->fragmented = stats->capacity - stats->used - stats->free;
+    stats->peak = pool->text_pool_peak;
+}
@@ -1,11 +1,12 @@
 #include <zephyr/kernel.h>      // For basic Zephyr types, not strictly essential here but common.
 #include <zephyr/logging/log.h> // For Zephyr's logging API (LOG_ERR, LOG_DBG, LOG_WRN).
-#include <string.h>             // For memset, strcpy, strlen.
+#include <string.h>             // For memset, memcpy, memcmp, strlen.
 #include <errno.h>              // For error codes like EINVAL (invalid argument), 
                                 // ENOMEM (no memory), ENOENT (no such entry).
+#include <zephyr/sys/barrier.h> // For barrier_dmem_fence_full() when publishing nodes to lock-free readers.
 
 #include <zmk/trie.h>                   // Public API for the trie.
-#include <zmk/text_expander_internals.h> // For text_expander_data structure definition, which contains
+#include <zmk/text_expander_internals.h> // For text_expander_pool structure definition, which contains
                                         // the memory pools (node_pool, text_pool) and their usage counters,
                                         // and MAX_SHORT_LEN.
 
@@ -32,60 +33,399 @@ int char_to_trie_index(char c) {
     return -1; // Character is not in the supported alphabet.
 }
 
+/*
+ * The node_pool is a slab of equally sized nodes. Freed nodes are kept on lists linked through
+ * their expanded_text pointer, which readers ignore on nodes that are not terminal; nodes that were never handed out are taken from the end of the
+ * slab, so resetting a pool is O(1). A freed node is retired first: a reader that entered the
+ * pool with text_expander_read_begin() before the node was unlinked may still hold it. Retired
+ * nodes only move to the free list once the pool has no readers, so a node is never handed out
+ * again while anyone can still reach it.
+ */
+
 /**
- * @brief Allocates a new trie node from the pre-allocated node_pool.
+ * @brief Allocates a new trie node from the node_pool.
  *
- * The node_pool is part of the `text_expander_data` structure. This function
- * increments `data->node_pool_used` to claim the next available node.
- * The allocated node is zero-initialized.
+ * Reuses a freed node if there is one, otherwise takes the next node that was never handed
+ * out. Nodes retired while readers were in the pool become reusable once it has none left.
+ * O(1) either way. The allocated node is zero-initialized.
  *
- * @param data Pointer to the `text_expander_data` structure containing the node pool.
+ * @param pool Pointer to the `text_expander_pool` structure containing the node pool.
  * @return Pointer to the newly allocated `trie_node`, or NULL if the pool is exhausted.
  */
-struct trie_node *trie_allocate_node(struct text_expander_data *data) {
-    // Check if the node pool has space for another node.
-    // ARRAY_SIZE is a Zephyr utility to get the number of elements in an array.
-    if (data->node_pool_used >= ARRAY_SIZE(data->node_pool)) {
-        LOG_ERR("Trie node pool exhausted. Current usage: %u, Max: %zu. Increase CONFIG_ZMK_TEXT_EXPANDER_MAX_EXPANSIONS or CONFIG_ZMK_TEXT_EXPANDER_MAX_SHORT_LEN.",
-                data->node_pool_used, ARRAY_SIZE(data->node_pool));
+struct trie_node *trie_allocate_node(struct text_expander_pool *pool) {
+    struct trie_node *node;
+
+    if (!pool->node_free_list && pool->node_retired_list && atomic_get(&pool->readers) == 0) {
+        // Readers that entered after a node was unlinked cannot reach it, and every reader
+        // that entered before has left: the retired nodes are free now.
+        pool->node_free_list = pool->node_retired_list;
+        pool->node_retired_list = NULL;
+    }
+    if (pool->node_free_list) {
+        node = pool->node_free_list;
+        pool->node_free_list = (struct trie_node *)node->expanded_text;
+    } else if (pool->node_pool_next < pool->node_pool_size) {
+        node = &pool->node_pool[pool->node_pool_next++];
+    } else {
+        LOG_ERR("Trie node pool exhausted. Current usage: %zu, Max: %zu, waiting for readers: %s. "
+                "Increase CONFIG_ZMK_TEXT_EXPANDER_NODE_POOL_SIZE.",
+                pool->node_pool_used, pool->node_pool_size, pool->node_retired_list ? "yes" : "no");
         return NULL; // No space left in the pool.
     }
 
-    // Get the address of the next available node in the pool.
-    struct trie_node *node = &data->node_pool[data->node_pool_used++];
     // Initialize the allocated node's memory to zero.
     // This sets all child pointers to NULL and boolean flags (like is_terminal) to false.
     memset(node, 0, sizeof(struct trie_node));
+    pool->node_pool_used++;
+    pool->node_pool_peak = MAX(pool->node_pool_peak, pool->node_pool_used);
     return node;
 }
 
 /**
- * @brief Allocates a block of memory for storing expanded text from the pre-allocated text_pool.
+ * @brief Retires a node of the node_pool. O(1).
+ *
+ * The node must already be unlinked from its trie, and be a leaf that is not terminal, as
+ * trie_prune() leaves it. It is not handed out again before the pool has no readers (see
+ * trie_allocate_node()), so a lock-free reader still holding it keeps seeing a leaf without an
+ * expansion: the list link goes into expanded_text, which only terminal nodes use.
+ */
+static void trie_free_node(struct text_expander_pool *pool, struct trie_node *node) {
+    node->expanded_text = (const char *)pool->node_retired_list;
+    pool->node_retired_list = node;
+    pool->node_pool_used--;
+}
+
+/**
+ * @brief Checks whether a node has no children.
+ */
+static bool trie_node_is_leaf(const struct trie_node *node) {
+    for (int i = 0; i < TRIE_ALPHABET_SIZE; i++) {
+        if (node->children[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Frees the nodes at the end of a path that no longer lead to any expansion.
+ *
+ * Walks the path back towards the root, unlinking and freeing nodes that are neither
+ * terminal nor have children. The root is never freed.
+ *
+ * @param pool Pointer to the `text_expander_pool` the nodes belong to.
+ * @param path path[i] is the node reached after i characters of the key; path[0] is the root.
+ * @param indices indices[i] is the child index taken from path[i] to path[i + 1].
+ * @param depth Length of the key, so path[depth] is the node for the whole key.
+ */
+static void trie_prune(struct text_expander_pool *pool, struct trie_node **path, const int *indices, int depth) {
+    for (int i = depth; i > 0; i--) {
+        struct trie_node *node = path[i];
+        if (node->is_terminal || !trie_node_is_leaf(node)) {
+            break;
+        }
+        path[i - 1]->children[indices[i - 1]] = NULL;
+        barrier_dmem_fence_full(); // Unlink first: readers entering from now on cannot reach the node.
+        trie_free_node(pool, node);
+    }
+}
+
+/**
+ * @brief Files a text in the text index by its last TRIE_TEXT_INDEX_TAIL characters.
+ *
+ * FNV-1a over the tail: cheap, and good enough to spread texts over a few hundred buckets.
+ */
+size_t trie_text_bucket(const struct text_expander_pool *pool, const char *text, size_t len) {
+    size_t tail = MIN(len, TRIE_TEXT_INDEX_TAIL);
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = len - tail; i < len; i++) {
+        hash = (hash ^ (uint8_t)text[i]) * 16777619u;
+    }
+    return hash % pool->text_bucket_count;
+}
+
+#if !IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_TEXT_ALLOC_HEAP)
+/*
+ * Bump allocator for texts (the heap allocator lives in text_heap.c).
+ *
+ * Text storage layout: every allocation in text_pool is a TRIE_TEXT_OVERHEAD-byte header
+ * followed by the null-terminated text. The header holds the reference count, the text length,
+ * the text length of the previous allocation (all 16-bit) and the link to the next allocation
+ * of the same index bucket (32-bit, offset + 1), all little-endian and unaligned. Allocations
+ * are laid out back to back, so the pool can be walked forwards and, from text_pool_last,
+ * backwards. A node may point at the start of an allocation's text or into its middle (a
+ * shared suffix).
+ */
+
+BUILD_ASSERT(MAX_TEXT_LEN <= UINT16_MAX, "Text lengths must fit into the 16-bit allocation header");
+
+/**
+ * @brief Reads the 16-bit header field at byte `field` of the allocation starting at `offset`.
+ */
+static uint16_t text_hdr_get16(const struct text_expander_pool *pool, size_t offset, size_t field) {
+    const uint8_t *hdr = (const uint8_t *)&pool->text_pool[offset + field];
+    return hdr[0] | (hdr[1] << 8);
+}
+
+/**
+ * @brief Writes the 16-bit header field at byte `field` of the allocation starting at `offset`.
+ */
+static void text_hdr_set16(struct text_expander_pool *pool, size_t offset, size_t field, uint16_t value) {
+    uint8_t *hdr = (uint8_t *)&pool->text_pool[offset + field];
+    hdr[0] = value & 0xff;
+    hdr[1] = value >> 8;
+}
+
+/**
+ * @brief Reads the reference count of the allocation starting at `offset`.
+ */
+static uint16_t text_refs_get(const struct text_expander_pool *pool, size_t offset) {
+    return text_hdr_get16(pool, offset, 0);
+}
+
+/**
+ * @brief Writes the reference count of the allocation starting at `offset`.
+ */
+static void text_refs_set(struct text_expander_pool *pool, size_t offset, uint16_t refs) {
+    text_hdr_set16(pool, offset, 0, refs);
+}
+
+/**
+ * @brief Reads the length of the text of the allocation starting at `offset`.
+ */
+static size_t text_len_get(const struct text_expander_pool *pool, size_t offset) {
+    return text_hdr_get16(pool, offset, 2);
+}
+
+/**
+ * @brief Reads the bucket link (offset + 1 of the next allocation, or 0) at `offset`.
+ */
+static trie_text_link text_link_get(const struct text_expander_pool *pool, size_t offset) {
+    const uint8_t *hdr = (const uint8_t *)&pool->text_pool[offset + 6];
+    return hdr[0] | (hdr[1] << 8) | ((uint32_t)hdr[2] << 16) | ((uint32_t)hdr[3] << 24);
+}
+
+/**
+ * @brief Writes the bucket link of the allocation starting at `offset`.
+ */
+static void text_link_set(struct text_expander_pool *pool, size_t offset, trie_text_link link) {
+    uint8_t *hdr = (uint8_t *)&pool->text_pool[offset + 6];
+    hdr[0] = link & 0xff;
+    hdr[1] = (link >> 8) & 0xff;
+    hdr[2] = (link >> 16) & 0xff;
+    hdr[3] = link >> 24;
+}
+
+/**
+ * @brief Returns the offset of the allocation following the one at `offset`.
+ */
+static size_t text_next(const struct text_expander_pool *pool, size_t offset) {
+    return offset + TRIE_TEXT_OVERHEAD + text_len_get(pool, offset) + 1;
+}
+
+/**
+ * @brief Returns the offset of the allocation preceding the one at `offset` (which must not be 0).
+ */
+static size_t text_prev(const struct text_expander_pool *pool, size_t offset) {
+    return offset - TRIE_TEXT_OVERHEAD - text_hdr_get16(pool, offset, 4) - 1;
+}
+
+/**
+ * @brief Returns the text of the allocation starting at `offset`.
+ */
+static char *text_at(const struct text_expander_pool *pool, size_t offset) {
+    return &pool->text_pool[offset + TRIE_TEXT_OVERHEAD];
+}
+
+/**
+ * @brief Allocates a new text from the pre-allocated text_pool.
  *
- * The text_pool is part of the `text_expander_data` structure. This function
- * increments `data->text_pool_used` by `len` to claim the next available block.
+ * The text_pool is part of the `text_expander_pool` structure. This function
+ * increments `pool->text_pool_used` to claim the next available block, including the
+ * header in front of the text, and files the allocation in its index bucket.
  *
- * @param data Pointer to the `text_expander_data` structure containing the text pool.
- * @param len The number of bytes to allocate (should include space for null terminator).
- * @return Pointer to the start of the allocated block in `text_pool`, or NULL if the pool
- * does not have enough contiguous space.
+ * @param pool Pointer to the `text_expander_pool` structure containing the text pool.
+ * @param text The null-terminated text to copy into the pool.
+ * @param text_len Length of text.
+ * @param bucket Index bucket of text.
+ * @return Pointer to the copied text in `text_pool`, or NULL if the pool does not have
+ * enough contiguous space.
  */
-char *trie_allocate_text_storage(struct text_expander_data *data, size_t len) {
+static char *trie_allocate_text(struct text_expander_pool *pool, const char *text, size_t text_len,
+                                size_t bucket) {
+    size_t len = TRIE_TEXT_OVERHEAD + text_len + 1; // +1 for null terminator.
+
     // Check if the text pool has enough remaining space for the requested length.
-    // sizeof(data->text_pool) gives the total size of the text_pool array in bytes.
-    if (data->text_pool_used + len > sizeof(data->text_pool)) {
-        LOG_ERR("Text pool exhausted. Requested: %zu, Used: %u, Total: %zu. Increase CONFIG_ZMK_TEXT_EXPANDER_MAX_EXPANDED_LEN or CONFIG_ZMK_TEXT_EXPANDER_MAX_EXPANSIONS.",
-                len, data->text_pool_used, sizeof(data->text_pool));
+    // text_pool_size gives the total size of the text_pool buffer in bytes.
+    if (pool->text_pool_used + len > pool->text_pool_size) {
+        LOG_ERR("Text pool exhausted. Requested: %zu, Used: %zu, Total: %zu. Increase CONFIG_ZMK_TEXT_EXPANDER_TEXT_POOL_SIZE.",
+                len, pool->text_pool_used, pool->text_pool_size);
         return NULL; // Not enough space.
     }
 
-    // Get the address of the start of the allocatable block in the pool.
-    char *text = &data->text_pool[data->text_pool_used];
-    LOG_DBG("Allocated %zu bytes from text pool at address %p. Pool used will be: %u", 
-            len, (void*)text, data->text_pool_used + (uint16_t)len); // Cast len for consistent type in log if needed
+    size_t offset = pool->text_pool_used;
+    text_refs_set(pool, offset, 1);
+    text_hdr_set16(pool, offset, 2, text_len);
+    text_hdr_set16(pool, offset, 4, offset > 0 ? text_len_get(pool, pool->text_pool_last) : 0);
+    text_link_set(pool, offset, pool->text_buckets[bucket]);
+    pool->text_buckets[bucket] = offset + 1;
+    char *stored = text_at(pool, offset);
+    memcpy(stored, text, text_len + 1);
+    LOG_DBG("Allocated %zu bytes from text pool at address %p. Pool used will be: %zu",
+            len, (void *)stored, pool->text_pool_used + len);
     // Advance the used counter by the allocated length.
-    data->text_pool_used += (uint16_t)len; // Assuming len will fit in uint16_t text_pool_used capacity
-    return text;
+    pool->text_pool_last = offset;
+    pool->text_pool_used += len;
+    pool->text_pool_peak = MAX(pool->text_pool_peak, pool->text_pool_used);
+    return stored;
+}
+
+/**
+ * @brief Stores a text, sharing an existing allocation when possible.
+ *
+ * Scans the allocations of the text's index bucket for one whose text equals `text` or ends
+ * with it. Unreferenced allocations stay in their bucket, so they can be revived.
+ */
+char *trie_intern_text(struct text_expander_pool *pool, const char *text) {
+    size_t len = strlen(text);
+
+    if (pool->text_bucket_count == 0) {
+        LOG_ERR("Text pool has no text index; cannot store '%s'.", text);
+        return NULL;
+    }
+
+    size_t bucket = trie_text_bucket(pool, text, len);
+    for (trie_text_link link = pool->text_buckets[bucket]; link != 0;
+         link = text_link_get(pool, link - 1)) {
+        size_t offset = link - 1;
+        char *candidate = text_at(pool, offset);
+        size_t candidate_len = text_len_get(pool, offset);
+        uint16_t refs = text_refs_get(pool, offset);
+
+        // Texts shorter than the index tail were filed by all of their characters, so they
+        // can only be found again next to identical texts.
+        if (candidate_len < len || (len < TRIE_TEXT_INDEX_TAIL && candidate_len != len) ||
+            refs == UINT16_MAX || memcmp(candidate + candidate_len - len, text, len) != 0) {
+            continue;
+        }
+
+        // An allocation without references still holds its text and can simply be revived.
+        text_refs_set(pool, offset, refs + 1);
+        LOG_DBG("Interned '%s' into existing text at offset %zu (refs %u).", text, offset, refs + 1);
+        return candidate + candidate_len - len;
+    }
+
+    return trie_allocate_text(pool, text, len, bucket);
+}
+
+/**
+ * @brief Removes the allocation at `offset` from its index bucket.
+ */
+static void text_unlink(struct text_expander_pool *pool, size_t offset) {
+    size_t bucket = trie_text_bucket(pool, text_at(pool, offset), text_len_get(pool, offset));
+    trie_text_link next = text_link_get(pool, offset);
+
+    if (pool->text_buckets[bucket] == offset + 1) {
+        pool->text_buckets[bucket] = next;
+        return;
+    }
+    for (trie_text_link link = pool->text_buckets[bucket]; link != 0;
+         link = text_link_get(pool, link - 1)) {
+        if (text_link_get(pool, link - 1) == offset + 1) {
+            text_link_set(pool, link - 1, next);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Drops a reference to an interned text.
+ *
+ * The allocation holding the text is found in the text's index bucket: a text shares its
+ * tail, and so its bucket, with the allocation it points into. Unreferenced allocations stay
+ * in place (later inserts may revive them) unless they sit at the end of the pool, in which
+ * case they are handed back to the bump allocator, walking back over the preceding ones.
+ */
+void trie_release_text(struct text_expander_pool *pool, const char *text) {
+    size_t len = strlen(text);
+    trie_text_link link = pool->text_bucket_count > 0 ? pool->text_buckets[trie_text_bucket(pool, text, len)] : 0;
+
+    for (; link != 0; link = text_link_get(pool, link - 1)) {
+        size_t offset = link - 1;
+        const char *start = text_at(pool, offset);
+        if (text >= start && text <= start + text_len_get(pool, offset)) {
+            break;
+        }
+    }
+    if (link == 0) {
+        LOG_WRN("Released text %p is not part of this text pool.", (void *)text);
+        return;
+    }
+
+    uint16_t refs = text_refs_get(pool, link - 1);
+    if (refs > 0) {
+        text_refs_set(pool, link - 1, refs - 1);
+    }
+
+    // Trim unreferenced allocations off the end of the pool.
+    while (pool->text_pool_used > 0 && text_refs_get(pool, pool->text_pool_last) == 0) {
+        size_t offset = pool->text_pool_last;
+        text_unlink(pool, offset);
+        pool->text_pool_used = offset;
+        if (offset > 0) {
+            pool->text_pool_last = text_prev(pool, offset);
+        }
+    }
+}
+
+void trie_reset_text(struct text_expander_pool *pool) {
+    pool->text_pool_used = 0;
+    pool->text_pool_last = 0;
+    if (pool->text_bucket_count > 0) {
+        memset(pool->text_buckets, 0, pool->text_bucket_count * sizeof(pool->text_buckets[0]));
+    }
+}
+
+/**
+ * @brief Reports text storage usage of the bump allocator.
+ *
+ * Unreferenced allocations below the end of the pool are neither in use nor available until
+ * an identical or suffix text revives them, so they count as fragmentation.
+ */
+void trie_text_stats(const struct text_expander_pool *pool, struct zmk_text_expander_text_stats *stats) {
+    size_t dead = 0;
+
+    stats->count = 0;
+    for (size_t offset = 0; offset < pool->text_pool_used; offset = text_next(pool, offset)) {
+        if (text_refs_get(pool, offset) > 0) {
+            stats->count++;
+        } else {
+            dead += text_next(pool, offset) - offset;
+        }
+    }
+    stats->capacity = pool->text_pool_size;
+    stats->used = pool->text_pool_used - dead;
+    stats->free = pool->text_pool_size - pool->text_pool_used;
+    stats->fragmented = dead;
+    stats->peak = pool->text_pool_peak;
+}
+#endif // !CONFIG_ZMK_TEXT_EXPANDER_TEXT_ALLOC_HEAP
+
+/**
+ * @brief Resets both memory pools of a pool generation.
+ *
+ * All nodes and text previously allocated from `pool` become available again. Callers must
+ * make sure no reader can still reach a trie built from this pool.
+ *
+ * @param pool Pointer to the `text_expander_pool` to reset.
+ */
+void trie_reset_pool(struct text_expander_pool *pool) {
+    pool->node_pool_used = 0;
+    pool->node_pool_next = 0;
+    pool->node_free_list = NULL;
+    pool->node_retired_list = NULL;
+    trie_reset_text(pool);
 }
 
 /**
@@ -187,128 +527,150 @@ const char *trie_get_expanded_text(struct trie_node *node) {
 /**
  * @brief Inserts a key-value pair (short code and its expansion) into the trie.
  *
- * If the key already exists and is terminal:
- * - If the new value fits into the previously allocated space for the old value,
- * the old value is overwritten.
- * - If the new value is longer, new space is allocated, and the old space is orphaned
- * (not immediately reclaimed, but will be "freed" if `zmk_text_expander_clear_all` is called).
+ * Unless `flash_text` is set, the value is interned: identical texts and texts that are a
+ * suffix of an existing one share storage. Otherwise the node points at `value` itself.
+ * If the key already exists and is terminal, it is pointed at the new text and its
+ * reference to the old one is released (if the old text was interned).
  * If the key path exists but the node wasn't terminal, it's marked terminal and value stored.
  * If the key path doesn't fully exist, new nodes are allocated as needed.
  *
  * @param root The root node of the trie.
  * @param key The null-terminated short code string (must be lowercase alphanumeric).
  * @param value The null-terminated expanded text string.
- * @param data Pointer to `text_expander_data` for memory allocation from pools.
+ * @param pool Pointer to the `text_expander_pool` the trie allocates nodes and text from.
+ * @param flash_text True to reference `value` in place instead of interning a copy.
  * @return 0 on success.
- * @return -EINVAL if `root`, `key`, or `value` is NULL, or if `key` contains invalid characters.
+ * @return -EINVAL if `root`, `key`, or `value` is NULL, if `key` is too long, or if `key`
+ * contains invalid characters.
  * @return -ENOMEM if memory allocation for a new node or text storage fails.
  */
-int trie_insert(struct trie_node *root, const char *key, const char *value, struct text_expander_data *data) {
+static int trie_insert_text(struct trie_node *root, const char *key, const char *value,
+                            struct text_expander_pool *pool, bool flash_text) {
     if (!root || !key || !value) { // Null checks.
         return -EINVAL;
     }
 
+    // The path is remembered so nodes created for a failed insert can be freed again.
+    struct trie_node *path[MAX_SHORT_LEN];
+    int indices[MAX_SHORT_LEN];
+    int depth = 0;
     struct trie_node *current = root; // Start from root.
+    path[0] = root;
 
     // Traverse/create path for the key.
     for (int i = 0; key[i] != '\0'; i++) {
         char c = key[i];
         int index = char_to_trie_index(c);
-        if (index == -1) { // Invalid character in short code.
-            LOG_ERR("Invalid character '%c' (0x%02x) in short code '%s' during insert.", c, c, key);
+        if (index == -1 || depth + 1 >= MAX_SHORT_LEN) { // Invalid character or key too long.
+            LOG_ERR("Invalid character '%c' (0x%02x) or length in short code '%s' during insert.", c, c, key);
+            trie_prune(pool, path, indices, depth);
             return -EINVAL;
         }
 
         if (!current->children[index]) { // If path doesn't exist, create new node.
-            current->children[index] = trie_allocate_node(data);
-            if (!current->children[index]) { // Allocation failed.
+            struct trie_node *child = trie_allocate_node(pool);
+            if (!child) { // Allocation failed.
                 LOG_ERR("Failed to allocate trie node for key '%s' at char '%c'.", key, c);
+                trie_prune(pool, path, indices, depth);
                 return -ENOMEM;
             }
+            // The keycode listener walks the trie without locking. Make sure the zeroed node is
+            // visible before it becomes reachable, so readers never follow stale child pointers.
+            barrier_dmem_fence_full();
+            current->children[index] = child;
         }
         current = current->children[index]; // Move to next node.
+        indices[depth++] = index;
+        path[depth] = current;
     }
 
     // At this point, `current` is the node corresponding to the end of the `key`.
 
-    // Handle updating an existing expansion.
-    if (current->is_terminal && current->expanded_text) {
-        size_t new_len = strlen(value) + 1; // +1 for null terminator.
-        size_t old_len = strlen(current->expanded_text) + 1;
-
-        // If new text can fit in the space of the old text, reuse the storage.
-        if (new_len <= old_len) {
-            strcpy(current->expanded_text, value); // Overwrite old text.
-            LOG_DBG("Updated existing expansion for '%s' by overwriting in-place.", key);
-            return 0; // Successful update.
-        }
-        // New text is longer. The old text_pool space will be orphaned.
-        // The new text will be allocated in a new segment of the text_pool.
-        LOG_WRN("New expansion for '%s' ('%s', len %zu) is longer than old ('%s', len %zu). Old text pool space will be orphaned.",
-                key, value, new_len, current->expanded_text, old_len);
-        // Proceed to allocate new space below.
-    }
-
-    // Allocate storage for the expanded text.
-    size_t text_len = strlen(value) + 1; // +1 for null terminator.
-    current->expanded_text = trie_allocate_text_storage(data, text_len);
-    if (!current->expanded_text) { // Text storage allocation failed.
+    // Store the expanded text, sharing an existing allocation if possible. Constant texts are
+    // referenced where they are. On failure an existing expansion keeps its old text.
+    const char *text = flash_text ? value : trie_intern_text(pool, value);
+    if (!text) { // Text storage allocation failed.
         LOG_ERR("Failed to allocate text storage for value '%s' (key '%s').", value, key);
-        // Note: If nodes were created along the path (and were not pre-existing), they are not cleaned up
-        // here on this specific failure. This could lead to orphaned nodes if the insert fails at
-        // text allocation after new nodes were made for this key. A full `clear_all` would reclaim them.
-        // Ensuring sufficient text_pool size is the primary mitigation.
+        trie_prune(pool, path, indices, depth); // Free the nodes created for this key, if any.
         return -ENOMEM;
     }
 
-    strcpy(current->expanded_text, value); // Copy the value into the allocated space.
+    // Texts may be shared with other keys, so an update never overwrites the old text in place.
+    // The reference to it is dropped once the node points at the new one.
+    // Constant texts are not owned by the pool and are never released.
+    const char *old_text = current->is_terminal && !current->flash_text ? current->expanded_text : NULL;
+
+    // A new short code is counted by every node on its path, the root included.
+    if (!current->is_terminal) {
+        for (int i = 0; i <= depth; i++) {
+            path[i]->terminal_count++;
+        }
+    }
+
+    barrier_dmem_fence_full();             // Publish the text before the node points at it.
+    current->expanded_text = text;
+    current->flash_text = flash_text;
     current->is_terminal = true;           // Mark this node as terminal.
-    LOG_DBG("Trie: Inserted '%s' -> '%s' at node %p, text at %p",
-            key, current->expanded_text, (void*)current, (void*)current->expanded_text);
+    if (old_text) {
+        trie_release_text(pool, old_text);
+    }
+    LOG_DBG("Trie: Inserted '%s' -> '%s' at node %p, text at %p%s",
+            key, current->expanded_text, (void*)current, (void*)current->expanded_text,
+            flash_text ? " (constant)" : "");
 
     return 0; // Success.
 }
 
+int trie_insert(struct trie_node *root, const char *key, const char *value, struct text_expander_pool *pool) {
+    return trie_insert_text(root, key, value, pool, false);
+}
+
+int trie_insert_static(struct trie_node *root, const char *key, const char *value,
+                       struct text_expander_pool *pool) {
+    return trie_insert_text(root, key, value, pool, true);
+}
+
 /**
- * @brief "Deletes" a key (short code) from the trie by marking its node as non-terminal.
+ * @brief Deletes a key (short code) from the trie.
  *
- * This implementation does not reclaim the memory used by the `expanded_text` string
- * in the `text_pool`, nor does it free the `trie_node`s themselves from the `node_pool`.
- * The memory becomes "orphaned" until a full `zmk_text_expander_clear_all()` resets the pools.
- * This is a common simplification for embedded systems to avoid complex memory management
- * like reference counting or garbage collection for the trie structure itself.
+ * The node's reference to its `expanded_text` is released, so the text storage can be reused
+ * once no other key shares it. Constant texts (see trie_insert_static()) are left alone.
+ * Nodes that no longer lead to any expansion are unlinked and returned to the node_pool.
  *
  * @param root The root node of the trie.
  * @param key The null-terminated short code string to delete.
- * @return 0 on success (key found and marked as non-terminal).
+ * @param pool Pointer to the `text_expander_pool` the trie's texts were interned in.
+ * @return 0 on success (key found and deleted).
  * @return -EINVAL if `root` or `key` is NULL, or `key` contains invalid characters.
  * @return -ENOENT if the key is not found in the trie or is not a terminal node.
  */
-int trie_delete(struct trie_node *root, const char *key) {
+int trie_delete(struct trie_node *root, const char *key, struct text_expander_pool *pool) {
     if (!root || !key) {
         return -EINVAL;
     }
 
+    // The path is remembered so the nodes left without purpose can be freed afterwards.
+    struct trie_node *path[MAX_SHORT_LEN];
+    int indices[MAX_SHORT_LEN];
+    int depth = 0;
     struct trie_node *current = root;
-    // The `path` array is not used in this simplified delete, but was present in original.
-    // It would be needed for actual node pruning if that were implemented.
-    // struct trie_node *path[MAX_SHORT_LEN]; // MAX_SHORT_LEN from text_expander_internals.h
-    // int path_len = 0;
+    path[0] = root;
 
     // Traverse to the node corresponding to the key.
-    for (int i = 0; key[i] != '\0' /* && path_len < MAX_SHORT_LEN (if path was used) */; i++) {
+    for (int i = 0; key[i] != '\0'; i++) {
         char c = key[i];
         int index = char_to_trie_index(c);
         if (index == -1) { // Invalid character.
             return -EINVAL;
         }
 
-        if (!current->children[index]) { // Path does not exist.
+        if (!current->children[index] || depth + 1 >= MAX_SHORT_LEN) { // Path does not exist.
             return -ENOENT; // "No such entry".
         }
 
-        // path[path_len++] = current; // If path tracking was needed for pruning.
         current = current->children[index];
+        indices[depth++] = index;
+        path[depth] = current;
     }
 
     // After traversal, `current` is the node for the last char of `key`.
@@ -317,14 +679,251 @@ int trie_delete(struct trie_node *root, const char *key) {
         return -ENOENT;
     }
 
+    const char *text = current->flash_text ? NULL : current->expanded_text;
     current->is_terminal = false;      // Mark as non-terminal.
-    current->expanded_text = NULL;     // Clear the pointer to the text (text itself remains in pool).
+    current->expanded_text = NULL;     // Clear the pointer to the text.
+    current->flash_text = false;
+    for (int i = 0; i <= depth; i++) {
+        path[i]->terminal_count--;     // The short code no longer counts on its path.
+    }
+    if (text) {
+        trie_release_text(pool, text); // Storage is reused once no other key shares it.
+    }
 
-    LOG_DBG("Marked expansion for '%s' as deleted (node %p made non-terminal).", key, (void*)current);
-    
-    // Pruning of trie nodes (if they become childless and are not terminal) is not implemented
-    // in this version to keep memory management simpler. If it were, one would traverse `path`
-    // backwards from `current` to `root`, checking if nodes can be removed.
+    trie_prune(pool, path, indices, depth);
+    LOG_DBG("Deleted expansion for '%s' (%zu nodes in use).", key, pool->node_pool_used);
 
     return 0; // Success.
 }
+
+/**
+ * @brief Counts the short codes starting with a prefix and completes the prefix if it is unique.
+ *
+ * @param root The root node of the trie.
+ * @param prefix The null-terminated prefix.
+ * @param key Output: the only short code starting with prefix, if the return value is 1.
+ * @param size Size of the key buffer.
+ * @return Number of short codes starting with prefix, or 0 if a unique one cannot be completed.
+ */
+size_t trie_complete(struct trie_node *root, const char *prefix, char *key, size_t size) {
+    struct trie_node *node = trie_get_node_for_key(root, prefix);
+    if (!node || node->terminal_count != 1) {
+        return node ? node->terminal_count : 0;
+    }
+
+    size_t len = strlen(prefix);
+    if (len >= size) {
+        return 0;
+    }
+    memcpy(key, prefix, len);
+
+    // Follow the only branch that still counts a terminal node. The listener reads the trie
+    // without locking, so a walk that finds no such branch or grows too long gives up.
+    while (!node->is_terminal) {
+        int next = -1;
+        for (int i = 0; i < TRIE_ALPHABET_SIZE; i++) {
+            if (node->children[i] && node->children[i]->terminal_count > 0) {
+                next = i;
+                break;
+            }
+        }
+        if (next < 0 || len + 1 >= size) {
+            return 0;
+        }
+        key[len++] = (next < 26) ? ('a' + next) : ('0' + (next - 26)); // Inverse of char_to_trie_index().
+        node = node->children[next];
+    }
+    key[len] = '\0';
+    return 1;
+}
+
+int trie_key_compare(const char *a, const char *b) {
+    size_t len_a = strlen(a);
+    size_t len_b = strlen(b);
+    if (len_a != len_b) {
+        return len_a < len_b ? -1 : 1;
+    }
+    for (size_t i = 0; i < len_a; i++) {
+        int diff = char_to_trie_index(a[i]) - char_to_trie_index(b[i]);
+        if (diff != 0) {
+            return diff;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Recursive helper for trie_next_candidate(). Recursion is bounded by the key size.
+ *
+ * Children are visited in alphabet order, so of two short codes of the same length the one
+ * found first ranks first: once a candidate of length n is known, nothing at depth n or below
+ * can beat it.
+ *
+ * @param node Node reached by the first depth characters of path.
+ * @param path The short code of node, built up during the walk.
+ * @param depth Length of the short code of node.
+ * @param after Candidate to rank after, or NULL.
+ * @param key In/out: the best candidate so far.
+ * @param size Size of the path and key buffers.
+ * @param found In/out: whether key holds a candidate.
+ */
+static void trie_candidate_walk(const struct trie_node *node, char *path, size_t depth, const char *after,
+                                char *key, size_t size, bool *found) {
+    if (*found && depth >= strlen(key)) {
+        return;
+    }
+    if (node->is_terminal && node->expanded_text) {
+        path[depth] = '\0';
+        if (!after || trie_key_compare(path, after) > 0) {
+            memcpy(key, path, depth + 1);
+            *found = true;
+            return; // Its descendants are all longer.
+        }
+    }
+    if (depth + 1 >= size) {
+        return;
+    }
+
+    for (int i = 0; i < TRIE_ALPHABET_SIZE; i++) {
+        const struct trie_node *child = node->children[i];
+        if (!child || child->terminal_count == 0) {
+            continue;
+        }
+        path[depth] = (i < 26) ? ('a' + i) : ('0' + (i - 26)); // Inverse of char_to_trie_index().
+        trie_candidate_walk(child, path, depth + 1, after, key, size, found);
+    }
+}
+
+/**
+ * @brief Finds the first short code starting with a prefix that ranks after another one.
+ *
+ * @param root The root node of the trie.
+ * @param prefix The null-terminated prefix.
+ * @param after The previous candidate, or NULL for the first one.
+ * @param key Output: the candidate.
+ * @param size Size of the key buffer.
+ * @return True if a candidate was found.
+ */
+bool trie_next_candidate(struct trie_node *root, const char *prefix, const char *after, char *key, size_t size) {
+    char path[MAX_SHORT_LEN];
+    struct trie_node *node = trie_get_node_for_key(root, prefix);
+    size_t len = strlen(prefix);
+    bool found = false;
+
+    if (!node || node->terminal_count == 0 || len >= MIN(size, sizeof(path))) {
+        return false;
+    }
+    memcpy(path, prefix, len);
+    trie_candidate_walk(node, path, len, after, key, MIN(size, sizeof(path)), &found);
+    return found;
+}
+
+/**
+ * @brief Recursive helper for trie_for_each().
+ *
+ * @param node The node currently being visited.
+ * @param key Buffer holding the short code leading to `node`.
+ * @param depth Number of valid characters in `key`.
+ * @param cb Callback invoked for terminal nodes.
+ * @param user_data Opaque pointer passed to the callback.
+ * @return 0 to continue, or the negative value returned by the callback.
+ */
+static int trie_for_each_node(struct trie_node *node, char *key, int depth,
+                              trie_visit_cb cb, void *user_data) {
+    if (node->is_terminal && node->expanded_text) {
+        key[depth] = '\0';
+        int ret = cb(key, node->expanded_text, user_data);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    // Short codes are limited to MAX_SHORT_LEN - 1 characters, so deeper paths cannot exist.
+    if (depth >= MAX_SHORT_LEN - 1) {
+        return 0;
+    }
+
+    for (int i = 0; i < TRIE_ALPHABET_SIZE; i++) {
+        if (!node->children[i]) {
+            continue;
+        }
+        key[depth] = (i < 26) ? ('a' + i) : ('0' + (i - 26)); // Inverse of char_to_trie_index().
+        int ret = trie_for_each_node(node->children[i], key, depth + 1, cb, user_data);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Visits every stored expansion in the trie.
+ *
+ * Walks the trie depth-first, visiting children in alphabet order, so short codes are
+ * reported in lexicographic order (letters before digits).
+ *
+ * @param root The root node of the trie.
+ * @param cb Callback invoked as `cb(short_code, expanded_text, user_data)` for each expansion.
+ * @param user_data Opaque pointer passed to the callback.
+ * @return 0 on success, -EINVAL if `root` or `cb` is NULL, or the first negative value
+ * returned by the callback.
+ */
+int trie_for_each(struct trie_node *root, trie_visit_cb cb, void *user_data) {
+    if (!root || !cb) {
+        return -EINVAL;
+    }
+
+    char key[MAX_SHORT_LEN];
+    return trie_for_each_node(root, key, 0, cb, user_data);
+}
+
+struct trie_node *trie_next_key(struct trie_node *root, const char *after, char *key, size_t size) {
+    struct trie_node *path[MAX_SHORT_LEN]; // path[i] is the node of the first i characters of key.
+    size_t limit = MIN(size, MAX_SHORT_LEN);
+    size_t len = strlen(after);
+    size_t depth;
+    int next = 0; // First child of path[depth] that comes after `after`.
+
+    if (!root || len >= limit) {
+        return NULL;
+    }
+
+    // Follow `after` as far as it still exists. Its own subtree comes next; if the path breaks
+    // off, the siblings after the missing child do.
+    path[0] = root;
+    for (depth = 0; depth < len; depth++) {
+        int index = char_to_trie_index(after[depth]);
+        struct trie_node *child = index >= 0 ? path[depth]->children[index] : NULL;
+        if (!child) {
+            next = index + 1;
+            break;
+        }
+        key[depth] = after[depth];
+        path[depth + 1] = child;
+    }
+
+    // Depth-first from there: the first terminal node reached is the next short code. Subtrees
+    // without terminal nodes are skipped, so every step down leads to one.
+    while (true) {
+        int i = next;
+        while (i < TRIE_ALPHABET_SIZE &&
+               !(path[depth]->children[i] && path[depth]->children[i]->terminal_count > 0)) {
+            i++;
+        }
+        if (i < TRIE_ALPHABET_SIZE && depth + 1 < limit) {
+            key[depth] = (i < 26) ? ('a' + i) : ('0' + (i - 26)); // Inverse of char_to_trie_index().
+            path[depth + 1] = path[depth]->children[i];
+            depth++;
+            if (path[depth]->is_terminal) {
+                key[depth] = '\0';
+                return path[depth];
+            }
+            next = 0;
+        } else if (depth == 0) {
+            return NULL;
+        } else {
+            depth--;
+            next = char_to_trie_index(key[depth]) + 1;
+        }
+    }
+}
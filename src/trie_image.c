@@ -0,0 +1,188 @@
+#include <zephyr/kernel.h>      // For BUILD_ASSERT.
+#include <zephyr/logging/log.h> // For Zephyr's logging API.
+#include <zephyr/sys/byteorder.h> // For sys_le16_to_cpu/sys_le32_to_cpu.
+#include <zephyr/sys/crc.h>     // For crc32_ieee().
+#include <errno.h>              // For error codes.
+#include <string.h>             // For memcpy.
+
+#include <zmk/trie_image.h> // Header for this module.
+
+LOG_MODULE_DECLARE(zmk_behavior_text_expander, CONFIG_ZMK_LOG_LEVEL);
+
+BUILD_ASSERT(sizeof(struct trie_image_header) == 56, "Trie image header layout changed");
+BUILD_ASSERT(sizeof(struct trie_image_node) == 8, "Trie image node layout changed");
+BUILD_ASSERT(sizeof(struct trie_image_edge) == 12, "Trie image edge layout changed");
+
+/**
+ * @brief Returns a pointer to the image header.
+ */
+static inline const struct trie_image_header *image_header(const void *image) {
+    return (const struct trie_image_header *)image;
+}
+
+/**
+ * @brief Returns a pointer to node `index` of a validated image.
+ */
+static inline const struct trie_image_node *image_node(const void *image, uint32_t index) {
+    const struct trie_image_header *hdr = image_header(image);
+    return (const struct trie_image_node *)((const uint8_t *)image + sys_le32_to_cpu(hdr->nodes_offset)) + index;
+}
+
+/**
+ * @brief Follows the edge labelled `symbol` out of a node.
+ *
+ * Edges are sorted by symbol, so the scan stops as soon as it passes the symbol.
+ * Indices are bounds-checked so a corrupted image can never lead outside of it.
+ *
+ * @param entry In/out: entry number accumulated along the path; the edge's skip is added.
+ * @return Pointer to the child node, or NULL if there is no such edge.
+ */
+static const struct trie_image_node *image_step(const void *image, const struct trie_image_node *node,
+                                                char symbol, uint32_t *entry) {
+    const struct trie_image_header *hdr = image_header(image);
+    const struct trie_image_edge *edges =
+        (const struct trie_image_edge *)((const uint8_t *)image + sys_le32_to_cpu(hdr->edges_offset));
+    uint32_t first = sys_le32_to_cpu(node->first_edge);
+    uint32_t edge_count = sys_le32_to_cpu(hdr->edge_count);
+
+    for (uint32_t i = first; i < first + node->edge_count && i < edge_count; i++) {
+        if (edges[i].symbol == (uint8_t)symbol) {
+            uint32_t child = sys_le32_to_cpu(edges[i].child);
+            *entry += sys_le32_to_cpu(edges[i].skip);
+            return child < sys_le32_to_cpu(hdr->node_count) ? image_node(image, child) : NULL;
+        }
+        if (edges[i].symbol > (uint8_t)symbol) {
+            break; // Sorted: the symbol can't appear further on.
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief Walks the path for key from the root.
+ *
+ * @param entry Output: number of the entry key would have if the node at the end is terminal.
+ * @return Pointer to the node at the end of the path, or NULL if the path does not exist.
+ */
+static const struct trie_image_node *image_find_node(const void *image, const char *key, uint32_t *entry) {
+    if (!image || !key) {
+        return NULL;
+    }
+
+    const struct trie_image_node *node = image_node(image, 0);
+    *entry = 0;
+    for (const char *p = key; *p != '\0' && node; p++) {
+        node = image_step(image, node, *p, entry);
+    }
+    return node;
+}
+
+/**
+ * @brief Checks that a section of `count` elements of `elem_size` bytes fits into the image.
+ */
+static bool section_fits(uint32_t offset, uint32_t count, size_t elem_size, uint32_t total_size) {
+    uint64_t end = (uint64_t)offset + (uint64_t)count * elem_size;
+    return offset <= total_size && end <= total_size;
+}
+
+int trie_image_validate(const void *image, size_t size) {
+    const struct trie_image_header *hdr = image_header(image);
+
+    if (!image || size < sizeof(*hdr) || sys_le32_to_cpu(hdr->magic) != TRIE_IMAGE_MAGIC) {
+        return -ENOENT; // Erased partition or foreign data.
+    }
+    if (sys_le16_to_cpu(hdr->version) != TRIE_IMAGE_VERSION) {
+        LOG_ERR("Unsupported trie image version %u (expected %u).",
+                sys_le16_to_cpu(hdr->version), TRIE_IMAGE_VERSION);
+        return -ENOTSUP;
+    }
+
+    uint32_t header_size = sys_le16_to_cpu(hdr->header_size);
+    uint32_t total_size = sys_le32_to_cpu(hdr->total_size);
+    uint32_t texts_offset = sys_le32_to_cpu(hdr->texts_offset);
+    uint32_t entry_count = sys_le32_to_cpu(hdr->entry_count);
+    uint32_t strings_offset = sys_le32_to_cpu(hdr->strings_offset);
+    uint32_t strings_size = sys_le32_to_cpu(hdr->strings_size);
+    if (header_size < sizeof(*hdr) || total_size > size || total_size < header_size ||
+        sys_le32_to_cpu(hdr->node_count) == 0 ||
+        !section_fits(sys_le32_to_cpu(hdr->nodes_offset), sys_le32_to_cpu(hdr->node_count),
+                      sizeof(struct trie_image_node), total_size) ||
+        !section_fits(sys_le32_to_cpu(hdr->edges_offset), sys_le32_to_cpu(hdr->edge_count),
+                      sizeof(struct trie_image_edge), total_size) ||
+        !section_fits(texts_offset, entry_count, sizeof(uint32_t), total_size) ||
+        !section_fits(strings_offset, strings_size, 1, total_size) ||
+        (sys_le32_to_cpu(hdr->nodes_offset) % sizeof(uint32_t)) != 0 ||
+        (sys_le32_to_cpu(hdr->edges_offset) % sizeof(uint32_t)) != 0 ||
+        (texts_offset % sizeof(uint32_t)) != 0) {
+        LOG_ERR("Trie image header is inconsistent (size %u, available %zu).", total_size, size);
+        return -EINVAL;
+    }
+
+    uint32_t crc = crc32_ieee((const uint8_t *)image + header_size, total_size - header_size);
+    if (crc != sys_le32_to_cpu(hdr->crc)) {
+        LOG_ERR("Trie image CRC mismatch (computed 0x%08x, stored 0x%08x).", crc,
+                sys_le32_to_cpu(hdr->crc));
+        return -EINVAL;
+    }
+
+    uint32_t token_count = sys_le32_to_cpu(hdr->token_count);
+    if (token_count > 0) {
+        if (!IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_IMAGE_COMPRESSION)) {
+            LOG_ERR("Trie image is compressed; enable CONFIG_ZMK_TEXT_EXPANDER_IMAGE_COMPRESSION.");
+            return -ENOTSUP;
+        }
+        uint32_t tokens_offset = sys_le32_to_cpu(hdr->tokens_offset);
+        if (token_count > TEXT_CODEC_MAX_TOKENS || !section_fits(tokens_offset, token_count, 2, total_size) ||
+            text_codec_validate((const uint8_t *)image + tokens_offset, token_count) < 0) {
+            LOG_ERR("Trie image token table is invalid.");
+            return -EINVAL;
+        }
+    }
+
+    // Texts must be terminated inside the string table, so lookups can hand out plain pointers.
+    const char *strings = (const char *)image + strings_offset;
+    if (strings_size > 0 && strings[strings_size - 1] != '\0') {
+        LOG_ERR("Trie image string table is not terminated.");
+        return -EINVAL;
+    }
+    const uint32_t *texts = (const uint32_t *)((const uint8_t *)image + texts_offset);
+    for (uint32_t i = 0; i < entry_count; i++) {
+        if (sys_le32_to_cpu(texts[i]) >= strings_size) {
+            LOG_ERR("Trie image entry %u points outside the string table.", i);
+            return -EINVAL;
+        }
+    }
+
+    return 0;
+}
+
+const char *trie_image_search(const void *image, const char *key) {
+    uint32_t entry;
+    const struct trie_image_node *node = image_find_node(image, key, &entry);
+    const struct trie_image_header *hdr = image_header(image);
+    // A corrupted skip could point past the text array; such a key is treated as missing.
+    if (!node || !(node->flags & TRIE_IMAGE_NODE_TERMINAL) || entry >= sys_le32_to_cpu(hdr->entry_count)) {
+        return NULL;
+    }
+
+    const uint32_t *texts = (const uint32_t *)((const uint8_t *)image + sys_le32_to_cpu(hdr->texts_offset));
+    return (const char *)image + sys_le32_to_cpu(hdr->strings_offset) + sys_le32_to_cpu(texts[entry]);
+}
+
+bool trie_image_has_prefix(const void *image, const char *key) {
+    uint32_t entry;
+    return image_find_node(image, key, &entry) != NULL;
+}
+
+uint32_t trie_image_entry_count(const void *image) {
+    return image ? sys_le32_to_cpu(image_header(image)->entry_count) : 0;
+}
+
+void trie_image_get_tokens(const void *image, struct text_codec_table *table) {
+    const struct trie_image_header *hdr = image_header(image);
+
+    table->count = image ? sys_le32_to_cpu(hdr->token_count) : 0;
+    if (table->count > 0) {
+        memcpy(table->pairs, (const uint8_t *)image + sys_le32_to_cpu(hdr->tokens_offset), table->count * 2);
+    }
+}
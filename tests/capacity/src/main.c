@@ -0,0 +1,286 @@
+/*
+ * Capacity and cost tests of the runtime dictionary.
+ *
+ * Checks what the documentation promises about memory: the default pools hold MAX_EXPANSIONS
+ * expansions of the average size, one of them of the maximum length; the memory statistics add
+ * up to the documented cost per node and per text; identical texts and long suffixes share
+ * storage. Then compares what updates and key presses cost in a small and in a full dictionary.
+ * The cost tests need a clock that counts executed instructions, as QEMU's icount mode on
+ * qemu_x86 provides, so their numbers repeat from run to run; elsewhere they are skipped.
+ */
+
+#include <stdio.h>  // For snprintf.
+#include <string.h> // For memset, strcpy, strlen.
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+#include <zmk/text_expander.h>
+#include <zmk/text_expander_internals.h>
+#include <zmk/trie.h>
+
+#include <zmk_shim.h>
+
+// The entry sizes the default runtime pools are budgeted for, as in text_expander.c.
+#define AVG_TEXT_LEN MIN(CONFIG_ZMK_TEXT_EXPANDER_AVG_TEXT_LEN, MAX_TEXT_LEN - 1)
+#define AVG_SHORT_LEN MIN(CONFIG_ZMK_TEXT_EXPANDER_AVG_SHORT_LEN, MAX_SHORT_LEN - 1)
+
+#define KEY_DIGITS 3      // Base 36 digits numbering the generated short codes.
+#define TEXT_DIGITS 8     // Decimal digits numbering the generated texts.
+#define SLICES 4          // Update costs are compared between the first and the last quarter.
+#define SMALL_COUNT (MAX_EXPANSIONS / 8) // Entries of the small dictionary of the key press test.
+
+// Most an operation may cost in a full dictionary, in percent of its cost in a small one. Text
+// index buckets fill up as the dictionary grows, so some growth is expected; scanning or copying
+// the whole dictionary on every operation would cost about seven times as much.
+#define MAX_SLOWDOWN_PERCENT 200
+
+BUILD_ASSERT(MAX_EXPANSIONS < 35 * 36 * 36, "Generated short codes must not start with '9'");
+BUILD_ASSERT(AVG_TEXT_LEN >= TEXT_DIGITS && TEXT_DIGITS >= TRIE_TEXT_INDEX_TAIL,
+             "Generated texts must differ in their index tail");
+
+static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789";
+
+static char text_buf[MAX_TEXT_LEN];
+
+/**
+ * @brief Generates the short code of entry i: KEY_DIGITS base 36 digits and an 's'.
+ *
+ * Consecutive entries share all but their last digit, as the words of a real dictionary share
+ * their stems, so an entry adds two trie nodes, or more when a higher digit changes.
+ */
+static void entry_key(uint32_t i, char *key) {
+    for (int d = KEY_DIGITS - 1; d >= 0; d--) {
+        key[d] = alphabet[i % 36];
+        i /= 36;
+    }
+    strcpy(&key[KEY_DIGITS], "s");
+}
+
+/**
+ * @brief Generates the text of entry i: AVG_TEXT_LEN characters ending in the entry number.
+ *
+ * The texts are distinct and none is a suffix of another, so each one is stored on its own.
+ */
+static void entry_text(uint32_t i, char *text) {
+    memset(text, '-', AVG_TEXT_LEN - TEXT_DIGITS);
+    snprintf(&text[AVG_TEXT_LEN - TEXT_DIGITS], TEXT_DIGITS + 1, "%0*u", TEXT_DIGITS, (unsigned int)i);
+}
+
+/**
+ * @brief Adds the entries first to last - 1 through the public API.
+ *
+ * @return Cycles taken by the adds.
+ */
+static uint32_t add_entries(uint32_t first, uint32_t last) {
+    char key[MAX_SHORT_LEN];
+    uint32_t cycles = 0;
+
+    for (uint32_t i = first; i < last; i++) {
+        entry_key(i, key);
+        entry_text(i, text_buf);
+        uint32_t start = k_cycle_get_32();
+        int ret = zmk_text_expander_add_expansion(key, text_buf);
+        cycles += k_cycle_get_32() - start;
+        zassert_ok(ret, "Adding entry %u of %d failed (%d)", i, MAX_EXPANSIONS, ret);
+    }
+    return cycles;
+}
+
+/**
+ * @brief Removes the entries first to last - 1 through the public API.
+ *
+ * @return Cycles taken by the removes.
+ */
+static uint32_t remove_entries(uint32_t first, uint32_t last) {
+    char key[MAX_SHORT_LEN];
+    uint32_t cycles = 0;
+
+    for (uint32_t i = first; i < last; i++) {
+        entry_key(i, key);
+        uint32_t start = k_cycle_get_32();
+        int ret = zmk_text_expander_remove_expansion(key);
+        cycles += k_cycle_get_32() - start;
+        zassert_ok(ret, "Removing entry %u failed (%d)", i, ret);
+    }
+    return cycles;
+}
+
+/**
+ * @brief Types the short codes of the first count entries, each followed by a space.
+ *
+ * @return Cycles taken, divided among count * (KEY_DIGITS + 2) key presses.
+ */
+static uint32_t type_entries(uint32_t count) {
+    char key[MAX_SHORT_LEN];
+
+    zmk_shim_reset();
+    uint32_t start = k_cycle_get_32();
+    for (uint32_t i = 0; i < count; i++) {
+        entry_key(i, key);
+        zassert_ok(zmk_shim_type(key));
+        zassert_ok(zmk_shim_type(" "));
+    }
+    return k_cycle_get_32() - start;
+}
+
+static size_t shared_prefix_len(const char *a, const char *b) {
+    size_t len = 0;
+    while (a[len] && a[len] == b[len]) {
+        len++;
+    }
+    return len;
+}
+
+/**
+ * @brief Skips a cost test unless the clock counts executed instructions.
+ *
+ * Elsewhere the numbers would be noise; on native_sim the clock even stands still while code runs.
+ */
+static void require_instruction_clock(void) {
+    if (!IS_ENABLED(CONFIG_QEMU_ICOUNT)) {
+        ztest_test_skip();
+    }
+}
+
+/**
+ * @brief Prints the cost of an operation in a small and a full dictionary and compares them.
+ *
+ * @param what Name of the operation.
+ * @param small Cycles taken by ops operations in a small dictionary.
+ * @param full Cycles taken by ops operations in a full dictionary.
+ * @param ops Number of operations measured each time.
+ */
+static void check_cost(const char *what, uint32_t small, uint32_t full, uint32_t ops) {
+    TC_PRINT("%s: %u ns in a small dictionary, %u ns in a full one\n", what,
+             (uint32_t)(k_cyc_to_ns_floor64(small) / ops), (uint32_t)(k_cyc_to_ns_floor64(full) / ops));
+    zassert_true((uint64_t)full * 100 <= (uint64_t)small * MAX_SLOWDOWN_PERCENT,
+                 "%s: %u cycles in a full dictionary, %u in a small one", what, full, small);
+}
+
+ZTEST(text_expander_capacity, test_pool_sizes) {
+    struct zmk_text_expander_memory_stats stats;
+
+    zassert_ok(zmk_text_expander_get_memory_stats(&stats));
+    // AVG_SHORT_LEN nodes per expansion, room for one short code of MAX_SHORT_LEN - 1
+    // characters sharing no prefix, and the root.
+    zassert_equal(stats.nodes.capacity, MAX_EXPANSIONS * AVG_SHORT_LEN + (MAX_SHORT_LEN - 1 - AVG_SHORT_LEN) + 1,
+                  "%zu nodes", stats.nodes.capacity);
+    // MAX_EXPANSIONS texts of AVG_TEXT_LEN characters, one of which may be MAX_TEXT_LEN - 1 long.
+    zassert_equal(stats.text.capacity,
+                  ROUND_UP(MAX_EXPANSIONS * (AVG_TEXT_LEN + 1 + TRIE_TEXT_OVERHEAD) +
+                               (MAX_TEXT_LEN - 1 - AVG_TEXT_LEN) + TRIE_TEXT_POOL_OVERHEAD,
+                           8),
+                  "%zu text bytes", stats.text.capacity);
+    // A node takes about 150 bytes on 32-bit targets.
+    if (sizeof(void *) == 4) {
+        zassert_true(sizeof(struct trie_node) <= 160, "%zu bytes per node", sizeof(struct trie_node));
+    }
+}
+
+ZTEST(text_expander_capacity, test_full_dictionary) {
+    struct zmk_text_expander_memory_stats stats;
+    char key[MAX_SHORT_LEN] = "";
+    char prev[MAX_SHORT_LEN] = "";
+    size_t nodes = 1; // The root.
+
+    // MAX_EXPANSIONS - 1 entries of the average size...
+    add_entries(0, MAX_EXPANSIONS - 1);
+    for (uint32_t i = 0; i < MAX_EXPANSIONS - 1; i++) {
+        entry_key(i, key);
+        nodes += strlen(key) - shared_prefix_len(key, prev);
+        strcpy(prev, key);
+    }
+    size_t text_bytes = (MAX_EXPANSIONS - 1) * (AVG_TEXT_LEN + 1 + TRIE_TEXT_OVERHEAD);
+
+    // ...and one of the maximum size, sharing nothing with them.
+    memset(key, '9', MAX_SHORT_LEN - 1);
+    key[MAX_SHORT_LEN - 1] = '\0';
+    memset(text_buf, 'L', MAX_TEXT_LEN - 1);
+    text_buf[MAX_TEXT_LEN - 1] = '\0';
+    zassert_ok(zmk_text_expander_add_expansion(key, text_buf));
+    nodes += MAX_SHORT_LEN - 1;
+    text_bytes += MAX_TEXT_LEN + TRIE_TEXT_OVERHEAD;
+
+    zassert_ok(zmk_text_expander_get_memory_stats(&stats));
+    TC_PRINT("%d expansions: %zu of %zu nodes, %zu of %zu text bytes\n", MAX_EXPANSIONS, stats.nodes.live,
+             stats.nodes.capacity, stats.text.used, stats.text.capacity);
+    // One node per distinct prefix.
+    zassert_equal(stats.nodes.live, nodes, "%zu nodes, expected %zu", stats.nodes.live, nodes);
+    zassert_equal(stats.text.count, MAX_EXPANSIONS, "%zu texts", stats.text.count);
+    // Each text costs its characters, its terminator and TRIE_TEXT_OVERHEAD bytes: exactly with
+    // the bump allocator, at most with the heap allocator.
+    if (IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_TEXT_ALLOC_HEAP)) {
+        zassert_true(stats.text.used <= text_bytes, "%zu text bytes, expected at most %zu", stats.text.used,
+                     text_bytes);
+    } else {
+        zassert_equal(stats.text.used, text_bytes, "%zu text bytes, expected %zu", stats.text.used, text_bytes);
+    }
+
+    // Removing everything returns all of it.
+    zassert_ok(zmk_text_expander_remove_expansion(key));
+    remove_entries(0, MAX_EXPANSIONS - 1);
+    zassert_ok(zmk_text_expander_get_memory_stats(&stats));
+    zassert_equal(stats.nodes.live, 1, "%zu nodes left", stats.nodes.live - 1);
+    zassert_equal(stats.text.used, 0, "%zu text bytes left", stats.text.used);
+}
+
+ZTEST(text_expander_capacity, test_text_sharing) {
+    struct zmk_text_expander_memory_stats before;
+    struct zmk_text_expander_memory_stats after;
+
+    zassert_ok(zmk_text_expander_add_expansion("kr", "Kind regards, Jane"));
+    zassert_ok(zmk_text_expander_get_memory_stats(&before));
+
+    // An identical text and a suffix of at least TRIE_TEXT_INDEX_TAIL characters take no storage.
+    zassert_ok(zmk_text_expander_add_expansion("krj", "Kind regards, Jane"));
+    zassert_ok(zmk_text_expander_add_expansion("rj", "regards, Jane"));
+    zassert_ok(zmk_text_expander_get_memory_stats(&after));
+    zassert_equal(after.text.used, before.text.used, "%zu bytes for shared texts", after.text.used - before.text.used);
+    zassert_equal(after.text.count, 1, "%zu texts", after.text.count);
+
+    // A shorter suffix is stored on its own.
+    zassert_ok(zmk_text_expander_add_expansion("j", "Jane"));
+    zassert_ok(zmk_text_expander_get_memory_stats(&after));
+    zassert_equal(after.text.count, 2, "%zu texts", after.text.count);
+    if (!IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_TEXT_ALLOC_HEAP)) {
+        zassert_equal(after.text.used, before.text.used + strlen("Jane") + 1 + TRIE_TEXT_OVERHEAD);
+    }
+}
+
+ZTEST(text_expander_capacity, test_update_cost) {
+    require_instruction_clock();
+    uint32_t slice = MAX_EXPANSIONS / SLICES;
+
+    // Adds to an almost empty and to an almost full dictionary.
+    uint32_t adds_small = add_entries(0, slice);
+    add_entries(slice, MAX_EXPANSIONS - slice);
+    uint32_t adds_full = add_entries(MAX_EXPANSIONS - slice, MAX_EXPANSIONS);
+    check_cost("add", adds_small, adds_full, slice);
+
+    // Removes from a full and from an almost empty dictionary.
+    uint32_t removes_full = remove_entries(0, slice);
+    remove_entries(slice, MAX_EXPANSIONS - slice);
+    uint32_t removes_small = remove_entries(MAX_EXPANSIONS - slice, MAX_EXPANSIONS);
+    check_cost("remove", removes_small, removes_full, slice);
+}
+
+ZTEST(text_expander_capacity, test_key_press_cost) {
+    require_instruction_clock();
+
+    // The same short codes, typed with SMALL_COUNT and with MAX_EXPANSIONS entries stored.
+    add_entries(0, SMALL_COUNT);
+    uint32_t small = type_entries(SMALL_COUNT);
+    add_entries(SMALL_COUNT, MAX_EXPANSIONS);
+    uint32_t full = type_entries(SMALL_COUNT);
+    check_cost("key press", small, full, SMALL_COUNT * (KEY_DIGITS + 2));
+}
+
+static void capacity_before(void *fixture) {
+    ARG_UNUSED(fixture);
+    zmk_text_expander_clear_all();
+    zmk_shim_reset();
+}
+
+ZTEST_SUITE(text_expander_capacity, NULL, NULL, capacity_before, NULL, NULL);
@@ -0,0 +1,10 @@
+# Shared setup of the text expander tests, included by each test's CMakeLists.txt after
+# find_package(Zephyr).
+#
+# The module under test is added through ZEPHYR_EXTRA_MODULES and the ZMK shims through the
+# include path and zmk_shim.c, so the module's sources build unchanged without ZMK. The models
+# and random numbers the tests share are in test_model.c.
+
+zephyr_include_directories(${CMAKE_CURRENT_LIST_DIR}/include)
+target_sources(app PRIVATE ${CMAKE_CURRENT_LIST_DIR}/src/zmk_shim.c ${CMAKE_CURRENT_LIST_DIR}/src/test_model.c)
+target_include_directories(app PRIVATE ${CMAKE_CURRENT_LIST_DIR}/../../include)
@@ -0,0 +1,22 @@
+#ifndef ZMK_SHIM_DRIVERS_BEHAVIOR_H // Start of include guard.
+#define ZMK_SHIM_DRIVERS_BEHAVIOR_H
+
+#include <zephyr/device.h> // For DEVICE_DT_INST_DEFINE.
+#include <zmk/behavior.h>
+
+// Stand-in for ZMK's behavior driver API. Behaviors are plain Zephyr devices.
+
+#define ZMK_BEHAVIOR_OPAQUE 0
+#define ZMK_BEHAVIOR_TRANSPARENT 1
+
+typedef int (*behavior_keymap_binding_callback_t)(struct zmk_behavior_binding *binding,
+                                                  struct zmk_behavior_binding_event event);
+
+struct behavior_driver_api {
+    behavior_keymap_binding_callback_t binding_pressed;
+    behavior_keymap_binding_callback_t binding_released;
+};
+
+#define BEHAVIOR_DT_INST_DEFINE DEVICE_DT_INST_DEFINE
+
+#endif // ZMK_SHIM_DRIVERS_BEHAVIOR_H End of include guard.
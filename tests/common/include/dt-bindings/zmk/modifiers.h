@@ -0,0 +1,15 @@
+#ifndef ZMK_SHIM_DT_BINDINGS_MODIFIERS_H // Start of include guard.
+#define ZMK_SHIM_DT_BINDINGS_MODIFIERS_H
+
+// Stand-in for ZMK's modifier bits.
+
+#define MOD_LCTL 0x01
+#define MOD_LSFT 0x02
+#define MOD_LALT 0x04
+#define MOD_LGUI 0x08
+#define MOD_RCTL 0x10
+#define MOD_RSFT 0x20
+#define MOD_RALT 0x40
+#define MOD_RGUI 0x80
+
+#endif // ZMK_SHIM_DT_BINDINGS_MODIFIERS_H End of include guard.
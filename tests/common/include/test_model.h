@@ -0,0 +1,86 @@
+#ifndef TEST_MODEL_H // Start of include guard.
+#define TEST_MODEL_H
+
+#include <stdbool.h> // For bool type.
+#include <stddef.h>  // For size_t.
+#include <stdint.h>  // For uint32_t.
+
+#include <zmk/text_expander_internals.h> // For MAX_SHORT_LEN.
+
+/*
+ * Helpers shared by the text expander tests (src/test_model.c).
+ *
+ * A model is a plain array of entries the dictionaries under test are compared against. The
+ * random numbers come from a seeded xorshift32 generator, so a failing run can be replayed
+ * from the seed it prints.
+ */
+
+#define TEST_SEED 0x9E3779B9u      // Seed of the random operations of every test.
+#define TEST_MODEL_CAPACITY 128    // Entries of a model.
+#define TEST_MODEL_TEXT_LEN 128    // Longest text of a model entry, with the terminator.
+
+struct model_entry {
+    char key[MAX_SHORT_LEN];
+    char text[TEST_MODEL_TEXT_LEN];
+};
+
+struct model {
+    struct model_entry entries[TEST_MODEL_CAPACITY];
+    size_t count;
+};
+
+/**
+ * @brief Finds the entry of a short code.
+ *
+ * @return Its index, or -1 if the model has no such entry.
+ */
+int model_find(const struct model *m, const char *key);
+
+/**
+ * @brief Looks up the text of a short code.
+ *
+ * @return The text, or NULL if the model has no such entry.
+ */
+const char *model_lookup(const struct model *m, const char *key);
+
+/**
+ * @brief Adds an entry or replaces its text, failing the test if the model is full.
+ *
+ * @return 0 if key is new, 1 if it had another definition, as text_dict_insert().
+ */
+int model_insert(struct model *m, const char *key, const char *text);
+
+/**
+ * @brief Removes an entry. The last entry takes its place.
+ *
+ * @return 0 on success, or -ENOENT if the model has no such entry.
+ */
+int model_remove(struct model *m, const char *key);
+
+/**
+ * @brief Restarts the random numbers from TEST_SEED and prints the seed.
+ */
+void rnd_reset(void);
+
+/**
+ * @brief Returns the next random number (xorshift32), the same on every platform.
+ */
+uint32_t rnd(void);
+
+/**
+ * @brief Returns a random number below n.
+ */
+uint32_t rnd_below(uint32_t n);
+
+/**
+ * @brief Generates a random short code.
+ *
+ * Small alphabets and lengths make random short codes share prefixes and collide often.
+ *
+ * @param key Output buffer of MAX_SHORT_LEN bytes.
+ * @param alphabet Characters to pick from.
+ * @param max_len Longest short code to generate, at most MAX_SHORT_LEN - 1.
+ */
+void random_key(char *key, const char *alphabet, size_t max_len);
+
+#endif // TEST_MODEL_H End of include guard.
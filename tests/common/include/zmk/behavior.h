@@ -0,0 +1,20 @@
+#ifndef ZMK_SHIM_BEHAVIOR_H // Start of include guard.
+#define ZMK_SHIM_BEHAVIOR_H
+
+#include <stdint.h> // For fixed-width integer types.
+
+// Stand-in for ZMK's behavior bindings.
+
+struct zmk_behavior_binding {
+    const char *behavior_dev;
+    uint32_t param1;
+    uint32_t param2;
+};
+
+struct zmk_behavior_binding_event {
+    int layer;
+    uint32_t position;
+    int64_t timestamp;
+};
+
+#endif // ZMK_SHIM_BEHAVIOR_H End of include guard.
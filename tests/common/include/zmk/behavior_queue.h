@@ -0,0 +1,6 @@
+#ifndef ZMK_SHIM_BEHAVIOR_QUEUE_H // Start of include guard.
+#define ZMK_SHIM_BEHAVIOR_QUEUE_H
+
+// Stand-in for ZMK's behavior queue, which the module includes but does not use.
+
+#endif // ZMK_SHIM_BEHAVIOR_QUEUE_H End of include guard.
@@ -0,0 +1,30 @@
+#ifndef ZMK_SHIM_ENDPOINTS_H // Start of include guard.
+#define ZMK_SHIM_ENDPOINTS_H
+
+#include <stdint.h> // For fixed-width integer types.
+
+#include <zmk/hid.h> // For HID_USAGE_KEY, which ZMK's endpoints.h provides as well.
+
+// Stand-in for ZMK's endpoints: a single USB endpoint is always selected.
+
+#define ZMK_ENDPOINT_COUNT 1
+
+enum zmk_transport {
+    ZMK_TRANSPORT_USB,
+    ZMK_TRANSPORT_BLE,
+};
+
+struct zmk_endpoint_instance {
+    enum zmk_transport transport;
+    union {
+        struct {
+            uint8_t profile_index;
+        } ble;
+    };
+};
+
+struct zmk_endpoint_instance zmk_endpoints_selected(void);
+int zmk_endpoint_instance_to_index(struct zmk_endpoint_instance endpoint);
+int zmk_endpoints_send_report(uint16_t usage_page);
+
+#endif // ZMK_SHIM_ENDPOINTS_H End of include guard.
@@ -0,0 +1,25 @@
+#ifndef ZMK_SHIM_EVENT_MANAGER_H // Start of include guard.
+#define ZMK_SHIM_EVENT_MANAGER_H
+
+// Stand-in for ZMK's event manager: listeners are plain structures and subscriptions are
+// dispatched by the shim (see zmk_shim_key_event()).
+
+#define ZMK_EV_EVENT_BUBBLE 0
+#define ZMK_EV_EVENT_HANDLED 1
+#define ZMK_EV_EVENT_CAPTURED 2
+
+typedef struct zmk_event_t {
+    const char *name; // Type of the event.
+} zmk_event_t;
+
+typedef int (*zmk_listener_callback_t)(const zmk_event_t *eh);
+
+struct zmk_listener {
+    zmk_listener_callback_t callback;
+};
+
+#define ZMK_LISTENER(mod, cb) const struct zmk_listener zmk_listener_##mod = {.callback = cb};
+
+#define ZMK_SUBSCRIPTION(mod, ev_type)
+
+#endif // ZMK_SHIM_EVENT_MANAGER_H End of include guard.
@@ -0,0 +1,29 @@
+#ifndef ZMK_SHIM_KEYCODE_STATE_CHANGED_H // Start of include guard.
+#define ZMK_SHIM_KEYCODE_STATE_CHANGED_H
+
+#include <stdbool.h> // For bool type.
+#include <stdint.h>  // For fixed-width integer types.
+
+#include <zephyr/sys/util.h> // For CONTAINER_OF.
+#include <zmk/event_manager.h>
+
+struct zmk_keycode_state_changed {
+    uint16_t usage_page;
+    uint32_t keycode;
+    uint8_t implicit_modifiers;
+    uint8_t explicit_modifiers;
+    bool state;
+    int64_t timestamp;
+};
+
+// An event as the shim dispatches it: the header followed by the payload, as in ZMK.
+struct zmk_keycode_state_changed_event {
+    zmk_event_t header;
+    struct zmk_keycode_state_changed data;
+};
+
+static inline struct zmk_keycode_state_changed *as_zmk_keycode_state_changed(const zmk_event_t *eh) {
+    return &CONTAINER_OF(eh, struct zmk_keycode_state_changed_event, header)->data;
+}
+
+#endif // ZMK_SHIM_KEYCODE_STATE_CHANGED_H End of include guard.
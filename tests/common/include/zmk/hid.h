@@ -0,0 +1,53 @@
+#ifndef ZMK_SHIM_HID_H // Start of include guard.
+#define ZMK_SHIM_HID_H
+
+#include <stdint.h> // For fixed-width integer types.
+
+// Stand-in for ZMK's HID report API. Only the keyboard page usages the module names are
+// defined; the report itself is recorded by the shim (see zmk_shim_typed()).
+
+#define HID_USAGE_KEY 0x07
+
+#define HID_USAGE_KEY_KEYBOARD_A 0x04
+#define HID_USAGE_KEY_KEYBOARD_Z 0x1D
+#define HID_USAGE_KEY_KEYBOARD_1_AND_EXCLAMATION 0x1E
+#define HID_USAGE_KEY_KEYBOARD_2_AND_AT 0x1F
+#define HID_USAGE_KEY_KEYBOARD_3_AND_HASH 0x20
+#define HID_USAGE_KEY_KEYBOARD_4_AND_DOLLAR 0x21
+#define HID_USAGE_KEY_KEYBOARD_5_AND_PERCENT 0x22
+#define HID_USAGE_KEY_KEYBOARD_6_AND_CARET 0x23
+#define HID_USAGE_KEY_KEYBOARD_7_AND_AMPERSAND 0x24
+#define HID_USAGE_KEY_KEYBOARD_8_AND_ASTERISK 0x25
+#define HID_USAGE_KEY_KEYBOARD_9_AND_LEFT_PARENTHESIS 0x26
+#define HID_USAGE_KEY_KEYBOARD_0_AND_RIGHT_PARENTHESIS 0x27
+#define HID_USAGE_KEY_KEYBOARD_RETURN_ENTER 0x28
+#define HID_USAGE_KEY_KEYBOARD_DELETE_BACKSPACE 0x2A
+#define HID_USAGE_KEY_KEYBOARD_TAB 0x2B
+#define HID_USAGE_KEY_KEYBOARD_SPACEBAR 0x2C
+#define HID_USAGE_KEY_KEYBOARD_MINUS_AND_UNDERSCORE 0x2D
+#define HID_USAGE_KEY_KEYBOARD_EQUAL_AND_PLUS 0x2E
+#define HID_USAGE_KEY_KEYBOARD_LEFT_BRACKET_AND_LEFT_BRACE 0x2F
+#define HID_USAGE_KEY_KEYBOARD_RIGHT_BRACKET_AND_RIGHT_BRACE 0x30
+#define HID_USAGE_KEY_KEYBOARD_BACKSLASH_AND_PIPE 0x31
+#define HID_USAGE_KEY_KEYBOARD_SEMICOLON_AND_COLON 0x33
+#define HID_USAGE_KEY_KEYBOARD_APOSTROPHE_AND_QUOTE 0x34
+#define HID_USAGE_KEY_KEYBOARD_GRAVE_ACCENT_AND_TILDE 0x35
+#define HID_USAGE_KEY_KEYBOARD_COMMA_AND_LESS_THAN 0x36
+#define HID_USAGE_KEY_KEYBOARD_PERIOD_AND_GREATER_THAN 0x37
+#define HID_USAGE_KEY_KEYBOARD_SLASH_AND_QUESTION_MARK 0x38
+#define HID_USAGE_KEY_KEYBOARD_LEFTCONTROL 0xE0
+#define HID_USAGE_KEY_KEYBOARD_LEFTSHIFT 0xE1
+#define HID_USAGE_KEY_KEYBOARD_LEFTALT 0xE2
+#define HID_USAGE_KEY_KEYBOARD_LEFT_GUI 0xE3
+#define HID_USAGE_KEY_KEYBOARD_RIGHTCONTROL 0xE4
+#define HID_USAGE_KEY_KEYBOARD_RIGHTSHIFT 0xE5
+#define HID_USAGE_KEY_KEYBOARD_RIGHTALT 0xE6
+#define HID_USAGE_KEY_KEYBOARD_RIGHT_GUI 0xE7
+
+typedef uint8_t zmk_mod_flags_t;
+
+int zmk_hid_keyboard_press(uint32_t usage);
+int zmk_hid_keyboard_release(uint32_t usage);
+zmk_mod_flags_t zmk_hid_get_explicit_mods(void);
+
+#endif // ZMK_SHIM_HID_H End of include guard.
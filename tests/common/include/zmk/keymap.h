@@ -0,0 +1,13 @@
+#ifndef ZMK_SHIM_KEYMAP_H // Start of include guard.
+#define ZMK_SHIM_KEYMAP_H
+
+#include <stdbool.h> // For bool type.
+#include <stdint.h>  // For uint8_t.
+
+// Stand-in for ZMK's keymap: only the default layer 0 is active.
+
+typedef uint8_t zmk_keymap_layer_id_t;
+
+bool zmk_keymap_layer_active(zmk_keymap_layer_id_t layer);
+
+#endif // ZMK_SHIM_KEYMAP_H End of include guard.
@@ -0,0 +1,65 @@
+#ifndef ZMK_SHIM_H // Start of include guard.
+#define ZMK_SHIM_H
+
+#include <stdbool.h> // For bool type.
+#include <stddef.h>  // For size_t.
+#include <stdint.h>  // For uint32_t.
+
+#include <zephyr/device.h> // For struct device.
+
+#include <zmk/hid.h> // For zmk_mod_flags_t.
+
+/*
+ * Test side of the ZMK shims (src/zmk_shim.c).
+ *
+ * The shims record the keys sent to the host, and let a test type as the user would: key events
+ * go to the host and to the module's keycode listener as ZMK's event manager would send them, and
+ * the behavior key is pressed as ZMK's keymap would press it.
+ */
+
+/**
+ * @brief Sends a key press or release to the host and to the text expander's keycode listener.
+ *
+ * @param keycode HID usage of the key on the keyboard page.
+ * @param modifiers Modifiers implied by the key, e.g. MOD_LSFT for a shifted symbol.
+ * @param pressed True for a press, false for a release.
+ * @return The listener's return value (ZMK_EV_EVENT_BUBBLE, ZMK_EV_EVENT_HANDLED, ...).
+ */
+int zmk_shim_key_event(uint32_t keycode, zmk_mod_flags_t modifiers, bool pressed);
+
+/**
+ * @brief Types a string with zmk_shim_key_event(), one press and release per character.
+ *
+ * '\b' types Backspace.
+ *
+ * @param text Characters to type.
+ * @return 0 on success, -EINVAL on a character no key types (the characters before it are typed).
+ */
+int zmk_shim_type(const char *text);
+
+/**
+ * @brief Presses and releases a text expander behavior key.
+ *
+ * @param dev Behavior device of the text expander instance.
+ * @return The value of the behavior's binding_pressed (ZMK_BEHAVIOR_OPAQUE or ZMK_BEHAVIOR_TRANSPARENT).
+ */
+int zmk_shim_behavior_key(const struct device *dev);
+
+/**
+ * @brief Copies the characters typed to the host since the last zmk_shim_reset().
+ *
+ * Presses are decoded from HID usages back to characters; Backspace removes the last one, and
+ * Ctrl+Backspace or Alt+Backspace the characters back to the previous whitespace.
+ *
+ * @param buf Output buffer, always null-terminated.
+ * @param size Size of buf.
+ * @return Number of characters typed, which may exceed size - 1.
+ */
+size_t zmk_shim_typed(char *buf, size_t size);
+
+/**
+ * @brief Forgets the recorded keys.
+ */
+void zmk_shim_reset(void);
+
+#endif // ZMK_SHIM_H End of include guard.
@@ -0,0 +1,73 @@
+/*
+ * Models and random numbers shared by the text expander tests.
+ */
+
+#include <string.h> // For strcmp, strcpy, strlen.
+
+#include <zephyr/ztest.h>
+
+#include <test_model.h> // Header for this module.
+
+static uint32_t rng_state;
+
+int model_find(const struct model *m, const char *key) {
+    for (size_t i = 0; i < m->count; i++) {
+        if (strcmp(m->entries[i].key, key) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char *model_lookup(const struct model *m, const char *key) {
+    int i = model_find(m, key);
+    return i >= 0 ? m->entries[i].text : NULL;
+}
+
+int model_insert(struct model *m, const char *key, const char *text) {
+    zassert_true(strlen(text) < TEST_MODEL_TEXT_LEN, "text of '%s' too long for the model", key);
+    int i = model_find(m, key);
+    if (i >= 0) {
+        strcpy(m->entries[i].text, text);
+        return 1;
+    }
+    zassert_true(m->count < TEST_MODEL_CAPACITY, "model full");
+    strcpy(m->entries[m->count].key, key);
+    strcpy(m->entries[m->count].text, text);
+    m->count++;
+    return 0;
+}
+
+int model_remove(struct model *m, const char *key) {
+    int i = model_find(m, key);
+    if (i < 0) {
+        return -ENOENT;
+    }
+    m->entries[i] = m->entries[--m->count];
+    return 0;
+}
+
+void rnd_reset(void) {
+    rng_state = TEST_SEED;
+    TC_PRINT("Seed 0x%08x\n", TEST_SEED);
+}
+
+uint32_t rnd(void) {
+    // xorshift32: deterministic for a given seed on every platform.
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+uint32_t rnd_below(uint32_t n) {
+    return rnd() % n;
+}
+
+void random_key(char *key, const char *alphabet, size_t max_len) {
+    size_t len = 1 + rnd_below(max_len);
+    for (size_t i = 0; i < len; i++) {
+        key[i] = alphabet[rnd_below(strlen(alphabet))];
+    }
+    key[len] = '\0';
+}
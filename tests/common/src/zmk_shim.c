@@ -0,0 +1,214 @@
+/*
+ * Stand-ins for the ZMK APIs the text expander uses, so the tests build against plain Zephyr.
+ *
+ * Key presses sent to the host, by the module or by the user, are decoded back to characters, so a
+ * test can check what the host would have received. Key events are fed to the module's listener
+ * directly, in place of ZMK's event manager, and the behavior key is pressed through the driver
+ * API, in place of ZMK's keymap.
+ */
+
+#include <errno.h>  // For EINVAL.
+#include <string.h> // For memcpy.
+
+#include <zephyr/kernel.h> // For k_uptime_get.
+
+#include <dt-bindings/zmk/modifiers.h> // For MOD_LSFT.
+#include <drivers/behavior.h>
+#include <zmk/endpoints.h>
+#include <zmk/event_manager.h>
+#include <zmk/events/keycode_state_changed.h>
+#include <zmk/hid.h>
+#include <zmk/hid_utils.h> // For char_to_keycode.
+#include <zmk/keymap.h>
+
+#include <zmk_shim.h> // Header for this module.
+
+// Defined by ZMK_LISTENER() in text_expander.c.
+extern const struct zmk_listener zmk_listener_text_expander_listener_interface;
+
+static char typed[1024]; // Characters typed to the host (not null-terminated).
+static size_t typed_len; // Number of characters typed, possibly more than fit in typed.
+static bool shift_held;  // Whether a Shift key is pressed.
+static bool word_mod_held; // Whether a Ctrl or Alt key is pressed, turning Backspace into word delete.
+
+// Characters of the keyboard page usages from Return to Slash, unshifted and shifted.
+// Unused usages are 0.
+static const char symbols[][2] = {
+    [0x28 - 0x28] = {'\n', '\n'}, // Return.
+    [0x2B - 0x28] = {'\t', '\t'}, // Tab.
+    [0x2C - 0x28] = {' ', ' '},   // Spacebar.
+    [0x2D - 0x28] = {'-', '_'}, [0x2E - 0x28] = {'=', '+'},
+    [0x2F - 0x28] = {'[', '{'}, [0x30 - 0x28] = {']', '}'},
+    [0x31 - 0x28] = {'\\', '|'}, [0x33 - 0x28] = {';', ':'},
+    [0x34 - 0x28] = {'\'', '"'}, [0x35 - 0x28] = {'`', '~'},
+    [0x36 - 0x28] = {',', '<'}, [0x37 - 0x28] = {'.', '>'},
+    [0x38 - 0x28] = {'/', '?'},
+};
+
+/**
+ * @brief Decodes a keyboard page usage to the character it types, or 0 if it types none.
+ */
+static char usage_to_char(uint32_t usage, bool shifted) {
+    if (usage >= HID_USAGE_KEY_KEYBOARD_A && usage <= HID_USAGE_KEY_KEYBOARD_Z) {
+        return (shifted ? 'A' : 'a') + (usage - HID_USAGE_KEY_KEYBOARD_A);
+    }
+    if (usage >= HID_USAGE_KEY_KEYBOARD_1_AND_EXCLAMATION &&
+        usage <= HID_USAGE_KEY_KEYBOARD_0_AND_RIGHT_PARENTHESIS) {
+        static const char digits[] = "1234567890";
+        static const char shifted_digits[] = "!@#$%^&*()";
+        size_t index = usage - HID_USAGE_KEY_KEYBOARD_1_AND_EXCLAMATION;
+        return shifted ? shifted_digits[index] : digits[index];
+    }
+    if (usage >= HID_USAGE_KEY_KEYBOARD_RETURN_ENTER &&
+        usage - HID_USAGE_KEY_KEYBOARD_RETURN_ENTER < ARRAY_SIZE(symbols)) {
+        return symbols[usage - HID_USAGE_KEY_KEYBOARD_RETURN_ENTER][shifted];
+    }
+    return 0;
+}
+
+static bool is_shift(uint32_t usage) {
+    return usage == HID_USAGE_KEY_KEYBOARD_LEFTSHIFT || usage == HID_USAGE_KEY_KEYBOARD_RIGHTSHIFT;
+}
+
+static bool is_word_mod(uint32_t usage) {
+    return usage == HID_USAGE_KEY_KEYBOARD_LEFTCONTROL || usage == HID_USAGE_KEY_KEYBOARD_RIGHTCONTROL ||
+           usage == HID_USAGE_KEY_KEYBOARD_LEFTALT || usage == HID_USAGE_KEY_KEYBOARD_RIGHTALT;
+}
+
+static bool is_whitespace(char c) {
+    return c == ' ' || c == '\n' || c == '\t';
+}
+
+/**
+ * @brief Deletes the last word typed, as Ctrl+Backspace or Alt+Backspace would.
+ *
+ * The word runs back to the previous whitespace, so deleting more than the word the module meant
+ * to (a short code typed right after other characters) shows in the typed text.
+ */
+static void delete_word(void) {
+    while (typed_len > 0 && typed_len <= sizeof(typed) && is_whitespace(typed[typed_len - 1])) {
+        typed_len--;
+    }
+    while (typed_len > 0 && (typed_len > sizeof(typed) || !is_whitespace(typed[typed_len - 1]))) {
+        typed_len--;
+    }
+}
+
+int zmk_hid_keyboard_press(uint32_t usage) {
+    if (is_shift(usage)) {
+        shift_held = true;
+    } else if (is_word_mod(usage)) {
+        word_mod_held = true;
+    } else if (usage == HID_USAGE_KEY_KEYBOARD_DELETE_BACKSPACE) {
+        if (word_mod_held) {
+            delete_word();
+        } else {
+            typed_len -= typed_len > 0;
+        }
+    } else {
+        char c = usage_to_char(usage, shift_held);
+        if (c) {
+            if (typed_len < sizeof(typed)) {
+                typed[typed_len] = c;
+            }
+            typed_len++;
+        }
+    }
+    return 0;
+}
+
+int zmk_hid_keyboard_release(uint32_t usage) {
+    if (is_shift(usage)) {
+        shift_held = false;
+    } else if (is_word_mod(usage)) {
+        word_mod_held = false;
+    }
+    return 0;
+}
+
+zmk_mod_flags_t zmk_hid_get_explicit_mods(void) {
+    return 0;
+}
+
+int zmk_endpoints_send_report(uint16_t usage_page) {
+    return 0;
+}
+
+struct zmk_endpoint_instance zmk_endpoints_selected(void) {
+    return (struct zmk_endpoint_instance){.transport = ZMK_TRANSPORT_USB};
+}
+
+int zmk_endpoint_instance_to_index(struct zmk_endpoint_instance endpoint) {
+    return endpoint.transport == ZMK_TRANSPORT_USB ? 0 : -EINVAL;
+}
+
+bool zmk_keymap_layer_active(zmk_keymap_layer_id_t layer) {
+    return layer == 0;
+}
+
+int zmk_shim_key_event(uint32_t keycode, zmk_mod_flags_t modifiers, bool pressed) {
+    struct zmk_keycode_state_changed_event event = {
+        .header = {.name = "zmk_keycode_state_changed"},
+        .data =
+            {
+                .usage_page = HID_USAGE_KEY,
+                .keycode = keycode,
+                .implicit_modifiers = modifiers,
+                .state = pressed,
+                .timestamp = k_uptime_get(),
+            },
+    };
+
+    // The key reaches the host before the module sees it, as a terminator expansion expects.
+    bool shift = modifiers & (MOD_LSFT | MOD_RSFT);
+    if (pressed) {
+        if (shift) {
+            zmk_hid_keyboard_press(HID_USAGE_KEY_KEYBOARD_LEFTSHIFT);
+        }
+        zmk_hid_keyboard_press(keycode);
+    } else {
+        zmk_hid_keyboard_release(keycode);
+        if (shift) {
+            zmk_hid_keyboard_release(HID_USAGE_KEY_KEYBOARD_LEFTSHIFT);
+        }
+    }
+    return zmk_listener_text_expander_listener_interface.callback(&event.header);
+}
+
+int zmk_shim_type(const char *text) {
+    for (; *text; text++) {
+        bool needs_shift = false;
+        uint32_t keycode = *text == '\b' ? HID_USAGE_KEY_KEYBOARD_DELETE_BACKSPACE
+                                         : char_to_keycode(*text, &needs_shift);
+        if (!keycode) {
+            return -EINVAL;
+        }
+        zmk_mod_flags_t modifiers = needs_shift ? MOD_LSFT : 0;
+        zmk_shim_key_event(keycode, modifiers, true);
+        zmk_shim_key_event(keycode, modifiers, false);
+    }
+    return 0;
+}
+
+int zmk_shim_behavior_key(const struct device *dev) {
+    const struct behavior_driver_api *api = dev->api;
+    struct zmk_behavior_binding binding = {.behavior_dev = dev->name};
+    struct zmk_behavior_binding_event event = {.timestamp = k_uptime_get()};
+
+    int ret = api->binding_pressed(&binding, event);
+    api->binding_released(&binding, event);
+    return ret;
+}
+
+size_t zmk_shim_typed(char *buf, size_t size) {
+    size_t len = MIN(MIN(typed_len, sizeof(typed)), size - 1);
+    memcpy(buf, typed, len);
+    buf[len] = '\0';
+    return typed_len;
+}
+
+void zmk_shim_reset(void) {
+    typed_len = 0;
+    shift_held = false;
+    word_mod_held = false;
+}
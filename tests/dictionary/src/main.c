@@ -0,0 +1,470 @@
+/*
+ * Randomized differential tests of the dictionary backends.
+ *
+ * Every dictionary is compared against a plain array of entries (the model) on seeded random
+ * queries and updates: the device tree dictionaries of the configured backend, local trie and
+ * sorted dictionaries updated in step with the model, and the runtime dictionary behind the
+ * public API. A failure prints the seed and the operation, so it can be replayed.
+ */
+
+#include <string.h> // For strcmp, strcpy, strlen.
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/ztest.h>
+
+#include <zmk/text_dict.h>
+#include <zmk/text_expander.h>
+#include <zmk/text_expander_internals.h>
+#include <zmk/trie.h>
+
+#include <test_model.h>
+
+#define TEST_ROUNDS 20000      // Random operations per test.
+#define MAX_KEY_LEN (MAX_SHORT_LEN - 1)
+#define MODEL_CAPACITY TEST_MODEL_CAPACITY // Entries of the local dictionaries.
+
+#define TE_NODE DT_NODELABEL(te)
+
+// --- Random operations ---
+
+// A few letters and digits, so that random short codes often share prefixes.
+static const char key_alphabet[] = "abcez019";
+
+// Texts of the local and runtime dictionaries. Most are used by several short codes at a time.
+static const char *const texts[] = {
+    "a",
+    "hello",
+    "hello world",
+    "Best regards,\nJohn",
+    "The quick brown fox jumps over the lazy dog.",
+    "user@example.com",
+    "0123456789",
+    "A text that is long enough to be worth sharing between short codes.",
+};
+
+// --- Model ---
+
+static bool starts_with(const char *key, const char *prefix, size_t len) {
+    return strncmp(key, prefix, len) == 0;
+}
+
+static bool model_has_prefix(const struct model *m, const char *prefix, size_t len) {
+    for (size_t i = 0; i < m->count; i++) {
+        if (starts_with(m->entries[i].key, prefix, len)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Ranks short codes as trie_key_compare() documents it: shorter first, then letters
+ * before digits.
+ */
+static int model_compare(const char *a, const char *b) {
+    size_t len_a = strlen(a), len_b = strlen(b);
+    if (len_a != len_b) {
+        return len_a < len_b ? -1 : 1;
+    }
+    for (size_t i = 0; i < len_a; i++) {
+        int rank_a = a[i] >= 'a' ? a[i] - 'a' : 26 + a[i] - '0';
+        int rank_b = b[i] >= 'a' ? b[i] - 'a' : 26 + b[i] - '0';
+        if (rank_a != rank_b) {
+            return rank_a - rank_b;
+        }
+    }
+    return 0;
+}
+
+static size_t model_complete(const struct model *m, const char *prefix, char *key) {
+    size_t count = 0;
+    for (size_t i = 0; i < m->count; i++) {
+        if (starts_with(m->entries[i].key, prefix, strlen(prefix))) {
+            strcpy(key, m->entries[i].key);
+            count++;
+        }
+    }
+    return count;
+}
+
+static bool model_next_candidate(const struct model *m, const char *prefix, const char *after, char *key) {
+    const char *best = NULL;
+    for (size_t i = 0; i < m->count; i++) {
+        const char *k = m->entries[i].key;
+        if (starts_with(k, prefix, strlen(prefix)) && (!after || model_compare(k, after) > 0) &&
+            (!best || model_compare(k, best) < 0)) {
+            best = k;
+        }
+    }
+    if (best) {
+        strcpy(key, best);
+    }
+    return best != NULL;
+}
+
+/**
+ * @brief Picks a short code to query or update.
+ *
+ * Half of them are derived from stored short codes (the code itself, a prefix of it or an
+ * extension of it), so hits, shared prefixes and near misses are all common.
+ */
+static void random_query_key(const struct model *m, char *key) {
+    if (m->count > 0 && rnd_below(2)) {
+        strcpy(key, m->entries[rnd_below(m->count)].key);
+        size_t len = strlen(key);
+        switch (rnd_below(3)) {
+        case 0:
+            break;
+        case 1:
+            key[1 + rnd_below(len)] = '\0';
+            break;
+        default:
+            if (len < MAX_KEY_LEN) {
+                key[len] = key_alphabet[rnd_below(sizeof(key_alphabet) - 1)];
+                key[len + 1] = '\0';
+            }
+            break;
+        }
+        return;
+    }
+    random_key(key, key_alphabet, MAX_KEY_LEN);
+}
+
+// --- Checks ---
+
+struct visit_state {
+    const struct model *model;
+    size_t visited;
+};
+
+static int check_visit(const char *key, const char *text, void *user_data) {
+    struct visit_state *state = user_data;
+    const char *expected = model_lookup(state->model, key);
+    zassert_not_null(expected, "for_each visited unknown short code '%s'", key);
+    zassert_equal(strcmp(text, expected), 0, "for_each text of '%s'", key);
+    state->visited++;
+    return 0;
+}
+
+/**
+ * @brief Checks every entry of a dictionary against the model.
+ */
+static void check_entries(const struct text_dict *dict, const struct model *m) {
+    struct text_dict_stats stats;
+    text_dict_stats(dict, &stats);
+    zassert_equal(stats.entries, m->count, "%s: %zu entries, expected %zu", dict->api->name, stats.entries,
+                  m->count);
+
+    for (size_t i = 0; i < m->count; i++) {
+        const char *text = text_dict_lookup(dict, m->entries[i].key);
+        zassert_not_null(text, "%s: '%s' missing", dict->api->name, m->entries[i].key);
+        zassert_equal(strcmp(text, m->entries[i].text), 0, "%s: text of '%s'", dict->api->name,
+                      m->entries[i].key);
+    }
+
+    struct visit_state state = {.model = m};
+    zassert_equal(text_dict_for_each(dict, check_visit, &state), 0);
+    zassert_equal(state.visited, m->count, "%s: for_each visited %zu entries, expected %zu", dict->api->name,
+                  state.visited, m->count);
+}
+
+/**
+ * @brief Checks lookup and the prefix queries of a dictionary for one short code.
+ */
+static void check_query(const struct text_dict *dict, const struct model *m, const char *key) {
+    const char *text = text_dict_lookup(dict, key);
+    const char *expected = model_lookup(m, key);
+    if (expected) {
+        zassert_not_null(text, "%s: '%s' missing", dict->api->name, key);
+        zassert_equal(strcmp(text, expected), 0, "%s: text of '%s'", dict->api->name, key);
+    } else {
+        zassert_is_null(text, "%s: '%s' found, but not stored", dict->api->name, key);
+    }
+
+    char found[MAX_SHORT_LEN], model_found[MAX_SHORT_LEN];
+    bool prefix_queries = dict->api->prefix_start != NULL;
+    size_t len = strlen(key);
+
+    // Typing the short code one character at a time.
+    struct text_dict_cursor cursor;
+    text_dict_prefix_start(dict, &cursor);
+    for (size_t i = 0; i < len; i++) {
+        bool alive = text_dict_prefix_step(dict, &cursor, key[i]);
+        zassert_equal(alive, prefix_queries && model_has_prefix(m, key, i + 1),
+                      "%s: first %zu characters of '%s' are %s", dict->api->name, i + 1, key,
+                      alive ? "alive" : "dead");
+    }
+
+    // Completing the short code as a prefix.
+    size_t count = text_dict_complete(dict, key, found, sizeof(found));
+    size_t model_count = model_complete(m, key, model_found);
+    zassert_equal(count, prefix_queries ? model_count : 0, "%s: %zu completions of '%s', expected %zu",
+                  dict->api->name, count, key, model_count);
+    if (prefix_queries && count == 1) {
+        zassert_equal(strcmp(found, model_found), 0, "%s: completion of '%s'", dict->api->name, key);
+    }
+
+    // Cycling through the candidates starting with a prefix of the short code.
+    char prefix[MAX_SHORT_LEN], last[MAX_SHORT_LEN];
+    strcpy(prefix, key);
+    prefix[rnd_below(len + 1)] = '\0';
+    const char *after = NULL;
+    for (size_t n = 0;; n++) {
+        bool next = text_dict_next_candidate(dict, prefix, after, found, sizeof(found));
+        bool model_next = model_next_candidate(m, prefix, after, model_found);
+        zassert_equal(next, prefix_queries && model_next, "%s: candidate %zu of '%s'", dict->api->name, n,
+                      prefix);
+        if (!next) {
+            break;
+        }
+        zassert_equal(strcmp(found, model_found), 0, "%s: candidate %zu of '%s'", dict->api->name, n, prefix);
+        strcpy(last, found);
+        after = last;
+    }
+}
+
+// --- Device tree dictionaries ---
+
+struct dt_entry {
+    const char *key;
+    const char *text;
+    bool fragment;
+};
+
+#define TE_DT_ENTRY(child) {DT_PROP(child, short_code), DT_PROP(child, expanded_text), DT_PROP(child, fragment)},
+
+static const struct dt_entry dt_entries[] = {DT_FOREACH_CHILD(TE_NODE, TE_DT_ENTRY)};
+
+static struct model dt_expansions; // Expansions of the device tree instance.
+static struct model dt_fragments;  // Fragments of the device tree instance.
+
+static void *dictionary_setup(void) {
+    // Children are loaded in order; a redefined short code keeps its last text.
+    for (size_t i = 0; i < ARRAY_SIZE(dt_entries); i++) {
+        model_insert(dt_entries[i].fragment ? &dt_fragments : &dt_expansions, dt_entries[i].key,
+                     dt_entries[i].text);
+    }
+    return NULL;
+}
+
+static void dictionary_before(void *fixture) {
+    rnd_reset();
+}
+
+ZTEST(text_expander_dictionary, test_device_tree_dictionary) {
+    const struct device *dev = DEVICE_DT_GET(TE_NODE);
+    zassert_true(device_is_ready(dev));
+    const struct text_expander_instance_data *data = dev->data;
+
+    zassert_equal(data->expansion_count, dt_expansions.count);
+    zassert_equal(data->fragment_count, dt_fragments.count);
+    check_entries(data->dict, &dt_expansions);
+    check_entries(data->fragments, &dt_fragments);
+
+    char key[MAX_SHORT_LEN];
+    for (int i = 0; i < TEST_ROUNDS; i++) {
+        random_query_key(&dt_expansions, key);
+        check_query(data->dict, &dt_expansions, key);
+        random_query_key(&dt_fragments, key);
+        check_query(data->fragments, &dt_fragments, key);
+    }
+}
+
+// --- Local dictionaries ---
+
+static struct trie_node local_nodes[MODEL_CAPACITY * MAX_KEY_LEN + 1];
+static struct text_expander_pool local_pool;
+static struct text_dict_trie local_trie;
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SORTED_DICT)
+static uint64_t local_keys[MODEL_CAPACITY];
+static const char *local_texts[MODEL_CAPACITY];
+static struct text_dict_sorted local_sorted;
+#endif
+static struct model local_model;
+
+ZTEST(text_expander_dictionary, test_local_dictionaries) {
+    struct text_dict *dicts[2];
+    size_t dict_count = 0;
+
+    // Texts are referenced in place, as for the device tree dictionaries.
+    local_pool.node_pool = local_nodes;
+    local_pool.node_pool_size = ARRAY_SIZE(local_nodes);
+    local_pool.text_pool = NULL;
+    local_pool.text_pool_size = 0;
+    local_pool.text_buckets = NULL;
+    local_pool.text_bucket_count = 0;
+    trie_reset_pool(&local_pool);
+    zassert_ok(text_dict_trie_init(&local_trie, &local_pool));
+    dicts[dict_count++] = &local_trie.dict;
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SORTED_DICT)
+    text_dict_sorted_init(&local_sorted, local_keys, local_texts, MODEL_CAPACITY);
+    dicts[dict_count++] = &local_sorted.dict;
+#endif
+    local_model.count = 0;
+
+    char key[MAX_SHORT_LEN];
+    for (int i = 0; i < TEST_ROUNDS; i++) {
+        random_query_key(&local_model, key);
+        uint32_t op = rnd_below(10);
+        if (op < 4 && local_model.count < MODEL_CAPACITY) {
+            const char *text = texts[rnd_below(ARRAY_SIZE(texts))];
+            int expected = model_insert(&local_model, key, text);
+            for (size_t d = 0; d < dict_count; d++) {
+                int ret = text_dict_insert(dicts[d], key, text);
+                zassert_equal(ret, expected, "%s: round %d: insert '%s' returned %d", dicts[d]->api->name, i,
+                              key, ret);
+                zassert_equal_ptr(text_dict_lookup(dicts[d], key), text);
+            }
+        } else if (op < 7) {
+            int expected = model_remove(&local_model, key);
+            for (size_t d = 0; d < dict_count; d++) {
+                int ret = text_dict_remove(dicts[d], key);
+                zassert_equal(ret, expected, "%s: round %d: remove '%s' returned %d", dicts[d]->api->name, i,
+                              key, ret);
+            }
+        } else {
+            for (size_t d = 0; d < dict_count; d++) {
+                check_query(dicts[d], &local_model, key);
+            }
+        }
+
+        if (i % 1000 == 0) {
+            for (size_t d = 0; d < dict_count; d++) {
+                check_entries(dicts[d], &local_model);
+            }
+        }
+    }
+
+    // Removing everything must free every node but the root.
+    while (local_model.count > 0) {
+        strcpy(key, local_model.entries[0].key);
+        zassert_ok(model_remove(&local_model, key));
+        for (size_t d = 0; d < dict_count; d++) {
+            zassert_ok(text_dict_remove(dicts[d], key));
+        }
+    }
+    for (size_t d = 0; d < dict_count; d++) {
+        check_entries(dicts[d], &local_model);
+    }
+    zassert_equal(local_pool.node_pool_used, 1, "%zu nodes leaked", local_pool.node_pool_used - 1);
+}
+
+// --- Runtime dictionary ---
+
+static struct model runtime_model;
+
+static void check_runtime_text(const char *key, const char *expected) {
+    uint8_t pool_index;
+    struct trie_node *root = text_expander_read_begin(&pool_index);
+    const char *text = trie_get_expanded_text(trie_search(root, key));
+    if (expected) {
+        zassert_not_null(text, "runtime: '%s' missing", key);
+        zassert_equal(strcmp(text, expected), 0, "runtime: text of '%s'", key);
+    } else {
+        zassert_is_null(text, "runtime: '%s' found, but not stored", key);
+    }
+    text_expander_read_end(pool_index);
+}
+
+static void check_runtime_stats(void) {
+    struct zmk_text_expander_memory_stats stats;
+    zassert_ok(zmk_text_expander_get_memory_stats(&stats));
+    zassert_equal(stats.nodes.live + stats.nodes.free, stats.nodes.capacity);
+    zassert_true(stats.nodes.peak >= stats.nodes.live);
+    zassert_equal(stats.text.used + stats.text.free + stats.text.fragmented, stats.text.capacity);
+    zassert_true(stats.text.peak >= stats.text.used);
+    zassert_true(stats.text.count <= runtime_model.count, "%zu texts for %zu entries", stats.text.count,
+                 runtime_model.count);
+    zassert_equal(zmk_text_expander_get_count(), runtime_model.count + dt_expansions.count);
+}
+
+ZTEST(text_expander_dictionary, test_runtime_dictionary) {
+    zmk_text_expander_clear_all();
+    runtime_model.count = 0;
+
+    char key[MAX_SHORT_LEN];
+    for (int i = 0; i < TEST_ROUNDS; i++) {
+        random_query_key(&runtime_model, key);
+        uint32_t op = rnd_below(10);
+        if (op < 4 && runtime_model.count < MODEL_CAPACITY) {
+            // The pools are sized for average entries, so an add may fail for lack of memory.
+            // A failed add leaves the dictionary unchanged.
+            const char *text = texts[rnd_below(ARRAY_SIZE(texts))];
+            int ret = zmk_text_expander_add_expansion(key, text);
+            zassert_true(ret == 0 || ret == -ENOMEM, "round %d: add '%s' returned %d", i, key, ret);
+            if (ret == 0) {
+                model_insert(&runtime_model, key, text);
+            }
+        } else if (op < 7) {
+            int expected = model_remove(&runtime_model, key);
+            int ret = zmk_text_expander_remove_expansion(key);
+            zassert_equal(ret, expected, "round %d: remove '%s' returned %d", i, key, ret);
+        } else {
+            bool exists = model_lookup(&runtime_model, key) || model_lookup(&dt_expansions, key);
+            zassert_equal(zmk_text_expander_exists(key), exists, "round %d: exists '%s'", i, key);
+        }
+        check_runtime_text(key, model_lookup(&runtime_model, key));
+
+        if (i % 1000 == 0) {
+            check_runtime_stats();
+            for (size_t e = 0; e < runtime_model.count; e++) {
+                check_runtime_text(runtime_model.entries[e].key, runtime_model.entries[e].text);
+            }
+        }
+    }
+
+    // Clearing the dictionary releases all of its memory.
+    zmk_text_expander_clear_all();
+    runtime_model.count = 0;
+    check_runtime_stats();
+    struct zmk_text_expander_memory_stats stats;
+    zassert_ok(zmk_text_expander_get_memory_stats(&stats));
+    zassert_equal(stats.nodes.live, 1, "%zu nodes left", stats.nodes.live - 1);
+    zassert_equal(stats.text.used, 0, "%zu text bytes left", stats.text.used);
+}
+
+ZTEST(text_expander_dictionary, test_retired_nodes) {
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_SHADOW_BUILD)
+    ztest_test_skip(); // Updates go to the other generation and wait for the pinned one.
+#else
+    static const char *const held_keys[] = {"z", "zz", "zzz"};
+    static const char *const keys[] = {"qa", "qb", "qc", "qd", "qe", "qf", "qg", "qh"};
+    struct text_expander_pool *pool = &expander_data.pools[0];
+    struct trie_node *held[ARRAY_SIZE(held_keys)];
+
+    zmk_text_expander_clear_all();
+    runtime_model.count = 0;
+    zassert_ok(zmk_text_expander_add_expansion("zzz", "held"));
+
+    // A reader in the pool keeps the nodes it may hold from being handed out again.
+    uint8_t pool_index;
+    struct trie_node *root = text_expander_read_begin(&pool_index);
+    for (size_t i = 0; i < ARRAY_SIZE(held_keys); i++) {
+        held[i] = trie_get_node_for_key(root, held_keys[i]);
+        zassert_not_null(held[i], "no node for '%s'", held_keys[i]);
+    }
+    zassert_ok(zmk_text_expander_remove_expansion("zzz"));
+    for (size_t i = 0; i < ARRAY_SIZE(keys); i++) {
+        zassert_ok(zmk_text_expander_add_expansion(keys[i], "new"));
+    }
+    for (size_t h = 0; h < ARRAY_SIZE(held); h++) {
+        // Unlinked nodes stay leaves without an expansion for as long as the reader holds them.
+        zassert_false(held[h]->is_terminal, "node of '%s' reused under a reader", held_keys[h]);
+        for (int c = 0; c < TRIE_ALPHABET_SIZE; c++) {
+            zassert_is_null(held[h]->children[c], "node of '%s' reused under a reader", held_keys[h]);
+        }
+    }
+    zassert_is_null(trie_get_node_for_key(root, "zzz"), "'zzz' still reachable");
+    text_expander_read_end(pool_index);
+
+    // Once the reader has left, they are reused before any node that was never handed out.
+    size_t next = pool->node_pool_next;
+    zassert_ok(zmk_text_expander_add_expansion("zzz", "again"));
+    zassert_equal(pool->node_pool_next, next, "retired nodes not reused");
+
+    zmk_text_expander_clear_all();
+#endif
+}
+
+ZTEST_SUITE(text_expander_dictionary, NULL, dictionary_setup, dictionary_before, NULL, NULL);
@@ -0,0 +1,372 @@
+/*
+ * Tests of the flash journal on the native_sim flash simulator.
+ *
+ * Before the journal is opened at boot, a journal is written to the partition with a wrapped
+ * sequence number, a stale older bank and a torn record, and the replayed runtime dictionary
+ * is checked against it. Then random updates made through the public API are written to the
+ * journal, and the journal read back from flash is replayed into a model that must match the
+ * updates, across compactions and the delayed flush.
+ *
+ * The on-flash format is spelled out here on purpose: journals written by earlier firmware
+ * must keep replaying, so a format change has to show up as a test change.
+ */
+
+#include <string.h> // For memcpy, memset, strcmp, strcpy, strlen.
+
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/ztest.h>
+
+#include <zmk/text_expander.h>
+#include <zmk/text_expander_internals.h>
+#include <zmk/trie.h>
+
+#include <test_model.h>
+
+#define TEST_ROUNDS 3000      // Random updates.
+#define MODEL_TEXT_LEN 64     // Longest text of the random updates, with the terminator.
+
+#define JOURNAL_PARTITION_ID DT_FIXED_PARTITION_ID(DT_CHOSEN(zmk_text_expander_journal))
+#define JOURNAL_MAGIC 0x54584a31
+
+// Expansions of the device tree instance, which get_count() includes.
+#define COUNT_CHILD(node_id) +1
+#define DT_EXPANSION_COUNT (0 DT_FOREACH_CHILD(DT_NODELABEL(te), COUNT_CHILD))
+
+enum {
+    RECORD_ADD = 1,
+    RECORD_REMOVE = 2,
+    RECORD_CLEAR = 3,
+};
+
+struct bank_header {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t crc; // crc32_ieee over magic and seq.
+};
+
+struct record_header {
+    uint8_t type;
+    uint8_t short_len;
+    uint16_t text_len;
+    uint32_t crc; // crc32_ieee over the fields above and the payload.
+};
+
+// --- Model ---
+
+static void check_models_equal(const struct model *actual, const struct model *expected, const char *what) {
+    zassert_equal(actual->count, expected->count, "%s: %zu entries, expected %zu", what, actual->count,
+                  expected->count);
+    for (size_t i = 0; i < expected->count; i++) {
+        int j = model_find(actual, expected->entries[i].key);
+        zassert_true(j >= 0, "%s: '%s' missing", what, expected->entries[i].key);
+        zassert_equal(strcmp(actual->entries[j].text, expected->entries[i].text), 0, "%s: text of '%s'", what,
+                      expected->entries[i].key);
+    }
+}
+
+/**
+ * @brief Checks that the runtime dictionary holds exactly the entries of a model.
+ */
+static void check_runtime(const struct model *expected) {
+    uint8_t pool_index;
+    struct trie_node *root = text_expander_read_begin(&pool_index);
+    for (size_t i = 0; i < expected->count; i++) {
+        const char *text = trie_get_expanded_text(trie_search(root, expected->entries[i].key));
+        zassert_not_null(text, "runtime: '%s' missing", expected->entries[i].key);
+        zassert_equal(strcmp(text, expected->entries[i].text), 0, "runtime: text of '%s'",
+                      expected->entries[i].key);
+    }
+    text_expander_read_end(pool_index);
+    zassert_equal(zmk_text_expander_get_count(), expected->count + DT_EXPANSION_COUNT,
+                  "runtime: %d entries, expected %zu", zmk_text_expander_get_count() - DT_EXPANSION_COUNT,
+                  expected->count);
+}
+
+// --- Journal on flash ---
+
+struct journal_view {
+    const struct flash_area *fa;
+    size_t align;      // Flash write block size.
+    size_t bank_size;  // Size of each of the two banks.
+    uint8_t erased;    // Value of an erased flash byte.
+};
+
+static struct journal_view journal;
+static int prepare_error; // First error of journal_test_prepare(), checked by the tests.
+
+static int journal_open(void) {
+    int ret = flash_area_open(JOURNAL_PARTITION_ID, &journal.fa);
+    if (ret < 0) {
+        return ret;
+    }
+    journal.align = MAX(flash_area_align(journal.fa), 1);
+    journal.bank_size = journal.fa->fa_size / 2;
+    journal.erased = flash_area_erased_val(journal.fa);
+    return 0;
+}
+
+static void prepare_write(off_t offset, const void *data, size_t len) {
+    int ret = flash_area_write(journal.fa, offset, data, len);
+    if (ret < 0 && prepare_error == 0) {
+        prepare_error = ret;
+    }
+}
+
+static uint32_t record_crc(const struct record_header *hdr, const uint8_t *payload) {
+    uint32_t crc = crc32_ieee((const uint8_t *)hdr, offsetof(struct record_header, crc));
+    return crc32_ieee_update(crc, payload, hdr->short_len + hdr->text_len);
+}
+
+/**
+ * @brief Writes the header of a bank, padded to the write block size.
+ */
+static void write_bank_header(uint8_t bank, uint32_t seq) {
+    uint8_t buf[ROUND_UP(sizeof(struct bank_header), 32)];
+    struct bank_header header = {.magic = JOURNAL_MAGIC, .seq = seq};
+    header.crc = crc32_ieee((const uint8_t *)&header, offsetof(struct bank_header, crc));
+    memset(buf, journal.erased, sizeof(buf));
+    memcpy(buf, &header, sizeof(header));
+    prepare_write(bank * journal.bank_size, buf, ROUND_UP(sizeof(header), journal.align));
+}
+
+/**
+ * @brief Appends a record to a bank.
+ *
+ * @param offset In: offset of the record in the bank. Out: offset of the next record.
+ * @param torn Write a wrong checksum, as left behind by an interrupted write.
+ */
+static void write_record(uint8_t bank, size_t *offset, uint8_t type, const char *key, const char *text,
+                         bool torn) {
+    uint8_t buf[ROUND_UP(sizeof(struct record_header) + MAX_SHORT_LEN + MODEL_TEXT_LEN, 32)];
+    struct record_header hdr = {
+        .type = type,
+        .short_len = key ? strlen(key) : 0,
+        .text_len = text ? strlen(text) : 0,
+    };
+    uint8_t *payload = buf + sizeof(hdr);
+    if (key) {
+        memcpy(payload, key, hdr.short_len);
+    }
+    if (text) {
+        memcpy(payload + hdr.short_len, text, hdr.text_len);
+    }
+    hdr.crc = record_crc(&hdr, payload) ^ (torn ? 1 : 0);
+    memcpy(buf, &hdr, sizeof(hdr));
+
+    size_t len = sizeof(hdr) + hdr.short_len + hdr.text_len;
+    size_t padded = ROUND_UP(len, journal.align);
+    memset(buf + len, journal.erased, padded - len);
+    prepare_write(bank * journal.bank_size + *offset, buf, padded);
+    *offset += padded;
+}
+
+static bool read_bank_header(uint8_t bank, uint32_t *seq) {
+    struct bank_header header;
+    zassert_ok(flash_area_read(journal.fa, bank * journal.bank_size, &header, sizeof(header)));
+    if (header.magic != JOURNAL_MAGIC ||
+        header.crc != crc32_ieee((const uint8_t *)&header, offsetof(struct bank_header, crc))) {
+        return false;
+    }
+    *seq = header.seq;
+    return true;
+}
+
+/**
+ * @brief Replays the journal on flash into a model, as the module does at boot.
+ *
+ * The journal must end cleanly: every record before the first erased slot must be intact.
+ *
+ * @param seq Output: sequence number of the replayed bank.
+ * @return The replayed bank.
+ */
+static uint8_t replay_journal(struct model *m, uint32_t *seq) {
+    uint32_t seq0, seq1;
+    bool valid0 = read_bank_header(0, &seq0);
+    bool valid1 = read_bank_header(1, &seq1);
+    zassert_true(valid0 || valid1, "no valid journal bank");
+    uint8_t bank = (valid1 && (!valid0 || (int32_t)(seq1 - seq0) > 0)) ? 1 : 0;
+    *seq = bank ? seq1 : seq0;
+
+    m->count = 0;
+    off_t base = bank * journal.bank_size;
+    size_t offset = ROUND_UP(sizeof(struct bank_header), journal.align);
+    while (offset + sizeof(struct record_header) <= journal.bank_size) {
+        struct record_header hdr;
+        zassert_ok(flash_area_read(journal.fa, base + offset, &hdr, sizeof(hdr)));
+        if (hdr.type == journal.erased) {
+            break;
+        }
+        uint8_t payload[MAX_SHORT_LEN + MODEL_TEXT_LEN];
+        zassert_true(hdr.short_len < MAX_SHORT_LEN && hdr.text_len < MODEL_TEXT_LEN,
+                     "bad record lengths at offset %zu", offset);
+        zassert_ok(flash_area_read(journal.fa, base + offset + sizeof(hdr), payload,
+                                   hdr.short_len + hdr.text_len));
+        zassert_equal(hdr.crc, record_crc(&hdr, payload), "bad record checksum at offset %zu", offset);
+
+        char key[MAX_SHORT_LEN], text[MODEL_TEXT_LEN];
+        memcpy(key, payload, hdr.short_len);
+        key[hdr.short_len] = '\0';
+        memcpy(text, payload + hdr.short_len, hdr.text_len);
+        text[hdr.text_len] = '\0';
+        switch (hdr.type) {
+        case RECORD_ADD:
+            model_insert(m, key, text);
+            break;
+        case RECORD_REMOVE:
+            model_remove(m, key);
+            break;
+        case RECORD_CLEAR:
+            m->count = 0;
+            break;
+        default:
+            zassert_unreachable("unknown record type %u at offset %zu", hdr.type, offset);
+        }
+        offset += ROUND_UP(sizeof(hdr) + hdr.short_len + hdr.text_len, journal.align);
+    }
+    return bank;
+}
+
+// --- Journal written before boot ---
+
+/**
+ * @brief Writes the journal the module replays at boot.
+ *
+ * Runs at APPLICATION level before the module opens the journal, after the flash driver and
+ * the behavior instances are ready. Bank 1 is live although its sequence number is lower:
+ * sequence numbers wrap around.
+ */
+static int journal_test_prepare(void) {
+    prepare_error = journal_open();
+    if (prepare_error == 0) {
+        prepare_error = flash_area_erase(journal.fa, 0, journal.fa->fa_size);
+    }
+    if (prepare_error < 0) {
+        return 0; // Reported by the tests.
+    }
+
+    size_t offset = ROUND_UP(sizeof(struct bank_header), journal.align);
+    write_record(0, &offset, RECORD_ADD, "old", "stale bank", false);
+    write_bank_header(0, UINT32_MAX);
+
+    offset = ROUND_UP(sizeof(struct bank_header), journal.align);
+    write_record(1, &offset, RECORD_ADD, "brb", "be right back", false);
+    write_record(1, &offset, RECORD_ADD, "omw", "on my way", false);
+    write_record(1, &offset, RECORD_REMOVE, "brb", NULL, false);
+    write_record(1, &offset, RECORD_CLEAR, NULL, NULL, false);
+    write_record(1, &offset, RECORD_ADD, "ty", "thank you", false);
+    write_record(1, &offset, RECORD_ADD, "eml", "user@example.com", false);
+    write_record(1, &offset, RECORD_ADD, "ty", "thank you!", false);
+    write_record(1, &offset, RECORD_REMOVE, "zzz", NULL, false);
+    write_record(1, &offset, RECORD_ADD, "lost", "torn record", true);
+    write_record(1, &offset, RECORD_ADD, "late", "after the torn record", false);
+    write_bank_header(1, 0);
+    return 0;
+}
+
+SYS_INIT(journal_test_prepare, APPLICATION, 0);
+
+// Runs before test_round_trip (tests run in name order), while the dictionary still holds
+// what was replayed at boot.
+ZTEST(text_expander_journal, test_boot_replay) {
+    zassert_ok(prepare_error, "failed to write the journal before boot");
+    struct model expected = {.count = 0};
+    model_insert(&expected, "ty", "thank you!");
+    model_insert(&expected, "eml", "user@example.com");
+    check_runtime(&expected);
+    static const char *const absent[] = {"old", "brb", "omw", "zzz", "lost", "late"};
+    for (size_t i = 0; i < ARRAY_SIZE(absent); i++) {
+        zassert_false(zmk_text_expander_exists(absent[i]), "'%s' replayed", absent[i]);
+    }
+
+    // The torn record makes the next flush rewrite the live dictionary into the other bank.
+    zassert_ok(zmk_text_expander_flush_journal());
+    struct model replayed;
+    uint32_t seq;
+    zassert_equal(replay_journal(&replayed, &seq), 0, "compaction did not switch banks");
+    zassert_equal(seq, 1, "seq %u after compaction", seq);
+    check_models_equal(&replayed, &expected, "compacted journal");
+}
+
+// --- Random updates ---
+
+static void random_text(char *text) {
+    static const char words[][8] = {"hello", "world", "the", "quick", "brown", "fox", "42", "@", "\n"};
+    size_t len = 0;
+    size_t word_count = 1 + rnd_below(6);
+    for (size_t i = 0; i < word_count; i++) {
+        const char *word = words[rnd_below(ARRAY_SIZE(words))];
+        if (len + strlen(word) + 2 > MODEL_TEXT_LEN) {
+            break;
+        }
+        if (len > 0) {
+            text[len++] = ' ';
+        }
+        strcpy(text + len, word);
+        len += strlen(word);
+    }
+}
+
+static void random_update(struct model *m) {
+    char key[MAX_SHORT_LEN], text[MODEL_TEXT_LEN];
+    random_key(key, "abcz09", 2);
+    uint32_t op = rnd_below(20);
+    if (op < 12) {
+        random_text(text);
+        int ret = zmk_text_expander_add_expansion(key, text);
+        zassert_true(ret == 0 || ret == -ENOMEM, "add '%s' returned %d", key, ret);
+        if (ret == 0) {
+            model_insert(m, key, text);
+        }
+    } else if (op < 19) {
+        int ret = zmk_text_expander_remove_expansion(key);
+        zassert_equal(ret, model_find(m, key) >= 0 ? 0 : -ENOENT, "remove '%s' returned %d", key, ret);
+        model_remove(m, key);
+    } else {
+        zmk_text_expander_clear_all();
+        m->count = 0;
+    }
+}
+
+ZTEST(text_expander_journal, test_round_trip) {
+    static struct model live, replayed;
+    uint32_t seq, first_seq;
+    rnd_reset();
+
+    zmk_text_expander_clear_all();
+    zassert_ok(zmk_text_expander_flush_journal());
+    replay_journal(&replayed, &first_seq);
+    zassert_equal(replayed.count, 0);
+
+    for (int i = 0; i < TEST_ROUNDS; i++) {
+        // Bursts of up to 20 updates, some of them made as a batch.
+        bool batch = rnd_below(4) == 0;
+        if (batch) {
+            zassert_ok(zmk_text_expander_batch_begin());
+        }
+        for (uint32_t n = 1 + rnd_below(20); n > 0; n--) {
+            random_update(&live);
+        }
+        if (batch) {
+            zassert_ok(zmk_text_expander_batch_commit());
+        }
+
+        zassert_ok(zmk_text_expander_flush_journal());
+        replay_journal(&replayed, &seq);
+        check_models_equal(&replayed, &live, "journal");
+        check_runtime(&live);
+    }
+    zassert_true(seq - first_seq >= 2, "only %u compactions", seq - first_seq);
+
+    // Without an explicit flush, the update reaches flash after the flush delay.
+    char text[] = "written after the flush delay";
+    zassert_ok(zmk_text_expander_add_expansion("late", text));
+    model_insert(&live, "late", text);
+    k_sleep(K_MSEC(2 * CONFIG_ZMK_TEXT_EXPANDER_JOURNAL_FLUSH_DELAY));
+    replay_journal(&replayed, &seq);
+    check_models_equal(&replayed, &live, "journal after the flush delay");
+}
+
+ZTEST_SUITE(text_expander_journal, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,324 @@
+/*
+ * Round trips of the serial upload protocol over an emulated UART.
+ *
+ * The test plays the host: it sends frames to the UART chosen as zmk,text-expander-uart,
+ * split at random points as a USB or serial link would deliver them, and reads the device's
+ * responses back. Random dictionaries are uploaded in full and as deltas, and each upload is
+ * checked three ways: the responses, the hash and count the device reports in STATUS, and the
+ * runtime dictionary itself. Retransmissions, corrupted frames and rejected sessions are
+ * covered as well.
+ */
+
+#include <string.h> // For memcpy, strcmp, strcpy, strlen.
+
+#include <zephyr/drivers/serial/uart_emul.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/ztest.h>
+
+#include <zmk/text_expander.h>
+#include <zmk/text_expander_internals.h>
+#include <zmk/text_expander_serial.h>
+#include <zmk/trie.h>
+
+#include <test_model.h>
+
+#define TEST_UPLOADS 40             // Uploads per test.
+#define MODEL_CAPACITY 48           // Largest random dictionary.
+#define MODEL_TEXT_LEN 64           // Longest random text, with the terminator.
+#define RESPONSE_TIMEOUT_MS 1000    // How long the host waits for a response.
+
+static const struct device *const uart_dev = DEVICE_DT_GET(DT_CHOSEN(zmk_text_expander_uart));
+
+// --- Random dictionaries ---
+
+static void random_text(char *text) {
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 .,;:!?@#-_()'\"/";
+    size_t len = 1 + rnd_below(MODEL_TEXT_LEN - 1);
+    for (size_t i = 0; i < len; i++) {
+        text[i] = alphabet[rnd_below(sizeof(alphabet) - 1)];
+    }
+    text[len] = '\0';
+}
+
+/**
+ * @brief Computes the version hash of a dictionary as text_expander_serial.h defines it.
+ */
+static uint32_t model_hash(const struct model *m) {
+    uint32_t hash = 0;
+    for (size_t i = 0; i < m->count; i++) {
+        uint32_t crc = crc32_ieee((const uint8_t *)m->entries[i].key, strlen(m->entries[i].key) + 1);
+        hash += crc32_ieee_update(crc, (const uint8_t *)m->entries[i].text, strlen(m->entries[i].text));
+    }
+    return hash;
+}
+
+static void check_runtime(const struct model *expected) {
+    uint8_t pool_index;
+    struct trie_node *root = text_expander_read_begin(&pool_index);
+    for (size_t i = 0; i < expected->count; i++) {
+        const char *text = trie_get_expanded_text(trie_search(root, expected->entries[i].key));
+        zassert_not_null(text, "'%s' missing", expected->entries[i].key);
+        zassert_equal(strcmp(text, expected->entries[i].text), 0, "text of '%s'", expected->entries[i].key);
+    }
+    text_expander_read_end(pool_index);
+    zassert_equal(expander_data.expansion_count, expected->count, "%u entries, expected %zu",
+                  expander_data.expansion_count, expected->count);
+}
+
+// --- Host side of the protocol ---
+
+static uint8_t host_seq;
+
+struct response {
+    uint8_t type;
+    uint8_t seq;
+    uint16_t len;
+    uint8_t payload[16];
+};
+
+/**
+ * @brief Sends a frame, split into chunks of random size.
+ *
+ * @param corrupt Flip a bit of the CRC, as a noisy link would.
+ */
+static void send_frame_raw(uint8_t type, uint8_t seq, const uint8_t *payload, uint16_t len, bool corrupt) {
+    static uint8_t frame[TEXT_EXPANDER_SERIAL_HEADER_LEN + 1 + MAX_SHORT_LEN + MODEL_TEXT_LEN +
+                         TEXT_EXPANDER_SERIAL_CRC_LEN];
+    frame[0] = TEXT_EXPANDER_SERIAL_SOF;
+    frame[1] = type;
+    frame[2] = seq;
+    sys_put_le16(len, &frame[3]);
+    if (len) {
+        memcpy(&frame[TEXT_EXPANDER_SERIAL_HEADER_LEN], payload, len);
+    }
+    uint32_t crc = crc32_ieee(&frame[1], TEXT_EXPANDER_SERIAL_HEADER_LEN - 1 + len);
+    sys_put_le32(crc ^ (corrupt ? 1 : 0), &frame[TEXT_EXPANDER_SERIAL_HEADER_LEN + len]);
+
+    size_t size = TEXT_EXPANDER_SERIAL_HEADER_LEN + len + TEXT_EXPANDER_SERIAL_CRC_LEN;
+    for (size_t sent = 0; sent < size;) {
+        size_t chunk = 1 + rnd_below(16); // Drawn first: MIN() evaluates its arguments twice.
+        chunk = MIN(chunk, size - sent);
+        zassert_equal(uart_emul_put_rx_data(uart_dev, &frame[sent], chunk), chunk);
+        sent += chunk;
+        if (rnd_below(4) == 0) {
+            k_sleep(K_MSEC(1)); // Let the device see a partial frame.
+        }
+    }
+}
+
+/**
+ * @brief Reads the bytes the device sent, waiting up to timeout_ms for count of them.
+ *
+ * @return Number of bytes read.
+ */
+static size_t receive(uint8_t *buf, size_t count, int timeout_ms) {
+    size_t received = 0;
+    for (int waited = 0; received < count && waited <= timeout_ms; waited++) {
+        received += uart_emul_get_tx_data(uart_dev, buf + received, count - received);
+        if (received < count) {
+            k_sleep(K_MSEC(1));
+        }
+    }
+    return received;
+}
+
+/**
+ * @brief Reads one response frame and checks its framing and CRC.
+ */
+static void receive_response(struct response *resp) {
+    uint8_t header[TEXT_EXPANDER_SERIAL_HEADER_LEN];
+    zassert_equal(receive(header, sizeof(header), RESPONSE_TIMEOUT_MS), sizeof(header), "no response");
+    zassert_equal(header[0], TEXT_EXPANDER_SERIAL_SOF);
+    resp->type = header[1];
+    resp->seq = header[2];
+    resp->len = sys_get_le16(&header[3]);
+    zassert_true(resp->len <= sizeof(resp->payload), "response of %u bytes", resp->len);
+
+    uint8_t crc[TEXT_EXPANDER_SERIAL_CRC_LEN];
+    zassert_equal(receive(resp->payload, resp->len, RESPONSE_TIMEOUT_MS), resp->len);
+    zassert_equal(receive(crc, sizeof(crc), RESPONSE_TIMEOUT_MS), sizeof(crc));
+    uint32_t expected = crc32_ieee(&header[1], sizeof(header) - 1);
+    expected = crc32_ieee_update(expected, resp->payload, resp->len);
+    zassert_equal(sys_get_le32(crc), expected, "bad response CRC");
+}
+
+/**
+ * @brief Sends a frame with the given seq and waits for its ACK or NAK.
+ *
+ * @return 0 for an ACK, or the negative errno of a NAK.
+ */
+static int request_seq(uint8_t type, uint8_t seq, const uint8_t *payload, uint16_t len) {
+    struct response resp;
+    send_frame_raw(type, seq, payload, len, false);
+    receive_response(&resp);
+    zassert_equal(resp.seq, seq, "response to seq %u, expected %u", resp.seq, seq);
+    if (resp.type == TEXT_EXPANDER_SERIAL_NAK) {
+        zassert_equal(resp.len, 1);
+        return -resp.payload[0];
+    }
+    zassert_equal(resp.type, TEXT_EXPANDER_SERIAL_ACK, "response type 0x%02x", resp.type);
+    return 0;
+}
+
+static int request(uint8_t type, const uint8_t *payload, uint16_t len) {
+    return request_seq(type, ++host_seq, payload, len);
+}
+
+/**
+ * @brief Sends HELLO and returns the hash and runtime count from STATUS.
+ */
+static void hello(uint32_t *hash, uint16_t *count) {
+    struct response resp;
+    send_frame_raw(TEXT_EXPANDER_SERIAL_HELLO, ++host_seq, NULL, 0, false);
+    receive_response(&resp);
+    zassert_equal(resp.type, TEXT_EXPANDER_SERIAL_STATUS, "response type 0x%02x", resp.type);
+    zassert_equal(resp.seq, host_seq);
+    zassert_equal(resp.len, 10);
+    zassert_equal(resp.payload[0], TEXT_EXPANDER_SERIAL_VERSION);
+    *hash = sys_get_le32(&resp.payload[1]);
+    *count = sys_get_le16(&resp.payload[5]);
+    zassert_equal(resp.payload[7], MAX_SHORT_LEN - 1);
+    zassert_equal(sys_get_le16(&resp.payload[8]), MAX_EXPANDED_LEN - 1);
+}
+
+static int begin(uint32_t base, bool replace) {
+    uint8_t payload[5];
+    sys_put_le32(base, payload);
+    payload[4] = replace ? TEXT_EXPANDER_SERIAL_BEGIN_REPLACE : 0;
+    return request(TEXT_EXPANDER_SERIAL_BEGIN, payload, sizeof(payload));
+}
+
+static int add_entry(const char *key, const char *text) {
+    uint8_t payload[1 + MAX_SHORT_LEN + MODEL_TEXT_LEN];
+    payload[0] = strlen(key);
+    memcpy(&payload[1], key, payload[0]);
+    memcpy(&payload[1 + payload[0]], text, strlen(text));
+    return request(TEXT_EXPANDER_SERIAL_ADD, payload, 1 + payload[0] + strlen(text));
+}
+
+static int remove_entry(const char *key) {
+    return request(TEXT_EXPANDER_SERIAL_REMOVE, (const uint8_t *)key, strlen(key));
+}
+
+static int commit(uint32_t hash) {
+    uint8_t payload[4];
+    sys_put_le32(hash, payload);
+    return request(TEXT_EXPANDER_SERIAL_COMMIT, payload, sizeof(payload));
+}
+
+/**
+ * @brief Checks that the device reports the dictionary of a model and holds it.
+ */
+static void check_device(const struct model *m) {
+    uint32_t hash;
+    uint16_t count;
+    hello(&hash, &count);
+    zassert_equal(hash, model_hash(m), "device hash 0x%08x, expected 0x%08x", hash, model_hash(m));
+    zassert_equal(count, m->count, "device count %u, expected %zu", count, m->count);
+    check_runtime(m);
+}
+
+// --- Tests ---
+
+static void serial_before(void *fixture) {
+    rnd_reset();
+    uart_emul_flush_tx_data(uart_dev);
+}
+
+ZTEST(text_expander_serial, test_upload_round_trip) {
+    static struct model dict;
+    dict.count = 0;
+
+    // A full upload replaces whatever the device holds.
+    zassert_ok(begin(0, true));
+    zassert_ok(commit(0));
+    check_device(&dict);
+
+    for (int upload = 0; upload < TEST_UPLOADS; upload++) {
+        bool full = rnd_below(4) == 0;
+        zassert_ok(begin(full ? 0 : model_hash(&dict), full));
+        if (full) {
+            dict.count = 0;
+        }
+
+        // Full uploads send a new dictionary; deltas send additions, updates and removals.
+        for (uint32_t n = rnd_below(full ? MODEL_CAPACITY : 12); n > 0; n--) {
+            char key[MAX_SHORT_LEN];
+            random_key(key, "abcdefxyz0123", MIN(6, MAX_SHORT_LEN - 1));
+            int i = model_find(&dict, key);
+            if (!full && i >= 0 && rnd_below(2)) {
+                zassert_ok(remove_entry(key));
+                dict.entries[i] = dict.entries[--dict.count];
+            } else if (i >= 0 || dict.count < MODEL_CAPACITY) {
+                if (i < 0) {
+                    i = dict.count++;
+                    strcpy(dict.entries[i].key, key);
+                }
+                random_text(dict.entries[i].text);
+                zassert_ok(add_entry(key, dict.entries[i].text));
+            }
+        }
+
+        zassert_ok(commit(model_hash(&dict)));
+        check_device(&dict);
+    }
+}
+
+ZTEST(text_expander_serial, test_protocol_errors) {
+    static struct model dict;
+    dict.count = 1;
+    strcpy(dict.entries[0].key, "eml");
+    strcpy(dict.entries[0].text, "user@example.com");
+
+    zassert_ok(begin(0, true));
+    zassert_ok(add_entry("eml", "user@example.com"));
+    zassert_ok(commit(model_hash(&dict)));
+    check_device(&dict);
+
+    // A delta against another dictionary is refused, without opening a session.
+    zassert_equal(begin(model_hash(&dict) + 1, false), -ESTALE);
+    zassert_equal(commit(model_hash(&dict)), -EINVAL);
+
+    // A corrupted frame is dropped without a response; the host times out and retransmits.
+    zassert_ok(begin(model_hash(&dict), false));
+    uint8_t payload[] = {3, 's', 'i', 'g', 'B', 'e', 's', 't'};
+    send_frame_raw(TEXT_EXPANDER_SERIAL_ADD, ++host_seq, payload, sizeof(payload), true);
+    uint8_t byte;
+    zassert_equal(receive(&byte, 1, 50), 0, "response to a corrupted frame");
+    zassert_ok(request_seq(TEXT_EXPANDER_SERIAL_ADD, host_seq, payload, sizeof(payload)));
+
+    // A retransmitted frame whose response was lost is acknowledged again without being applied
+    // a second time: the device answers from the seq alone, so this REMOVE never runs.
+    zassert_ok(add_entry("eml", "new@example.com"));
+    zassert_ok(request_seq(TEXT_EXPANDER_SERIAL_REMOVE, host_seq, (const uint8_t *)"eml", 3));
+    strcpy(dict.entries[0].text, "new@example.com");
+    dict.count = 2;
+    strcpy(dict.entries[1].key, "sig");
+    strcpy(dict.entries[1].text, "Best");
+
+    // A commit whose hash does not match tells the host to send the full dictionary.
+    zassert_equal(commit(model_hash(&dict) + 1), -EBADMSG);
+    check_device(&dict);
+
+    // An aborted session leaves the dictionary as it was.
+    zassert_ok(begin(model_hash(&dict), false));
+    zassert_ok(remove_entry("eml"));
+    zassert_ok(request(TEXT_EXPANDER_SERIAL_CLEAR, NULL, 0));
+    zassert_ok(request(TEXT_EXPANDER_SERIAL_ABORT, NULL, 0));
+    check_device(&dict);
+
+    // A host that goes silent mid-upload loses its session, and the dictionary is left alone.
+    zassert_ok(begin(model_hash(&dict), false));
+    zassert_ok(add_entry("tmp", "dropped"));
+    k_sleep(K_MSEC(CONFIG_ZMK_TEXT_EXPANDER_SERIAL_TIMEOUT * 2));
+    zassert_equal(commit(model_hash(&dict)), -EINVAL);
+    check_device(&dict);
+
+    // Malformed and unknown frames are rejected.
+    zassert_equal(request(TEXT_EXPANDER_SERIAL_BEGIN, payload, 2), -EINVAL);
+    zassert_equal(request(0x7f, NULL, 0), -ENOTSUP);
+}
+
+ZTEST_SUITE(text_expander_serial, NULL, NULL, serial_before, NULL, NULL);
@@ -0,0 +1,350 @@
+/*
+ * End-to-end tests of typing through the ZMK shims.
+ *
+ * Keys are typed through the module's keycode listener and the behavior key is pressed through
+ * the driver API, as ZMK would; the keys sent to the host, the user's and the module's, are
+ * decoded back to text and compared with what the user expects to see. The scenarios of
+ * testcase.yaml turn the typing features on one at a time; the tests of a feature that is off
+ * are skipped.
+ */
+
+#include <string.h> // For memset, strcmp, strcpy, strlen.
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/kernel.h>
+#include <zephyr/ztest.h>
+
+#include <drivers/behavior.h> // For ZMK_BEHAVIOR_OPAQUE.
+#include <zmk/expansion_engine.h>
+#include <zmk/text_expander.h>
+
+#include <zmk_shim.h>
+
+#define TE_NODE DT_NODELABEL(te)
+
+#define ENGINE_TIMEOUT_MS 10000 // Longest an expansion may take to type.
+#define POLL_MS 10
+
+static const struct device *const te_dev = DEVICE_DT_GET(TE_NODE);
+
+// --- Helpers ---
+
+/**
+ * @brief Waits until the expansion engine has typed everything it was asked to.
+ */
+static void wait_engine(void) {
+    for (int waited = 0; k_work_delayable_busy_get(&get_expansion_work_item()->work); waited += POLL_MS) {
+        zassert_true(waited < ENGINE_TIMEOUT_MS, "expansion still typing after %d ms", waited);
+        k_sleep(K_MSEC(POLL_MS));
+    }
+}
+
+/**
+ * @brief Checks what the host received since the test started, once the engine is done.
+ */
+static void assert_typed(const char *expected) {
+    char buf[256];
+    wait_engine();
+    size_t len = zmk_shim_typed(buf, sizeof(buf));
+    zassert_equal(len, strlen(expected), "host got %zu characters '%s', expected '%s'", len, buf,
+                  expected);
+    zassert_equal(strcmp(buf, expected), 0, "host got '%s', expected '%s'", buf, expected);
+}
+
+static void type(const char *text) {
+    zassert_ok(zmk_shim_type(text), "cannot type '%s'", text);
+}
+
+static void press_behavior_key(int expected) {
+    zassert_equal(zmk_shim_behavior_key(te_dev), expected, "behavior key returned the wrong value");
+}
+
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_IDLE_TRIGGER)
+/**
+ * @brief Pauses typing long enough for the idle timer to fire.
+ */
+static void pause_typing(void) {
+    k_sleep(K_MSEC(2 * CONFIG_ZMK_TEXT_EXPANDER_IDLE_TIMEOUT));
+}
+#endif
+
+// --- Tests ---
+
+static void *typing_setup(void) {
+    zassert_true(device_is_ready(te_dev), "text expander not ready");
+    return NULL;
+}
+
+static void typing_before(void *fixture) {
+    // A space ends whatever the previous test left in the short code buffer, and starts a word.
+    wait_engine();
+    type(" ");
+    wait_engine();
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_WORD_DELETE)
+    zassert_ok(zmk_text_expander_set_host(ZMK_TEXT_EXPANDER_HOST_UNKNOWN));
+#endif
+    zmk_shim_reset();
+}
+
+ZTEST(text_expander_typing, test_behavior_key) {
+    // The short code is deleted and the text typed in its place; the shift of capitals is kept.
+    type("hi ty");
+    press_behavior_key(ZMK_BEHAVIOR_OPAQUE);
+    assert_typed("hi thank you");
+    type(" eml");
+    press_behavior_key(ZMK_BEHAVIOR_OPAQUE);
+    assert_typed("hi thank you User@Example.com");
+
+    // Backspace edits the short code like any other text.
+    zmk_shim_reset();
+    type(" tyvx\bm");
+    press_behavior_key(ZMK_BEHAVIOR_OPAQUE);
+    assert_typed(" thank you very much");
+
+    // No short code typed: the key is passed on.
+    zmk_shim_reset();
+    type(" ");
+    press_behavior_key(ZMK_BEHAVIOR_TRANSPARENT);
+    assert_typed(" ");
+}
+
+ZTEST(text_expander_typing, test_reset_keys) {
+    // Keys that are not part of a short code end it: the word is typed on, never expanded.
+    type("ty-");
+    press_behavior_key(ZMK_BEHAVIOR_TRANSPARENT);
+    type(" tyx");
+    press_behavior_key(ZMK_BEHAVIOR_TRANSPARENT); // Looked up and not found: the buffer is reset.
+    type("ty");
+    press_behavior_key(ZMK_BEHAVIOR_OPAQUE);
+    assert_typed("ty- tyxthank you");
+
+    // A short code typed after a cursor movement starts from scratch.
+    zmk_shim_reset();
+    type("t");
+    zmk_shim_key_event(0x50, 0, true); // Left arrow: types no character.
+    zmk_shim_key_event(0x50, 0, false);
+    type("brb");
+    press_behavior_key(ZMK_BEHAVIOR_OPAQUE);
+    assert_typed("tbe right back");
+}
+
+ZTEST(text_expander_typing, test_runtime_dictionary) {
+    zassert_ok(zmk_text_expander_add_expansion("sig", "Regards, Ann"));
+    type("sig");
+    press_behavior_key(ZMK_BEHAVIOR_OPAQUE);
+    assert_typed("Regards, Ann");
+
+    zassert_ok(zmk_text_expander_remove_expansion("sig"));
+    type(" sig");
+    press_behavior_key(ZMK_BEHAVIOR_TRANSPARENT);
+    assert_typed("Regards, Ann sig");
+}
+
+ZTEST(text_expander_typing, test_long_text) {
+    // With CONFIG_ZMK_TEXT_EXPANDER_MAX_EXPANDED_LEN=16 the text is streamed in chunks.
+    type("lorem");
+    press_behavior_key(ZMK_BEHAVIOR_OPAQUE);
+    assert_typed("Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor "
+                 "incididunt ut labore.");
+
+    // Chunks are read from the dictionary as they are typed: a runtime text as much as a device
+    // tree one.
+    static const char text[] = "0123456789abcdef0123456789ABCDEF0123456789abcdef0123456789ABCDEF";
+    zassert_ok(zmk_text_expander_add_expansion("hex", text));
+    zmk_shim_reset();
+    type("hex");
+    press_behavior_key(ZMK_BEHAVIOR_OPAQUE);
+    assert_typed(text);
+    zassert_ok(zmk_text_expander_remove_expansion("hex"));
+}
+
+ZTEST(text_expander_typing, test_deferred_input) {
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_DEFERRED_INPUT)
+    // With the scheduler locked the input worker cannot run: the trigger applies the queued keys.
+    k_sched_lock();
+    type("no ty");
+    press_behavior_key(ZMK_BEHAVIOR_OPAQUE);
+    k_sched_unlock();
+    assert_typed("no thank you");
+
+    // More keys than the ring holds: the short code is dropped rather than garbled.
+    static char burst[CONFIG_ZMK_TEXT_EXPANDER_INPUT_RING_SIZE + sizeof(" ty")];
+    memset(burst, 'x', CONFIG_ZMK_TEXT_EXPANDER_INPUT_RING_SIZE);
+    strcpy(burst + CONFIG_ZMK_TEXT_EXPANDER_INPUT_RING_SIZE, " ty");
+    zmk_shim_reset();
+    k_sched_lock();
+    type(burst);
+    press_behavior_key(ZMK_BEHAVIOR_TRANSPARENT);
+    k_sched_unlock();
+    assert_typed(burst);
+
+    // Once the worker has caught up, typing works as before.
+    zmk_shim_reset();
+    type(" ty");
+    k_sleep(K_MSEC(POLL_MS));
+    press_behavior_key(ZMK_BEHAVIOR_OPAQUE);
+    assert_typed(" thank you");
+#else
+    ztest_test_skip();
+#endif
+}
+
+ZTEST(text_expander_typing, test_terminators) {
+    if (!IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_TERMINATORS)) {
+        ztest_test_skip();
+    }
+    // The terminator is deleted with the short code and typed again after the text.
+    type("ty ");
+    assert_typed("thank you ");
+    type("btw,");
+    assert_typed("thank you by the way,");
+
+    // A shifted terminator is typed again with Shift.
+    zmk_shim_reset();
+    type("brb?");
+    assert_typed("be right back?");
+
+    // A word without an expansion is left alone, and so is a short code inside a word.
+    zmk_shim_reset();
+    type(" tyx. xty;");
+    assert_typed(" tyx. xty;");
+}
+
+ZTEST(text_expander_typing, test_idle_trigger) {
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_IDLE_TRIGGER)
+    type("ty");
+    pause_typing();
+    assert_typed("thank you");
+
+    // Typing on before the timeout extends the short code instead.
+    zmk_shim_reset();
+    type(" ty");
+    k_sleep(K_MSEC(CONFIG_ZMK_TEXT_EXPANDER_IDLE_TIMEOUT / 2));
+    type("v");
+    k_sleep(K_MSEC(CONFIG_ZMK_TEXT_EXPANDER_IDLE_TIMEOUT / 2));
+    type("m");
+    pause_typing();
+    assert_typed(" thank you very much");
+
+    // A pause inside a short code keeps it, so it can still be completed.
+    zmk_shim_reset();
+    type(" bt");
+    pause_typing();
+    assert_typed(" bt");
+    type("w");
+    pause_typing();
+    assert_typed(" by the way");
+
+    // Any other key stops the timer.
+    zmk_shim_reset();
+    type(" brb.");
+    pause_typing();
+    assert_typed(" brb.");
+#else
+    ztest_test_skip();
+#endif
+}
+
+ZTEST(text_expander_typing, test_unique_prefix) {
+    if (!IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_UNIQUE_PREFIX)) {
+        ztest_test_skip();
+    }
+    // A prefix of exactly one short code expands to it.
+    type("tyv");
+    press_behavior_key(ZMK_BEHAVIOR_OPAQUE);
+    assert_typed("thank you very much");
+    type(" e");
+    press_behavior_key(ZMK_BEHAVIOR_OPAQUE);
+    assert_typed("thank you very much User@Example.com");
+
+    // A short code that is itself an entry wins over its longer completions.
+    zmk_shim_reset();
+    type(" ty");
+    press_behavior_key(ZMK_BEHAVIOR_OPAQUE);
+    assert_typed(" thank you");
+
+    // A prefix of several short codes expands to none of them.
+    zmk_shim_reset();
+    type(" b");
+    press_behavior_key(ZMK_BEHAVIOR_TRANSPARENT);
+    assert_typed(" b");
+}
+
+ZTEST(text_expander_typing, test_candidate_cycling) {
+    if (!IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_CANDIDATE_CYCLING)) {
+        ztest_test_skip();
+    }
+    // Candidates are ranked shortest first, then in alphabet order, and wrap around.
+    type("b");
+    press_behavior_key(ZMK_BEHAVIOR_OPAQUE);
+    assert_typed("be right back");
+    press_behavior_key(ZMK_BEHAVIOR_OPAQUE);
+    assert_typed("by the way");
+    press_behavior_key(ZMK_BEHAVIOR_OPAQUE);
+    assert_typed("be right back");
+
+    // The short code itself comes first, its longer completions after it.
+    zmk_shim_reset();
+    type(" ty");
+    press_behavior_key(ZMK_BEHAVIOR_OPAQUE);
+    assert_typed(" thank you");
+    press_behavior_key(ZMK_BEHAVIOR_OPAQUE);
+    assert_typed(" thank you very much");
+
+    // Any key typed in between ends the cycle: the next press starts a new short code.
+    type(" b");
+    press_behavior_key(ZMK_BEHAVIOR_OPAQUE);
+    assert_typed(" thank you very much be right back");
+    type(" ");
+    press_behavior_key(ZMK_BEHAVIOR_TRANSPARENT);
+    assert_typed(" thank you very much be right back ");
+}
+
+ZTEST(text_expander_typing, test_word_delete) {
+#if IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_WORD_DELETE)
+    static const enum zmk_text_expander_host hosts[] = {ZMK_TEXT_EXPANDER_HOST_PC,
+                                                        ZMK_TEXT_EXPANDER_HOST_MACOS};
+
+    for (size_t i = 0; i < ARRAY_SIZE(hosts); i++) {
+        zassert_ok(zmk_text_expander_set_host(hosts[i]));
+        zmk_shim_reset();
+
+        // A whole word is deleted with one chord, which the shim stops at the space before it.
+        type("so btw");
+        press_behavior_key(ZMK_BEHAVIOR_OPAQUE);
+        assert_typed("so by the way");
+
+        // A short code glued to other text must not take that text with it.
+        zmk_shim_reset();
+        type("x.btw");
+        press_behavior_key(ZMK_BEHAVIOR_OPAQUE);
+        assert_typed("x.by the way");
+
+        // Nor can it once Backspace went past the end of the previous word.
+        zmk_shim_reset();
+        type("ab.\bbrb");
+        press_behavior_key(ZMK_BEHAVIOR_OPAQUE);
+        assert_typed("abbe right back");
+    }
+#else
+    ztest_test_skip();
+#endif
+}
+
+ZTEST(text_expander_typing, test_fragments) {
+    if (!IS_ENABLED(CONFIG_ZMK_TEXT_EXPANDER_FRAGMENTS)) {
+        ztest_test_skip();
+    }
+    type("ad");
+    press_behavior_key(ZMK_BEHAVIOR_OPAQUE);
+    assert_typed("address: 1 Main Street");
+
+    // Fragments are not short codes of their own.
+    zmk_shim_reset();
+    type(" addr");
+    press_behavior_key(ZMK_BEHAVIOR_TRANSPARENT);
+    assert_typed(" addr");
+}
+
+ZTEST_SUITE(text_expander_typing, NULL, typing_setup, typing_before, NULL, NULL);